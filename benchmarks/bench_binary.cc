@@ -0,0 +1,127 @@
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "mecab/binary_format.h"
+#include "mecab/tagger.h"
+
+// End-to-end throughput of the text (%m\t%H\n) and binary output formats:
+// the analysis with the writer, and a consumer that recovers the surface and the feature columns of every token.
+//
+// usage: bench-binary FILE [mecab options]
+//   e.g. bench-binary corpus.txt -r /dev/null -d /path/to/dic
+
+namespace {
+
+double seconds_since(const std::chrono::steady_clock::time_point& start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+size_t split_feature(const char* feature, size_t size, std::vector<std::string>* columns) {
+  std::string buf(feature, size);
+  char* ptr[64];
+  const size_t n = MeCab::tokenizeCSV(&buf[0], ptr, 64);
+  columns->assign(ptr, ptr + n);
+  return n;
+}
+
+// The text consumer splits lines, the tab and the feature columns of every token.
+size_t consume_text(const std::string& output) {
+  size_t tokens = 0;
+  std::vector<std::string> columns;
+  const char* p = output.data();
+  const char* end = p + output.size();
+  while (p < end) {
+    const char* eol = std::find(p, end, '\n');
+    if (eol - p != 3 || std::strncmp(p, "EOS", 3) != 0) {
+      const char* tab = std::find(p, eol, '\t');
+      const std::string surface(p, tab);
+      tokens += split_feature(tab + 1, eol - tab - 1, &columns) > 0;
+    }
+    p = eol + 1;
+  }
+  return tokens;
+}
+
+// The binary consumer splits every distinct feature once and caches the columns by feature id.
+size_t consume_binary(const std::string& output) {
+  size_t tokens = 0;
+  std::unordered_map<uint64_t, std::vector<std::string>> cache;
+  MeCab::BinaryRecord record;
+  const char* p = output.data();
+  const char* end = p + output.size();
+  while (p < end) {
+    const size_t size = MeCab::readBinaryRecord(p, end - p, &record);
+    CHECK_DIE(size) << "broken record";
+    for (size_t i = 0; i < record.features.size(); ++i) {
+      const MeCab::BinaryFeature& feature = record.features[i];
+      if (cache.find(feature.id) == cache.end()) {
+        split_feature(feature.feature, feature.size, &cache[feature.id]);
+      }
+    }
+    for (size_t i = 0; i < record.tokens.size(); ++i) {
+      const std::string surface = record.surface(record.tokens[i]);
+      tokens += !cache[record.tokens[i].feature_id].empty();
+    }
+    p += size;
+  }
+  return tokens;
+}
+
+void run(const char* name, const std::vector<std::string>& lines, std::vector<char*> args, bool binary) {
+  if (binary) {
+    args.push_back(const_cast<char*>("-O"));
+    args.push_back(const_cast<char*>("binary"));
+  }
+  MeCab::scoped_ptr<MeCab::Model> model(MeCab::Model::create(args.size(), args.data()));
+  CHECK_DIE(model.get()) << "cannot create model";
+  MeCab::scoped_ptr<MeCab::Tagger> tagger(MeCab::Tagger::create(model.get()));
+  MeCab::scoped_ptr<MeCab::Lattice> lattice(model->createLattice());
+  lattice->set_request_type(model->request_type());
+
+  std::string output;
+  MeCab::StringBuffer os;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < lines.size(); ++i) {
+    lattice->set_sentence(lines[i].c_str());
+    CHECK_DIE(tagger->parse(lattice.get())) << lattice->what();
+    os.clear();
+    CHECK_DIE(model->writer()->write(lattice.get(), &os)) << lattice->what();
+    output.append(os.str(), os.size());
+  }
+  const double write_seconds = seconds_since(start);
+
+  start = std::chrono::steady_clock::now();
+  const size_t tokens = binary ? consume_binary(output) : consume_text(output);
+  const double read_seconds = seconds_since(start);
+
+  std::cout << name << "\tanalysis+write " << write_seconds << " sec\tread " << read_seconds << " sec\ttotal "
+            << (write_seconds + read_seconds) << " sec\t" << (lines.size() / (write_seconds + read_seconds))
+            << " sentences/sec\t" << (output.size() / 1e6) << " MB\t" << tokens << " tokens" << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  CHECK_DIE(argc >= 2) << "usage: " << argv[0] << " FILE [mecab options]";
+  std::ifstream ifs(argv[1]);
+  CHECK_DIE(ifs) << "no such file or directory: " << argv[1];
+  std::vector<std::string> lines;
+  for (std::string line; std::getline(ifs, line);) {
+    lines.push_back(line);
+  }
+
+  std::vector<char*> args;
+  args.push_back(argv[0]);
+  for (int i = 2; i < argc; ++i) {
+    args.push_back(argv[i]);
+  }
+
+  run("text", lines, args, false);
+  run("binary", lines, args, true);
+
+  return 0;
+}
@@ -0,0 +1,116 @@
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "mecab/package.h"
+#include "mecab/tagger.h"
+
+// Latency of the first N sentences after a dictionary is opened, for each dictionary-load option.
+// The dictionary files are dropped from the page cache before each run, so the first sentences take the
+// page faults unless the option loads the pages when the dictionary is opened.
+//
+// usage: bench-cold-start DICDIR FILE N [LOAD...]
+//   e.g. bench-cold-start /path/to/dic corpus.txt 100 "" prefault prefault,mlock hugepage
+//        bench-cold-start /path/to/dic/dic.pack corpus.txt 100
+
+namespace {
+
+double seconds_since(const std::chrono::steady_clock::time_point& start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void drop_page_cache(const std::string& filename) {
+  const int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd >= 0) {
+    ::fdatasync(fd);
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    ::close(fd);
+  }
+}
+
+void drop_dictionary(const std::string& dicdir) {
+  if (MeCab::DictionaryPackage::is_package(dicdir.c_str())) {
+    drop_page_cache(dicdir);
+    return;
+  }
+  const char* files[] = {SYS_DIC_FILE, UNK_DIC_FILE, MATRIX_FILE, CHAR_PROPERTY_FILE};
+  for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); ++i) {
+    drop_page_cache(MeCab::create_filename(dicdir, files[i]));
+  }
+}
+
+void run(const std::string& dicdir, const std::string& load, const std::vector<std::string>& lines) {
+  drop_dictionary(dicdir);
+
+  std::vector<std::string> arguments = {"bench-cold-start", "-r", "/dev/null", "-d", dicdir};
+  if (!load.empty()) {
+    arguments.push_back("-L");
+    arguments.push_back(load);
+  }
+  std::vector<char*> args;
+  for (size_t i = 0; i < arguments.size(); ++i) {
+    args.push_back(const_cast<char*>(arguments[i].c_str()));
+  }
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  MeCab::scoped_ptr<MeCab::Model> model(MeCab::Model::create(args.size(), args.data()));
+  CHECK_DIE(model.get()) << "cannot create model";
+  MeCab::scoped_ptr<MeCab::Tagger> tagger(MeCab::Tagger::create(model.get()));
+  MeCab::scoped_ptr<MeCab::Lattice> lattice(model->createLattice());
+  const double open_seconds = seconds_since(start);
+
+  std::vector<double> latencies;
+  for (size_t i = 0; i < lines.size(); ++i) {
+    start = std::chrono::steady_clock::now();
+    lattice->set_sentence(lines[i].c_str());
+    CHECK_DIE(tagger->parse(lattice.get())) << lattice->what();
+    latencies.push_back(seconds_since(start) * 1e6);
+  }
+  double total = 0;
+  for (size_t i = 0; i < latencies.size(); ++i) {
+    total += latencies[i];
+  }
+  const double first = latencies.empty() ? 0 : latencies[0];
+  std::sort(latencies.begin(), latencies.end());
+  const double p50 = latencies.empty() ? 0 : latencies[latencies.size() / 2];
+  const double p99 = latencies.empty() ? 0 : latencies[latencies.size() * 99 / 100];
+  const double max = latencies.empty() ? 0 : latencies.back();
+
+  std::cout << (load.empty() ? "on-demand" : load) << "\topen " << (open_seconds * 1e3) << " ms\tfirst " << first
+            << " us\tp50 " << p50 << " us\tp99 " << p99 << " us\tmax " << max << " us\ttotal " << (total / 1e3)
+            << " ms" << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  CHECK_DIE(argc >= 4) << "usage: " << argv[0] << " DICDIR FILE N [LOAD...]";
+  const std::string dicdir = argv[1];
+  std::ifstream ifs(argv[2]);
+  CHECK_DIE(ifs) << "no such file or directory: " << argv[2];
+  const size_t n = std::atol(argv[3]);
+  std::vector<std::string> lines;
+  for (std::string line; lines.size() < n && std::getline(ifs, line);) {
+    lines.push_back(line);
+  }
+
+  std::vector<std::string> loads;
+  for (int i = 4; i < argc; ++i) {
+    loads.push_back(argv[i]);
+  }
+  if (loads.empty()) {
+    loads = {"", "prefault", "mlock", "hugepage", "prefault,mlock"};
+  }
+
+  for (size_t i = 0; i < loads.size(); ++i) {
+    run(dicdir, loads[i], lines);
+  }
+
+  return 0;
+}
@@ -0,0 +1,73 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "mecab/cli/cost_trainer.h"
+
+// Wall time of reading a training corpus into lattices in mecab-cost-train with 1 to 64 threads, which read the
+// shards of the corpus with their own caches and merge their features at last.
+// The number of features and the sum of the observed features are printed to check that they do not change.
+// DICDIR is a dictionary compiled from a seed dictionary, and CORPUS is a training corpus.
+//
+// usage: bench-corpus-reader DICDIR CORPUS [THREADS...]
+//   e.g. bench-corpus-reader /tmp/seed corpus.txt 1 2 4 8
+
+namespace {
+
+double seconds_since(const std::chrono::steady_clock::time_point& start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  CHECK_DIE(argc >= 3) << "usage: " << argv[0] << " DICDIR CORPUS [THREADS...]";
+  const std::string dicdir = argv[1];
+  std::vector<size_t> thread_nums;
+  for (int i = 3; i < argc; ++i) {
+    thread_nums.push_back(std::atoi(argv[i]));
+  }
+  if (thread_nums.empty()) {
+    thread_nums = {1, 2, 4, 8};
+  }
+
+  MeCab::Param param;
+  param.set("dicdir", dicdir);
+  CHECK_DIE(param.parseFile(MeCab::create_filename(dicdir, DICRC).c_str())) << "no dicrc in " << dicdir;
+  MeCab::Tokenizer<MeCab::LearnerNode, MeCab::LearnerPath> tokenizer;
+  CHECK_DIE(tokenizer.open(param)) << "cannot open tokenizer";
+
+  for (size_t i = 0; i < thread_nums.size(); ++i) {
+    MeCab::EncoderFeatureIndex feature_index;
+    CHECK_DIE(feature_index.open(param)) << "cannot open feature index";
+    std::vector<MeCab::EncoderLearnerTagger*> x;
+    std::vector<double> observed;
+
+    std::ostringstream output;
+    std::streambuf* const buf = std::cout.rdbuf(output.rdbuf());
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    {
+      MeCab::CorpusReader reader(param, &tokenizer, &feature_index, param.get<size_t>("eval-size"),
+                                 param.get<size_t>("unk-eval-size"));
+      reader.read(argv[2], thread_nums[i], &x, &observed);
+      const double seconds = seconds_since(start);
+      std::cout.rdbuf(buf);
+
+      double observed_sum = 0.0;
+      for (size_t k = 0; k < observed.size(); ++k) {
+        observed_sum += observed[k];
+      }
+      std::cout << thread_nums[i] << " threads\t" << x.size() << " sentences\t" << feature_index.size()
+                << " features\tobserved " << observed_sum << "\tread " << (seconds * 1e3) << " ms" << std::endl;
+
+      for (size_t k = 0; k < x.size(); ++k) {
+        delete x[k];
+      }
+    }
+  }
+
+  return 0;
+}
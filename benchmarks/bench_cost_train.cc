@@ -0,0 +1,169 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "mecab/cli/cost_trainer.h"
+
+// Wall time of the gradient computation and of the sum of the expectations of the threads in an iteration of
+// mecab-cost-train with 1 to 64 threads: LearnerThreadPool, and fresh threads taking every THREADS-th sentence
+// whose expectations are added up by the main thread, which was used before.
+// The busy time of the threads shows the imbalance.
+// DICDIR is a dictionary compiled from a seed dictionary, and CORPUS is a training corpus.
+//
+// usage: bench-cost-train DICDIR CORPUS ITERATIONS [THREADS...]
+//   e.g. bench-cost-train /tmp/seed corpus.txt 5 1 2 4 8 16 32 64
+
+namespace {
+
+double seconds_since(const std::chrono::steady_clock::time_point& start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// fresh threads for every iteration, each taking every |thread_num|-th sentence
+class strided_thread : public MeCab::thread {
+ public:
+  size_t start_i;
+  size_t thread_num;
+  const std::vector<MeCab::EncoderLearnerTagger*>* x;
+  std::vector<double> expected;
+  size_t micro_p;
+  size_t micro_r;
+  size_t micro_c;
+  double busy;
+  void run() {
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    micro_p = micro_r = micro_c = 0;
+    std::fill(expected.begin(), expected.end(), 0.0);
+    for (size_t i = start_i; i < x->size(); i += thread_num) {
+      (*x)[i]->gradient(&expected[0]);
+      (*x)[i]->eval(&micro_c, &micro_p, &micro_r);
+    }
+    busy = seconds_since(start);
+  }
+};
+
+void report(const char* name,
+            size_t thread_num,
+            double seconds,
+            double reduce_seconds,
+            const std::vector<double>& busy) {
+  const double max = *std::max_element(busy.begin(), busy.end());
+  const double min = *std::min_element(busy.begin(), busy.end());
+  std::cout << name << "\tthreads " << thread_num << "\t" << (seconds * 1e3) << " ms/iteration\treduction "
+            << (reduce_seconds * 1e3) << " ms\tbusy min " << (min * 1e3) << " ms\tmax " << (max * 1e3) << " ms"
+            << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  CHECK_DIE(argc >= 4) << "usage: " << argv[0] << " DICDIR CORPUS ITERATIONS [THREADS...]";
+  const std::string dicdir = argv[1];
+  const size_t iterations = std::max(1, std::atoi(argv[3]));
+  std::vector<size_t> thread_nums;
+  for (int i = 4; i < argc; ++i) {
+    thread_nums.push_back(std::atol(argv[i]));
+  }
+  if (thread_nums.empty()) {
+    thread_nums = {1, 2, 4, 8, 16, 32, 64};
+  }
+
+  MeCab::Param param;
+  param.set("dicdir", dicdir);
+  CHECK_DIE(param.parseFile(MeCab::create_filename(dicdir, DICRC).c_str())) << "no dicrc in " << dicdir;
+
+  MeCab::EncoderFeatureIndex feature_index;
+  MeCab::Tokenizer<MeCab::LearnerNode, MeCab::LearnerPath> tokenizer;
+  MeCab::Allocator<MeCab::LearnerNode, MeCab::LearnerPath> allocator;
+  CHECK_DIE(tokenizer.open(param)) << "cannot open tokenizer";
+  CHECK_DIE(feature_index.open(param)) << "cannot open feature index";
+
+  std::ifstream ifs(argv[2]);
+  CHECK_DIE(ifs) << "no such file or directory: " << argv[2];
+  std::vector<double> observed;
+  std::vector<MeCab::EncoderLearnerTagger*> x;
+  while (ifs) {
+    MeCab::EncoderLearnerTagger* tagger = new MeCab::EncoderLearnerTagger();
+    CHECK_DIE(tagger->open(&tokenizer, &allocator, &feature_index, param.get<size_t>("eval-size"),
+                           param.get<size_t>("unk-eval-size")));
+    CHECK_DIE(tagger->read(&ifs, &observed));
+    if (!tagger->empty()) {
+      x.push_back(tagger);
+    } else {
+      delete tagger;
+    }
+  }
+  feature_index.shrink(1, &observed);
+  feature_index.clearcache();
+  const size_t psize = feature_index.size();
+  std::vector<double> alpha(psize, 0.0);
+  std::vector<double> expected(psize, 0.0);
+  feature_index.set_alpha(&alpha[0]);
+  std::cout << x.size() << " sentences\t" << psize << " features" << std::endl;
+
+  for (size_t t = 0; t < thread_nums.size(); ++t) {
+    const size_t thread_num = thread_nums[t];
+
+    std::vector<double> busy(thread_num);
+    {
+      std::vector<strided_thread> threads(thread_num);
+      for (size_t i = 0; i < thread_num; ++i) {
+        threads[i].start_i = i;
+        threads[i].thread_num = thread_num;
+        threads[i].x = &x;
+        threads[i].expected.resize(psize);
+      }
+      double reduce_seconds = 0.0;
+      const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      for (size_t itr = 0; itr < iterations; ++itr) {
+        for (size_t i = 0; i < thread_num; ++i) {
+          threads[i].start();
+        }
+        for (size_t i = 0; i < thread_num; ++i) {
+          threads[i].join();
+        }
+        const std::chrono::steady_clock::time_point reduce_start = std::chrono::steady_clock::now();
+        std::fill(expected.begin(), expected.end(), 0.0);
+        for (size_t i = 0; i < thread_num; ++i) {
+          for (size_t k = 0; k < psize; ++k) {
+            expected[k] += threads[i].expected[k];
+          }
+        }
+        reduce_seconds += seconds_since(reduce_start);
+      }
+      const double seconds = seconds_since(start) / iterations;
+      for (size_t i = 0; i < thread_num; ++i) {
+        busy[i] = threads[i].busy;
+      }
+      report("strided", thread_num, seconds, reduce_seconds / iterations, busy);
+    }
+
+    {
+      MeCab::LearnerThreadPool pool(x, thread_num, psize);
+      const std::function<double(size_t, size_t)> update = [](size_t, size_t) { return 0.0; };
+      double reduce_seconds = 0.0;
+      const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      for (size_t itr = 0; itr < iterations; ++itr) {
+        pool.compute();
+        const std::chrono::steady_clock::time_point reduce_start = std::chrono::steady_clock::now();
+        pool.reduce(&expected[0], update);
+        reduce_seconds += seconds_since(reduce_start);
+      }
+      const double seconds = seconds_since(start) / iterations;
+      for (size_t i = 0; i < thread_num; ++i) {
+        busy[i] = pool.worker(i).busy;
+      }
+      report("pool", thread_num, seconds, reduce_seconds / iterations, busy);
+    }
+  }
+
+  for (size_t i = 0; i < x.size(); ++i) {
+    delete x[i];
+  }
+
+  return 0;
+}
@@ -0,0 +1,107 @@
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "mecab/tagger.h"
+
+// Time and peak resident memory of Dictionary::compile for a synthetic lexicon of N entries.
+// The lexicon (lexicon.csv, matrix.def) is generated in DIR unless it exists, and compiled into DIR/sys.dic
+// with THREADS threads. With SORT_BUFFER, entries beyond SORT_BUFFER megabytes are sorted in temporary files.
+// Run each setting in its own process to compare the peak memory.
+//
+// usage: bench-dictionary DIR N THREADS [SORT_BUFFER]
+//   e.g. bench-dictionary /tmp/lexicon 5000000 4
+//        bench-dictionary /tmp/lexicon 5000000 4 256
+
+namespace {
+
+double seconds_since(const std::chrono::steady_clock::time_point& start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// peak resident set size
+std::string peak_rss() {
+  std::ifstream ifs("/proc/self/status");
+  for (std::string line; std::getline(ifs, line);) {
+    if (line.compare(0, 6, "VmHWM:") == 0) {
+      return line;
+    }
+  }
+  return "";
+}
+
+// Katakana surfaces of 1 to 8 characters, about 10% of which are homographs of earlier entries.
+void generate(const std::string& dir, size_t size) {
+  const size_t kContextSize = 64;
+  std::ofstream matrix((dir + "/matrix.def").c_str());
+  CHECK_DIE(matrix) << "permission denied: " << dir;
+  matrix << kContextSize << " " << kContextSize << "\n";
+  for (size_t i = 0; i < kContextSize; ++i) {
+    for (size_t j = 0; j < kContextSize; ++j) {
+      matrix << i << " " << j << " " << (std::rand() % 1000) << "\n";
+    }
+  }
+
+  std::ofstream csv((dir + "/lexicon.csv").c_str());
+  std::srand(0);
+  std::vector<std::string> surfaces;
+  for (size_t i = 0; i < size; ++i) {
+    std::string w;
+    if (!surfaces.empty() && std::rand() % 10 == 0) {
+      w = surfaces[std::rand() % surfaces.size()];
+    } else {
+      const size_t length = 1 + std::rand() % 8;
+      for (size_t j = 0; j < length; ++j) {
+        const int c = 0x30a1 + std::rand() % 86;  // ァ..ヶ
+        w += static_cast<char>(0xe0 | (c >> 12));
+        w += static_cast<char>(0x80 | ((c >> 6) & 0x3f));
+        w += static_cast<char>(0x80 | (c & 0x3f));
+      }
+      if (surfaces.size() < 100000) {
+        surfaces.push_back(w);
+      }
+    }
+    const int id = std::rand() % kContextSize;
+    csv << w << "," << id << "," << id << "," << (std::rand() % 10000) << ",名詞,一般,*,*,*,*," << w << "," << w << ","
+        << w << "\n";
+  }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  CHECK_DIE(argc >= 4) << "usage: " << argv[0] << " DIR N THREADS [SORT_BUFFER]";
+  const std::string dir = argv[1];
+  const size_t size = std::atol(argv[2]);
+
+  if (!std::ifstream((dir + "/lexicon.csv").c_str())) {
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    generate(dir, size);
+    std::cout << "generated " << size << " entries in " << seconds_since(start) << " sec" << std::endl;
+  }
+
+  MeCab::Param param;
+  param.set("dicdir", dir);
+  param.set("dictionary-charset", "utf-8");
+  param.set("charset", "utf-8");
+  param.set("cost-factor", "800");
+  param.set("type", std::to_string(MECAB_SYS_DIC));
+  param.set("threads", argv[3]);
+  param.set("sort-buffer", argc > 4 ? argv[4] : "0");
+
+  std::vector<std::string> dics;
+  dics.push_back(dir + "/lexicon.csv");
+  const std::string output = dir + "/sys.dic";
+
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  CHECK_DIE(MeCab::Dictionary::compile(param, dics, output.c_str()));
+  const double seconds = seconds_since(start);
+
+  std::cout << "threads " << argv[3] << "\tsort-buffer " << (argc > 4 ? argv[4] : "0") << "\t" << seconds << " sec\t"
+            << (size / seconds) << " entries/sec\t" << peak_rss() << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,107 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "mecab/cli/entrypoints.h"
+
+// Time of the steps of mecab-cost-train and mecab-dict-gen which look up the feature index and the rewrite cache
+// for every path: reading a training corpus into lattices with their feature vectors, and generating a dictionary
+// from a model.
+// DICDIR is a dictionary compiled from a seed dictionary, CORPUS is a training corpus, MODEL is a model trained on
+// DICDIR, and the dictionary is generated in OUTDIR. The best of REPEAT runs is reported in the last two lines;
+// the progress bars of mecab-dict-gen are written to stdout with printf.
+//
+// usage: bench-feature-cache DICDIR CORPUS MODEL OUTDIR REPEAT
+//   e.g. bench-feature-cache /tmp/seed corpus.txt model /tmp/gen 5
+
+namespace {
+
+double seconds_since(const std::chrono::steady_clock::time_point& start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// reads |corpus| as mecab-cost-train does and returns the number of sentences
+size_t read_corpus(const std::string& dicdir, const std::string& corpus, size_t* features) {
+  MeCab::Param param;
+  param.set("dicdir", dicdir);
+  CHECK_DIE(param.parseFile(MeCab::create_filename(dicdir, DICRC).c_str())) << "no dicrc in " << dicdir;
+
+  MeCab::EncoderFeatureIndex feature_index;
+  MeCab::Tokenizer<MeCab::LearnerNode, MeCab::LearnerPath> tokenizer;
+  MeCab::Allocator<MeCab::LearnerNode, MeCab::LearnerPath> allocator;
+  CHECK_DIE(tokenizer.open(param)) << "cannot open tokenizer";
+  CHECK_DIE(feature_index.open(param)) << "cannot open feature index";
+
+  std::ifstream ifs(corpus.c_str());
+  CHECK_DIE(ifs) << "no such file or directory: " << corpus;
+  std::vector<double> observed;
+  std::vector<MeCab::EncoderLearnerTagger*> x;
+  while (ifs) {
+    MeCab::EncoderLearnerTagger* tagger = new MeCab::EncoderLearnerTagger();
+    CHECK_DIE(tagger->open(&tokenizer, &allocator, &feature_index, param.get<size_t>("eval-size"),
+                           param.get<size_t>("unk-eval-size")));
+    CHECK_DIE(tagger->read(&ifs, &observed));
+    if (tagger->empty()) {
+      delete tagger;
+      continue;
+    }
+    x.push_back(tagger);
+  }
+  feature_index.shrink(1, &observed);
+  *features = feature_index.size();
+
+  const size_t sentences = x.size();
+  for (size_t i = 0; i < x.size(); ++i) {
+    delete x[i];
+  }
+  return sentences;
+}
+
+void generate(const std::string& dicdir, const std::string& model, const std::string& outdir) {
+  std::vector<std::string> arguments = {"bench-feature-cache", "-d", dicdir, "-m", model, "-o", outdir};
+  std::vector<char*> args;
+  for (size_t i = 0; i < arguments.size(); ++i) {
+    args.push_back(const_cast<char*>(arguments[i].c_str()));
+  }
+
+  std::ostringstream output;
+  std::streambuf* const buf = std::cout.rdbuf(output.rdbuf());
+  const int result = MeCab::DictionaryGenerator::run(args.size(), args.data());
+  std::cout.rdbuf(buf);
+  CHECK_DIE(result == 0) << "cannot generate a dictionary in " << outdir;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  CHECK_DIE(argc == 6) << "usage: " << argv[0] << " DICDIR CORPUS MODEL OUTDIR REPEAT";
+  const size_t repeat = std::max(1, std::atoi(argv[5]));
+
+  double read_seconds = 0.0;
+  double generate_seconds = 0.0;
+  size_t sentences = 0;
+  size_t features = 0;
+  for (size_t i = 0; i < repeat; ++i) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    sentences = read_corpus(argv[1], argv[2], &features);
+    const double read = seconds_since(start);
+
+    start = std::chrono::steady_clock::now();
+    generate(argv[1], argv[3], argv[4]);
+    const double gen = seconds_since(start);
+
+    read_seconds = i == 0 ? read : std::min(read_seconds, read);
+    generate_seconds = i == 0 ? gen : std::min(generate_seconds, gen);
+  }
+
+  std::cout << "cost-train\t" << sentences << " sentences\t" << features << " features\tread "
+            << (read_seconds * 1e3) << " ms" << std::endl;
+  std::cout << "dict-gen\t" << (generate_seconds * 1e3) << " ms" << std::endl;
+
+  return 0;
+}
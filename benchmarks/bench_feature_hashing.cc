@@ -0,0 +1,72 @@
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "mecab/cli/cost_trainer.h"
+
+// Peak memory and the F on the training corpus of mecab-cost-train with the features hashed to HASH_SIZE buckets,
+// or with the whole features for 0. The peak memory is of the whole process, so run each size in its own process.
+// DICDIR is a dictionary compiled from a seed dictionary, and CORPUS is a training corpus.
+// The accuracy on a held-out corpus needs the dictionary of the model, see tests-integration/test_cost_train.cc.
+//
+// usage: bench-feature-hashing DICDIR CORPUS HASH_SIZE
+//   e.g. for h in 0 4096 65536; do bench-feature-hashing /tmp/seed corpus.txt $h; done
+
+namespace {
+
+// the value of |name| in a line like "iter=1 err=0.5 F=0.9 target=100 diff=1 time=0.1"
+double field(const std::string& line, const std::string& name) {
+  const size_t pos = line.find(" " + name + "=");
+  return pos == std::string::npos ? 0.0 : std::atof(line.c_str() + pos + name.size() + 2);
+}
+
+// the peak resident memory of the process in bytes
+size_t peak_resident_bytes() {
+  std::ifstream ifs("/proc/self/status");
+  for (std::string line; std::getline(ifs, line);) {
+    if (line.compare(0, 7, "VmHWM:\t") == 0) {
+      return std::strtoull(line.c_str() + 7, 0, 10) * 1024;
+    }
+  }
+  return 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  CHECK_DIE(argc == 4) << "usage: " << argv[0] << " DICDIR CORPUS HASH_SIZE";
+  std::vector<std::string> arguments = {"bench-feature-hashing", "-d", argv[1], "-c", "1.0", "-f", "1",
+                                        "-H", argv[3], argv[2], "/dev/null"};
+  std::vector<char*> args;
+  for (size_t i = 0; i < arguments.size(); ++i) {
+    args.push_back(const_cast<char*>(arguments[i].c_str()));
+  }
+
+  std::ostringstream output;
+  std::streambuf* const buf = std::cout.rdbuf(output.rdbuf());
+  const int result = MeCab::Learner::run(args.size(), args.data());
+  std::cout.rdbuf(buf);
+  CHECK_DIE(result == 0) << "cannot train with hash-size " << argv[3];
+
+  std::istringstream lines(output.str());
+  size_t features = 0;
+  size_t iterations = 0;
+  std::string last;
+  for (std::string line; std::getline(lines, line);) {
+    if (line.compare(0, 20, "Number of features: ") == 0) {
+      features = std::strtoull(line.c_str() + 20, 0, 10);
+    } else if (line.compare(0, 5, "iter=") == 0) {
+      ++iterations;
+      last = " " + line;
+    }
+  }
+
+  std::cout << "hash-size " << argv[3] << "\tfeatures " << features << "\tpeak resident "
+            << (peak_resident_bytes() >> 20) << " MB\titerations " << iterations << "\tF " << field(last, "F")
+            << "\ttime " << field(last, "time") << " s" << std::endl;
+
+  return 0;
+}
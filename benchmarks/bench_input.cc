@@ -0,0 +1,88 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+
+#include "mecab/cli/pipeline.h"
+#include "mecab/cli/sentence_reader.h"
+
+// Input throughput of the mecab CLI: lines read by getline() into the input buffer through istream_wrapper,
+// and lines of the mapped file returned by SentenceReader. With mecab options, every line is also analyzed.
+// Run each mode in its own process so that both start from the same page cache state.
+//
+// usage: bench-input FILE (stream|mapped) [mecab options]
+//   e.g. bench-input corpus.txt mapped
+//        bench-input corpus.txt mapped -r /dev/null -d /path/to/dic
+
+namespace {
+
+double seconds_since(const std::chrono::steady_clock::time_point& start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  CHECK_DIE(argc >= 3) << "usage: " << argv[0] << " FILE (stream|mapped) [mecab options]";
+  const std::string mode = argv[2];
+  CHECK_DIE(mode == "stream" || mode == "mapped") << "unknown mode: " << mode;
+
+  MeCab::scoped_ptr<MeCab::Model> model;
+  MeCab::scoped_ptr<MeCab::Tagger> tagger;
+  MeCab::scoped_ptr<MeCab::Lattice> lattice;
+  if (argc > 3) {
+    std::vector<char*> args;
+    args.push_back(argv[0]);
+    for (int i = 3; i < argc; ++i) {
+      args.push_back(argv[i]);
+    }
+    model.reset(MeCab::Model::create(args.size(), args.data()));
+    CHECK_DIE(model.get()) << "cannot create model";
+    tagger.reset(MeCab::Tagger::create(model.get()));
+    lattice.reset(model->createLattice());
+  }
+
+  size_t lines = 0;
+  size_t bytes = 0;
+  size_t output = 0;
+  MeCab::StringBuffer os;
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  const char* sentence = 0;
+  size_t length = 0;
+  MeCab::scoped_array<char> ibuf(new char[MAX_INPUT_BUFFER_SIZE]);
+  MeCab::scoped_ptr<MeCab::istream_wrapper> ifs;
+  MeCab::scoped_ptr<MeCab::SentenceReader> reader;
+  if (mode == "stream") {
+    ifs.reset(new MeCab::istream_wrapper(argv[1]));
+    CHECK_DIE(**ifs) << "no such file or directory: " << argv[1];
+  } else {
+    reader.reset(new MeCab::SentenceReader(argv[1], MAX_INPUT_BUFFER_SIZE, false));
+    CHECK_DIE(reader->good() && reader->is_mapped()) << "cannot map: " << argv[1];
+  }
+
+  for (;;) {
+    if (ifs.get()) {
+      if (!(*ifs)->getline(ibuf.get(), MAX_INPUT_BUFFER_SIZE)) {
+        break;
+      }
+      sentence = ibuf.get();
+      length = std::strlen(sentence);
+    } else if (!reader->next(&sentence, &length)) {
+      break;
+    }
+    ++lines;
+    bytes += length;
+    if (model.get()) {
+      os.clear();
+      CHECK_DIE(MeCab::analyzeSentence(model.get(), tagger.get(), lattice.get(), 1, sentence, length, &os))
+          << lattice->what();
+      output += os.size();
+    }
+  }
+  const double seconds = seconds_since(start);
+
+  std::cout << mode << "\t" << seconds << " sec\t" << (lines / seconds) << " lines/sec\t" << (bytes / seconds / 1e6)
+            << " MB/sec\t" << lines << " lines\t" << (output / 1e6) << " MB output" << std::endl;
+
+  return 0;
+}
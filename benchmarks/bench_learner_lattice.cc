@@ -0,0 +1,125 @@
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "mecab/learner_tagger.h"
+
+// Memory per sentence and time of the lattices of mecab-cost-train: the lattices of LearnerNode and LearnerPath
+// which stay in the allocator ("full"), and the lattices moved to CompactLattice after each sentence is read
+// ("compact"), which mecab-cost-train uses.
+// The resident memory is measured from the start, so run each mode in its own process.
+// DICDIR is a dictionary compiled from a seed dictionary, and CORPUS is a training corpus.
+//
+// usage: bench-learner-lattice DICDIR CORPUS ITERATIONS MODE
+//   e.g. bench-learner-lattice /tmp/seed corpus.txt 5 full; bench-learner-lattice /tmp/seed corpus.txt 5 compact
+
+namespace {
+
+double seconds_since(const std::chrono::steady_clock::time_point& start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+size_t resident_bytes() {
+  std::ifstream ifs("/proc/self/statm");
+  size_t size = 0;
+  size_t resident = 0;
+  ifs >> size >> resident;
+  return resident * ::sysconf(_SC_PAGESIZE);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  CHECK_DIE(argc == 5) << "usage: " << argv[0] << " DICDIR CORPUS ITERATIONS MODE";
+  const std::string dicdir = argv[1];
+  const size_t iterations = std::max(1, std::atoi(argv[3]));
+  const std::string mode = argv[4];
+  CHECK_DIE(mode == "full" || mode == "compact") << "unknown mode: " << mode;
+
+  MeCab::Param param;
+  param.set("dicdir", dicdir);
+  CHECK_DIE(param.parseFile(MeCab::create_filename(dicdir, DICRC).c_str())) << "no dicrc in " << dicdir;
+
+  MeCab::EncoderFeatureIndex feature_index;
+  MeCab::Tokenizer<MeCab::LearnerNode, MeCab::LearnerPath> tokenizer;
+  MeCab::Allocator<MeCab::LearnerNode, MeCab::LearnerPath> allocator;
+  CHECK_DIE(tokenizer.open(param)) << "cannot open tokenizer";
+  CHECK_DIE(feature_index.open(param)) << "cannot open feature index";
+
+  std::ifstream ifs(argv[2]);
+  CHECK_DIE(ifs) << "no such file or directory: " << argv[2];
+  std::vector<double> observed;
+  std::vector<MeCab::EncoderLearnerTagger*> x;
+  size_t nodes = 0;
+  size_t lattice_size = 0;
+  size_t compact_bytes = 0;
+  const size_t start_bytes = resident_bytes();
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  while (ifs) {
+    MeCab::EncoderLearnerTagger* tagger = new MeCab::EncoderLearnerTagger();
+    CHECK_DIE(tagger->open(&tokenizer, &allocator, &feature_index, param.get<size_t>("eval-size"),
+                           param.get<size_t>("unk-eval-size")));
+    const size_t node_size = allocator.node_size();
+    CHECK_DIE(tagger->read(&ifs, &observed));
+    if (tagger->empty()) {
+      delete tagger;
+      continue;
+    }
+    nodes += allocator.node_size() - node_size;
+    lattice_size += tagger->lattice_size() + 1;  // with BOS
+    if (mode == "compact") {
+      tagger->compact();
+      compact_bytes += tagger->lattice_memory();
+      allocator.free();
+    }
+    x.push_back(tagger);
+  }
+  const double read_seconds = seconds_since(start);
+  const size_t read_bytes = resident_bytes() - start_bytes;
+  feature_index.shrink(1, &observed);
+  feature_index.clearcache();
+
+  const size_t psize = feature_index.size();
+  std::vector<double> alpha(psize, 0.0);
+  std::vector<double> expected(psize, 0.0);
+  feature_index.set_alpha(&alpha[0]);
+
+  start = std::chrono::steady_clock::now();
+  size_t micro_p = 0;
+  size_t micro_r = 0;
+  size_t micro_c = 0;
+  for (size_t itr = 0; itr < iterations; ++itr) {
+    for (size_t i = 0; i < x.size(); ++i) {
+      x[i]->gradient(&expected[0]);
+      x[i]->eval(&micro_c, &micro_p, &micro_r);
+    }
+  }
+  const double gradient_seconds = seconds_since(start) / iterations;
+
+  const size_t paths = lattice_size - nodes;
+  std::cout << mode << "\t" << x.size() << " sentences\t" << (1.0 * nodes / x.size()) << " nodes/sentence\t"
+            << (1.0 * paths / x.size()) << " paths/sentence" << std::endl;
+  std::cout << mode << "\tresident " << (read_bytes / x.size()) << " bytes/sentence";
+  if (mode == "compact") {
+    std::cout << "\tlattice " << (compact_bytes / x.size()) << " bytes/sentence";
+  } else {
+    std::cout << "\tnodes and paths "
+              << ((nodes * sizeof(MeCab::LearnerNode) + paths * sizeof(MeCab::LearnerPath)) / x.size())
+              << " bytes/sentence";
+  }
+  std::cout << std::endl;
+  std::cout << mode << "\tread " << (read_seconds * 1e3) << " ms\tgradient " << (gradient_seconds * 1e3)
+            << " ms/iteration" << std::endl;
+
+  for (size_t i = 0; i < x.size(); ++i) {
+    delete x[i];
+  }
+
+  return 0;
+}
@@ -0,0 +1,137 @@
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "mecab/connector.h"
+
+// Time of Connector::compile for a synthetic SIZE x SIZE matrix.def, e.g. 9M lines for 3000, and of random
+// lookups in the compiled matrix.
+// The matrix.def is generated in DIR unless it exists, and compiled into DIR/matrix.bin with THREADS threads
+// and the matrix compression COMPRESSION (dedup or delta8). A quarter of the rows and columns are distinct.
+// Cache misses of the lookups are counted where hardware counters are available.
+//
+// usage: bench-matrix DIR SIZE THREADS [COMPRESSION]
+//   e.g. bench-matrix /tmp/matrix 3000 4
+//        bench-matrix /tmp/matrix 3000 4 dedup
+
+namespace {
+
+double seconds_since(const std::chrono::steady_clock::time_point& start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void generate(const std::string& filename, size_t size) {
+  std::ofstream ofs(filename.c_str());
+  CHECK_DIE(ofs) << "permission denied: " << filename;
+  ofs << size << " " << size << "\n";
+  std::srand(0);
+  std::vector<size_t> classes(size);
+  for (size_t i = 0; i < size; ++i) {
+    classes[i] = std::rand() % std::max<size_t>(1, size / 4);
+  }
+  for (size_t i = 0; i < size; ++i) {
+    for (size_t j = 0; j < size; ++j) {
+      ofs << i << " " << j << " " << static_cast<int>((classes[i] * 7919 + classes[j] * 104729) % 20000) - 10000
+          << "\n";
+    }
+  }
+}
+
+// counter of cache misses of this thread, or -1 if it is not available.
+class CacheMissCounter {
+ public:
+  CacheMissCounter() {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    fd_ = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+  }
+  ~CacheMissCounter() {
+    if (fd_ >= 0) {
+      ::close(fd_);
+    }
+  }
+
+  void start() {
+    if (fd_ >= 0) {
+      ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+      ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+    }
+  }
+
+  long long stop() {
+    long long count = -1;
+    if (fd_ < 0 || ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0) != 0 || read(fd_, &count, sizeof(count)) != sizeof(count)) {
+      return -1;
+    }
+    return count;
+  }
+
+ private:
+  int fd_;
+};
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  CHECK_DIE(argc >= 4) << "usage: " << argv[0] << " DIR SIZE THREADS [COMPRESSION]";
+  const std::string dir = argv[1];
+  const size_t size = std::atol(argv[2]);
+  const std::string compression = argc > 4 ? argv[4] : "";
+  const std::string input = dir + "/matrix.def";
+  const std::string output = dir + "/matrix.bin";
+
+  if (!std::ifstream(input.c_str())) {
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    generate(input, size);
+    std::cout << "generated " << size << "x" << size << " in " << seconds_since(start) << " sec" << std::endl;
+  }
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  CHECK_DIE(MeCab::Connector::compile(input.c_str(), output.c_str(), std::atol(argv[3]), compression));
+  const double seconds = seconds_since(start);
+
+  MeCab::Connector connector;
+  CHECK_DIE(connector.open(output.c_str()));
+  const size_t lsize = connector.left_size();
+  const size_t rsize = connector.right_size();
+  const double lines = static_cast<double>(lsize) * rsize;
+
+  std::cout << "threads " << argv[3] << "\t" << seconds << " sec\t" << (lines / seconds) << " lines/sec\t"
+            << std::ifstream(output.c_str(), std::ios::binary | std::ios::ate).tellg() << " bytes" << std::endl;
+
+  // pairs of context ids from a linear congruential generator, as a lattice connects arbitrary nodes.
+  const size_t kLookups = 50000000;
+  CacheMissCounter counter;
+  unsigned int x = 1;
+  long long sum = 0;
+  start = std::chrono::steady_clock::now();
+  counter.start();
+  for (size_t i = 0; i < kLookups; ++i) {
+    x = x * 1103515245u + 12345u;
+    const unsigned short l = (x >> 8) % lsize;
+    x = x * 1103515245u + 12345u;
+    const unsigned short r = (x >> 8) % rsize;
+    sum += connector.transition_cost(l, r);
+  }
+  const long long misses = counter.stop();
+  const double lookup_seconds = seconds_since(start);
+
+  std::cout << "lookups\t" << (lookup_seconds * 1e9 / kLookups) << " ns/lookup\t"
+            << (misses < 0 ? std::string("n/a") : std::to_string(static_cast<double>(misses) / kLookups))
+            << " cache misses/lookup\t(sum " << sum << ")" << std::endl;
+
+  return 0;
+}
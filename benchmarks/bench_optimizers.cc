@@ -0,0 +1,97 @@
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "mecab/cli/cost_trainer.h"
+
+// Wall time of mecab-cost-train to reach a target F on the training corpus with LBFGS and the mini-batch
+// optimizers, and the F and the objective at the end of the training.
+// DICDIR is a dictionary compiled from a seed dictionary, and CORPUS is a training corpus.
+// An optimizer is ALGORITHM[:LEARNING_RATE].
+//
+// usage: bench-optimizers DICDIR CORPUS TARGET_F THREADS BATCH_SIZE EPOCHS [OPTIMIZER...]
+//   e.g. bench-optimizers /tmp/seed corpus.txt 0.99 4 32 20 lbfgs sgd:0.2 adagrad:0.1 adam:0.01
+
+namespace {
+
+// the value of |name| in a line like "iter=1 err=0.5 F=0.9 target=100 diff=1 time=0.1"
+double field(const std::string& line, const std::string& name) {
+  const size_t pos = line.find(" " + name + "=");
+  return pos == std::string::npos ? 0.0 : std::atof(line.c_str() + pos + name.size() + 2);
+}
+
+void run(const std::string& dicdir,
+         const std::string& corpus,
+         double target,
+         const std::string& thread_num,
+         const std::string& batch_size,
+         const std::string& epochs,
+         const std::string& optimizer) {
+  const size_t colon = optimizer.find(':');
+  const std::string algorithm = optimizer.substr(0, colon);
+  std::vector<std::string> arguments = {"bench-optimizers", "-d", dicdir, "-f", "1", "-c", "1.0", "-p", thread_num,
+                                        "-a", algorithm, "-b", batch_size, "-i", epochs};
+  if (colon != std::string::npos) {
+    arguments.push_back("-l");
+    arguments.push_back(optimizer.substr(colon + 1));
+  }
+  arguments.push_back(corpus);
+  arguments.push_back("/dev/null");
+  std::vector<char*> args;
+  for (size_t i = 0; i < arguments.size(); ++i) {
+    args.push_back(const_cast<char*>(arguments[i].c_str()));
+  }
+
+  std::ostringstream output;
+  std::streambuf* const buf = std::cout.rdbuf(output.rdbuf());
+  const int result = MeCab::Learner::run(args.size(), args.data());
+  std::cout.rdbuf(buf);
+  CHECK_DIE(result == 0) << "cannot train with " << optimizer;
+
+  std::istringstream lines(output.str());
+  double reached = -1.0;
+  size_t steps = 0;
+  std::string last;
+  for (std::string line; std::getline(lines, line);) {
+    if (line.compare(0, 5, "iter=") != 0 && line.compare(0, 6, "epoch=") != 0) {
+      continue;
+    }
+    line.insert(0, " ");
+    ++steps;
+    if (reached < 0.0 && field(line, "F") >= target) {
+      reached = field(line, "time");
+    }
+    last = line;
+  }
+
+  std::cout << optimizer << "\t";
+  if (reached < 0.0) {
+    std::cout << "F " << target << " not reached";
+  } else {
+    std::cout << "F " << target << " in " << reached << " s";
+  }
+  std::cout << "\tpasses " << steps << "\tfinal F " << field(last, "F") << "\ttarget " << field(last, "target")
+            << "\ttime " << field(last, "time") << " s" << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  CHECK_DIE(argc >= 7) << "usage: " << argv[0]
+                       << " DICDIR CORPUS TARGET_F THREADS BATCH_SIZE EPOCHS [OPTIMIZER...]";
+  std::vector<std::string> optimizers;
+  for (int i = 7; i < argc; ++i) {
+    optimizers.push_back(argv[i]);
+  }
+  if (optimizers.empty()) {
+    optimizers = {"lbfgs", "sgd:0.2", "adagrad:0.1", "adam:0.01"};
+  }
+
+  for (size_t i = 0; i < optimizers.size(); ++i) {
+    run(argv[1], argv[2], std::atof(argv[3]), argv[4], argv[5], argv[6], optimizers[i]);
+  }
+
+  return 0;
+}
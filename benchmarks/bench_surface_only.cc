@@ -0,0 +1,77 @@
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "mecab/tagger.h"
+
+// Throughput and resident memory of the analysis with and without MECAB_SURFACE_ONLY.
+// Dictionaries are mapped into memory, so their pages become resident only when they are read.
+// Run each mode in its own process to compare the resident set sizes.
+//
+// usage: bench-surface-only FILE (default|surface-only) [mecab options]
+//   e.g. bench-surface-only corpus.txt surface-only -r /dev/null -d /path/to/dic
+
+namespace {
+
+// resident set size in kB, the whole and the file-backed part.
+void print_rss(const char* label) {
+  std::ifstream ifs("/proc/self/status");
+  std::cout << label;
+  for (std::string line; std::getline(ifs, line);) {
+    if (line.compare(0, 6, "VmRSS:") == 0 || line.compare(0, 8, "RssFile:") == 0) {
+      std::cout << "\t" << line;
+    }
+  }
+  std::cout << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  CHECK_DIE(argc >= 3) << "usage: " << argv[0] << " FILE (default|surface-only) [mecab options]";
+  std::ifstream ifs(argv[1]);
+  CHECK_DIE(ifs) << "no such file or directory: " << argv[1];
+  std::vector<std::string> lines;
+  for (std::string line; std::getline(ifs, line);) {
+    lines.push_back(line);
+  }
+  const bool surface_only = std::strcmp(argv[2], "surface-only") == 0;
+
+  std::vector<char*> args;
+  args.push_back(argv[0]);
+  for (int i = 3; i < argc; ++i) {
+    args.push_back(argv[i]);
+  }
+
+  MeCab::scoped_ptr<MeCab::Model> model(MeCab::Model::create(args.size(), args.data()));
+  CHECK_DIE(model.get()) << "cannot create model";
+  MeCab::scoped_ptr<MeCab::Tagger> tagger(MeCab::Tagger::create(model.get()));
+  MeCab::scoped_ptr<MeCab::Lattice> lattice(model->createLattice());
+  lattice->set_request_type(model->request_type() | (surface_only ? MECAB_SURFACE_ONLY : 0));
+  print_rss("open");
+
+  size_t tokens = 0;
+  size_t bytes = 0;
+  MeCab::StringBuffer os;
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < lines.size(); ++i) {
+    lattice->set_sentence(lines[i].c_str());
+    CHECK_DIE(tagger->parse(lattice.get())) << lattice->what();
+    os.clear();
+    CHECK_DIE(model->writer()->write(lattice.get(), &os)) << lattice->what();
+    bytes += os.size();
+    for (const MeCab::Node* node = lattice->bos_node()->next; node->next; node = node->next) {
+      ++tokens;
+    }
+  }
+  const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  std::cout << argv[2] << "\t" << seconds << " sec\t" << (lines.size() / seconds) << " sentences/sec\t" << tokens
+            << " tokens\t" << (bytes / 1e6) << " MB output" << std::endl;
+  print_rss("parsed");
+
+  return 0;
+}
@@ -0,0 +1,79 @@
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "mecab/cli/pipeline.h"
+
+// Throughput of the mecab CLI pipeline (reader -> parser pool -> ordered writer) for 1..N threads,
+// compared with the single-threaded loop. The output is written to memory.
+//
+// usage: bench-threads FILE N [mecab options]
+//   e.g. bench-threads corpus.txt 8 -r /dev/null -d /path/to/dic
+
+namespace {
+
+double seconds_since(const std::chrono::steady_clock::time_point& start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void report(const char* name, size_t threads, size_t lines, size_t bytes, double seconds) {
+  std::cout << name << "\tthreads " << threads << "\t" << seconds << " sec\t" << (lines / seconds) << " lines/sec\t"
+            << (bytes / 1e6) << " MB output" << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  CHECK_DIE(argc >= 3) << "usage: " << argv[0] << " FILE N [mecab options]";
+  std::ifstream ifs(argv[1]);
+  CHECK_DIE(ifs) << "no such file or directory: " << argv[1];
+  std::vector<std::string> lines;
+  for (std::string line; std::getline(ifs, line);) {
+    lines.push_back(line);
+  }
+  const size_t max_threads = std::atoi(argv[2]);
+  CHECK_DIE(max_threads > 0) << "invalid N";
+
+  std::vector<char*> args;
+  args.push_back(argv[0]);
+  for (int i = 3; i < argc; ++i) {
+    args.push_back(argv[i]);
+  }
+
+  MeCab::scoped_ptr<MeCab::Model> model(MeCab::Model::create(args.size(), args.data()));
+  CHECK_DIE(model.get()) << "cannot create model";
+
+  {
+    MeCab::scoped_ptr<MeCab::Tagger> tagger(MeCab::Tagger::create(model.get()));
+    MeCab::scoped_ptr<MeCab::Lattice> lattice(model->createLattice());
+    MeCab::StringBuffer os;
+    size_t bytes = 0;
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < lines.size(); ++i) {
+      os.clear();
+      CHECK_DIE(MeCab::analyzeSentence(model.get(), tagger.get(), lattice.get(), 1, lines[i].data(), lines[i].size(), &os))
+          << lattice->what();
+      bytes += os.size();
+    }
+    report("loop", 1, lines.size(), bytes, seconds_since(start));
+  }
+
+  for (size_t threads = 1; threads <= max_threads; ++threads) {
+    std::ostringstream output;
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    {
+      MeCab::Pipeline pipeline(model.get(), threads, 1, &output);
+      for (size_t i = 0; i < lines.size(); ++i) {
+        pipeline.add(lines[i].data(), lines[i].size());
+      }
+      pipeline.finish();
+    }
+    report("pipeline", threads, lines.size(), output.str().size(), seconds_since(start));
+  }
+
+  return 0;
+}
@@ -0,0 +1,79 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "mecab/lattice.h"
+#include "mecab/utils/param.h"
+#include "mecab/writer.h"
+
+namespace {
+
+const char* kResult =
+    "すもも\t名詞,一般,*,*,*,*,すもも,スモモ,スモモ\n"
+    "も\t助詞,係助詞,*,*,*,*,も,モ,モ\n"
+    "もも\t名詞,一般,*,*,*,*,もも,モモ,モモ\n"
+    "も\t助詞,係助詞,*,*,*,*,も,モ,モ\n"
+    "もも\t名詞,一般,*,*,*,*,もも,モモ,モモ\n"
+    "の\t助詞,連体化,*,*,*,*,の,ノ,ノ\n"
+    "うち\t名詞,非自立,副詞可能,*,*,*,うち,ウチ,ウチ\n"
+    "、\t記号,読点,*,*,*,*,、,、,、\n"
+    "これ\t名詞,代名詞,一般,*,*,*,これ,コレ,コレ\n"
+    "は\t助詞,係助詞,*,*,*,*,は,ハ,ワ\n"
+    "長い\t形容詞,自立,*,*,形容詞・アウオ段,基本形,長い,ナガイ,ナガイ\n"
+    "文\t名詞,一般,*,*,*,*,文,ブン,ブン\n"
+    "です\t助動詞,*,*,*,特殊・デス,基本形,です,デス,デス\n"
+    "。\t記号,句点,*,*,*,*,。,。,。\n"
+    "EOS\n";
+
+// Output formats of the chasen and yomi styles of ipadic.
+struct Format {
+  const char* name;
+  const char* node_format;
+  const char* eos_format;
+};
+
+const Format kFormats[] = {
+    {"chasen", "%m\\t%f[7]\\t%f[6]\\t%F-[0,1,2,3]\\t%f[4]\\t%f[5]\\n", "EOS\\n"},
+    {"yomi", "%pS%f[7]", "\\n"},
+    {"user", "%m\\t%H\\t%pw\\t%pC\\t%pc\\n", "EOS\\n"},
+};
+
+double run(const Format& format, size_t iterations) {
+  MeCab::Param param;
+  param.set("output-format-type", "");
+  param.set("node-format", format.node_format);
+  param.set("unk-format", format.node_format);
+  param.set("bos-format", "");
+  param.set("eos-format", format.eos_format);
+  param.set("eon-format", "");
+
+  MeCab::Writer writer;
+  CHECK_DIE(writer.open(param)) << "cannot open writer";
+
+  MeCab::Lattice lattice;
+  lattice.set_result(kResult);
+
+  MeCab::StringBuffer os;
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < iterations; ++i) {
+    os.clear();
+    CHECK_DIE(writer.write(&lattice, &os)) << lattice.what();
+  }
+  const std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double>(end - start).count();
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const size_t iterations = argc > 1 ? std::atoi(argv[1]) : 100000;
+
+  for (size_t i = 0; i < sizeof(kFormats) / sizeof(kFormats[0]); ++i) {
+    const double seconds = run(kFormats[i], iterations);
+    std::cout << kFormats[i].name << "\t" << seconds << " sec\t" << (iterations * 14 / seconds / 1e6)
+              << " M nodes/sec" << std::endl;
+  }
+
+  return 0;
+}
@@ -3,6 +3,8 @@ from typing import List, Optional, Tuple
 class Tagger:
     def __init__(self, dic_dir: Optional[str] = ...): ...
     def parse(self, text: str) -> Tuple[Tuple[str, str], ...]: ...
+    def parse_surface(self, text: str) -> Tuple[Tuple[str, int, int, int], ...]: ...
+    def parse_document(self, text: str, threads: int = ...) -> Tuple[Tuple[str, str, int, int], ...]: ...
 
 def mecab_main(argv: List[str]) -> None: ...
 def mecab_dict_index(argv: List[str]) -> None: ...
@@ -11,8 +11,13 @@ static PyObject* tagger_new(PyTypeObject* subtype, PyObject* args);
 static void tagger_dealloc(Tagger* self);
 static int tagger_traverse(Tagger* self, visitproc visit, void* arg);
 static PyObject* tagger_parse(Tagger* self, PyObject* args);
+static PyObject* tagger_parse_surface(Tagger* self, PyObject* args);
+static PyObject* tagger_parse_document(Tagger* self, PyObject* args);
 
-static PyMethodDef taggerMethods[] = {{"parse", (PyCFunction)tagger_parse, METH_VARARGS, ""}, {NULL}};
+static PyMethodDef taggerMethods[] = {{"parse", (PyCFunction)tagger_parse, METH_VARARGS, ""},
+                                      {"parse_surface", (PyCFunction)tagger_parse_surface, METH_VARARGS, ""},
+                                      {"parse_document", (PyCFunction)tagger_parse_document, METH_VARARGS, ""},
+                                      {NULL}};
 static PyTypeObject taggerType = {
     PyVarObject_HEAD_INIT(&PyType_Type, 0) "mecab._C.Tagger",
     sizeof(Tagger),
@@ -127,6 +132,116 @@ static PyObject* tagger_parse(Tagger* self, PyObject* args) {
   return resultObject;
 }
 
+// Counts the code points of the UTF-8 bytes from *position to end into *offset and moves *position to end.
+static void advance_offset(const char** position, const char* end, Py_ssize_t* offset) {
+  for (; *position < end; ++*position) {
+    *offset += (**position & 0xC0) != 0x80;
+  }
+}
+
+// The same as parse(), but returns (surface, posid, begin, end) without looking up dictionary features,
+// where begin and end are offsets of the surface in text.
+static PyObject* tagger_parse_surface(Tagger* self, PyObject* args) {
+  PyObject* string = NULL;
+  if (!PyArg_UnpackTuple(args, "args", 1, 1, &string))
+    return NULL;
+
+  if (!PyUnicode_Check(string)) {
+    PyErr_SetString(PyExc_TypeError, "arg must be str type");
+    return NULL;
+  }
+
+  char* text;
+  Py_ssize_t size;
+
+  PyObject* bytes = PyUnicode_AsUTF8String(string);
+  PyBytes_AsStringAndSize(bytes, &text, &size);
+
+  MeCab::Lattice lattice;
+  lattice.set_request_type(MECAB_ONE_BEST | MECAB_SURFACE_ONLY);
+  lattice.set_sentence(text, size);
+  if (!self->tagger->parse(&lattice)) {
+    Py_DECREF(bytes);
+    PyErr_SetString(PyExc_Exception, lattice.what());
+    return NULL;
+  }
+
+  size_t nodeCount = 0;
+  for (const MeCab::Node* node = lattice.bos_node()->next; node->next; node = node->next, ++nodeCount)
+    ;
+
+  PyObject* resultObject = PyTuple_New(nodeCount);
+  size_t index = 0;
+  const char* position = text;
+  Py_ssize_t offset = 0;
+  for (const MeCab::Node* node = lattice.bos_node()->next; node->next; node = node->next) {
+    advance_offset(&position, node->surface, &offset);
+    const Py_ssize_t begin = offset;
+    advance_offset(&position, node->surface + node->length, &offset);
+    PyObject* surface = PyUnicode_FromStringAndSize(node->surface, node->length);
+    PyTuple_SetItem(resultObject, index++, Py_BuildValue("(Nlnn)", surface, static_cast<long>(node->posid), begin, offset));
+  }
+  Py_DECREF(bytes);
+  return resultObject;
+}
+
+// Analyzes text as a document split at sentence punctuation and line breaks, with |threads| threads.
+// Returns (surface, feature, begin, end), where begin and end are offsets of the surface in text.
+static PyObject* tagger_parse_document(Tagger* self, PyObject* args) {
+  PyObject* string = NULL;
+  Py_ssize_t threads = 1;
+  if (!PyArg_ParseTuple(args, "O|n", &string, &threads))
+    return NULL;
+
+  if (!PyUnicode_Check(string)) {
+    PyErr_SetString(PyExc_TypeError, "arg must be str type");
+    return NULL;
+  }
+  if (threads <= 0) {
+    PyErr_SetString(PyExc_ValueError, "threads must be positive");
+    return NULL;
+  }
+
+  char* text;
+  Py_ssize_t size;
+
+  PyObject* bytes = PyUnicode_AsUTF8String(string);
+  PyBytes_AsStringAndSize(bytes, &text, &size);
+
+  MeCab::Lattice lattice;
+  lattice.set_request_type(MECAB_ONE_BEST);
+  lattice.set_sentence(text, size);
+  bool parsed;
+  Py_BEGIN_ALLOW_THREADS;
+  parsed = self->tagger->parseDocument(&lattice, threads);
+  Py_END_ALLOW_THREADS;
+  if (!parsed) {
+    Py_DECREF(bytes);
+    PyErr_SetString(PyExc_Exception, lattice.what());
+    return NULL;
+  }
+
+  size_t nodeCount = 0;
+  for (const MeCab::Node* node = lattice.bos_node()->next; node->next; node = node->next, ++nodeCount)
+    ;
+
+  PyObject* resultObject = PyTuple_New(nodeCount);
+  size_t index = 0;
+  // offsets in code points, counted from the UTF-8 bytes
+  const char* position = text;
+  Py_ssize_t offset = 0;
+  for (const MeCab::Node* node = lattice.bos_node()->next; node->next; node = node->next) {
+    advance_offset(&position, node->surface, &offset);
+    const Py_ssize_t begin = offset;
+    advance_offset(&position, node->surface + node->length, &offset);
+    PyObject* surface = PyUnicode_FromStringAndSize(node->surface, node->length);
+    PyObject* feature = PyUnicode_FromString(node->feature);
+    PyTuple_SetItem(resultObject, index++, Py_BuildValue("(NNnn)", surface, feature, begin, offset));
+  }
+  Py_DECREF(bytes);
+  return resultObject;
+}
+
 bool initializeTaggerClass(PyObject* to) {
   if (PyType_Ready(&taggerType) < 0) {
     return false;
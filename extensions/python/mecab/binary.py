@@ -0,0 +1,97 @@
+"""Decoder of the binary output format (``--output-format-type=binary``).
+
+See include/mecab/binary_format.h for the record layout.
+"""
+import struct
+from typing import BinaryIO, Dict, Iterator, List, NamedTuple, Tuple
+
+MAGIC = b"MCB1"
+
+_HEADER = struct.Struct("<4sIIIII")
+_TOKEN = struct.Struct("<IHHHHhBxqQ")
+_FEATURE = struct.Struct("<QI")
+
+
+class Token(NamedTuple):
+    surface: str
+    offset: int
+    length: int
+    posid: int
+    lc_attr: int
+    rc_attr: int
+    wcost: int
+    stat: int
+    cost: int
+    feature_id: int
+    feature: str
+
+
+class Sentence(NamedTuple):
+    sentence: str
+    tokens: List[Token]
+
+
+def decode_record(data: bytes, offset: int = 0, encoding: str = "utf-8") -> Tuple[Sentence, int]:
+    """Decode one record at ``offset`` and return it with the offset of the next record."""
+    if len(data) - offset < _HEADER.size:
+        raise ValueError("truncated record header")
+    magic, record_size, sentence_size, token_size, feature_size, _ = _HEADER.unpack_from(data, offset)
+    if magic != MAGIC:
+        raise ValueError("invalid magic: %r" % magic)
+    end = offset + 8 + record_size
+    if len(data) < end:
+        raise ValueError("truncated record")
+
+    p = offset + _HEADER.size
+    raw_tokens = list(_TOKEN.iter_unpack(data[p : p + token_size * _TOKEN.size]))
+    p += token_size * _TOKEN.size
+
+    features: Dict[int, str] = {}
+    for _ in range(feature_size):
+        feature_id, size = _FEATURE.unpack_from(data, p)
+        p += _FEATURE.size
+        features[feature_id] = data[p : p + size].decode(encoding)
+        p += size
+
+    sentence = data[p : p + sentence_size]
+    if p + sentence_size != end:
+        raise ValueError("inconsistent record size")
+
+    tokens = [
+        Token(
+            sentence[t_offset : t_offset + length].decode(encoding),
+            t_offset,
+            length,
+            posid,
+            lc_attr,
+            rc_attr,
+            wcost,
+            stat,
+            cost,
+            feature_id,
+            features[feature_id],
+        )
+        for t_offset, length, posid, lc_attr, rc_attr, wcost, stat, cost, feature_id in raw_tokens
+    ]
+    return Sentence(sentence.decode(encoding), tokens), end
+
+
+def decode(data: bytes, encoding: str = "utf-8") -> Iterator[Sentence]:
+    """Decode all records in ``data``."""
+    offset = 0
+    while offset < len(data):
+        sentence, offset = decode_record(data, offset, encoding)
+        yield sentence
+
+
+def read(stream: BinaryIO, encoding: str = "utf-8") -> Iterator[Sentence]:
+    """Decode records from a binary stream, e.g. the stdout of ``mecab -Obinary``."""
+    while True:
+        header = stream.read(8)
+        if not header:
+            return
+        if len(header) < 8:
+            raise ValueError("truncated record header")
+        (record_size,) = struct.unpack_from("<I", header, 4)
+        body = stream.read(record_size)
+        yield decode_record(header + body, 0, encoding)[0]
@@ -0,0 +1,37 @@
+import os
+
+from mecab.binary import read
+from mecab.cli import run_mecab_dict_index, run_mecab_main
+
+MECAB_UNK_NODE = 1
+
+
+def test_binary_output_matches_text_output(tmpdir):
+    DIC_DIR = "../../test-data/katakana"
+    PROCESSED_DIC_DIR = tmpdir.mkdir("katakana")
+
+    TEST_CASE = os.path.join(DIC_DIR, "test")
+    TEXT_PATH = PROCESSED_DIC_DIR.join("output.txt")
+    BINARY_PATH = PROCESSED_DIC_DIR.join("output.bin")
+
+    _copy_file(os.path.join(DIC_DIR, "dicrc"), PROCESSED_DIC_DIR.join("dicrc"))
+    run_mecab_dict_index(["index", "-d", DIC_DIR, "-o", str(PROCESSED_DIC_DIR)])
+    run_mecab_main(["mecab", "-r", "/dev/null", "-d", str(PROCESSED_DIC_DIR), "-o", str(TEXT_PATH), TEST_CASE])
+    run_mecab_main(
+        ["mecab", "-r", "/dev/null", "-d", str(PROCESSED_DIC_DIR), "-O", "binary", "-o", str(BINARY_PATH), TEST_CASE]
+    )
+
+    # the yomi format of the dictionary, i.e. the feature of known words and the surface of unknown words
+    decoded = []
+    with open(str(BINARY_PATH), "rb") as f:
+        for sentence in read(f):
+            for token in sentence.tokens:
+                decoded.append(token.surface if token.stat == MECAB_UNK_NODE else token.feature)
+            decoded.append("\n")
+
+    assert "".join(decoded) == TEXT_PATH.read()
+
+
+def _copy_file(from_, to):
+    with open(from_) as f:
+        to.write(f.read())
@@ -28,6 +28,48 @@ def test_tagger_with_test_data_katakana(tmpdir):
     assert result == true_data
 
 
+def test_tagger_parse_surface_keeps_segmentation(tmpdir):
+    DIC_DIR = "../../test-data/katakana"
+    PROCESSED_DIC_DIR = tmpdir.mkdir("katakana")
+
+    with open(os.path.join(DIC_DIR, "test")) as f:
+        test_data = [line.strip() for line in f]
+
+    _copy_file(os.path.join(DIC_DIR, "dicrc"), PROCESSED_DIC_DIR.join("dicrc"))
+    run_mecab_dict_index(["index", "-d", DIC_DIR, "-o", str(PROCESSED_DIC_DIR)])
+    tagger = Tagger(str(PROCESSED_DIC_DIR))
+
+    for line in test_data:
+        result = tagger.parse_surface(line)
+        assert [surface for surface, _, _, _ in result] == [surface for surface, _ in tagger.parse(line)]
+        for surface, _, begin, end in result:
+            assert line[begin:end] == surface
+
+
+def test_tagger_parse_document_keeps_offsets(tmpdir):
+    DIC_DIR = "../../test-data/katakana"
+    PROCESSED_DIC_DIR = tmpdir.mkdir("katakana")
+
+    with open(os.path.join(DIC_DIR, "test")) as f:
+        test_data = [line.strip() for line in f if line.strip()]
+
+    _copy_file(os.path.join(DIC_DIR, "dicrc"), PROCESSED_DIC_DIR.join("dicrc"))
+    run_mecab_dict_index(["index", "-d", DIC_DIR, "-o", str(PROCESSED_DIC_DIR)])
+    tagger = Tagger(str(PROCESSED_DIC_DIR))
+
+    document = "".join(line + "。" for line in test_data)
+    result = tagger.parse_document(document)
+
+    assert "".join(surface for surface, _, _, _ in result) == document
+    for surface, _, begin, end in result:
+        assert document[begin:end] == surface
+    assert tagger.parse_document(document, 4) == result
+
+    # every sentence is analyzed on its own
+    expected = [token for line in test_data for token in tagger.parse(line + "。")]
+    assert [(surface, feature) for surface, feature, _, _ in result] == expected
+
+
 def _copy_file(from_, to):
     with open(from_) as f:
         to.write(f.read())
@@ -5,6 +5,7 @@
 #include "mecab/darts.h"
 #include "mecab/nbest_generator.h"
 #include "mecab/utils/scoped_ptr.h"
+#include "mecab/utils/string_utils.h"
 
 namespace MeCab {
 
@@ -36,7 +37,8 @@ class Allocator {
 
   char* strdup(const char* str, size_t size) {
     char* n = alloc(size + 1);
-    std::strncpy(n, str, size + 1);
+    std::memcpy(n, str, size);
+    n[size] = '\0';
     return n;
   }
 
@@ -52,10 +54,41 @@ class Allocator {
     return &partial_buffer_[0];
   }
 
+  char* scratch_buffer(size_t size) {
+    if (scratch_buffer_.size() < size) {
+      scratch_buffer_.resize(size);
+    }
+    return &scratch_buffer_[0];
+  }
+
+  /**
+   * Split |feature| into CSV columns. The result is kept until free() and is reused while
+   * the writer asks for the same feature, i.e. for every %f[...] of one node.
+   * @param feature feature string of a node
+   * @param columns receives the columns
+   * @return the number of columns
+   */
+  size_t feature_columns(const char* feature, char*** columns) {
+    if (feature != feature_) {
+      const size_t size = std::strlen(feature) + 1;
+      if (feature_buffer_.size() < size) {
+        feature_buffer_.resize(size);
+      }
+      std::memcpy(&feature_buffer_[0], feature, size);
+      feature_columns_size_ = tokenizeCSV(&feature_buffer_[0], feature_columns_, kFeatureColumnsSize);
+      feature_ = feature;
+    }
+    *columns = feature_columns_;
+    return feature_columns_size_;
+  }
+
+  size_t node_size() const { return id_; }
+
   size_t results_size() const { return kResultsSize; }
 
   void free() {
     id_ = 0;
+    feature_ = 0;
     node_freelist_->free();
     if (path_freelist_.get()) {
       path_freelist_->free();
@@ -71,18 +104,26 @@ class Allocator {
         path_freelist_(0),
         char_freelist_(0),
         nbest_generator_(0),
-        results_(new Darts::DoubleArray::result_pair_type[kResultsSize]) {}
+        results_(new Darts::DoubleArray::result_pair_type[kResultsSize]),
+        feature_(0),
+        feature_columns_size_(0) {}
   virtual ~Allocator() {}
 
  private:
   static const size_t kResultsSize = 512;
+  static const size_t kFeatureColumnsSize = 64;
   size_t id_;
   scoped_ptr<FreeList<N>> node_freelist_;
   scoped_ptr<FreeList<P>> path_freelist_;
   scoped_ptr<ChunkFreeList<char>> char_freelist_;
   scoped_ptr<NBestGenerator> nbest_generator_;
   std::vector<char> partial_buffer_;
+  std::vector<char> scratch_buffer_;
   scoped_array<Darts::DoubleArray::result_pair_type> results_;
+  const char* feature_;
+  std::vector<char> feature_buffer_;
+  char* feature_columns_[kFeatureColumnsSize];
+  size_t feature_columns_size_;
 };
 
 }  // namespace MeCab
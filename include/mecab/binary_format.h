@@ -0,0 +1,248 @@
+#ifndef _MECAB_BINARY_FORMAT_H_
+#define _MECAB_BINARY_FORMAT_H_
+
+#include <stdint.h>
+
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "mecab/common.h"
+#include "mecab/data_structure.h"
+#include "mecab/lattice.h"
+#include "mecab/utils/fingerprint.h"
+#include "mecab/utils/string_buffer.h"
+
+/**
+ * Binary output format, i.e. --output-format-type=binary.
+ * Every sentence is written as one self-contained record so that the stream can be split
+ * at any record boundary. All integers are little-endian.
+ *
+ * record header (24 bytes)
+ *   char[4]  magic "MCB1"
+ *   uint32   size of the record following this field
+ *   uint32   sentence size in bytes
+ *   uint32   number of tokens (BOS and EOS are not included)
+ *   uint32   number of features
+ *   uint32   reserved (0)
+ * tokens (32 bytes each)
+ *   uint32   offset of the surface in the sentence
+ *   uint16   length of the surface
+ *   uint16   posid
+ *   uint16   lcAttr
+ *   uint16   rcAttr
+ *   int16    wcost
+ *   uint8    stat
+ *   uint8    reserved (0)
+ *   int64    cumulative cost of the best path
+ *   uint64   feature id
+ * features, each feature used in the sentence once
+ *   uint64   feature id
+ *   uint32   feature size in bytes
+ *   char[]   feature
+ * sentence
+ *   char[]   sentence
+ *
+ * The feature id is the fingerprint of the feature string. It is stable across sentences,
+ * streams and processes, so consumers can cache whatever they derive from a feature by its id.
+ */
+#define MECAB_BINARY_MAGIC "MCB1"
+#define MECAB_BINARY_HEADER_SIZE 24
+#define MECAB_BINARY_TOKEN_SIZE 32
+
+namespace MeCab {
+
+struct BinaryToken {
+  uint32_t offset;
+  uint16_t length;
+  uint16_t posid;
+  uint16_t lcAttr;
+  uint16_t rcAttr;
+  int16_t wcost;
+  uint8_t stat;
+  int64_t cost;
+  uint64_t feature_id;
+};
+
+struct BinaryFeature {
+  uint64_t id;
+  const char* feature;
+  size_t size;
+};
+
+/**
+ * Decoded record. The pointers refer to the decoded buffer.
+ */
+struct BinaryRecord {
+  const char* sentence;
+  size_t size;
+  std::vector<BinaryToken> tokens;
+  std::vector<BinaryFeature> features;
+
+  std::string surface(const BinaryToken& token) const { return std::string(sentence + token.offset, token.length); }
+
+  /**
+   * Return the feature of |token|, or NULL if the record has no such feature.
+   */
+  const BinaryFeature* feature(const BinaryToken& token) const {
+    for (size_t i = 0; i < features.size(); ++i) {
+      if (features[i].id == token.feature_id) {
+        return &features[i];
+      }
+    }
+    return 0;
+  }
+};
+
+namespace {
+template <typename T>
+inline void write_le(T value, StringBuffer* os) {
+  char buf[sizeof(T)];
+  uint64_t v = static_cast<uint64_t>(value);
+  for (size_t i = 0; i < sizeof(T); ++i) {
+    buf[i] = static_cast<char>(v & 0xff);
+    v >>= 8;
+  }
+  os->write(buf, sizeof(T));
+}
+
+template <typename T>
+inline T read_le(const char* p) {
+  uint64_t v = 0;
+  for (size_t i = sizeof(T); i > 0; --i) {
+    v = (v << 8) | static_cast<unsigned char>(p[i - 1]);
+  }
+  return static_cast<T>(v);
+}
+}  // namespace
+
+/**
+ * Write the best path of |lattice| as one binary record.
+ * @return boolean
+ */
+inline bool writeBinaryRecord(Lattice* lattice, StringBuffer* os) {
+  // features are looked up by pointer; nodes of the same dictionary entry share it.
+  std::unordered_map<const char*, size_t> feature_index;
+  std::vector<const char*> features;
+  std::vector<uint64_t> feature_ids;
+  std::vector<size_t> token_features;
+  size_t feature_bytes = 0;
+  for (const Node* node = lattice->bos_node()->next; node->next; node = node->next) {
+    std::pair<std::unordered_map<const char*, size_t>::iterator, bool> it =
+        feature_index.insert(std::make_pair(node->feature, features.size()));
+    if (it.second) {
+      const size_t size = std::strlen(node->feature);
+      features.push_back(node->feature);
+      feature_ids.push_back(fingerprint(node->feature, size));
+      feature_bytes += 8 + 4 + size;
+    }
+    token_features.push_back(it.first->second);
+  }
+  const size_t token_size = token_features.size();
+
+  const size_t record_size = MECAB_BINARY_HEADER_SIZE - 8 + token_size * MECAB_BINARY_TOKEN_SIZE + feature_bytes +
+                             lattice->size();
+  os->write(MECAB_BINARY_MAGIC, 4);
+  write_le<uint32_t>(record_size, os);
+  write_le<uint32_t>(lattice->size(), os);
+  write_le<uint32_t>(token_size, os);
+  write_le<uint32_t>(features.size(), os);
+  write_le<uint32_t>(0, os);
+
+  size_t i = 0;
+  for (const Node* node = lattice->bos_node()->next; node->next; node = node->next, ++i) {
+    write_le<uint32_t>(node->surface - lattice->sentence(), os);
+    write_le<uint16_t>(node->length, os);
+    write_le<uint16_t>(node->posid, os);
+    write_le<uint16_t>(node->lcAttr, os);
+    write_le<uint16_t>(node->rcAttr, os);
+    write_le<int16_t>(node->wcost, os);
+    write_le<uint8_t>(node->stat, os);
+    write_le<uint8_t>(0, os);
+    write_le<int64_t>(node->cost, os);
+    write_le<uint64_t>(feature_ids[token_features[i]], os);
+  }
+
+  for (i = 0; i < features.size(); ++i) {
+    const size_t size = std::strlen(features[i]);
+    write_le<uint64_t>(feature_ids[i], os);
+    write_le<uint32_t>(size, os);
+    os->write(features[i], size);
+  }
+
+  os->write(lattice->sentence(), lattice->size());
+
+  return true;
+}
+
+/**
+ * Read one binary record from |data|.
+ * Return the number of bytes consumed, or 0 if |data| does not start with a complete record.
+ * @param data buffer
+ * @param size buffer size
+ * @param record decoded record
+ * @return the record size
+ */
+inline size_t readBinaryRecord(const char* data, size_t size, BinaryRecord* record) {
+  if (size < MECAB_BINARY_HEADER_SIZE || std::memcmp(data, MECAB_BINARY_MAGIC, 4) != 0) {
+    return 0;
+  }
+  const size_t record_size = 8 + read_le<uint32_t>(data + 4);
+  if (size < record_size) {
+    return 0;
+  }
+  const char* end = data + record_size;
+  record->size = read_le<uint32_t>(data + 8);
+  const size_t token_size = read_le<uint32_t>(data + 12);
+  const size_t feature_size = read_le<uint32_t>(data + 16);
+
+  const char* p = data + MECAB_BINARY_HEADER_SIZE;
+  if (static_cast<size_t>(end - p) < token_size * MECAB_BINARY_TOKEN_SIZE) {
+    return 0;
+  }
+  record->tokens.resize(token_size);
+  for (size_t i = 0; i < token_size; ++i, p += MECAB_BINARY_TOKEN_SIZE) {
+    BinaryToken* token = &record->tokens[i];
+    token->offset = read_le<uint32_t>(p);
+    token->length = read_le<uint16_t>(p + 4);
+    token->posid = read_le<uint16_t>(p + 6);
+    token->lcAttr = read_le<uint16_t>(p + 8);
+    token->rcAttr = read_le<uint16_t>(p + 10);
+    token->wcost = read_le<int16_t>(p + 12);
+    token->stat = read_le<uint8_t>(p + 14);
+    token->cost = read_le<int64_t>(p + 16);
+    token->feature_id = read_le<uint64_t>(p + 24);
+  }
+
+  record->features.resize(feature_size);
+  for (size_t i = 0; i < feature_size; ++i) {
+    if (end - p < 12) {
+      return 0;
+    }
+    BinaryFeature* feature = &record->features[i];
+    feature->id = read_le<uint64_t>(p);
+    feature->size = read_le<uint32_t>(p + 8);
+    feature->feature = p + 12;
+    if (static_cast<size_t>(end - p - 12) < feature->size) {
+      return 0;
+    }
+    p += 12 + feature->size;
+  }
+
+  if (static_cast<size_t>(end - p) != record->size) {
+    return 0;
+  }
+  record->sentence = p;
+  for (size_t i = 0; i < token_size; ++i) {
+    if (record->tokens[i].offset + record->tokens[i].length > record->size) {
+      return 0;
+    }
+  }
+
+  return record_size;
+}
+
+}  // namespace MeCab
+
+#endif  // _MECAB_BINARY_FORMAT_H_
@@ -75,17 +75,26 @@ CharInfo encode(const std::vector<std::string>& c, std::map<std::string, CharInf
 
 class CharProperty {
  public:
-  void open(const std::string filename) {
-    if (!cmmap_->open(filename.c_str(), "r"))
+  void open(const std::string filename, int load = 0) {
+    if (!cmmap_->open(filename.c_str(), "r", load))
       throw std::runtime_error("Cannot open " + filename);
 
-    const char* ptr = cmmap_->begin();
+    openFromArray(filename, cmmap_->begin(), cmmap_->end());
+  }
+
+  // Open char.bin in [begin, end), e.g. in a dictionary package, which is kept while the table is used.
+  void openFromArray(const std::string& filename, const char* begin, const char* end) {
+    const size_t size = end - begin;
+    if (size < sizeof(unsigned int))
+      throw std::runtime_error("invalid file size: " + filename);
+
+    const char* ptr = begin;
     unsigned int csize;
     read_static<unsigned int>(&ptr, csize);
 
     size_t fsize = sizeof(unsigned int) + (32 * csize) + sizeof(unsigned int) * 0xffff;
 
-    if (fsize != cmmap_->size())
+    if (fsize != size)
       throw std::runtime_error("invalid file size: " + filename);
 
     clist_.clear();
@@ -0,0 +1,263 @@
+#ifndef _MECAB_CHECKPOINT_H_
+#define _MECAB_CHECKPOINT_H_
+
+#include <stdint.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "mecab/common.h"
+#include "mecab/lbfgs.h"
+#include "mecab/mmap.h"
+#include "mecab/utils/thread.h"
+
+/**
+ * Checkpoint of mecab-cost-train with L-BFGS, written with --checkpoint and read with --resume.
+ * Every field is 8 bytes in the byte order of the host, like the compiled dictionaries, so the arrays of a mapped
+ * checkpoint are aligned and can be used in place.
+ *
+ * header (96 bytes)
+ *   char[8]  magic "MCCKPT01"
+ *   uint64   number of features
+ *   uint64   size of the feature keys in bytes, a multiple of 8
+ *   uint64   size of the optimizer state in bytes
+ *   uint64   next iteration
+ *   uint64   number of the last iterations which have converged
+ *   double   objective of the last iteration
+ *   double   training time in seconds
+ *   double   cost of the L2 penalty, 0 without it
+ *   double   cost of the L1 penalty, 0 without it
+ *   uint64   reserved (0)
+ *   uint64   reserved (0)
+ * feature keys
+ *   char[]   null terminated keys in the order of their ids, padded with zeros, or none for hashed features
+ * alpha
+ *   double[] a weight for each feature
+ * optimizer state
+ *   the fields visited by LBFGS::serialize(), an int as int64, a double as it is, and an array as its uint64 size
+ *   and its doubles
+ */
+#define MECAB_CHECKPOINT_MAGIC "MCCKPT01"
+
+namespace MeCab {
+
+// The state of mecab-cost-train after an iteration, besides the weights and the optimizer.
+struct CheckpointState {
+  uint64_t iteration;  // the iteration to run next
+  uint64_t converge;   // the number of the last iterations whose objective has converged
+  double objective;    // the objective of the last iteration
+  double seconds;      // the training time until the checkpoint
+  double l2_cost;
+  double l1_cost;
+};
+
+struct CheckpointHeader {
+  char magic[8];
+  uint64_t features;
+  uint64_t keys_size;
+  uint64_t state_size;
+  CheckpointState state;
+  uint64_t reserved[2];
+};
+
+// Appends the values visited by LBFGS::serialize() to |out|.
+class CheckpointWriter {
+ public:
+  explicit CheckpointWriter(std::string* out) : out_(out) {}
+
+  void value(int* v) {
+    const int64_t i = *v;
+    append(&i, sizeof(i));
+  }
+  void value(double* v) { append(v, sizeof(*v)); }
+  void array(std::vector<double>* v) {
+    const uint64_t size = v->size();
+    append(&size, sizeof(size));
+    if (size > 0) {
+      append(&(*v)[0], size * sizeof(double));
+    }
+  }
+
+ private:
+  void append(const void* data, size_t size) { out_->append(static_cast<const char*>(data), size); }
+
+  std::string* out_;
+};
+
+// Restores the values visited by LBFGS::serialize() from [begin, end), which CheckpointWriter has written.
+class CheckpointReader {
+ public:
+  CheckpointReader(const char* begin, const char* end) : ptr_(begin), end_(end), ok_(true) {}
+
+  void value(int* v) {
+    int64_t i = 0;
+    read(&i, sizeof(i));
+    *v = static_cast<int>(i);
+  }
+  void value(double* v) { read(v, sizeof(*v)); }
+  void array(std::vector<double>* v) {
+    uint64_t size = 0;
+    read(&size, sizeof(size));
+    if (!ok_ || size > static_cast<size_t>(end_ - ptr_) / sizeof(double)) {
+      ok_ = false;
+      v->clear();
+      return;
+    }
+    v->resize(size);
+    if (size > 0) {
+      read(&(*v)[0], size * sizeof(double));
+    }
+  }
+
+  // true if every value was in the buffer and nothing is left
+  bool done() const { return ok_ && ptr_ == end_; }
+
+ private:
+  void read(void* data, size_t size) {
+    if (!ok_ || static_cast<size_t>(end_ - ptr_) < size) {
+      ok_ = false;
+      std::memset(data, 0, size);
+      return;
+    }
+    std::memcpy(data, ptr_, size);
+    ptr_ += size;
+  }
+
+  const char* ptr_;
+  const char* end_;
+  bool ok_;
+};
+
+// Writes a snapshot of a checkpoint to a temporary file and renames it, so that the checkpoint is either the
+// previous or the new one when the process is killed.
+class checkpoint_writer_thread : public thread {
+ public:
+  std::string filename;
+  const std::string* keys;
+  std::string header;
+  std::string body;
+  bool ok;
+
+  void run();
+};
+
+inline void checkpoint_writer_thread::run() {
+  const std::string tmp = filename + ".tmp";
+  std::ofstream ofs(tmp.c_str(), std::ios::binary);
+  ofs.write(header.data(), header.size());
+  ofs.write(keys->data(), keys->size());
+  ofs.write(body.data(), body.size());
+  ofs.close();
+  ok = ofs.good() && std::rename(tmp.c_str(), filename.c_str()) == 0;
+}
+
+/**
+ * Checkpoints of the training of |features| features, whose keys are |keys| in the order of their ids, or no keys
+ * for hashed features.
+ * write() copies the weights and the optimizer and writes them in the background while the training goes on, and
+ * read() restores them after the corpus is read again, checking that it gives the same features.
+ */
+class Checkpoint {
+ public:
+  Checkpoint(size_t features, const std::vector<const char*>& keys) : features_(features), writing_(false) {
+    CHECK_DIE(keys.empty() || keys.size() == features) << "keys are not of the features";
+    for (size_t i = 0; i < keys.size(); ++i) {
+      keys_.append(keys[i], std::strlen(keys[i]) + 1);
+    }
+    keys_.resize((keys_.size() + 7) / 8 * 8, '\0');
+    writer_.keys = &keys_;
+  }
+  virtual ~Checkpoint() { wait(); }
+
+  /**
+   * Write |state|, |alpha| and |lbfgs| to |filename| in the background. A write waits for the previous one.
+   */
+  void write(const std::string& filename,
+             const CheckpointState& state,
+             const std::vector<double>& alpha,
+             LBFGS* lbfgs) {
+    CHECK_DIE(wait()) << "cannot write checkpoint";
+    CHECK_DIE(alpha.size() == features_) << "alpha is not of the features of the checkpoint";
+    writer_.filename = filename;
+    writer_.body.clear();
+    if (features_ > 0) {
+      writer_.body.append(reinterpret_cast<const char*>(&alpha[0]), features_ * sizeof(double));
+    }
+    CheckpointWriter ar(&writer_.body);
+    lbfgs->serialize(&ar);
+
+    CheckpointHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, MECAB_CHECKPOINT_MAGIC, sizeof(header.magic));
+    header.features = features_;
+    header.keys_size = keys_.size();
+    header.state_size = writer_.body.size() - features_ * sizeof(double);
+    header.state = state;
+    writer_.header.assign(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    writer_.start();
+    writing_ = true;
+  }
+
+  /**
+   * Wait until the last write finishes, and return false if it has failed.
+   */
+  bool wait() {
+    if (!writing_) {
+      return true;
+    }
+    writer_.join();
+    writing_ = false;
+    CHECK_FALSE(writer_.ok) << "cannot write checkpoint: " << writer_.filename;
+    return true;
+  }
+
+  /**
+   * Restore |state|, |alpha| and |lbfgs| from the checkpoint |filename|.
+   * Return false if it is broken or it is not of the same features.
+   */
+  bool read(const std::string& filename, CheckpointState* state, std::vector<double>* alpha, LBFGS* lbfgs) const {
+    Mmap<char> mmap;
+    CHECK_FALSE(mmap.open(filename.c_str())) << "no such file or directory: " << filename;
+    const char* ptr = mmap.begin();
+    const size_t size = mmap.file_size();
+
+    CheckpointHeader header;
+    CHECK_FALSE(size >= sizeof(header)) << "broken checkpoint: " << filename;
+    std::memcpy(&header, ptr, sizeof(header));
+    CHECK_FALSE(std::memcmp(header.magic, MECAB_CHECKPOINT_MAGIC, sizeof(header.magic)) == 0)
+        << "not a checkpoint: " << filename;
+    CHECK_FALSE(size == sizeof(header) + header.keys_size + header.features * sizeof(double) + header.state_size)
+        << "broken checkpoint: " << filename;
+    ptr += sizeof(header);
+    CHECK_FALSE(header.features == features_ && header.keys_size == keys_.size() &&
+                std::memcmp(ptr, keys_.data(), keys_.size()) == 0)
+        << "the features of the checkpoint are not the features of the corpus: " << filename;
+    ptr += header.keys_size;
+
+    alpha->resize(features_);
+    if (features_ > 0) {
+      std::memcpy(&(*alpha)[0], ptr, features_ * sizeof(double));
+    }
+    ptr += features_ * sizeof(double);
+
+    CheckpointReader ar(ptr, ptr + header.state_size);
+    lbfgs->serialize(&ar);
+    CHECK_FALSE(ar.done()) << "broken checkpoint: " << filename;
+
+    *state = header.state;
+    return true;
+  }
+
+ private:
+  const size_t features_;
+  std::string keys_;
+  checkpoint_writer_thread writer_;
+  bool writing_;
+};
+}  // namespace MeCab
+
+#endif  // _MECAB_CHECKPOINT_H_
@@ -0,0 +1,106 @@
+#ifndef __MECAB_BUILD_MANIFEST_H__
+#define __MECAB_BUILD_MANIFEST_H__
+
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "mecab/common.h"
+#include "mecab/utils/fingerprint.h"
+#include "mecab/utils/param.h"
+#include "mecab/utils/string_utils.h"
+
+// used in mecab/cli/dictionary_compiler.h
+
+#define BUILD_MANIFEST_FILE "dict-index.manifest"
+#define BUILD_CACHE_DIR "dict-index.cache"
+
+namespace MeCab {
+
+// Hash of the inputs of a build step: the contents of files, in order, and the options.
+// Paths are not hashed, and BuildManifest keeps the outputs by file name, so moving the dictionary
+// directories does not invalidate the outputs.
+class BuildHash {
+ public:
+  void addFile(const std::string& filename) {
+    uint64_t fp = 0;
+    if (fingerprint_file(filename.c_str(), &fp)) {
+      buffer_ += to_hex(fp);
+    } else {
+      buffer_ += "-";
+    }
+    buffer_ += '\n';
+  }
+
+  // The options |keys| of |param|, which have to be the options that the build step reads.
+  void addParam(const Param& param, const std::vector<std::string>& keys) {
+    for (size_t i = 0; i < keys.size(); ++i) {
+      add(keys[i] + ": " + param.get<std::string>(keys[i]));
+    }
+  }
+
+  void add(const std::string& str) {
+    buffer_ += str;
+    buffer_ += '\n';
+  }
+
+  std::string str() const { return to_hex(fingerprint(buffer_)); }
+
+ private:
+  std::string buffer_;
+};
+
+// Hashes of the inputs and of the output of each file built by mecab-dict-index, kept in
+// BUILD_MANIFEST_FILE of the output directory by the file name of the output. An output is up to date if
+// its inputs have the recorded hash and the output file has not been modified since it was built.
+class BuildManifest {
+ public:
+  explicit BuildManifest(const std::string& filename) : filename_(filename) {
+    std::ifstream ifs(filename_.c_str());
+    char* col[3];
+    for (std::string line; std::getline(ifs, line);) {
+      if (tokenize(&line[0], "\t", col, 3) == 3) {
+        entries_[col[0]] = std::make_pair(std::string(col[1]), std::string(col[2]));
+      }
+    }
+  }
+
+  bool isUpToDate(const std::string& output, const std::string& input_hash) const {
+    std::map<std::string, std::pair<std::string, std::string>>::const_iterator it = entries_.find(key(output));
+    if (it == entries_.end() || it->second.first != input_hash) {
+      return false;
+    }
+    uint64_t fp = 0;
+    return fingerprint_file(output.c_str(), &fp) && it->second.second == to_hex(fp);
+  }
+
+  // Record a built output. The manifest is saved at once, so an interrupted build keeps the finished outputs.
+  void update(const std::string& output, const std::string& input_hash) {
+    uint64_t fp = 0;
+    CHECK_DIE(fingerprint_file(output.c_str(), &fp)) << "no such file or directory: " << output;
+    entries_[key(output)] = std::make_pair(input_hash, to_hex(fp));
+
+    const std::string tmp = filename_ + ".tmp";
+    {
+      std::ofstream ofs(tmp.c_str());
+      CHECK_DIE(ofs) << "permission denied: " << tmp;
+      for (std::map<std::string, std::pair<std::string, std::string>>::const_iterator it = entries_.begin();
+           it != entries_.end(); ++it) {
+        ofs << it->first << '\t' << it->second.first << '\t' << it->second.second << '\n';
+      }
+    }
+    CHECK_DIE(std::rename(tmp.c_str(), filename_.c_str()) == 0) << "cannot write: " << filename_;
+  }
+
+ private:
+  static std::string key(const std::string& output) { return output.substr(output.rfind('/') + 1); }
+
+  std::string filename_;
+  std::map<std::string, std::pair<std::string, std::string>> entries_;
+};
+
+}  // namespace MeCab
+
+#endif  // __MECAB_BUILD_MANIFEST_H__
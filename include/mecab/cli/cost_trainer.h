@@ -1,8 +1,21 @@
 #ifndef __MECAB_COST_TRAINER_H__
 #define __MECAB_COST_TRAINER_H__
 
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <utility>
+
+#include "mecab/checkpoint.h"
 #include "mecab/lbfgs.h"
 #include "mecab/learner_tagger.h"
+#include "mecab/online_optimizer.h"
 #include "mecab/utils/thread.h"
 
 // used in mecab/_C/cli/cost_trainer.cc
@@ -11,31 +24,706 @@ namespace MeCab {
 
 #define DCONF(file) create_filename(dicdir, std::string(file)).c_str()
 
+class LearnerThreadPool;
+
+// A worker of LearnerThreadPool, which keeps the sums of the sentences of its chunks in an iteration.
 class learner_thread : public thread {
  public:
-  unsigned short start_i;
-  unsigned short thread_num;
-  size_t size;
+  LearnerThreadPool* pool;
+  size_t index;
+  std::vector<size_t> chunks;  // the chunks of the sentences assigned to the thread, from the largest
   size_t micro_p;
   size_t micro_r;
   size_t micro_c;
   size_t err;
   double f;
-  EncoderLearnerTagger** x;
+  double busy;     // seconds spent on sentences in the last iteration
+  double partial;  // result of the update in LearnerThreadPool::reduce()
+  // allocated by the thread itself, so that its pages are local to the thread. it is cleared by reduce().
   std::vector<double> expected;
-  void run() {
+  std::vector<int> ids;         // features in |expected| of a mini-batch
+  std::vector<size_t> batches;  // the last mini-batch which a feature is added to |ids| in
+
+  void clear() {
     micro_p = micro_r = micro_c = err = 0;
     f = 0.0;
-    std::fill(expected.begin(), expected.end(), 0.0);
-    for (size_t i = start_i; i < size; i += thread_num) {
-      f += x[i]->gradient(&expected[0]);
-      err += x[i]->eval(&micro_c, &micro_p, &micro_r);
+    busy = 0.0;
+  }
+
+  void run();
+};
+
+/**
+ * Threads computing the gradient of the sentences in every iteration of L-BFGS.
+ * The threads are started once and wait for the next iteration between them. The sentences are
+ * sorted by the size of their lattices and cut into chunks of similar cost. The chunks are assigned to the
+ * threads once, the largest first to the thread with the least cost so far, so that all threads finish at about
+ * the same time and every thread adds up the same sentences in the same order in every iteration.
+ * The calling thread works as the first thread.
+ *
+ * The expectations of the threads are added up by reduce() in parallel too, each thread adding a fixed range of
+ * the features in the order of the threads. So the gradient does not depend on the scheduling of the threads, and
+ * training is deterministic for a number of threads, although the rounding differs between numbers of threads.
+ *
+ * computeBatch() computes the gradient of a mini-batch for the stochastic optimizers in the same way, each thread
+ * taking every size()-th sentence of the batch, and adds up the features in the mini-batch only.
+ */
+class LearnerThreadPool {
+ public:
+  LearnerThreadPool(const std::vector<EncoderLearnerTagger*>& x, size_t thread_num, size_t psize)
+      : x_(x),
+        threads_(thread_num),
+        psize_(psize),
+        task_(0),
+        expected_(0),
+        update_(0),
+        batch_(0),
+        batch_size_(0),
+        batch_num_(0),
+        batch_ids_(0),
+        generation_(0),
+        running_(0),
+        stop_(false) {
+    std::vector<std::pair<size_t, size_t>> sizes(x.size());
+    size_t total = 0;
+    for (size_t i = 0; i < x.size(); ++i) {
+      sizes[i] = std::make_pair(x[i]->lattice_size(), i);
+      total += sizes[i].first;
+    }
+    std::stable_sort(sizes.begin(), sizes.end(), std::greater<std::pair<size_t, size_t>>());
+
+    // about 16 chunks per thread, and a sentence larger than a chunk is a chunk by itself
+    const size_t chunk_size = std::max<size_t>(1, total / (thread_num * 16));
+    order_.resize(x.size());
+    size_t current = chunk_size;
+    for (size_t i = 0; i < sizes.size(); ++i) {
+      order_[i] = sizes[i].second;
+      if (current >= chunk_size) {
+        chunks_.push_back(i);
+        current = 0;
+      }
+      current += sizes[i].first;
+    }
+    chunks_.push_back(order_.size());
+
+    std::vector<std::pair<size_t, size_t>> costs(chunks_.size() - 1);
+    for (size_t chunk = 0; chunk + 1 < chunks_.size(); ++chunk) {
+      costs[chunk] = std::make_pair(0, chunk);
+      for (size_t i = chunks_[chunk]; i < chunks_[chunk + 1]; ++i) {
+        costs[chunk].first += sizes[i].first;
+      }
+    }
+    std::stable_sort(costs.begin(), costs.end(), std::greater<std::pair<size_t, size_t>>());
+    std::vector<size_t> loads(threads_.size(), 0);
+    for (size_t i = 0; i < costs.size(); ++i) {
+      const size_t t = std::min_element(loads.begin(), loads.end()) - loads.begin();
+      loads[t] += costs[i].first;
+      threads_[t].chunks.push_back(costs[i].second);
+    }
+
+    for (size_t i = 0; i < threads_.size(); ++i) {
+      threads_[i].pool = this;
+      threads_[i].index = i;
+    }
+    for (size_t i = 1; i < threads_.size(); ++i) {
+      threads_[i].start();
+    }
+  }
+
+  ~LearnerThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+      start_.notify_all();
+    }
+    for (size_t i = 1; i < threads_.size(); ++i) {
+      threads_[i].join();
+    }
+  }
+
+  // Compute the gradient of all sentences with all threads, and return when all of them finish.
+  void compute() {
+    run(&LearnerThreadPool::gradient);
+  }
+
+  /**
+   * Set |expected| to the sum of the expectations of the threads and clear them for the next iteration.
+   * Then |update|(begin, end) is called for the features in [begin, end) by the thread which added them,
+   * while they are in its cache.
+   * @return the sum of the results of |update|
+   */
+  double reduce(double* expected, const std::function<double(size_t, size_t)>& update) {
+    expected_ = expected;
+    update_ = &update;
+    run(&LearnerThreadPool::add);
+    double sum = 0.0;
+    for (size_t i = 0; i < threads_.size(); ++i) {
+      sum += threads_[i].partial;
+    }
+    return sum;
+  }
+
+  /**
+   * Set |gradient| to the mean gradient of the sentences |batch| over its |size| sentences, and |ids| to the
+   * features in it. |gradient| has to be 0 for the other features, e.g. by clearing |ids| of the last batch.
+   * The losses and the evaluation of the sentences are kept in the workers.
+   */
+  void computeBatch(const size_t* batch, size_t size, double* gradient, std::vector<int>* ids) {
+    batch_ = batch;
+    batch_size_ = size;
+    ++batch_num_;
+    run(&LearnerThreadPool::batchGradient);
+
+    // union of the features of the threads
+    merged_.resize(psize_, 0);
+    ids->clear();
+    for (size_t i = 0; i < threads_.size(); ++i) {
+      for (size_t j = 0; j < threads_[i].ids.size(); ++j) {
+        const int id = threads_[i].ids[j];
+        if (merged_[id] != batch_num_) {
+          merged_[id] = batch_num_;
+          ids->push_back(id);
+        }
+      }
+    }
+
+    expected_ = gradient;
+    batch_ids_ = ids;
+    run(&LearnerThreadPool::addBatch);
+  }
+
+  const learner_thread& worker(size_t i) const { return threads_[i]; }
+  size_t size() const { return threads_.size(); }
+  size_t chunk_num() const { return chunks_.size() - 1; }
+
+ private:
+  friend class learner_thread;
+
+  void wait(learner_thread* t) {
+    for (size_t generation = 0;;) {
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        start_.wait(lock, [this, generation] { return stop_ || generation_ != generation; });
+        if (stop_) {
+          return;
+        }
+        generation = generation_;
+      }
+      (this->*task_)(t);
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (--running_ == 0) {
+        done_.notify_one();
+      }
+    }
+  }
+
+  // Run |task| with all threads.
+  void run(void (LearnerThreadPool::*task)(learner_thread*)) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      task_ = task;
+      running_ = threads_.size() - 1;
+      ++generation_;
+      start_.notify_all();
+    }
+    (this->*task)(&threads_[0]);
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this] { return running_ == 0; });
+  }
+
+  void gradient(learner_thread* t) {
+    t->clear();
+    if (t->expected.size() != psize_) {
+      t->expected.resize(psize_);
+    }
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (size_t k = 0; k < t->chunks.size(); ++k) {
+      const size_t chunk = t->chunks[k];
+      for (size_t i = chunks_[chunk]; i < chunks_[chunk + 1]; ++i) {
+        EncoderLearnerTagger* tagger = x_[order_[i]];
+        t->f += tagger->gradient(&t->expected[0]);
+        t->err += tagger->eval(&t->micro_c, &t->micro_p, &t->micro_r);
+      }
     }
+    t->busy = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
   }
+
+  void batchGradient(learner_thread* t) {
+    t->clear();
+    if (t->expected.size() != psize_) {
+      t->expected.resize(psize_);
+      t->batches.resize(psize_);
+    }
+    t->ids.clear();
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (size_t i = t->index; i < batch_size_; i += threads_.size()) {
+      EncoderLearnerTagger* tagger = x_[batch_[i]];
+      t->f += tagger->gradient(&t->expected[0]);
+      t->err += tagger->eval(&t->micro_c, &t->micro_p, &t->micro_r);
+      tagger->add_observed(&t->expected[0], -1.0);
+      tagger->for_each_feature([this, t](int id) {
+        if (t->batches[id] != batch_num_) {
+          t->batches[id] = batch_num_;
+          t->ids.push_back(id);
+        }
+      });
+    }
+    t->busy = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  }
+
+  void addBatch(learner_thread* t) {
+    const std::vector<int>& ids = *batch_ids_;
+    const size_t begin = ids.size() * t->index / threads_.size();
+    const size_t end = ids.size() * (t->index + 1) / threads_.size();
+    const double scale = 1.0 / std::max<size_t>(1, batch_size_);
+    for (size_t i = begin; i < end; ++i) {
+      const int id = ids[i];
+      double sum = 0.0;
+      for (size_t j = 0; j < threads_.size(); ++j) {
+        if (!threads_[j].expected.empty()) {
+          sum += threads_[j].expected[id];
+          threads_[j].expected[id] = 0.0;
+        }
+      }
+      expected_[id] = sum * scale;
+    }
+  }
+
+  void add(learner_thread* t) {
+    // blocks of the output stay in L1 while the expectations of all threads are added to them.
+    const size_t kBlockSize = 1024;
+    const size_t begin = psize_ * t->index / threads_.size();
+    const size_t end = psize_ * (t->index + 1) / threads_.size();
+    for (size_t block = begin; block < end; block += kBlockSize) {
+      const size_t size = std::min(kBlockSize, end - block);
+      // plain loops over contiguous arrays, which the compiler vectorizes
+      double* output = expected_ + block;
+      double* input = &threads_[0].expected[block];
+      for (size_t k = 0; k < size; ++k) {
+        output[k] = input[k];
+        input[k] = 0.0;
+      }
+      for (size_t i = 1; i < threads_.size(); ++i) {
+        input = &threads_[i].expected[block];
+        for (size_t k = 0; k < size; ++k) {
+          output[k] += input[k];
+          input[k] = 0.0;
+        }
+      }
+    }
+    t->partial = (*update_)(begin, end);
+  }
+
+  const std::vector<EncoderLearnerTagger*>& x_;
+  std::vector<learner_thread> threads_;
+  std::vector<size_t> order_;   // indices of the sentences from the largest lattice
+  std::vector<size_t> chunks_;  // beginnings of the chunks in |order_|, and its size at last
+  const size_t psize_;
+  void (LearnerThreadPool::*task_)(learner_thread*);
+  double* expected_;
+  const std::function<double(size_t, size_t)>* update_;
+  const size_t* batch_;
+  size_t batch_size_;
+  size_t batch_num_;
+  const std::vector<int>* batch_ids_;
+  std::vector<size_t> merged_;  // the last mini-batch which a feature is added to the union in
+  std::mutex mutex_;
+  std::condition_variable start_;
+  std::condition_variable done_;
+  size_t generation_;
+  size_t running_;
+  bool stop_;
+};
+
+inline void learner_thread::run() { pool->wait(this); }
+
+class CorpusReader;
+
+// A thread of CorpusReader, which reads a shard of the corpus with its own feature index.
+class corpus_reader_thread : public thread {
+ public:
+  const CorpusReader* reader;
+  std::string shard;
+  EncoderFeatureIndex* feature_index;
+  std::vector<EncoderLearnerTagger*> x;
+  std::vector<double> observed;
+
+  void run();
 };
 
+/**
+ * Reads a training corpus into taggers with compacted lattices.
+ * With more than one thread, the corpus is cut at sentence boundaries into a shard per thread, and every thread
+ * reads its shard with its own allocator and its own EncoderFeatureIndex, so the threads share no rewrite or feature
+ * cache. The shards are then merged into the feature index in the order of the corpus, which gives every feature the
+ * id, the observed count and the feature vectors it gets from one thread. The trained model still differs in
+ * rounding between numbers of threads, as LearnerThreadPool adds up the gradient in a different order.
+ * The feature vectors of the sentences stay in the feature indexes of the shards, which live as long as the reader.
+ */
+class CorpusReader {
+ public:
+  CorpusReader(const Param& param,
+               Tokenizer<LearnerNode, LearnerPath>* tokenizer,
+               EncoderFeatureIndex* feature_index,
+               size_t eval_size,
+               size_t unk_eval_size)
+      : param_(param),
+        tokenizer_(tokenizer),
+        feature_index_(feature_index),
+        eval_size_(eval_size),
+        unk_eval_size_(unk_eval_size) {}
+  ~CorpusReader() {
+    for (size_t i = 0; i < shards_.size(); ++i) {
+      delete shards_[i];
+    }
+  }
+
+  // Read |filename| with |thread_num| threads, and append the sentences to |x| and their features to |observed|.
+  void read(const std::string& filename,
+            size_t thread_num,
+            std::vector<EncoderLearnerTagger*>* x,
+            std::vector<double>* observed) {
+    std::ifstream ifs(filename.c_str());
+    CHECK_DIE(ifs) << "no such file or directory: " << filename;
+    if (thread_num <= 1) {
+      read(&ifs, feature_index_, x, observed, true);
+      return;
+    }
+
+    std::ostringstream buf;
+    buf << ifs.rdbuf();
+    const std::string corpus = buf.str();
+    const std::vector<size_t> bounds = split(corpus, thread_num);
+
+    std::vector<corpus_reader_thread> threads(thread_num);
+    for (size_t i = 0; i < threads.size(); ++i) {
+      threads[i].reader = this;
+      threads[i].shard = corpus.substr(bounds[i], bounds[i + 1] - bounds[i]);
+      shards_.push_back(new EncoderFeatureIndex());
+      CHECK_DIE(shards_.back()->open(param_)) << "cannot open feature index";
+      threads[i].feature_index = shards_.back();
+    }
+    for (size_t i = 1; i < threads.size(); ++i) {
+      threads[i].start();
+    }
+    threads[0].run();
+    for (size_t i = 1; i < threads.size(); ++i) {
+      threads[i].join();
+    }
+
+    for (size_t i = 0; i < threads.size(); ++i) {
+      feature_index_->merge(threads[i].feature_index, threads[i].observed, observed);
+      // only the feature vectors of the shard are used after the merge
+      threads[i].feature_index->close();
+      threads[i].feature_index->clearcache();
+      for (size_t j = 0; j < threads[i].x.size(); ++j) {
+        threads[i].x[j]->set_feature_index(feature_index_);
+        x->push_back(threads[i].x[j]);
+      }
+    }
+    std::cout << x->size() << "... " << std::flush;
+  }
+
+ private:
+  friend class corpus_reader_thread;
+
+  // the beginnings of |size| shards of |corpus|, each of which is cut after a line ending a sentence, and the end
+  static std::vector<size_t> split(const std::string& corpus, size_t size) {
+    std::vector<size_t> bounds(1, 0);
+    for (size_t i = 1; i < size; ++i) {
+      // the first whole line from the i-th part of the corpus
+      size_t pos = std::max(bounds.back(), corpus.size() * i / size);
+      if (pos > 0) {
+        pos = std::min(corpus.find('\n', pos - 1), corpus.size() - 1) + 1;
+      }
+      // up to "EOS" or an empty line, which EncoderLearnerTagger::read() ends a sentence at
+      while (pos < corpus.size()) {
+        const size_t end = std::min(corpus.find('\n', pos), corpus.size());
+        const bool eos = end == pos || corpus.compare(pos, end - pos, "EOS") == 0;
+        pos = std::min(end + 1, corpus.size());
+        if (eos) {
+          break;
+        }
+      }
+      bounds.push_back(pos);
+    }
+    bounds.push_back(corpus.size());
+    return bounds;
+  }
+
+  void read(std::istream* is,
+            EncoderFeatureIndex* feature_index,
+            std::vector<EncoderLearnerTagger*>* x,
+            std::vector<double>* observed,
+            bool progress) const {
+    Allocator<LearnerNode, LearnerPath> allocator;
+    while (*is) {
+      EncoderLearnerTagger* tagger = new EncoderLearnerTagger();
+
+      CHECK_DIE(tagger->open(tokenizer_, &allocator, feature_index, eval_size_, unk_eval_size_));
+
+      CHECK_DIE(tagger->read(is, observed));
+
+      if (!tagger->empty()) {
+        tagger->compact();
+        x->push_back(tagger);
+      } else {
+        delete tagger;
+      }
+      // the lattice of a sentence is in the tagger after compact()
+      allocator.free();
+
+      if (progress && x->size() % 100 == 0) {
+        std::cout << x->size() << "... " << std::flush;
+      }
+    }
+  }
+
+  const Param& param_;
+  Tokenizer<LearnerNode, LearnerPath>* tokenizer_;
+  EncoderFeatureIndex* feature_index_;
+  const size_t eval_size_;
+  const size_t unk_eval_size_;
+  std::vector<EncoderFeatureIndex*> shards_;
+};
+
+inline void corpus_reader_thread::run() {
+  std::istringstream is(shard);
+  reader->read(&is, feature_index, &x, &observed, false);
+  std::string().swap(shard);
+}
+
 class CRFLearner {
  public:
+  // Train with L-BFGS, which computes the gradient of all sentences in every iteration.
+  // The L2 penalty |alpha - old_alpha|^2 / (2 * l2_cost) and the L1 penalty |alpha| / l1_cost are added to the
+  // objective, where a zero cost disables the penalty. The L1 penalty is minimized by OWL-QN.
+  // With --checkpoint, the weights and the optimizer are written to |checkpoint| every --checkpoint-interval
+  // iterations, and with --resume, the training continues from the iteration after such a checkpoint.
+  static void runLBFGS(const Param& param,
+                       const std::vector<EncoderLearnerTagger*>& x,
+                       size_t psize,
+                       double l2_cost,
+                       double l1_cost,
+                       double eta,
+                       size_t thread_num,
+                       const std::vector<double>& observed,
+                       const std::vector<double>& old_alpha,
+                       Checkpoint* checkpoint,
+                       std::vector<double>* alpha_vector) {
+    const std::string checkpoint_file = param.get<std::string>("checkpoint");
+    const size_t checkpoint_interval = param.get<size_t>("checkpoint-interval");
+    const std::string resume_file = param.get<std::string>("resume");
+    std::vector<double>& alpha = *alpha_vector;
+    std::vector<double> expected(psize);
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    scoped_ptr<LearnerThreadPool> pool;
+    if (thread_num > 1) {
+      pool.reset(new LearnerThreadPool(x, thread_num, psize));
+    }
+
+    int converge = 0;
+    double prev_obj = 0.0;
+    LBFGS lbfgs;
+    size_t first_itr = 0;
+    double resumed_seconds = 0.0;
+    if (!resume_file.empty()) {
+      CheckpointState state;
+      CHECK_DIE(checkpoint->read(resume_file, &state, &alpha, &lbfgs)) << "cannot resume from " << resume_file;
+      CHECK_DIE(state.l2_cost == l2_cost && state.l1_cost == l1_cost)
+          << "the checkpoint is of another cost or regularization: " << resume_file;
+      first_itr = state.iteration;
+      converge = static_cast<int>(state.converge);
+      prev_obj = state.objective;
+      resumed_seconds = state.seconds;
+      std::cout << "Resuming from checkpoint: " << resume_file << " iter=" << first_itr << std::endl;
+    }
+
+    // adds the L2 penalty to the gradient of the features in [begin, end), and returns it and the L1 penalty, which
+    // OWL-QN handles, for the objective
+    const std::function<double(size_t, size_t)> penalize = [&](size_t begin, size_t end) {
+      double penalty_sum = 0.0;
+      for (size_t i = begin; i < end; ++i) {
+        expected[i] -= observed[i];
+        if (l2_cost > 0.0) {
+          const double penalty = (alpha[i] - old_alpha[i]);
+          penalty_sum += (penalty * penalty / (2.0 * l2_cost));
+          expected[i] += penalty / l2_cost;
+        }
+        if (l1_cost > 0.0) {
+          penalty_sum += std::fabs(alpha[i]) / l1_cost;
+        }
+      }
+      return penalty_sum;
+    };
+
+    for (size_t itr = first_itr;; ++itr) {
+      double obj = 0.0;
+      size_t err = 0;
+      size_t micro_p = 0;
+      size_t micro_r = 0;
+      size_t micro_c = 0;
+
+      if (thread_num > 1) {
+        pool->compute();
+        for (size_t i = 0; i < thread_num; ++i) {
+          const learner_thread& thread = pool->worker(i);
+          obj += thread.f;
+          err += thread.err;
+          micro_r += thread.micro_r;
+          micro_p += thread.micro_p;
+          micro_c += thread.micro_c;
+        }
+        obj += pool->reduce(&expected[0], penalize);
+      } else {
+        std::fill(expected.begin(), expected.end(), 0.0);
+        for (size_t i = 0; i < x.size(); ++i) {
+          obj += x[i]->gradient(&expected[0]);
+          err += x[i]->eval(&micro_c, &micro_p, &micro_r);
+        }
+        obj += penalize(0, psize);
+      }
+
+      const double p = 1.0 * micro_c / micro_p;
+      const double r = 1.0 * micro_c / micro_r;
+      const double micro_f = 2 * p * r / (p + r);
+
+      const double diff = (itr == 0 ? 1.0 : std::fabs(1.0 * (prev_obj - obj)) / prev_obj);
+      const double seconds =
+          resumed_seconds + std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      std::cout << "iter=" << itr << " err=" << 1.0 * err / x.size() << " F=" << micro_f << " target=" << obj
+                << " diff=" << diff << " time=" << seconds << std::endl;
+      if (thread_num > 1) {
+        // the slowest thread is the wall time of the iteration
+        std::cout << "  busy(sec)=";
+        for (size_t i = 0; i < thread_num; ++i) {
+          std::cout << (i ? "," : "") << pool->worker(i).busy;
+        }
+        std::cout << std::endl;
+      }
+      prev_obj = obj;
+
+      if (diff < eta) {
+        converge++;
+      } else {
+        converge = 0;
+      }
+
+      if (converge == 3) {
+        break;  // 3 is ad-hoc
+      }
+
+      const int ret = lbfgs.optimize(psize, &alpha[0], obj, &expected[0], l1_cost > 0.0, l1_cost);
+
+      CHECK_DIE(ret >= 0) << "unexpected error in LBFGS routin";
+
+      if (ret == 0) {
+        break;
+      }
+
+      if (!checkpoint_file.empty() && (itr + 1) % checkpoint_interval == 0) {
+        const CheckpointState state = {itr + 1, static_cast<uint64_t>(converge), prev_obj, seconds, l2_cost, l1_cost};
+        checkpoint->write(checkpoint_file, state, alpha, &lbfgs);
+      }
+    }
+
+    if (checkpoint) {
+      CHECK_DIE(checkpoint->wait()) << "cannot write checkpoint: " << checkpoint_file;
+    }
+  }
+
+  // Train with a stochastic optimizer on mini-batches of the sentences, which are shuffled in every epoch.
+  static void runOnline(const Param& param,
+                        const std::vector<EncoderLearnerTagger*>& x,
+                        size_t psize,
+                        double C,
+                        double eta,
+                        size_t thread_num,
+                        const std::vector<double>& old_alpha,
+                        std::vector<double>* alpha) {
+    OnlineOptimizer::Algorithm algorithm;
+    CHECK_DIE(OnlineOptimizer::parse(param.get<std::string>("algorithm"), &algorithm));
+    const size_t batch_size = param.get<size_t>("batch-size");
+    const double rate = param.get<double>("learning-rate");
+    const double rate_decay = param.get<double>("learning-rate-decay");
+    const size_t epochs = param.get<size_t>("epochs");
+    CHECK_DIE(batch_size > 0) << "batch-size is out of range: " << batch_size;
+    CHECK_DIE(rate > 0) << "learning-rate is out of range: " << rate;
+    CHECK_DIE(rate_decay >= 0) << "learning-rate-decay is out of range: " << rate_decay;
+    CHECK_DIE(epochs > 0) << "epochs is out of range: " << epochs;
+
+    std::cout << "algorithm:           " << param.get<std::string>("algorithm") << std::endl;
+    std::cout << "batch-size:          " << batch_size << std::endl;
+    std::cout << "learning-rate:       " << rate << std::endl << std::endl;
+
+    LearnerThreadPool pool(x, thread_num, psize);
+    // the L2 penalty of the objective divided by the number of sentences, as a gradient is the mean of a batch
+    OnlineOptimizer optimizer(algorithm, psize, 1.0 / (C * x.size()), &old_alpha[0]);
+    std::vector<double> gradient(psize, 0.0);
+    std::vector<int> ids;
+    std::vector<size_t> order(x.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+      order[i] = i;
+    }
+    std::mt19937 random(0);
+
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    int converge = 0;
+    double prev_obj = 0.0;
+    for (size_t epoch = 0; epoch < epochs; ++epoch) {
+      std::shuffle(order.begin(), order.end(), random);
+      const double epoch_rate = rate / (1.0 + rate_decay * epoch);
+      // the losses and the errors are of the weights when a sentence is in a batch
+      double obj = 0.0;
+      size_t err = 0;
+      size_t micro_p = 0;
+      size_t micro_r = 0;
+      size_t micro_c = 0;
+
+      for (size_t begin = 0; begin < order.size(); begin += batch_size) {
+        const size_t size = std::min(batch_size, order.size() - begin);
+        pool.computeBatch(&order[begin], size, &gradient[0], &ids);
+        for (size_t i = 0; i < pool.size(); ++i) {
+          const learner_thread& thread = pool.worker(i);
+          obj += thread.f;
+          err += thread.err;
+          micro_r += thread.micro_r;
+          micro_p += thread.micro_p;
+          micro_c += thread.micro_c;
+        }
+        optimizer.update(&(*alpha)[0], ids.data(), ids.size(), &gradient[0], epoch_rate);
+        for (size_t i = 0; i < ids.size(); ++i) {
+          gradient[ids[i]] = 0.0;
+        }
+      }
+      optimizer.finish(&(*alpha)[0], epoch_rate);
+
+      for (size_t i = 0; i < psize; ++i) {
+        const double penalty = ((*alpha)[i] - old_alpha[i]);
+        obj += (penalty * penalty / (2.0 * C));
+      }
+
+      const double p = 1.0 * micro_c / micro_p;
+      const double r = 1.0 * micro_c / micro_r;
+      const double micro_f = 2 * p * r / (p + r);
+      const double diff = (epoch == 0 ? 1.0 : std::fabs(1.0 * (prev_obj - obj)) / prev_obj);
+      const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      std::cout << "epoch=" << epoch << " err=" << 1.0 * err / x.size() << " F=" << micro_f << " target=" << obj
+                << " diff=" << diff << " time=" << seconds << std::endl;
+      prev_obj = obj;
+
+      if (diff < eta) {
+        converge++;
+      } else {
+        converge = 0;
+      }
+
+      if (converge == 3) {
+        break;
+      }
+    }
+  }
+
   static int run(Param* param) {
     const std::string dicdir = param->get<std::string>("dicdir");
     CHECK_DIE(param->parseFile(DCONF(DICRC))) << "no such file or directory: " << DCONF(DICRC);
@@ -51,13 +739,11 @@ class CRFLearner {
     const std::string old_model = param->get<std::string>("old-model");
 
     EncoderFeatureIndex feature_index;
-    std::vector<double> expected;
     std::vector<double> observed;
     std::vector<double> alpha;
     std::vector<double> old_alpha;
     std::vector<EncoderLearnerTagger*> x;
     Tokenizer<LearnerNode, LearnerPath> tokenizer;
-    Allocator<LearnerNode, LearnerPath> allocator;
 
     CHECK_DIE(tokenizer.open(*param)) << "cannot open tokenizer";
     CHECK_DIE(feature_index.open(*param)) << "cannot open feature index";
@@ -83,39 +769,48 @@ class CRFLearner {
     CHECK_DIE(unk_eval_size > 0) << "unk-eval-size is out of range: " << unk_eval_size;
     CHECK_DIE(freq > 0) << "freq is out of range: " << unk_eval_size;
     CHECK_DIE(thread_num > 0 && thread_num <= 512) << "# thread is invalid: " << thread_num;
+    OnlineOptimizer::Algorithm algorithm;
+    CHECK_DIE(param->get<std::string>("algorithm") == "lbfgs" ||
+              OnlineOptimizer::parse(param->get<std::string>("algorithm"), &algorithm));
+
+    // the costs of the L2 and the L1 penalties; elastic-net splits 1 / C into them by l1-ratio
+    const std::string regularization = param->get<std::string>("regularization");
+    double l2_cost = 0.0;
+    double l1_cost = 0.0;
+    if (regularization == "l2") {
+      l2_cost = C;
+    } else if (regularization == "l1") {
+      l1_cost = C;
+    } else if (regularization == "elastic-net") {
+      const double l1_ratio = param->get<double>("l1-ratio");
+      CHECK_DIE(l1_ratio > 0 && l1_ratio < 1) << "l1-ratio is out of range: " << l1_ratio;
+      l1_cost = C / l1_ratio;
+      l2_cost = C / (1.0 - l1_ratio);
+    } else {
+      CHECK_DIE(false) << "unknown regularization: " << regularization;
+    }
+    CHECK_DIE(l1_cost == 0.0 || param->get<std::string>("algorithm") == "lbfgs")
+        << regularization << " regularization is only supported by lbfgs";
+    const bool use_checkpoint = !param->get<std::string>("checkpoint").empty() ||
+                                !param->get<std::string>("resume").empty();
+    CHECK_DIE(!use_checkpoint || param->get<std::string>("algorithm") == "lbfgs")
+        << "checkpoint and resume are only supported by lbfgs";
+    CHECK_DIE(param->get<size_t>("checkpoint-interval") > 0)
+        << "checkpoint-interval is out of range: " << param->get<size_t>("checkpoint-interval");
 
     std::cout.setf(std::ios::fixed, std::ios::floatfield);
     std::cout.precision(5);
 
     std::cout << "reading corpus ..." << std::flush;
 
-    std::ifstream ifs(ifile.c_str());
-    CHECK_DIE(ifs) << "no such file or directory: " << ifile;
-
-    while (ifs) {
-      EncoderLearnerTagger* tagger = new EncoderLearnerTagger();
-
-      CHECK_DIE(tagger->open(&tokenizer, &allocator, &feature_index, eval_size, unk_eval_size));
-
-      CHECK_DIE(tagger->read(&ifs, &observed));
-
-      if (!tagger->empty()) {
-        x.push_back(tagger);
-      } else {
-        delete tagger;
-      }
-
-      if (x.size() % 100 == 0) {
-        std::cout << x.size() << "... " << std::flush;
-      }
-    }
+    CorpusReader reader(*param, &tokenizer, &feature_index, eval_size, unk_eval_size);
+    reader.read(ifile, thread_num, &x, &observed);
 
     feature_index.shrink(freq, &observed);
     feature_index.clearcache();
 
     const size_t psize = feature_index.size();
     observed.resize(psize);
-    expected.resize(psize);
     alpha.resize(psize);
     old_alpha.resize(psize);
     alpha = old_alpha;
@@ -131,93 +826,28 @@ class CRFLearner {
     std::cout << "unk-eval-size:       " << unk_eval_size << std::endl;
     std::cout << "threads:             " << thread_num << std::endl;
     std::cout << "charset:             " << tokenizer.dictionary_info()->charset << std::endl;
-    std::cout << "C(sigma^2):          " << C << std::endl << std::endl;
-
-    std::vector<learner_thread> thread;
-    if (thread_num > 1) {
-      thread.resize(thread_num);
-      for (size_t i = 0; i < thread_num; ++i) {
-        thread[i].start_i = i;
-        thread[i].size = x.size();
-        thread[i].thread_num = thread_num;
-        thread[i].x = &x[0];
-        thread[i].expected.resize(expected.size());
-      }
+    std::cout << "C(sigma^2):          " << C << std::endl;
+    std::cout << "regularization:      " << regularization << std::endl;
+    if (feature_index.hash_size()) {
+      std::cout << "hash-size:           " << feature_index.hash_size() << std::endl;
     }
+    std::cout << std::endl;
 
-    int converge = 0;
-    double prev_obj = 0.0;
-    LBFGS lbfgs;
-
-    for (size_t itr = 0;; ++itr) {
-      std::fill(expected.begin(), expected.end(), 0.0);
-      double obj = 0.0;
-      size_t err = 0;
-      size_t micro_p = 0;
-      size_t micro_r = 0;
-      size_t micro_c = 0;
-
-      if (thread_num > 1) {
-        for (size_t i = 0; i < thread_num; ++i) {
-          thread[i].start();
-        }
-
-        for (size_t i = 0; i < thread_num; ++i) {
-          thread[i].join();
-        }
-
-        for (size_t i = 0; i < thread_num; ++i) {
-          obj += thread[i].f;
-          err += thread[i].err;
-          micro_r += thread[i].micro_r;
-          micro_p += thread[i].micro_p;
-          micro_c += thread[i].micro_c;
-          for (size_t k = 0; k < psize; ++k) {
-            expected[k] += thread[i].expected[k];
-          }
-        }
-      } else {
-        for (size_t i = 0; i < x.size(); ++i) {
-          obj += x[i]->gradient(&expected[0]);
-          err += x[i]->eval(&micro_c, &micro_p, &micro_r);
-        }
-      }
-
-      const double p = 1.0 * micro_c / micro_p;
-      const double r = 1.0 * micro_c / micro_r;
-      const double micro_f = 2 * p * r / (p + r);
-
-      for (size_t i = 0; i < psize; ++i) {
-        const double penalty = (alpha[i] - old_alpha[i]);
-        obj += (penalty * penalty / (2.0 * C));
-        expected[i] = expected[i] - observed[i] + penalty / C;
-      }
-
-      const double diff = (itr == 0 ? 1.0 : std::fabs(1.0 * (prev_obj - obj)) / prev_obj);
-      std::cout << "iter=" << itr << " err=" << 1.0 * err / x.size() << " F=" << micro_f << " target=" << obj
-                << " diff=" << diff << std::endl;
-      prev_obj = obj;
-
-      if (diff < eta) {
-        converge++;
-      } else {
-        converge = 0;
-      }
-
-      if (converge == 3) {
-        break;  // 3 is ad-hoc
-      }
-
-      const int ret = lbfgs.optimize(psize, &alpha[0], obj, &expected[0], false, C);
-
-      CHECK_DIE(ret >= 0) << "unexpected error in LBFGS routin";
-
-      if (ret == 0) {
-        break;
+    if (param->get<std::string>("algorithm") == "lbfgs") {
+      scoped_ptr<Checkpoint> checkpoint;
+      if (use_checkpoint) {
+        std::vector<const char*> keys;
+        feature_index.keys(&keys);
+        checkpoint.reset(new Checkpoint(psize, keys));
       }
+      runLBFGS(*param, x, psize, l2_cost, l1_cost, eta, thread_num, observed, old_alpha, checkpoint.get(), &alpha);
+    } else {
+      runOnline(*param, x, psize, C, eta, thread_num, old_alpha, &alpha);
     }
 
-    std::cout << "\nDone! writing model file ... " << std::endl;
+    std::cout << "\nNumber of non-zero features: " << (psize - std::count(alpha.begin(), alpha.end(), 0.0))
+              << std::endl;
+    std::cout << "Done! writing model file ... " << std::endl;
 
     std::ostringstream oss;
 
@@ -229,6 +859,9 @@ class CRFLearner {
     oss << "eval-size: " << eval_size << std::endl;
     oss << "unk-eval-size: " << unk_eval_size << std::endl;
     oss << "charset: " << tokenizer.dictionary_info()->charset << std::endl;
+    if (feature_index.hash_size()) {
+      oss << "hash-size: " << feature_index.hash_size() << std::endl;
+    }
 
     const std::string header = oss.str();
 
@@ -247,7 +880,19 @@ class Learner {
         {"cost", 'c', "1.0", "FLOAT", "set FLOAT for cost C for constraints violatoin"},
         {"freq", 'f', "1", "INT", "set the frequency cut-off (default 1)"},
         {"eta", 'e', "0.00005", "DIR", "set FLOAT for tolerance of termination criterion"},
-        {"thread", 'p', "1", "INT", "number of threads(default 1)"}};
+        {"thread", 'p', "1", "INT", "number of threads(default 1)"},
+        {"algorithm", 'a', "lbfgs", "TYPE", "optimize with TYPE: lbfgs, sgd, adagrad or adam (default lbfgs)"},
+        {"batch-size", 'b', "32", "INT", "set INT sentences in a mini-batch of sgd, adagrad and adam (default 32)"},
+        {"learning-rate", 'l', "0.05", "FLOAT",
+         "set FLOAT for the learning rate of sgd, adagrad and adam (default 0.05)"},
+        {"learning-rate-decay", 'D', "0", "FLOAT", "divide the learning rate by 1 + FLOAT * epoch (default 0)"},
+        {"epochs", 'i', "50", "INT", "run sgd, adagrad and adam for INT epochs at most (default 50)"},
+        {"regularization", 'R', "l2", "TYPE", "regularize with TYPE: l2, l1 or elastic-net (default l2)"},
+        {"l1-ratio", 'r', "0.5", "FLOAT", "set FLOAT for the ratio of L1 in elastic-net (default 0.5)"},
+        {"hash-size", 'H', "0", "INT", "hash the features to INT buckets without keeping them (default 0, no hashing)"},
+        {"checkpoint", 'k', "", "FILE", "write a checkpoint of lbfgs to FILE in the background"},
+        {"checkpoint-interval", 'K', "10", "INT", "write the checkpoint every INT iterations (default 10)"},
+        {"resume", 'S', "", "FILE", "resume lbfgs from the checkpoint FILE of the same corpus and options"}};
 
     Param param;
 
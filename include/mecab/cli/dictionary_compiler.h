@@ -1,12 +1,17 @@
 #ifndef __MECAB_DICTIONARY_COMPILER_H__
 #define __MECAB_DICTIONARY_COMPILER_H__
 
+#include <sys/stat.h>
+
+#include <cerrno>
 #include <vector>
 
 #include "mecab/char_property.h"
+#include "mecab/cli/build_manifest.h"
 #include "mecab/common.h"
 #include "mecab/dictionary.h"
 #include "mecab/feature_index.h"
+#include "mecab/package.h"
 #include "mecab/utils/io.h"
 #include "mecab/utils/param.h"
 
@@ -24,6 +29,54 @@ inline bool file_exists(const char* filename) {
 
 class DictionaryComplier {
  public:
+  // Options which Dictionary::compile writes into the outputs. The paths, threads, sort-buffer and
+  // shard-cache only change how they are built.
+  static const std::vector<std::string>& dictionaryOptions() {
+    static const std::vector<std::string> options{"charset",     "dictionary-charset", "config-charset", "type",
+                                                  "wakati",      "node-format",        "cost-factor",
+                                                  "feature-pool"};
+    return options;
+  }
+
+  // Options which FeatureIndex::compile writes into the model.
+  static const std::vector<std::string>& modelOptions() {
+    static const std::vector<std::string> options{"charset", "dictionary-charset"};
+    return options;
+  }
+
+  // Hash of the files and the options which Dictionary::compile reads besides the CSV files.
+  // matrix.bin is read only without matrix.def.
+  static BuildHash dictionaryHash(const Param& param, const std::string& dicdir) {
+    const char* files[] = {LEFT_ID_FILE, RIGHT_ID_FILE, REWRITE_FILE, POS_ID_FILE, CHAR_PROPERTY_FILE, FEATURE_FILE};
+    BuildHash hash;
+    hash.addParam(param, dictionaryOptions());
+    const std::string matrix_file = create_filename(dicdir, std::string(MATRIX_DEF_FILE));
+    hash.addFile(file_exists(matrix_file.c_str()) ? matrix_file : create_filename(dicdir, std::string(MATRIX_FILE)));
+    for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); ++i) {
+      hash.addFile(create_filename(dicdir, std::string(files[i])));
+    }
+    const std::string model = param.get<std::string>("model");
+    if (!model.empty()) {
+      hash.addFile(model);
+    }
+    return hash;
+  }
+
+  // Return false if |output| is up to date in |manifest|.
+  static bool needsBuild(const BuildManifest* manifest, const std::string& output, const BuildHash& hash) {
+    if (manifest && manifest->isUpToDate(output, hash.str())) {
+      std::cout << output << " is up to date. skipped." << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  static void built(BuildManifest* manifest, const std::string& output, const BuildHash& hash) {
+    if (manifest) {
+      manifest->update(output, hash.str());
+    }
+  }
+
   static int run(int argc, char** argv) {
     const std::vector<MeCab::Option> long_options{
         {"dicdir", 'd', ".", "DIR", "set DIR as dic dir (default \".\")"},
@@ -49,7 +102,20 @@ class DictionaryComplier {
             "build wakati-gaki only dictionary",
         },
         {"posid", 'p', "", "", "assign Part-of-speech id"},
-        {"node-format", 'F', "", "STR", "use STR as the user defined node format"}};
+        {"node-format", 'F', "", "STR", "use STR as the user defined node format"},
+        {"feature-pool", 'P', "", "TYPE",
+         "store identical features once (\"dedup\"), and also features at the end of others (\"suffix\")"},
+        {"matrix-compression", 'X', "", "TYPE",
+         "store identical rows and columns of the matrix once (\"dedup\"), and also costs as 8-bit deltas, "
+         "which rounds rows with a wide range of costs (\"delta8\")"},
+        {"incremental", 'I', "", "",
+         "rebuild only the outputs whose inputs have changed, and reuse converted CSV files (see " BUILD_MANIFEST_FILE
+         " and " BUILD_CACHE_DIR " in the output dir)"},
+        {"package", 'k', "", "",
+         "also pack the dictionary into a single file " DIC_PACKAGE_FILE " in the output dir, which is opened with -d"},
+        {"threads", 'T', "0", "INT", "compile with INT threads (default 0: the number of CPUs)"},
+        {"sort-buffer", 'S', "0", "MB",
+         "sort entries in temporary files beyond MB megabytes in memory (default 0: half of the physical memory)"}};
 
     Param param;
 
@@ -76,6 +142,8 @@ class DictionaryComplier {
     bool opt_model = param.get<bool>("build-model");
     bool opt_assign_user_dictionary_costs = param.get<bool>("assign-user-dictionary-costs");
     const std::string userdic = param.get<std::string>("userdic");
+    const bool incremental = param.get<bool>("incremental");
+    const bool opt_package = param.get<bool>("package");
 
 #define DCONF(file) create_filename(dicdir, std::string(file)).c_str()
 #define OCONF(file) create_filename(outdir, std::string(file)).c_str()
@@ -89,13 +157,30 @@ class DictionaryComplier {
       dic = param.getRestParameters();
     }
 
+    // outputs are skipped when the hashes of their inputs are the same as in the manifest.
+    scoped_ptr<BuildManifest> manifest;
+    if (incremental) {
+      manifest.reset(new BuildManifest(OCONF(BUILD_MANIFEST_FILE)));
+      const std::string cache = OCONF(BUILD_CACHE_DIR);
+      CHECK_DIE(::mkdir(cache.c_str(), 0755) == 0 || errno == EEXIST) << "cannot create directory: " << cache;
+      param.set("shard-cache", cache);
+    }
+
     if (!userdic.empty()) {
       CHECK_DIE(dic.size()) << "no dictionaries are specified";
       param.set("type", std::to_string(MECAB_USR_DIC));
       if (opt_assign_user_dictionary_costs) {
         Dictionary::assignUserDictionaryCosts(param, dic, userdic.c_str());
       } else {
-        Dictionary::compile(param, dic, userdic.c_str());
+        BuildHash hash = dictionaryHash(param, dicdir);
+        param.set("shard-salt", hash.str());
+        for (size_t i = 0; i < dic.size(); ++i) {
+          hash.addFile(dic[i]);
+        }
+        if (needsBuild(manifest.get(), userdic, hash)) {
+          Dictionary::compile(param, dic, userdic.c_str());
+          built(manifest.get(), userdic, hash);
+        }
       }
     } else {
       if (!opt_unknown && !opt_matrix && !opt_charcategory && !opt_sysdic && !opt_model) {
@@ -103,19 +188,37 @@ class DictionaryComplier {
       }
 
       if (opt_charcategory || opt_unknown) {
-        CharProperty::compile(DCONF(CHAR_PROPERTY_DEF_FILE), DCONF(UNK_DEF_FILE), OCONF(CHAR_PROPERTY_FILE));
+        BuildHash hash;
+        hash.addFile(DCONF(CHAR_PROPERTY_DEF_FILE));
+        hash.addFile(DCONF(UNK_DEF_FILE));
+        if (needsBuild(manifest.get(), OCONF(CHAR_PROPERTY_FILE), hash)) {
+          CharProperty::compile(DCONF(CHAR_PROPERTY_DEF_FILE), DCONF(UNK_DEF_FILE), OCONF(CHAR_PROPERTY_FILE));
+          built(manifest.get(), OCONF(CHAR_PROPERTY_FILE), hash);
+        }
       }
 
       if (opt_unknown) {
         std::vector<std::string> tmp;
         tmp.push_back(DCONF(UNK_DEF_FILE));
         param.set("type", std::to_string(MECAB_UNK_DIC));
-        Dictionary::compile(param, tmp, OCONF(UNK_DIC_FILE));
+        BuildHash hash = dictionaryHash(param, dicdir);
+        param.set("shard-salt", hash.str());
+        hash.addFile(DCONF(UNK_DEF_FILE));
+        if (needsBuild(manifest.get(), OCONF(UNK_DIC_FILE), hash)) {
+          Dictionary::compile(param, tmp, OCONF(UNK_DIC_FILE));
+          built(manifest.get(), OCONF(UNK_DIC_FILE), hash);
+        }
       }
 
       if (opt_model) {
         if (file_exists(DCONF(MODEL_DEF_FILE))) {
-          FeatureIndex::compile(param, DCONF(MODEL_DEF_FILE), OCONF(MODEL_FILE));
+          BuildHash hash;
+          hash.addParam(param, modelOptions());
+          hash.addFile(DCONF(MODEL_DEF_FILE));
+          if (needsBuild(manifest.get(), OCONF(MODEL_FILE), hash)) {
+            FeatureIndex::compile(param, DCONF(MODEL_DEF_FILE), OCONF(MODEL_FILE));
+            built(manifest.get(), OCONF(MODEL_FILE), hash);
+          }
         } else {
           std::cout << DCONF(MODEL_DEF_FILE) << " is not found. skipped." << std::endl;
         }
@@ -124,11 +227,50 @@ class DictionaryComplier {
       if (opt_sysdic) {
         CHECK_DIE(dic.size()) << "no dictionaries are specified";
         param.set("type", std::to_string(MECAB_SYS_DIC));
-        Dictionary::compile(param, dic, OCONF(SYS_DIC_FILE));
+        BuildHash hash = dictionaryHash(param, dicdir);
+        param.set("shard-salt", hash.str());
+        for (size_t i = 0; i < dic.size(); ++i) {
+          hash.addFile(dic[i]);
+        }
+        if (needsBuild(manifest.get(), OCONF(SYS_DIC_FILE), hash)) {
+          Dictionary::compile(param, dic, OCONF(SYS_DIC_FILE));
+          built(manifest.get(), OCONF(SYS_DIC_FILE), hash);
+        }
       }
 
       if (opt_matrix) {
-        Connector::compile(DCONF(MATRIX_DEF_FILE), OCONF(MATRIX_FILE));
+        const std::string compression = param.get<std::string>("matrix-compression");
+        BuildHash hash;
+        hash.addFile(DCONF(MATRIX_DEF_FILE));
+        hash.add(compression);
+        if (needsBuild(manifest.get(), OCONF(MATRIX_FILE), hash)) {
+          Connector::compile(DCONF(MATRIX_DEF_FILE), OCONF(MATRIX_FILE), param.get<size_t>("threads"), compression);
+          Connector matrix;
+          CHECK_DIE(matrix.open(OCONF(MATRIX_FILE)) && matrix.verify()) << "cannot build " << OCONF(MATRIX_FILE);
+          built(manifest.get(), OCONF(MATRIX_FILE), hash);
+        }
+      }
+
+      if (opt_package) {
+        std::vector<std::pair<std::string, std::string>> files;
+        files.push_back(std::make_pair(std::string(SYS_DIC_FILE), std::string(OCONF(SYS_DIC_FILE))));
+        files.push_back(std::make_pair(std::string(UNK_DIC_FILE), std::string(OCONF(UNK_DIC_FILE))));
+        files.push_back(std::make_pair(std::string(MATRIX_FILE), std::string(OCONF(MATRIX_FILE))));
+        files.push_back(std::make_pair(std::string(CHAR_PROPERTY_FILE), std::string(OCONF(CHAR_PROPERTY_FILE))));
+        files.push_back(std::make_pair(std::string(DICRC), std::string(DCONF(DICRC))));
+        BuildHash hash;
+        for (size_t i = 0; i < files.size(); ++i) {
+          hash.add(files[i].first);
+          hash.addFile(files[i].second);
+        }
+        if (needsBuild(manifest.get(), OCONF(DIC_PACKAGE_FILE), hash)) {
+          DictionaryPackage::build(files, OCONF(DIC_PACKAGE_FILE));
+          DictionaryPackage package;
+          CHECK_DIE(package.open(OCONF(DIC_PACKAGE_FILE)) && package.verify())
+              << "cannot build " << OCONF(DIC_PACKAGE_FILE);
+          std::cout << "packed " << files.size() << " files into " << OCONF(DIC_PACKAGE_FILE) << std::endl;
+          built(manifest.get(), OCONF(DIC_PACKAGE_FILE), hash);
+        }
       }
     }
 
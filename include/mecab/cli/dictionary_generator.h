@@ -30,9 +30,8 @@ inline void copy(const char* src, const char* dst) {
 class DictionaryGenerator {
  private:
   static void gencid_bos(const std::string& bos_feature, DictionaryRewriter* rewrite, ContextID* cid) {
-    std::string ufeature, lfeature, rfeature;
-    rewrite->rewrite2(bos_feature, &ufeature, &lfeature, &rfeature);
-    cid->addBOS(lfeature.c_str(), rfeature.c_str());
+    const FeatureSet& features = rewrite->rewrite_or_empty(bos_feature);
+    cid->addBOS(features.lfeature.c_str(), features.rfeature.c_str());
   }
 
   static void gencid(const char* filename, DictionaryRewriter* rewrite, ContextID* cid) {
@@ -41,14 +40,12 @@ class DictionaryGenerator {
     scoped_fixed_array<char, BUF_SIZE> line;
     std::cout << "reading " << filename << " ... " << std::flush;
     size_t num = 0;
-    std::string feature, ufeature, lfeature, rfeature;
     char* col[8];
     while (ifs.getline(line.get(), line.size())) {
       const size_t n = tokenizeCSV(line.get(), col, 5);
       CHECK_DIE(n == 5) << "format error: " << line.get();
-      feature = col[4];
-      rewrite->rewrite2(feature, &ufeature, &lfeature, &rfeature);
-      cid->add(lfeature.c_str(), rfeature.c_str());
+      const FeatureSet& features = rewrite->rewrite_or_empty(col[4]);
+      cid->add(features.lfeature.c_str(), features.rfeature.c_str());
       ++num;
     }
     std::cout << num << std::endl;
@@ -127,13 +124,12 @@ class DictionaryGenerator {
       std::string w = std::string(col[0]);
       const std::string feature = std::string(col[4]);
 
-      std::string ufeature, lfeature, rfeature;
-      rewrite->rewrite2(feature, &ufeature, &lfeature, &rfeature);
-      const int lid = cid.lid(lfeature.c_str());
-      const int rid = cid.rid(rfeature.c_str());
+      const FeatureSet& features = rewrite->rewrite_or_empty(feature);
+      const int lid = cid.lid(features.lfeature.c_str());
+      const int rid = cid.rid(features.rfeature.c_str());
 
-      CHECK_DIE(lid > 0) << "CID is not found for " << lfeature;
-      CHECK_DIE(rid > 0) << "CID is not found for " << rfeature;
+      CHECK_DIE(lid > 0) << "CID is not found for " << features.lfeature;
+      CHECK_DIE(rid > 0) << "CID is not found for " << features.rfeature;
 
       if (unk) {
         const int c = property.id(w.c_str());
@@ -145,7 +141,7 @@ class DictionaryGenerator {
         path.rnode->char_type = cinfo.default_type;
       }
 
-      fi->buildUnigramFeature(&path, ufeature.c_str());
+      fi->buildUnigramFeature(&path, features.ufeature.c_str());
       fi->calcCost(&rnode);
       CHECK_DIE(escape_csv_element(&w)) << "invalid character found: " << w;
 
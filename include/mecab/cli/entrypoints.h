@@ -5,6 +5,8 @@
 #include "mecab/cli/dictionary_compiler.h"
 #include "mecab/cli/dictionary_generator.h"
 #include "mecab/cli/eval.h"
+#include "mecab/cli/pipeline.h"
+#include "mecab/cli/sentence_reader.h"
 #include "mecab/utils.h"
 #include "mecab/utils/param.h"
 #include "mecab/utils/scoped_ptr.h"
@@ -16,11 +18,16 @@ const std::vector<MeCab::Option> mecab_options{
     {"userdic", 'u', "", "FILE", "use FILE as a user dictionary"},
     {"lattice-level", 'l', "0", "INT", "lattice information level (DEPRECATED)"},
     {"dictionary-info", 'D', "", "", "show dictionary information and exit"},
-    {"output-format-type", 'O', "", "TYPE", "set output format type (wakati,none,...)"},
+    {"output-format-type", 'O', "", "TYPE", "set output format type (wakati,none,binary,...)"},
     {"all-morphs", 'a', "", "", "output all morphs(default false)"},
     {"nbest", 'N', "1", "INT", "output N best results (default 1)"},
     {"partial", 'p', "", "", "partial parsing mode (default false)"},
     {"marginal", 'm', "", "", "output marginal probability (default false)"},
+    {"marginal-float", 'f', "", "",
+     "compute marginal probability faster in single precision, within 1e-3 of the exact values (default false)"},
+    {"pruned-marginal", 'g', "", "", "output marginal probability of nodes near the best path only (default false)"},
+    {"marginal-margin", 'G', "10", "FLOAT", "prune nodes less probable than the best path by FLOAT in log (default 10)"},
+    {"surface-only", 's', "", "", "skip dictionary features, which are left empty, so %f and %F formats are not available (default false)"},
     {"max-grouping-size", 'M', "24", "INT", "maximum grouping size for unknown words (default 24)"},
     {"node-format", 'F', "%m\\t%H\\n", "STR", "use STR as the user-defined node format"},
     {"unk-format", 'U', "%m\\t%H\\n", "STR", "use STR as the user-defined unknown node format"},
@@ -33,7 +40,10 @@ const std::vector<MeCab::Option> mecab_options{
     {"allocate-sentence", 'C', "", "", "allocate new memory for input sentence"},
     {"theta", 't', "0.75", "FLOAT", "set temparature parameter theta (default 0.75)"},
     {"cost-factor", 'c', "700", "INT", "set cost factor (default 700)"},
-    {"output", 'o', "", "FILE", "set the output file name"}};
+    {"dictionary-load", 'L', "", "TYPE",
+     "load dictionary files with TYPE, a comma-separated list of prefault, mlock and hugepage (default on demand)"},
+    {"output", 'o', "", "FILE", "set the output file name"},
+    {"threads", 'T', "1", "INT", "analyze sentences with INT threads, keeping the input order (default 1)"}};
 
 inline int mecab_main(int argc, char** argv) {
   MeCab::Param param;
@@ -110,48 +120,60 @@ inline int mecab_main(int argc, char** argv) {
     ibufsize *= 8;
   }
 
-  MeCab::scoped_array<char> ibuf_data(new char[ibufsize]);
-  char* ibuf = ibuf_data.get();
+  const int thread_num = param.get<int>("threads");
+  CHECK_DIE(thread_num > 0 && thread_num <= 512) << "# thread is invalid: " << thread_num;
+
+  const char* sentence = 0;
+  size_t length = 0;
+
+  if (thread_num > 1) {
+    // sentences in mapped files are passed without copying, so the files stay mapped until the pipeline finishes.
+    std::vector<MeCab::SentenceReader*> mapped;
+    MeCab::Pipeline pipeline(model.get(), thread_num, nbest, &*ofs);
+    for (size_t i = 0; i < rest.size(); ++i) {
+      MeCab::SentenceReader* reader = new MeCab::SentenceReader(rest[i].c_str(), ibufsize, partial);
+      CHECK_DIE(reader->good()) << "no such file or directory: " << rest[i];
+      while (reader->next(&sentence, &length)) {
+        pipeline.add(sentence, length, !reader->is_mapped());
+      }
+      if (reader->is_mapped()) {
+        mapped.push_back(reader);
+      } else {
+        delete reader;
+      }
+    }
+    pipeline.finish();
+    for (size_t i = 0; i < mapped.size(); ++i) {
+      delete mapped[i];
+    }
+    return EXIT_SUCCESS;
+  }
 
   MeCab::scoped_ptr<MeCab::Tagger> tagger(MeCab::Tagger::create(model.get()));
 
   CHECK_DIE(tagger.get()) << "cannot create tagger";
 
-  for (size_t i = 0; i < rest.size(); ++i) {
-    MeCab::istream_wrapper ifs(rest[i].c_str());
-    CHECK_DIE(*ifs) << "no such file or directory: " << rest[i];
+  MeCab::scoped_ptr<MeCab::Lattice> lattice(model->createLattice());
+  MeCab::StringBuffer obuf;
 
-    while (true) {
-      if (!partial) {
-        ifs->getline(ibuf, ibufsize);
-      } else {
-        std::string sentence;
-        MeCab::scoped_fixed_array<char, BUF_SIZE> line;
-        for (;;) {
-          if (!ifs->getline(line.get(), line.size())) {
-            ifs->clear(std::ios::eofbit | std::ios::badbit);
-            break;
-          }
-          sentence += line.get();
-          sentence += '\n';
-          if (std::strcmp(line.get(), "EOS") == 0 || line[0] == '\0') {
-            break;
-          }
-        }
-        std::strncpy(ibuf, sentence.c_str(), ibufsize);
-      }
-      if (ifs->eof() && !ibuf[0]) {
-        return false;
-      }
-      if (ifs->fail()) {
-        std::cerr << "input-buffer overflow. "
-                  << "The line is split. use -b #SIZE option." << std::endl;
-        ifs->clear();
+  for (size_t i = 0; i < rest.size(); ++i) {
+    MeCab::SentenceReader reader(rest[i].c_str(), ibufsize, partial);
+    CHECK_DIE(reader.good()) << "no such file or directory: " << rest[i];
+
+    // results are flushed per sentence only for the standard input, which may be interactive.
+    const bool interactive = rest[i] == "-";
+    while (reader.next(&sentence, &length)) {
+      CHECK_DIE(MeCab::analyzeSentence(model.get(), tagger.get(), lattice.get(), nbest, sentence, length, &obuf))
+          << lattice->what();
+      if (interactive || obuf.size() >= MeCab::Pipeline::kFlushSize) {
+        ofs->write(obuf.str(), obuf.size());
+        ofs->flush();
+        obuf.clear();
       }
-      const char* r = (nbest >= 2) ? tagger->parseNBest(nbest, ibuf) : tagger->parse(ibuf);
-      CHECK_DIE(r) << tagger->what();
-      *ofs << r << std::flush;
     }
+    ofs->write(obuf.str(), obuf.size());
+    ofs->flush();
+    obuf.clear();
   }
 
   return EXIT_SUCCESS;
@@ -0,0 +1,201 @@
+#ifndef __MECAB_PIPELINE_H__
+#define __MECAB_PIPELINE_H__
+
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "mecab/common.h"
+#include "mecab/tagger.h"
+#include "mecab/utils/scoped_ptr.h"
+#include "mecab/utils/string_buffer.h"
+#include "mecab/utils/thread.h"
+
+namespace MeCab {
+
+// Analyze a sentence with the request type of the model and append the result to os.
+inline bool analyzeSentence(const Model* model, const Tagger* tagger, Lattice* lattice, size_t nbest,
+                            const char* sentence, size_t length, StringBuffer* os) {
+  lattice->set_request_type(model->request_type());
+  lattice->set_theta(model->theta());
+  lattice->set_margin(model->margin());
+  if (nbest >= 2) {
+    lattice->add_request_type(MECAB_NBEST);
+  }
+  lattice->set_sentence(sentence, length);
+  if (!tagger->parse(lattice)) {
+    return false;
+  }
+  if (nbest >= 2) {
+    return model->writer()->writeNBest(lattice, nbest, os);
+  }
+  return model->writer()->write(lattice, os);
+}
+
+// Reader -> parser pool -> writer pipeline.
+// The caller reads sentences and add()s them. Sentences are batched into chunks, which are
+// analyzed by the worker threads, each with its own Tagger and Lattice over the shared Model.
+// The writer thread puts the results back in the input order and flushes the output stream
+// only after kFlushSize bytes. The number of chunks in flight is bounded, so is the memory.
+class Pipeline {
+ public:
+  static const size_t kChunkSentences = 256;
+  static const size_t kChunkBytes = 64 * 1024;
+  static const size_t kFlushSize = 1024 * 1024;
+
+  Pipeline(const Model* model, size_t thread_num, size_t nbest, std::ostream* os)
+      : chunks_(4 * thread_num),
+        free_(chunks_.size()),
+        input_(chunks_.size()),
+        output_(chunks_.size()),
+        current_(0),
+        next_id_(0),
+        writer_(this, os) {
+    for (size_t i = 0; i < chunks_.size(); ++i) {
+      CHECK_DIE(free_.push(&chunks_[i]));
+    }
+    workers_.resize(thread_num);
+    for (size_t i = 0; i < workers_.size(); ++i) {
+      workers_[i] = new worker_thread(this, model, nbest);
+      workers_[i]->start();
+    }
+    writer_.start();
+  }
+
+  ~Pipeline() { finish(); }
+
+  // Queue a sentence. Block while all chunks are in flight.
+  // Unless |copy| is true, the sentence is not copied and must stay valid until finish().
+  void add(const char* sentence, size_t length, bool copy = true) {
+    if (!current_) {
+      CHECK_DIE(free_.pop(&current_));
+      current_->id = next_id_++;
+      current_->text.clear();
+      current_->sentences.clear();
+      current_->bytes = 0;
+      current_->output.clear();
+    }
+    Sentence s = {copy ? 0 : sentence, current_->text.size(), length};
+    if (copy) {
+      current_->text.append(sentence, length);
+    }
+    current_->sentences.push_back(s);
+    current_->bytes += length;
+    if (current_->sentences.size() >= kChunkSentences || current_->bytes >= kChunkBytes) {
+      dispatch();
+    }
+  }
+
+  // Wait until all queued sentences are written and flushed.
+  void finish() {
+    if (workers_.empty()) {
+      return;
+    }
+    dispatch();
+    input_.close();
+    for (size_t i = 0; i < workers_.size(); ++i) {
+      workers_[i]->join();
+      delete workers_[i];
+    }
+    workers_.clear();
+    output_.close();
+    writer_.join();
+  }
+
+ private:
+  struct Sentence {
+    const char* str;  // 0 if the sentence is copied to Chunk::text at |offset|
+    size_t offset;
+    size_t length;
+  };
+
+  struct Chunk {
+    size_t id;
+    std::string text;
+    std::vector<Sentence> sentences;
+    size_t bytes;
+    StringBuffer output;
+  };
+
+  class worker_thread : public thread {
+   public:
+    worker_thread(Pipeline* pipeline, const Model* model, size_t nbest)
+        : pipeline_(pipeline), model_(model), nbest_(nbest), tagger_(Tagger::create(model)), lattice_(model->createLattice()) {
+      CHECK_DIE(tagger_.get()) << "cannot create tagger";
+    }
+
+    void run() {
+      Chunk* chunk = 0;
+      while (pipeline_->input_.pop(&chunk)) {
+        for (size_t i = 0; i < chunk->sentences.size(); ++i) {
+          const Sentence& s = chunk->sentences[i];
+          const char* str = s.str ? s.str : chunk->text.data() + s.offset;
+          CHECK_DIE(analyzeSentence(model_, tagger_.get(), lattice_.get(), nbest_, str, s.length, &chunk->output))
+              << lattice_->what();
+        }
+        CHECK_DIE(pipeline_->output_.push(chunk));
+      }
+    }
+
+   private:
+    Pipeline* pipeline_;
+    const Model* model_;
+    const size_t nbest_;
+    scoped_ptr<Tagger> tagger_;
+    scoped_ptr<Lattice> lattice_;
+  };
+
+  class writer_thread : public thread {
+   public:
+    writer_thread(Pipeline* pipeline, std::ostream* os) : pipeline_(pipeline), os_(os) {}
+
+    void run() {
+      std::map<size_t, Chunk*> pending;
+      size_t next_id = 0;
+      size_t unflushed = 0;
+      Chunk* chunk = 0;
+      while (pipeline_->output_.pop(&chunk)) {
+        pending[chunk->id] = chunk;
+        for (std::map<size_t, Chunk*>::iterator it = pending.begin(); it != pending.end() && it->first == next_id;
+             it = pending.begin()) {
+          Chunk* c = it->second;
+          os_->write(c->output.str(), c->output.size());
+          unflushed += c->output.size();
+          if (unflushed >= kFlushSize) {
+            os_->flush();
+            unflushed = 0;
+          }
+          pending.erase(it);
+          ++next_id;
+          CHECK_DIE(pipeline_->free_.push(c));
+        }
+      }
+      os_->flush();
+    }
+
+   private:
+    Pipeline* pipeline_;
+    std::ostream* os_;
+  };
+
+  void dispatch() {
+    if (current_) {
+      CHECK_DIE(input_.push(current_));
+      current_ = 0;
+    }
+  }
+
+  std::vector<Chunk> chunks_;
+  BoundedQueue<Chunk*> free_;
+  BoundedQueue<Chunk*> input_;
+  BoundedQueue<Chunk*> output_;
+  Chunk* current_;
+  size_t next_id_;
+  std::vector<worker_thread*> workers_;
+  writer_thread writer_;
+};
+
+}  // namespace MeCab
+
+#endif  // __MECAB_PIPELINE_H__
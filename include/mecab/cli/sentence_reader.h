@@ -0,0 +1,121 @@
+#ifndef __MECAB_SENTENCE_READER_H__
+#define __MECAB_SENTENCE_READER_H__
+
+#include <sys/stat.h>
+
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "mecab/common.h"
+#include "mecab/mmap.h"
+#include "mecab/utils/scoped_ptr.h"
+#include "mecab/utils/stream_wrapper.h"
+
+namespace MeCab {
+
+// Reads sentences of an input file of the mecab command, a line or, in partial mode, lines until "EOS" or an empty
+// line. A regular file is mapped into memory and the returned sentences point into the mapping, so they are not
+// copied and have no length limit; they stay valid while the reader is alive. The standard input and pipes are read
+// through a stream into a buffer of |buffer_size| bytes; the returned sentence is valid until the next call.
+class SentenceReader {
+ public:
+  SentenceReader(const char* filename, size_t buffer_size, bool partial)
+      : partial_(partial), mapped_(false), cur_(0), end_(0), buffer_size_(buffer_size) {
+    struct stat st;
+    if (std::strcmp(filename, "-") != 0 && ::stat(filename, &st) == 0 && S_ISREG(st.st_mode) &&
+        mmap_.open(filename)) {
+      mapped_ = true;
+      cur_ = mmap_.begin();
+      end_ = mmap_.end();
+      if (cur_ != end_) {
+        ::madvise(const_cast<char*>(cur_), end_ - cur_, MADV_SEQUENTIAL);
+      }
+      return;
+    }
+    is_.reset(new istream_wrapper(filename));
+    buffer_.reset(new char[buffer_size_]);
+  }
+
+  bool good() const { return mapped_ || **is_; }
+
+  bool is_mapped() const { return mapped_; }
+
+  // Return false at the end of the input.
+  bool next(const char** sentence, size_t* length) {
+    return mapped_ ? nextMapped(sentence, length) : nextStream(sentence, length);
+  }
+
+ private:
+  bool partial_;
+  bool mapped_;
+  Mmap<char> mmap_;
+  const char* cur_;
+  const char* end_;
+  scoped_ptr<istream_wrapper> is_;
+  scoped_array<char> buffer_;
+  size_t buffer_size_;
+
+  bool nextMapped(const char** sentence, size_t* length) {
+    if (cur_ == end_) {
+      return false;
+    }
+    const char* begin = cur_;
+    for (;;) {
+      const char* line = cur_;
+      const char* eol = static_cast<const char*>(std::memchr(cur_, '\n', end_ - cur_));
+      cur_ = eol ? eol + 1 : end_;
+      if (!partial_) {
+        *sentence = begin;
+        *length = (eol ? eol : end_) - begin;
+        return true;
+      }
+      const size_t size = (eol ? eol : end_) - line;
+      if (cur_ == end_ || size == 0 || (size == 3 && std::strncmp(line, "EOS", 3) == 0)) {
+        break;
+      }
+    }
+    // lines of a partial sentence keep their line breaks.
+    *sentence = begin;
+    *length = cur_ - begin;
+    return true;
+  }
+
+  bool nextStream(const char** sentence, size_t* length) {
+    std::istream* is = is_->operator->();
+    char* buf = buffer_.get();
+    if (!partial_) {
+      is->getline(buf, buffer_size_);
+    } else {
+      std::string str;
+      scoped_fixed_array<char, BUF_SIZE> line;
+      for (;;) {
+        if (!is->getline(line.get(), line.size())) {
+          is->clear(std::ios::eofbit | std::ios::badbit);
+          break;
+        }
+        str += line.get();
+        str += '\n';
+        if (std::strcmp(line.get(), "EOS") == 0 || line[0] == '\0') {
+          break;
+        }
+      }
+      std::strncpy(buf, str.c_str(), buffer_size_);
+    }
+    if (is->eof() && !buf[0]) {
+      return false;
+    }
+    if (is->fail()) {
+      std::cerr << "input-buffer overflow. "
+                << "The line is split. use -b #SIZE option." << std::endl;
+      is->clear();
+    }
+    *sentence = buf;
+    *length = std::strlen(buf);
+    return true;
+  }
+};
+
+}  // namespace MeCab
+
+#endif  // __MECAB_SENTENCE_READER_H__
@@ -20,6 +20,8 @@
 #define MECAB_DEFAULT_RC "/usr/local/etc/mecabrc"
 
 #define DIC_VERSION 102
+#define MATRIX_VERSION 1
+#define PACKAGE_VERSION 1
 
 #define SYS_DIC_FILE "sys.dic"
 #define UNK_DEF_FILE "unk.def"
@@ -36,6 +38,7 @@
 #define MODEL_DEF_FILE "model.def"
 #define MODEL_FILE "model.bin"
 #define DICRC "dicrc"
+#define DIC_PACKAGE_FILE "dic.pack"
 #define BOS_KEY "BOS/EOS"
 
 #define DEFAULT_MAX_GROUPING_SIZE 24
@@ -53,6 +56,7 @@
 #define MAX_INPUT_BUFFER_SIZE (8192 * 640)
 #define BUF_SIZE 8192
 #define DEFAULT_THETA 0.75
+#define DEFAULT_MARGIN 10.0
 
 #ifndef EXIT_FAILURE
 #define EXIT_FAILURE 1
@@ -0,0 +1,387 @@
+#ifndef _MECAB_COMPACT_LATTICE_H_
+#define _MECAB_COMPACT_LATTICE_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "mecab/learner_node.h"
+
+namespace MeCab {
+
+/**
+ * The lattice of a training sentence for mecab-cost-train, stored in a few arrays of indices and feature vectors
+ * instead of LearnerNode and LearnerPath, so that the nodes and paths of the allocator can be freed after a
+ * sentence is read.
+ *
+ * The nodes are in the order of the begin positions and the paths are grouped by the right nodes, in the orders
+ * of the lists of a LearnerTagger, so the viterbi path and eval() are the same as those of EncoderLearnerTagger.
+ * The costs, alpha and beta of the nodes are computed in a buffer for every call of gradient().
+ *
+ * gradient() computes alpha and beta of a node with one max-shifted expsum() over the paths entering or leaving
+ * it instead of pairwise logsumexp(), and reuses exp(score - max) of the right paths for the expectations of the
+ * paths, as forwardbackward_fast() does. The feature vectors are shared by many paths through the feature cache of
+ * EncoderFeatureIndex, so the paths refer to the distinct feature vectors of the lattice, whose costs are summed
+ * and whose expectations are added to |expected| once per vector. The results are equal to the gradient of
+ * EncoderLearnerTagger, which is the reference, up to rounding.
+ */
+class CompactLattice {
+ public:
+  bool empty() const { return nodes_.empty(); }
+
+  // the number of nodes after BOS and paths, which the cost of gradient() is proportional to
+  size_t size() const { return empty() ? 0 : nodes_.size() - 2 + paths_.size(); }
+
+  // the bytes of the arrays
+  size_t memory() const {
+    return nodes_.capacity() * sizeof(nodes_[0]) + paths_.capacity() * sizeof(paths_[0]) +
+           fvectors_.capacity() * sizeof(fvectors_[0]) +
+           (rpaths_.capacity() + end_order_.capacity() + ans_paths_.capacity() + best_.capacity()) *
+               sizeof(uint32_t);
+  }
+
+  /**
+   * Build the lattice from the lists of nodes of a LearnerTagger whose sentence has |len| bytes, and the paths of
+   * the correct answer. The ids of the nodes and the costs of the paths are overwritten with their indices.
+   */
+  void build(const std::vector<LearnerNode*>& begin_node_list,
+             const std::vector<LearnerNode*>& end_node_list,
+             size_t len,
+             const std::vector<LearnerPath*>& ans_path_list,
+             size_t eval_size,
+             size_t unk_eval_size) {
+    std::vector<LearnerNode*> nodes(1, end_node_list[0]);  // BOS
+    for (size_t pos = 0; pos <= len; ++pos) {
+      for (LearnerNode* node = begin_node_list[pos]; node; node = node->bnext) {
+        nodes.push_back(node);
+      }
+    }
+    for (size_t i = 0; i < nodes.size(); ++i) {
+      nodes[i]->id = static_cast<unsigned int>(i);
+    }
+    CHECK_DIE(nodes.back()->stat == MECAB_EOS_NODE) << "the last node is not EOS";
+
+    std::map<std::string, uint32_t> keys;
+    // the feature vectors are numbered in the order they appear, so the order of the sums does not depend on the
+    // addresses
+    std::unordered_map<const int*, uint32_t> fvectors;
+    fvectors_.clear();
+    nodes_.resize(nodes.size() + 1);  // with a sentinel of the ranges of the paths
+    paths_.clear();
+    for (size_t i = 0; i < nodes.size(); ++i) {
+      const LearnerNode* node = nodes[i];
+      node_t& compact = nodes_[i];
+      compact.fvector = fvector(node->fvector, &fvectors);
+      compact.lpath = static_cast<uint32_t>(paths_.size());
+      compact.rlength = node->rlength;
+      compact.stat = node->stat;
+      compact.key[0] = key(node, eval_size, &keys);
+      compact.key[1] = key(node, unk_eval_size, &keys);
+      for (LearnerPath* path = node->lpath; path; path = path->lnext) {
+        path->cost = static_cast<double>(paths_.size());
+        path_t compact_path = {fvector(path->fvector, &fvectors), path->lnode->id, static_cast<uint32_t>(i), 0};
+        paths_.push_back(compact_path);
+      }
+    }
+    nodes_.back().lpath = static_cast<uint32_t>(paths_.size());
+
+    rpaths_.clear();
+    for (size_t i = 0; i < nodes.size(); ++i) {
+      nodes_[i].rpath = static_cast<uint32_t>(rpaths_.size());
+      for (const LearnerPath* path = nodes[i]->rpath; path; path = path->rnext) {
+        rpaths_.push_back(static_cast<uint32_t>(path->cost));
+      }
+    }
+    nodes_.back().rpath = static_cast<uint32_t>(rpaths_.size());
+
+    // is_empty() of LearnerPath
+    for (size_t p = 0; p < paths_.size(); ++p) {
+      const uint32_t r = paths_[p].rnode;
+      const uint32_t l = paths_[p].lnode;
+      paths_[p].empty = ((nodes_[r + 1].rpath == nodes_[r].rpath && nodes_[r].stat != MECAB_EOS_NODE) ||
+                         (nodes_[l + 1].lpath == nodes_[l].lpath && nodes_[l].stat != MECAB_BOS_NODE));
+    }
+
+    end_order_.clear();
+    for (long pos = static_cast<long>(len); pos >= 0; --pos) {
+      for (const LearnerNode* node = end_node_list[pos]; node; node = node->enext) {
+        end_order_.push_back(node->id);
+      }
+    }
+
+    ans_paths_.clear();
+    for (size_t i = 0; i < ans_path_list.size(); ++i) {
+      ans_paths_.push_back(static_cast<uint32_t>(ans_path_list[i]->cost));
+    }
+    best_.clear();
+
+    nodes_.shrink_to_fit();
+    paths_.shrink_to_fit();
+    rpaths_.shrink_to_fit();
+    end_order_.shrink_to_fit();
+    ans_paths_.shrink_to_fit();
+    fvectors_.shrink_to_fit();
+  }
+
+  // Add the expectations of the features with the weights |alpha| to |expected|, and return the loss.
+  double gradient(const double* alpha, double* expected) {
+    const size_t size = nodes_.size() - 1;
+    const uint32_t eos = static_cast<uint32_t>(size - 1);
+    size_t degree = 0;
+    for (uint32_t i = 0; i < size; ++i) {
+      degree = std::max<size_t>(degree, std::max(nodes_[i + 1].lpath - nodes_[i].lpath,
+                                                  nodes_[i + 1].rpath - nodes_[i].rpath));
+    }
+    // the scores of the paths of a node, with room for the blocks of expsum()
+    const size_t scores_size = (degree + EXPSUM_BLOCK_SIZE) / EXPSUM_BLOCK_SIZE * EXPSUM_BLOCK_SIZE;
+    std::vector<double> buffer(size * 4 + paths_.size() + fvectors_.size() * 2 + scores_size, 0.0);
+    double* const node_alpha = &buffer[0];
+    double* const node_beta = node_alpha + size;
+    double* const node_wcost = node_beta + size;
+    double* const node_cost = node_wcost + size;
+    double* const path_cost = node_cost + size;
+    double* const fvector_cost = path_cost + paths_.size();
+    double* const fvector_expected = fvector_cost + fvectors_.size();
+    double* const scores = fvector_expected + fvectors_.size();
+    const uint32_t kNone = 0xffffffff;
+    std::vector<uint32_t> prev(size, kNone);
+
+    for (size_t k = 0; k < fvectors_.size(); ++k) {
+      for (const int* f = fvectors_[k]; *f != -1; ++f) {
+        fvector_cost[k] += alpha[*f];
+      }
+    }
+
+    // viterbi, where BOS is the node 0
+    for (uint32_t i = 1; i < size; ++i) {
+      if (nodes_[i].stat != MECAB_EOS_NODE) {
+        node_wcost[i] = fvector_cost[nodes_[i].fvector];
+      }
+      double bestc = -1e37;
+      for (uint32_t p = nodes_[i].lpath; p < nodes_[i + 1].lpath; ++p) {
+        if (!paths_[p].empty) {
+          path_cost[p] = node_wcost[i] + fvector_cost[paths_[p].fvector];
+        }
+        const double cost = path_cost[p] + node_cost[paths_[p].lnode];
+        if (cost > bestc) {
+          bestc = cost;
+          prev[i] = paths_[p].lnode;
+        }
+      }
+      node_cost[i] = bestc;
+    }
+
+    best_.clear();
+    for (uint32_t i = eos; prev[i] != kNone; i = prev[i]) {
+      best_.push_back(i);
+    }
+    std::reverse(best_.begin(), best_.end());
+
+    for (uint32_t i = 1; i < size; ++i) {
+      const uint32_t begin = nodes_[i].lpath;
+      const uint32_t n = nodes_[i + 1].lpath - begin;
+      if (n == 0) {
+        continue;
+      }
+      for (uint32_t k = 0; k < n; ++k) {
+        scores[k] = path_cost[begin + k] + node_alpha[paths_[begin + k].lnode];
+      }
+      double vmax;
+      const double sum = expsum<double, double>(scores, n, &vmax);
+      node_alpha[i] = vmax + std::log(sum);
+    }
+
+    const double Z = node_alpha[eos];
+
+    // the expectation of a path is exp(alpha(lnode) + score - Z) = exp(score - vmax) * exp(alpha(lnode) + vmax - Z)
+    for (size_t k = 0; k < end_order_.size(); ++k) {
+      const uint32_t i = end_order_[k];
+      const uint32_t begin = nodes_[i].rpath;
+      const uint32_t n = nodes_[i + 1].rpath - begin;
+      if (n == 0) {
+        continue;
+      }
+      for (uint32_t r = 0; r < n; ++r) {
+        const uint32_t p = rpaths_[begin + r];
+        scores[r] = path_cost[p] + node_beta[paths_[p].rnode];
+      }
+      double vmax;
+      const double sum = expsum<double, double>(scores, n, &vmax);
+      node_beta[i] = vmax + std::log(sum);
+      const double scale = std::exp(node_alpha[i] + vmax - Z);
+      for (uint32_t r = 0; r < n; ++r) {
+        const path_t& path = paths_[rpaths_[begin + r]];
+        if (path.empty) {
+          continue;
+        }
+        const double c = scores[r] * scale;
+        fvector_expected[path.fvector] += c;
+        if (nodes_[path.rnode].stat != MECAB_EOS_NODE) {
+          fvector_expected[nodes_[path.rnode].fvector] += c;
+        }
+      }
+    }
+
+    for (size_t k = 0; k < fvectors_.size(); ++k) {
+      const double c = fvector_expected[k];
+      if (c != 0.0) {
+        for (const int* f = fvectors_[k]; *f != -1; ++f) {
+          expected[*f] += c;
+        }
+      }
+    }
+
+    double loss = Z;
+    for (size_t k = 0; k < ans_paths_.size(); ++k) {
+      loss -= path_cost[ans_paths_[k]];
+    }
+
+    return loss;
+  }
+
+  // Compare the viterbi path of the last gradient() with the correct answer, as EncoderLearnerTagger::eval() does.
+  int eval(size_t* crr, size_t* prec, size_t* recall) const {
+    int zeroone = 0;
+
+    // the nodes after BOS, which end with EOS
+    size_t res = 0;
+    size_t ans = 0;
+
+    size_t resp = 0;
+    size_t ansp = 0;
+
+    while (ans + 1 < ans_paths_.size() && res + 1 < best_.size()) {
+      if (resp == ansp) {
+        if (is_equal(answer(ans), best_[res])) {
+          ++(*crr);  // same
+        } else {
+          zeroone = 1;
+        }
+        ++(*prec);
+        ++(*recall);
+        ++res;
+        ++ans;
+        resp += nodes_[best_[res]].rlength;
+        ansp += nodes_[answer(ans)].rlength;
+      } else if (resp < ansp) {
+        ++res;
+        resp += nodes_[best_[res]].rlength;
+        zeroone = 1;
+        ++(*recall);
+      } else {
+        ++ans;
+        ansp += nodes_[answer(ans)].rlength;
+        zeroone = 1;
+        ++(*prec);
+      }
+    }
+
+    for (; ans + 1 < ans_paths_.size(); ++ans) {
+      ++(*prec);
+    }
+
+    for (; res + 1 < best_.size(); ++res) {
+      ++(*recall);
+    }
+
+    return zeroone;
+  }
+
+  // Add |scale| times the features of the correct path.
+  void add_observed(double* vector, double scale) const {
+    for (size_t k = 0; k < ans_paths_.size(); ++k) {
+      const path_t& path = paths_[ans_paths_[k]];
+      for (const int* f = fvectors_[path.fvector]; *f != -1; ++f) {
+        vector[*f] += scale;
+      }
+      if (nodes_[path.rnode].stat != MECAB_EOS_NODE) {
+        for (const int* f = fvectors_[nodes_[path.rnode].fvector]; *f != -1; ++f) {
+          vector[*f] += scale;
+        }
+      }
+    }
+  }
+
+  // Call |func| with the features which gradient() adds to, with duplicates.
+  template <class F>
+  void for_each_feature(F func) const {
+    for (size_t p = 0; p < paths_.size(); ++p) {
+      const path_t& path = paths_[p];
+      if (path.empty) {
+        continue;
+      }
+      for (const int* f = fvectors_[path.fvector]; *f != -1; ++f) {
+        func(*f);
+      }
+      if (nodes_[path.rnode].stat != MECAB_EOS_NODE) {
+        for (const int* f = fvectors_[nodes_[path.rnode].fvector]; *f != -1; ++f) {
+          func(*f);
+        }
+      }
+    }
+  }
+
+ private:
+  struct node_t {
+    uint32_t fvector;  // the index in fvectors_
+    uint32_t lpath;   // the first path whose right node is this node
+    uint32_t rpath;   // the first index of rpaths_ of the paths whose left node is this node
+    uint32_t key[2];  // the surface and the features up to eval-size and unk-eval-size, for node_cmp_eq()
+    unsigned short rlength;
+    unsigned char stat;
+  };
+
+  struct path_t {
+    uint32_t fvector;  // the index in fvectors_
+    uint32_t lnode;
+    uint32_t rnode : 31;
+    uint32_t empty : 1;  // which gradient() skips, as is_empty() of LearnerPath
+  };
+
+  static uint32_t key(const LearnerNode* node, size_t size, std::map<std::string, uint32_t>* keys) {
+    std::string key(node->surface ? node->surface : "", node->surface ? node->length : 0);
+    key += '\0';
+    if (node->feature) {
+      const char* end = node->feature + std::strlen(node->feature);
+      key.append(node->feature, repeat_find_if(node->feature, end, ',', size));
+    }
+    return keys->insert(std::make_pair(key, static_cast<uint32_t>(keys->size()))).first->second;
+  }
+
+  // node_cmp_eq() of the answer |ans| and the system output |res|
+  bool is_equal(uint32_t ans, uint32_t res) const {
+    const int k = nodes_[res].stat == MECAB_UNK_NODE ? 1 : 0;
+    return nodes_[ans].key[k] == nodes_[res].key[k];
+  }
+
+  uint32_t answer(size_t k) const { return paths_[ans_paths_[k]].rnode; }
+
+  // the index of |fvector| in fvectors_, which is added at the first time. BOS has no feature vector.
+  uint32_t fvector(const int* fvector, std::unordered_map<const int*, uint32_t>* fvectors) {
+    if (!fvector) {
+      return 0xffffffff;
+    }
+    std::pair<std::unordered_map<const int*, uint32_t>::iterator, bool> it =
+        fvectors->insert(std::make_pair(fvector, static_cast<uint32_t>(fvectors_.size())));
+    if (it.second) {
+      fvectors_.push_back(fvector);
+    }
+    return it.first->second;
+  }
+
+  std::vector<node_t> nodes_;
+  std::vector<path_t> paths_;
+  std::vector<const int*> fvectors_;  // the distinct feature vectors of the nodes and the paths
+  std::vector<uint32_t> rpaths_;
+  std::vector<uint32_t> end_order_;  // the nodes in the order of the end positions from the last, for beta
+  std::vector<uint32_t> ans_paths_;
+  std::vector<uint32_t> best_;  // the viterbi path of the last gradient() after BOS
+};
+
+}  // namespace MeCab
+
+#endif  // _MECAB_COMPACT_LATTICE_H_
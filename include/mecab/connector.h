@@ -1,41 +1,343 @@
 #ifndef _MECAB_CONNECTOR_H_
 #define _MECAB_CONNECTOR_H_
 
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
 #include "mecab/common.h"
+#include "mecab/data_structure.h"
 #include "mecab/mmap.h"
+#include "mecab/utils/fingerprint.h"
 #include "mecab/utils/param.h"
 #include "mecab/utils/scoped_ptr.h"
+#include "mecab/utils/string_utils.h"
+#include "mecab/utils/thread.h"
 
 namespace MeCab {
 
+namespace {
+const unsigned int MatrixMagicID = 0x584d434du;            // "MCMX"
+const unsigned int CompressedMatrixMagicID = 0x5a4d434du;  // "MCMZ"
+}  // namespace
+
+// Header of matrix.bin, followed by lsize * rsize costs, or by a compressed matrix with CompressedMatrixMagicID.
+// The checksum is fingerprint_blocks() of the data after the header.
+struct MatrixHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t lsize;
+  uint32_t rsize;
+  uint64_t checksum;
+};
+
+// A compressed matrix keeps each distinct row (right context id) and column (left context id) once.
+// The header is followed by
+//   unsigned short columns[lsize]: the column of each left context id
+//   unsigned short rows[rsize]: the row of each right context id
+// and either, with 8-bit deltas,
+//   short bases[row_num]: the minimum cost of each row
+//   unsigned char shifts[row_num]: the deltas of each row are shifted to the left by shifts[row]
+//   unsigned char deltas[row_num * column_num]: cost = bases[row] + (deltas[column + column_num * row] << shifts[row])
+// or the costs as they are
+//   short costs[row_num * column_num]
+// Each array starts at an even offset.
+struct CompressedMatrixHeader {
+  uint32_t row_num;
+  uint32_t column_num;
+  uint32_t delta;
+  uint32_t reserved;
+};
+
 class Connector {
  private:
+  // Parses the lines of matrix.def in [begin, end) into the matrix.
+  class parse_thread : public thread {
+   public:
+    void init(const char* begin, const char* end, unsigned short lsize, unsigned short rsize, short* matrix) {
+      begin_ = begin;
+      end_ = end;
+      lsize_ = lsize;
+      rsize_ = rsize;
+      matrix_ = matrix;
+    }
+
+    void run() {
+      for (const char* p = begin_; p < end_;) {
+        const char* eol = parseLine(p);
+        if (!eol) {
+          return;
+        }
+        p = eol + 1;
+      }
+    }
+
+    const std::string& what() const { return what_; }
+
+   private:
+    const char* begin_;
+    const char* end_;
+    unsigned short lsize_;
+    unsigned short rsize_;
+    short* matrix_;
+    std::string what_;
+
+    // "left right cost" separated by spaces or tabs. The rest of the line is ignored.
+    // Return the end of the line, or NULL on errors.
+    const char* parseLine(const char* begin) {
+      long value[3];
+      const char* p = begin;
+      for (size_t i = 0; i < 3; ++i) {
+        while (p < end_ && (*p == ' ' || *p == '\t')) {
+          ++p;
+        }
+        const char* next = parse_integer(p, end_, &value[i]);
+        if (next == p || (i < 2 && (next == end_ || (*next != ' ' && *next != '\t')))) {
+          what_ = "format error: " + std::string(begin, std::find(begin, end_, '\n'));
+          return 0;
+        }
+        p = next;
+      }
+      const char* eol = std::find(p, end_, '\n');
+      if (value[0] < 0 || value[0] >= lsize_ || value[1] < 0 || value[1] >= rsize_) {
+        what_ = "index values are out of range: " + std::string(begin, eol);
+        return 0;
+      }
+      matrix_[value[0] + static_cast<size_t>(lsize_) * value[1]] = static_cast<short>(value[2]);
+      return eol;
+    }
+  };
+
   scoped_ptr<Mmap<short>> cmmap_;
   short* matrix_;
   unsigned short lsize_;
   unsigned short rsize_;
 
+  // compressed matrix, in which matrix_ is the costs of distinct rows and columns unless deltas_ is set.
+  const unsigned short* columns_;
+  const unsigned short* rows_;
+  const short* bases_;
+  const unsigned char* shifts_;
+  const unsigned char* deltas_;
+  size_t column_num_;
+
+  // the header and the size of the data after it, which verify() checks, or no header in the older format
+  const MatrixHeader* header_;
+  size_t data_size_;
+  std::string filename_;
+
+  static size_t align2(size_t size) { return (size + 1) & ~static_cast<size_t>(1); }
+
+  bool openCompressed(const char* filename, const char* data, size_t size) {
+    CHECK_FALSE(size >= sizeof(CompressedMatrixHeader)) << "file size is invalid: " << filename;
+    const CompressedMatrixHeader* header = reinterpret_cast<const CompressedMatrixHeader*>(data);
+    const size_t row_num = header->row_num;
+    column_num_ = header->column_num;
+
+    size_t offset = sizeof(CompressedMatrixHeader);
+    columns_ = reinterpret_cast<const unsigned short*>(data + offset);
+    offset += sizeof(unsigned short) * lsize_;
+    rows_ = reinterpret_cast<const unsigned short*>(data + offset);
+    offset += sizeof(unsigned short) * rsize_;
+    if (header->delta) {
+      bases_ = reinterpret_cast<const short*>(data + offset);
+      offset += sizeof(short) * row_num;
+      shifts_ = reinterpret_cast<const unsigned char*>(data + offset);
+      offset = align2(offset + row_num);
+      deltas_ = reinterpret_cast<const unsigned char*>(data + offset);
+      offset += row_num * column_num_;
+    } else {
+      matrix_ = reinterpret_cast<short*>(const_cast<char*>(data + offset));
+      offset += sizeof(short) * row_num * column_num_;
+    }
+    CHECK_FALSE(align2(offset) == size) << "file size is invalid: " << filename;
+
+    for (size_t i = 0; i < lsize_; ++i) {
+      CHECK_FALSE(columns_[i] < column_num_) << "matrix file is broken: " << filename;
+    }
+    for (size_t i = 0; i < rsize_; ++i) {
+      CHECK_FALSE(rows_[i] < row_num) << "matrix file is broken: " << filename;
+    }
+    return true;
+  }
+
+  inline int compressed_cost(unsigned short rcAttr, unsigned short lcAttr) const {
+    const size_t row = rows_[lcAttr];
+    const size_t i = columns_[rcAttr] + column_num_ * row;
+    if (deltas_) {
+      return bases_[row] + (deltas_[i] << shifts_[row]);
+    }
+    return matrix_[i];
+  }
+
+  // Compress |matrix| of lsize * rsize costs into |data|, the layout of which is in CompressedMatrixHeader.
+  // Costs are kept as they are unless |delta|. With |delta|, rows whose costs range over more than 255
+  // are rounded to multiples of a power of 2 from their minimum.
+  static void compress(const std::vector<short>& matrix,
+                       unsigned short lsize,
+                       unsigned short rsize,
+                       bool delta,
+                       std::string* data) {
+    // distinct rows, and then distinct columns of the distinct rows
+    std::vector<unsigned short> rows(rsize);
+    std::vector<size_t> row_ids;
+    {
+      std::unordered_map<std::string, unsigned short> ids;
+      for (size_t r = 0; r < rsize; ++r) {
+        const std::string row(reinterpret_cast<const char*>(matrix.data() + lsize * r), sizeof(short) * lsize);
+        std::pair<std::unordered_map<std::string, unsigned short>::iterator, bool> it =
+            ids.insert(std::make_pair(row, static_cast<unsigned short>(row_ids.size())));
+        if (it.second) {
+          row_ids.push_back(r);
+        }
+        rows[r] = it.first->second;
+      }
+    }
+    std::vector<unsigned short> columns(lsize);
+    std::vector<size_t> column_ids;
+    {
+      std::unordered_map<std::string, unsigned short> ids;
+      std::vector<short> column(row_ids.size());
+      for (size_t l = 0; l < lsize; ++l) {
+        for (size_t i = 0; i < row_ids.size(); ++i) {
+          column[i] = matrix[l + lsize * row_ids[i]];
+        }
+        const std::string key(reinterpret_cast<const char*>(column.data()), sizeof(short) * column.size());
+        std::pair<std::unordered_map<std::string, unsigned short>::iterator, bool> it =
+            ids.insert(std::make_pair(key, static_cast<unsigned short>(column_ids.size())));
+        if (it.second) {
+          column_ids.push_back(l);
+        }
+        columns[l] = it.first->second;
+      }
+    }
+
+    const size_t row_num = row_ids.size();
+    const size_t column_num = column_ids.size();
+    CompressedMatrixHeader header = {static_cast<uint32_t>(row_num), static_cast<uint32_t>(column_num), delta, 0};
+    data->assign(reinterpret_cast<const char*>(&header), sizeof(header));
+    data->append(reinterpret_cast<const char*>(columns.data()), sizeof(unsigned short) * lsize);
+    data->append(reinterpret_cast<const char*>(rows.data()), sizeof(unsigned short) * rsize);
+
+    if (!delta) {
+      for (size_t i = 0; i < row_num; ++i) {
+        for (size_t j = 0; j < column_num; ++j) {
+          const short cost = matrix[column_ids[j] + lsize * row_ids[i]];
+          data->append(reinterpret_cast<const char*>(&cost), sizeof(cost));
+        }
+      }
+      std::cout << "compressed " << lsize << "x" << rsize << " matrix into " << column_num << "x" << row_num
+                << std::endl;
+      return;
+    }
+
+    std::vector<short> bases(row_num);
+    std::string shifts(row_num, '\0');
+    std::string deltas(row_num * column_num, '\0');
+    int max_error = 0;
+    for (size_t i = 0; i < row_num; ++i) {
+      int min_cost = 0x7fff;
+      int max_cost = -0x8000;
+      for (size_t j = 0; j < column_num; ++j) {
+        const int cost = matrix[column_ids[j] + lsize * row_ids[i]];
+        min_cost = std::min(min_cost, cost);
+        max_cost = std::max(max_cost, cost);
+      }
+      int shift = 0;
+      while (((max_cost - min_cost) >> shift) > 0xff) {
+        ++shift;
+      }
+      bases[i] = static_cast<short>(min_cost);
+      shifts[i] = static_cast<char>(shift);
+      for (size_t j = 0; j < column_num; ++j) {
+        const int cost = matrix[column_ids[j] + lsize * row_ids[i]];
+        const int d = std::min(0xff, (cost - min_cost + ((1 << shift) >> 1)) >> shift);
+        deltas[j + column_num * i] = static_cast<char>(d);
+        max_error = std::max(max_error, std::abs(min_cost + (d << shift) - cost));
+      }
+    }
+    data->append(reinterpret_cast<const char*>(bases.data()), sizeof(short) * row_num);
+    data->append(shifts);
+    data->resize(align2(data->size()));
+    data->append(deltas);
+    data->resize(align2(data->size()));
+    std::cout << "compressed " << lsize << "x" << rsize << " matrix into " << column_num << "x" << row_num
+              << " with 8-bit deltas (max error " << max_error << ")" << std::endl;
+  }
+
  public:
   bool open(const Param& param) { return open(param.get<std::string>("dicdir")); }
-  bool open(const std::string dicdir) {
+  bool open(const std::string dicdir, int load = 0) {
     const std::string filename = create_filename(dicdir, MATRIX_FILE);
-    return open(filename.c_str());
+    return open(filename.c_str(), "r", load);
+  }
+
+  // |load| is a set of MMAP_* flags.
+  bool open(const char* filename, const char* mode = "r", int load = 0) {
+    CHECK_FALSE(cmmap_->open(filename, mode, load)) << "cannot open: " << filename;
+    CHECK_FALSE(cmmap_->begin()) << "matrix is NULL";
+    const char* begin = reinterpret_cast<const char*>(cmmap_->begin());
+    return openFromArray(filename, begin, begin + cmmap_->file_size());
   }
 
-  bool open(const char* filename, const char* mode = "r") {
-    CHECK_FALSE(cmmap_->open(filename, mode)) << "cannot open: " << filename;
+  // Open matrix.bin in [begin, end), e.g. in a dictionary package, which is kept while the matrix is used.
+  bool openFromArray(const char* filename, const char* begin, const char* end) {
+    const size_t file_size = end - begin;
+    CHECK_FALSE(file_size >= 2 * sizeof(short)) << "file size is invalid: " << filename;
 
-    matrix_ = cmmap_->begin();
+    columns_ = rows_ = 0;
+    bases_ = 0;
+    shifts_ = deltas_ = 0;
+    column_num_ = 0;
+    header_ = 0;
+    data_size_ = 0;
+    filename_ = filename;
 
-    CHECK_FALSE(matrix_) << "matrix is NULL";
-    CHECK_FALSE(cmmap_->size() >= 2) << "file size is invalid: " << filename;
+    // matrix.bin with a header, or the older format which only has the sizes
+    const MatrixHeader* header = reinterpret_cast<const MatrixHeader*>(begin);
+    if (file_size >= sizeof(MatrixHeader) &&
+        (header->magic == MatrixMagicID || header->magic == CompressedMatrixMagicID)) {
+      CHECK_FALSE(header->version == MATRIX_VERSION) << "incompatible version: " << header->version;
+      CHECK_FALSE(header->lsize <= 0xffff && header->rsize <= 0xffff) << "file size is invalid: " << filename;
+      lsize_ = static_cast<unsigned short>(header->lsize);
+      rsize_ = static_cast<unsigned short>(header->rsize);
+      header_ = header;
 
-    lsize_ = static_cast<unsigned short>((*cmmap_)[0]);
-    rsize_ = static_cast<unsigned short>((*cmmap_)[1]);
+      const char* data = begin + sizeof(MatrixHeader);
+      const size_t size = file_size - sizeof(MatrixHeader);
+      data_size_ = size;
+      if (header->magic == CompressedMatrixMagicID) {
+        return openCompressed(filename, data, size);
+      }
+
+      CHECK_FALSE(static_cast<size_t>(lsize_) * rsize_ * sizeof(short) == size) << "file size is invalid: " << filename;
+      matrix_ = reinterpret_cast<short*>(const_cast<char*>(data));
+      return true;
+    }
 
-    CHECK_FALSE(static_cast<size_t>(lsize_ * rsize_ + 2) == cmmap_->size()) << "file size is invalid: " << filename;
+    const short* sizes = reinterpret_cast<const short*>(begin);
+    lsize_ = static_cast<unsigned short>(sizes[0]);
+    rsize_ = static_cast<unsigned short>(sizes[1]);
+
+    CHECK_FALSE(static_cast<size_t>(lsize_ * rsize_ + 2) * sizeof(short) == file_size)
+        << "file size is invalid: " << filename;
+
+    matrix_ = const_cast<short*>(sizes + 2);
+    return true;
+  }
 
-    matrix_ = cmmap_->begin() + 2;
+  /**
+   * Check the checksum of the opened matrix, which reads the whole matrix.
+   * open() checks only the header and the sizes. The older format has no checksum.
+   */
+  bool verify() const {
+    if (!header_) {
+      return true;
+    }
+    const char* data = reinterpret_cast<const char*>(header_ + 1);
+    CHECK_FALSE(fingerprint_blocks(data, data_size_) == header_->checksum) << "matrix file is broken: " << filename_;
     return true;
   }
 
@@ -60,65 +362,165 @@ class Connector {
   void set_left_size(size_t lsize) { lsize_ = lsize; }
   void set_right_size(size_t rsize) { rsize_ = rsize; }
 
+  // The cost of a dense or a compressed matrix. Viterbi and forward-backward choose DenseCost or CompressedCost
+  // once per sentence instead.
   inline int transition_cost(unsigned short rcAttr, unsigned short lcAttr) const {
+    if (rows_) {
+      return compressed_cost(rcAttr, lcAttr);
+    }
     return matrix_[rcAttr + lsize_ * lcAttr];
   }
 
   inline int cost(const Node* lNode, const Node* rNode) const {
-    return matrix_[lNode->rcAttr + lsize_ * rNode->lcAttr] + rNode->wcost;
+    return transition_cost(lNode->rcAttr, rNode->lcAttr) + rNode->wcost;
   }
 
-  // access to raw matrix
-  short* mutable_matrix() { return &matrix_[0]; }
-  const short* matrix() const { return &matrix_[0]; }
+  // cost(lNode, rNode) of a matrix which is not compressed.
+  class DenseCost {
+   public:
+    explicit DenseCost(const Connector* connector) : matrix_(connector->matrix()), lsize_(connector->lsize_) {}
 
-  bool is_valid(size_t lid, size_t rid) const { return (lid >= 0 && lid < rsize_ && rid >= 0 && rid < lsize_); }
+    inline int cost(const Node* lNode, const Node* rNode) const {
+      return matrix_[lNode->rcAttr + lsize_ * rNode->lcAttr] + rNode->wcost;
+    }
 
-  static bool compile(const char* ifile, const char* ofile) {
-    std::ifstream ifs(ifile);
-    std::istringstream iss(MATRIX_DEF_DEFAULT);
-    std::istream* is = &ifs;
+   private:
+    const short* matrix_;
+    unsigned short lsize_;
+  };
 
-    if (!ifs) {
-      std::cerr << ifile << " is not found. minimum setting is used." << std::endl;
-      is = &iss;
+  // cost(lNode, rNode) of a compressed matrix.
+  class CompressedCost {
+   public:
+    explicit CompressedCost(const Connector* connector) : connector_(connector) {
+      CHECK_DIE(connector->is_compressed()) << "matrix is not compressed";
     }
 
-    char* column[4];
-    scoped_fixed_array<char, BUF_SIZE> buf;
+    inline int cost(const Node* lNode, const Node* rNode) const {
+      return connector_->compressed_cost(lNode->rcAttr, rNode->lcAttr) + rNode->wcost;
+    }
 
-    is->getline(buf.get(), buf.size());
+   private:
+    const Connector* connector_;
+  };
 
-    CHECK_DIE(tokenize2(buf.get(), "\t ", column, 2) == 2) << "format error: " << buf.get();
+  bool is_compressed() const { return rows_ != 0; }
+
+  // access to raw matrix, which is not available for a compressed matrix
+  short* mutable_matrix() {
+    CHECK_DIE(!is_compressed()) << "raw matrix is not available for a compressed matrix: " << filename_;
+    return &matrix_[0];
+  }
+  const short* matrix() const {
+    CHECK_DIE(!is_compressed()) << "raw matrix is not available for a compressed matrix: " << filename_;
+    return &matrix_[0];
+  }
+
+  bool is_valid(size_t lid, size_t rid) const { return (lid >= 0 && lid < rsize_ && rid >= 0 && rid < lsize_); }
+
+  /**
+   * Compile matrix.def |ifile| into matrix.bin |ofile| with |thread_num| threads (0 for all processors).
+   * The lines of the mapped input are split into parts which are parsed in parallel straight into the matrix.
+   * Each pair of context ids is expected only once.
+   * |compression| is "dedup" to keep distinct rows and columns once, "delta8" to also store 8-bit deltas,
+   * or "" for the matrix as it is.
+   */
+  static bool compile(const char* ifile,
+                      const char* ofile,
+                      size_t thread_num = 0,
+                      const std::string& compression = "") {
+    CHECK_DIE(compression.empty() || compression == "dedup" || compression == "delta8")
+        << "unknown matrix compression: " << compression;
+
+    Mmap<char> mmap;
+    const char* begin = MATRIX_DEF_DEFAULT;
+    const char* end = begin + std::strlen(begin);
+    if (std::ifstream(ifile)) {
+      CHECK_DIE(mmap.open(ifile)) << "cannot open: " << ifile;
+      begin = mmap.begin();
+      end = mmap.end();
+    } else {
+      std::cerr << ifile << " is not found. minimum setting is used." << std::endl;
+    }
+
+    const char* eol = std::find(begin, end, '\n');
+    std::string header(begin, eol);
+    char* column[2];
+    CHECK_DIE(tokenize2(&header[0], "\t ", column, 2) == 2) << "format error: " << header;
 
     const unsigned short lsize = std::atoi(column[0]);
     const unsigned short rsize = std::atoi(column[1]);
-    std::vector<short> matrix(lsize * rsize);
-    std::fill(matrix.begin(), matrix.end(), 0);
+    std::vector<short> matrix(static_cast<size_t>(lsize) * rsize, 0);
 
     std::cout << "reading " << ifile << " ... " << lsize << "x" << rsize << std::endl;
 
-    while (is->getline(buf.get(), buf.size())) {
-      CHECK_DIE(tokenize2(buf.get(), "\t ", column, 3) == 3) << "format error: " << buf.get();
-      const size_t l = std::atoi(column[0]);
-      const size_t r = std::atoi(column[1]);
-      const int c = std::atoi(column[2]);
-      CHECK_DIE(l < lsize && r < rsize) << "index values are out of range";
-      progress_bar("emitting matrix      ", l + 1, lsize);
-      matrix[(l + lsize * r)] = static_cast<short>(c);
+    if (thread_num == 0) {
+      thread_num = std::max<long>(1, sysconf(_SC_NPROCESSORS_ONLN));
+    }
+    const size_t kMinPartSize = 1 << 20;
+    const char* body = std::min(eol + 1, end);
+    const size_t size = end - body;
+    const size_t part_num = std::max<size_t>(1, std::min(thread_num, size / kMinPartSize));
+
+    // parts end after a line break. the calling thread parses the first part.
+    std::vector<parse_thread> parsers(part_num);
+    const char* part_begin = body;
+    for (size_t i = 0; i < part_num; ++i) {
+      const char* part_end = end;
+      if (i + 1 < part_num) {
+        part_end = std::find(std::max(part_begin, body + size * (i + 1) / part_num), end, '\n');
+        if (part_end < end) {
+          ++part_end;
+        }
+      }
+      parsers[i].init(part_begin, part_end, lsize, rsize, matrix.data());
+      part_begin = part_end;
+    }
+    for (size_t i = 1; i < part_num; ++i) {
+      parsers[i].start();
+    }
+    parsers[0].run();
+    for (size_t i = 1; i < part_num; ++i) {
+      parsers[i].join();
+    }
+    for (size_t i = 0; i < part_num; ++i) {
+      CHECK_DIE(parsers[i].what().empty()) << parsers[i].what();
+    }
+
+    const char* data = reinterpret_cast<const char*>(matrix.data());
+    size_t data_size = matrix.size() * sizeof(short);
+    unsigned int magic = MatrixMagicID;
+    std::string compressed;
+    if (!compression.empty()) {
+      compress(matrix, lsize, rsize, compression == "delta8", &compressed);
+      data = compressed.data();
+      data_size = compressed.size();
+      magic = CompressedMatrixMagicID;
     }
+    MatrixHeader matrix_header = {magic, MATRIX_VERSION, lsize, rsize, fingerprint_blocks(data, data_size)};
 
     std::ofstream ofs(ofile, std::ios::binary | std::ios::out);
     CHECK_DIE(ofs) << "permission denied: " << ofile;
-    ofs.write(reinterpret_cast<const char*>(&lsize), sizeof(unsigned short));
-    ofs.write(reinterpret_cast<const char*>(&rsize), sizeof(unsigned short));
-    ofs.write(reinterpret_cast<const char*>(&matrix[0]), lsize * rsize * sizeof(short));
+    ofs.write(reinterpret_cast<const char*>(&matrix_header), sizeof(matrix_header));
+    ofs.write(data, data_size);
     ofs.close();
 
     return true;
   }
 
-  explicit Connector() : cmmap_(new Mmap<short>), matrix_(0), lsize_(0), rsize_(0) {}
+  explicit Connector()
+      : cmmap_(new Mmap<short>),
+        matrix_(0),
+        lsize_(0),
+        rsize_(0),
+        columns_(0),
+        rows_(0),
+        bases_(0),
+        shifts_(0),
+        deltas_(0),
+        column_num_(0),
+        header_(0),
+        data_size_(0) {}
 
   virtual ~Connector() { this->close(); }
 };
@@ -87,7 +87,26 @@ enum {
    * When this flag is set, tagger internally copies the body of passed
    * sentence into internal buffer.
    */
-  MECAB_ALLOCATE_SENTENCE = 64
+  MECAB_ALLOCATE_SENTENCE = 64,
+
+  /**
+   * Set this flag if you want to obtain marginal probabilities of the nodes near the best path.
+   * Nodes and connections whose best path costs more than MeCab::Lattice::margin() over
+   * the best path in log-probability are pruned, and their MeCab::Node::prob is 0.
+   * Paths are not allocated, so MeCab::Path::prob is not available.
+   * The parsing speed is close to the default mode.
+   * MECAB_MARGINAL_PROB takes precedence over this flag.
+   */
+  MECAB_MARGINAL_PRUNED = 128,
+
+  /**
+   * When this flag is set, the dictionary features are not looked up and
+   * MeCab::Node::feature is an empty string except for BOS/EOS.
+   * Only the boundaries, posid and context ids of tokens are available, and
+   * the feature section of the dictionary is never read.
+   * This flag is ignored with MECAB_PARTIAL, whose constraints are matched against features.
+   */
+  MECAB_SURFACE_ONLY = 256
 };
 
 /**
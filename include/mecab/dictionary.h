@@ -1,13 +1,24 @@
 #ifndef _MECAB_DICTIONARY_H_
 #define _MECAB_DICTIONARY_H_
 
+#include <dirent.h>
+#include <unistd.h>
+
 #include <climits>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <queue>
+#include <unordered_map>
 
 #include "mecab/connector.h"
 #include "mecab/context_id.h"
 #include "mecab/feature_index.h"
 #include "mecab/learner_node.h"
+#include "mecab/utils/fingerprint.h"
+#include "mecab/utils/parallel_sort.h"
 #include "mecab/utils/string_utils.h"
+#include "mecab/utils/thread.h"
 #include "mecab/writer.h"
 
 namespace MeCab {
@@ -44,9 +55,8 @@ int calcCost(const std::string& w,
   size_t mblen = 0;
   const CharInfo cinfo = property->getCharInfo(w.c_str(), w.c_str() + w.size(), &mblen);
   path.rnode->char_type = cinfo.default_type;
-  std::string ufeature, lfeature, rfeature;
-  rewriter->rewrite2(feature, &ufeature, &lfeature, &rfeature);
-  fi->buildUnigramFeature(&path, ufeature.c_str());
+  const FeatureSet& features = rewriter->rewrite_or_empty(feature);
+  fi->buildUnigramFeature(&path, features.ufeature.c_str());
   fi->calcCost(&rnode);
   return tocost(rnode.wcost, factor);
 }
@@ -54,11 +64,6 @@ int calcCost(const std::string& w,
 int progress_bar_darts(size_t current, size_t total) {
   return progress_bar("emitting double-array", current, total);
 }
-
-template <typename T1, typename T2>
-struct pair_1st_cmp : public std::binary_function<bool, T1, T2> {
-  bool operator()(const std::pair<T1, T2>& x1, const std::pair<T1, T2>& x2) { return x1.first < x2.first; }
-};
 }  // namespace
 
 struct Token {
@@ -70,20 +75,758 @@ struct Token {
   unsigned int compound;
 };
 
+// An entry of the lexicon being compiled. The surface is |length| bytes at |key| in a buffer of surfaces.
+struct LexiconEntry {
+  size_t key;
+  unsigned int length;
+  Token token;
+};
+
+// Orders entries by their surfaces, as std::string does.
+struct LexiconEntryCompare {
+  const char* keys;
+  bool operator()(const LexiconEntry& x, const LexiconEntry& y) const {
+    const int r = std::memcmp(keys + x.key, keys + y.key, std::min(x.length, y.length));
+    return r < 0 || (r == 0 && x.length < y.length);
+  }
+};
+
+// Converts CSV lines of a lexicon into tokens.
+// The rewriter, the feature index and iconv keep state, so every thread needs its own converter.
+class LexiconConverter {
+ public:
+  LexiconConverter(const Param& param, const Connector* matrix, const POSIDGenerator* posid)
+      : param_(param), matrix_(matrix), posid_(posid) {
+    const std::string dicdir = param.get<std::string>("dicdir");
+    left_id_file_ = create_filename(dicdir, std::string(LEFT_ID_FILE));
+    right_id_file_ = create_filename(dicdir, std::string(RIGHT_ID_FILE));
+    rewrite_file_ = create_filename(dicdir, std::string(REWRITE_FILE));
+
+    from_ = param.get<std::string>("dictionary-charset");
+    const std::string to = param.get<std::string>("charset");
+    wakati_ = param.get<bool>("wakati");
+    type_ = param.get<int>("type");
+    node_format_ = param.get<std::string>("node-format");
+    factor_ = param.get<int>("cost-factor");
+    CHECK_DIE(factor_ > 0) << "cost factor needs to be positive value";
+
+    // for backward compatibility
+    std::string config_charset = param.get<std::string>("config-charset");
+    if (config_charset.empty()) {
+      config_charset = from_;
+    }
+
+    CHECK_DIE(!from_.empty()) << "input dictionary charset is empty";
+    CHECK_DIE(!to.empty()) << "output dictionary charset is empty";
+
+    CHECK_DIE(iconv_.open(from_.c_str(), to.c_str())) << "iconv_open() failed with from=" << from_ << " to=" << to;
+    CHECK_DIE(config_iconv_.open(config_charset.c_str(), from_.c_str()))
+        << "iconv_open() failed with from=" << config_charset << " to=" << from_;
+
+    if (!node_format_.empty()) {
+      writer_.reset(new Writer);
+      lattice_.reset(new Lattice);
+      os_.reset(new StringBuffer);
+      memset(&node_, 0, sizeof(node_));
+    }
+  }
+
+  // Convert a CSV line into a token. The surface and the feature stored in the dictionary are
+  // surface() and key(); token->feature is left to the caller.
+  // Return false if the entry is discarded.
+  bool convert(char* line, Token* token) {
+    char* col[8];
+    const size_t n = tokenizeCSV(line, col, 5);
+    CHECK_DIE(n == 5) << "format error: " << line;
+
+    w_ = col[0];
+    int lid = toInt(col[1]);
+    int rid = toInt(col[2]);
+    int cost = toInt(col[3]);
+    feature_ = col[4];
+    const int pid = posid_->id(feature_.c_str());
+
+    if (cost == INT_MAX) {
+      CHECK_DIE(type_ == MECAB_USR_DIC) << "cost field should not be empty in sys/unk dic.";
+      if (!rewrite_.get()) {
+        rewrite_.reset(new DictionaryRewriter);
+        rewrite_->open(rewrite_file_.c_str(), &config_iconv_);
+      }
+      if (!fi_.get()) {
+        fi_.reset(new DecoderFeatureIndex);
+        CHECK_DIE(fi_->open(param_)) << "cannot open feature index";
+        property_.reset(new CharProperty);
+        property_->open(create_filename(param_.get<std::string>("dicdir"), CHAR_PROPERTY_FILE));
+        property_->set_charset(from_.c_str());
+      }
+      cost = calcCost(w_, feature_, factor_, fi_.get(), rewrite_.get(), property_.get());
+    }
+
+    if (lid < 0 || rid < 0 || lid == INT_MAX || rid == INT_MAX) {
+      if (!rewrite_.get()) {
+        rewrite_.reset(new DictionaryRewriter);
+        rewrite_->open(rewrite_file_.c_str(), &config_iconv_);
+      }
+
+      std::string ufeature, lfeature, rfeature;
+      CHECK_DIE(rewrite_->rewrite(feature_, &ufeature, &lfeature, &rfeature)) << "rewrite failed: " << feature_;
+
+      if (!cid_.get()) {
+        cid_.reset(new ContextID);
+        cid_->open(left_id_file_.c_str(), right_id_file_.c_str(), &config_iconv_);
+        CHECK_DIE(cid_->left_size() == matrix_->left_size() && cid_->right_size() == matrix_->right_size())
+            << "Context ID files(" << left_id_file_ << " or " << right_id_file_ << " may be broken";
+      }
+
+      lid = cid_->lid(lfeature.c_str());
+      rid = cid_->rid(rfeature.c_str());
+    }
+
+    CHECK_DIE(lid >= 0 && rid >= 0 && matrix_->is_valid(lid, rid))
+        << "invalid ids are found lid=" << lid << " rid=" << rid;
+
+    if (w_.empty()) {
+      std::cerr << "empty word is found, discard this line" << std::endl;
+      return false;
+    }
+
+    if (!iconv_.convert(&feature_)) {
+      std::cerr << "iconv conversion failed. skip this entry" << std::endl;
+      return false;
+    }
+
+    if (type_ != MECAB_UNK_DIC && !iconv_.convert(&w_)) {
+      std::cerr << "iconv conversion failed. skip this entry" << std::endl;
+      return false;
+    }
+
+    if (!node_format_.empty()) {
+      node_.surface = w_.c_str();
+      node_.feature = feature_.c_str();
+      node_.length = w_.size();
+      node_.rlength = w_.size();
+      node_.posid = pid;
+      node_.stat = MECAB_NOR_NODE;
+      lattice_->set_sentence(w_.c_str());
+      os_->clear();
+      CHECK_DIE(writer_->writeNode(lattice_.get(), node_format_.c_str(), &node_, &*os_))
+          << "conversion error: " << feature_ << " with " << node_format_;
+      *os_ << '\0';
+      feature_ = os_->str();
+    }
+
+    key_.clear();
+    if (!wakati_) {
+      key_.append(feature_.c_str(), feature_.size() + 1);
+    }
+
+    token->lcAttr = lid;
+    token->rcAttr = rid;
+    token->posid = pid;
+    token->wcost = cost;
+    token->feature = 0;
+    token->compound = 0;
+    return true;
+  }
+
+  const std::string& surface() const { return w_; }
+  const std::string& key() const { return key_; }
+
+ private:
+  const Param& param_;
+  const Connector* matrix_;
+  const POSIDGenerator* posid_;
+  std::string left_id_file_;
+  std::string right_id_file_;
+  std::string rewrite_file_;
+  std::string from_;
+  bool wakati_;
+  int type_;
+  std::string node_format_;
+  int factor_;
+  Iconv iconv_;
+  Iconv config_iconv_;
+  scoped_ptr<DictionaryRewriter> rewrite_;
+  scoped_ptr<DecoderFeatureIndex> fi_;
+  scoped_ptr<CharProperty> property_;
+  scoped_ptr<ContextID> cid_;
+  scoped_ptr<Writer> writer_;
+  scoped_ptr<Lattice> lattice_;
+  scoped_ptr<StringBuffer> os_;
+  Node node_;
+  std::string w_;
+  std::string feature_;
+  std::string key_;
+};
+
+// Reads the CSV files of a lexicon in chunks of lines, which are converted by |thread_num| threads.
+// next() returns the chunks in the input order, so the entries are the same as with a single thread.
+// The number of chunks in flight is bounded, so is the memory.
+//
+// With a shard cache, the converted chunks of a CSV file are saved by the caller into a shard named after
+// the hashes of the file and of the conversion settings ("shard-salt"), and a later build reads the shard
+// instead of converting the file again.
+class LexiconReader {
+ public:
+  static const size_t kChunkBytes = 1024 * 1024;
+
+  struct Chunk {
+    size_t id;
+    size_t file;         // index of the CSV file
+    bool last;           // the last chunk of the file
+    bool cached;         // read from the shard, already converted
+    std::string shard;   // shard of the CSV file, empty without a shard cache
+    std::string text;
+    std::string keys;                   // surfaces of the entries
+    std::string features;               // features of the entries stored in the dictionary
+    std::vector<LexiconEntry> entries;  // token.feature is an offset in |features|
+  };
+
+  LexiconReader(const Param& param,
+                const std::vector<std::string>& dics,
+                const Connector* matrix,
+                const POSIDGenerator* posid,
+                size_t thread_num,
+                const std::string& shard_prefix = "")
+      : dics_(dics),
+        shard_prefix_(shard_prefix),
+        shard_salt_(param.get<std::string>("shard-salt")),
+        chunks_(4 * thread_num),
+        free_(chunks_.size()),
+        input_(chunks_.size()),
+        output_(chunks_.size()),
+        current_(0),
+        next_id_(0),
+        reader_(this, param.get<int>("type")) {
+    for (size_t i = 0; i < chunks_.size(); ++i) {
+      CHECK_DIE(free_.push(&chunks_[i]));
+    }
+    // converters are created here so that errors in opening them are reported once.
+    workers_.resize(thread_num);
+    for (size_t i = 0; i < workers_.size(); ++i) {
+      workers_[i] = new convert_thread(this, new LexiconConverter(param, matrix, posid));
+    }
+    for (size_t i = 0; i < workers_.size(); ++i) {
+      workers_[i]->start();
+    }
+    reader_.start();
+  }
+
+  ~LexiconReader() {
+    free_.close();
+    input_.close();
+    reader_.join();
+    for (size_t i = 0; i < workers_.size(); ++i) {
+      workers_[i]->join();
+      delete workers_[i];
+    }
+  }
+
+  // Return the next chunk, or 0 after the last chunk of the last file.
+  // The chunk is valid until the next call.
+  const Chunk* next() {
+    if (current_) {
+      const bool done = current_->last && current_->file + 1 == dics_.size();
+      CHECK_DIE(free_.push(current_));
+      current_ = 0;
+      if (done) {
+        return 0;
+      }
+    } else if (dics_.empty()) {
+      return 0;
+    }
+    while (pending_.find(next_id_) == pending_.end()) {
+      Chunk* chunk = 0;
+      CHECK_DIE(output_.pop(&chunk));
+      pending_[chunk->id] = chunk;
+    }
+    current_ = pending_[next_id_];
+    pending_.erase(next_id_++);
+    return current_;
+  }
+
+  // Append the converted |chunk| to a shard.
+  static void writeShard(const Chunk& chunk, std::ostream* os) {
+    const uint64_t sizes[3] = {chunk.keys.size(), chunk.features.size(), chunk.entries.size()};
+    os->write(reinterpret_cast<const char*>(sizes), sizeof(sizes));
+    os->write(chunk.keys.data(), chunk.keys.size());
+    os->write(chunk.features.data(), chunk.features.size());
+    os->write(reinterpret_cast<const char*>(chunk.entries.data()), chunk.entries.size() * sizeof(LexiconEntry));
+  }
+
+  // Remove the shards starting with |shard_prefix| other than |used|.
+  static void pruneShards(const std::string& shard_prefix, const std::vector<std::string>& used) {
+    const size_t slash = shard_prefix.rfind('/');
+    const std::string dir = slash == std::string::npos ? "." : shard_prefix.substr(0, slash);
+    const std::string prefix = shard_prefix.substr(slash + 1);
+    DIR* dp = opendir(dir.c_str());
+    if (!dp) {
+      return;
+    }
+    for (struct dirent* ent = readdir(dp); ent; ent = readdir(dp)) {
+      const std::string name = ent->d_name;
+      const std::string path = create_filename(dir, name);
+      if (name.compare(0, prefix.size(), prefix) == 0 && std::find(used.begin(), used.end(), path) == used.end()) {
+        std::remove(path.c_str());
+      }
+    }
+    closedir(dp);
+  }
+
+ private:
+  // Reads the files into chunks which end at line breaks.
+  class read_thread : public thread {
+   public:
+    read_thread(LexiconReader* reader, int type) : reader_(reader), type_(type) {}
+
+    void run() {
+      const std::vector<std::string>& dics = reader_->dics_;
+      size_t id = 0;
+      for (size_t i = 0; i < dics.size(); ++i) {
+        std::ifstream ifs(dics[i].c_str());
+        std::istringstream iss(UNK_DEF_DEFAULT);
+        std::istream* is = &ifs;
+        if (!ifs) {
+          if (type_ == MECAB_UNK_DIC) {
+            std::cerr << dics[i] << " is not found. minimum setting is used." << std::endl;
+            is = &iss;
+          } else {
+            CHECK_DIE(ifs) << "no such file or directory: " << dics[i];
+          }
+        }
+
+        std::string shard;
+        if (!reader_->shard_prefix_.empty()) {
+          uint64_t fp = fingerprint(UNK_DEF_DEFAULT);
+          CHECK_DIE(is == &iss || fingerprint_file(dics[i].c_str(), &fp)) << "cannot read: " << dics[i];
+          shard = reader_->shard_prefix_ + to_hex(fingerprint(reader_->shard_salt_ + to_hex(fp))) + ".shard";
+          std::ifstream sfs(shard.c_str(), std::ios::binary);
+          if (sfs) {
+            if (!readShard(&sfs, i, shard, &id)) {
+              return;
+            }
+            continue;
+          }
+        }
+
+        // every file has at least one chunk, which may be empty.
+        for (bool last = false; !last;) {
+          Chunk* chunk = 0;
+          if (!reader_->free_.pop(&chunk)) {
+            return;
+          }
+          chunk->id = id++;
+          chunk->file = i;
+          chunk->cached = false;
+          chunk->shard = shard;
+          chunk->text.resize(kChunkBytes);
+          is->read(&chunk->text[0], kChunkBytes);
+          chunk->text.resize(is->gcount());
+          std::string rest;
+          if (*is && chunk->text[chunk->text.size() - 1] != '\n' && std::getline(*is, rest)) {
+            chunk->text += rest;
+            chunk->text += '\n';
+          }
+          last = !*is || is->peek() == EOF;
+          chunk->last = last;
+          CHECK_DIE(reader_->input_.push(chunk));
+        }
+      }
+      reader_->input_.close();
+    }
+
+   private:
+    LexiconReader* reader_;
+    int type_;
+
+    // Read the chunks written by writeShard().
+    bool readShard(std::istream* is, size_t file, const std::string& shard, size_t* id) {
+      for (bool last = false; !last;) {
+        Chunk* chunk = 0;
+        if (!reader_->free_.pop(&chunk)) {
+          return false;
+        }
+        uint64_t sizes[3] = {0, 0, 0};
+        is->read(reinterpret_cast<char*>(sizes), sizeof(sizes));
+        chunk->keys.resize(sizes[0]);
+        chunk->features.resize(sizes[1]);
+        chunk->entries.resize(sizes[2]);
+        is->read(&chunk->keys[0], sizes[0]);
+        is->read(&chunk->features[0], sizes[1]);
+        is->read(reinterpret_cast<char*>(chunk->entries.data()), sizes[2] * sizeof(LexiconEntry));
+        CHECK_DIE(*is) << "shard is broken: " << shard;
+        chunk->id = (*id)++;
+        chunk->file = file;
+        chunk->cached = true;
+        chunk->shard = shard;
+        last = is->peek() == EOF;
+        chunk->last = last;
+        CHECK_DIE(reader_->input_.push(chunk));
+      }
+      return true;
+    }
+  };
+
+  class convert_thread : public thread {
+   public:
+    convert_thread(LexiconReader* reader, LexiconConverter* converter) : reader_(reader), converter_(converter) {}
+
+    void run() {
+      Chunk* chunk = 0;
+      while (reader_->input_.pop(&chunk)) {
+        if (chunk->cached) {
+          CHECK_DIE(reader_->output_.push(chunk));
+          continue;
+        }
+        chunk->keys.clear();
+        chunk->features.clear();
+        chunk->entries.clear();
+        std::string& text = chunk->text;
+        if (!text.empty() && text[text.size() - 1] != '\n') {
+          text += '\n';
+        }
+        char* end = &text[0] + text.size();
+        for (char* line = &text[0]; line < end;) {
+          char* eol = static_cast<char*>(std::memchr(line, '\n', end - line));
+          *eol = '\0';
+          LexiconEntry entry;
+          if (converter_->convert(line, &entry.token)) {
+            entry.key = chunk->keys.size();
+            entry.length = converter_->surface().size();
+            entry.token.feature = chunk->features.size();
+            chunk->keys += converter_->surface();
+            chunk->features += converter_->key();
+            chunk->entries.push_back(entry);
+          }
+          line = eol + 1;
+        }
+        CHECK_DIE(reader_->output_.push(chunk));
+      }
+    }
+
+   private:
+    LexiconReader* reader_;
+    scoped_ptr<LexiconConverter> converter_;
+  };
+
+  const std::vector<std::string>& dics_;
+  const std::string shard_prefix_;
+  const std::string shard_salt_;
+  std::vector<Chunk> chunks_;
+  BoundedQueue<Chunk*> free_;
+  BoundedQueue<Chunk*> input_;
+  BoundedQueue<Chunk*> output_;
+  std::map<size_t, Chunk*> pending_;
+  Chunk* current_;
+  size_t next_id_;
+  std::vector<convert_thread*> workers_;
+  read_thread reader_;
+};
+
+// Entries and features of a lexicon in the input order, which are sorted by the surfaces at the end.
+// The surfaces are packed into one buffer and the tokens are stored in the entries, without an allocation
+// per entry. Once the entries and the features take more than |max_memory| bytes, the entries are sorted
+// into a run in a temporary file and the features are moved to another temporary file. The runs are merged
+// at the end, so only the surfaces of a run are kept in memory.
+//
+// With a feature pool, identical features are stored once and the tokens share their offsets; with
+// SUFFIX_POOL, a feature which is the end of another one is not stored either but points into it.
+// Dictionary::feature() reads either layout as NUL-terminated strings at the offsets of the tokens.
+class LexiconStore {
+ public:
+  enum FeaturePool { NO_POOL, DEDUP_POOL, SUFFIX_POOL };
+
+  LexiconStore(const char* prefix, size_t max_memory, size_t thread_num, FeaturePool pool = NO_POOL)
+      : prefix_(prefix),
+        max_memory_(max_memory),
+        thread_num_(thread_num),
+        pool_(pool),
+        size_(0),
+        feature_size_(0),
+        pooled_(false) {}
+
+  ~LexiconStore() {
+    for (size_t i = 0; i < runs_.size(); ++i) {
+      std::remove(runs_[i].c_str());
+    }
+    if (fofs_.get()) {
+      fofs_.reset(0);
+      std::remove(feature_file().c_str());
+    }
+  }
+
+  void add(const LexiconReader::Chunk& chunk) {
+    const size_t key_base = keys_.size();
+    if (pool_ == NO_POOL) {
+      CHECK_DIE(feature_size_ + chunk.features.size() <= UINT_MAX) << "too large features";
+      for (size_t i = 0; i < chunk.entries.size(); ++i) {
+        LexiconEntry entry = chunk.entries[i];
+        entry.key += key_base;
+        entry.token.feature += feature_size_;
+        entries_.push_back(entry);
+      }
+      features_.append(chunk.features);
+      feature_size_ += chunk.features.size();
+    } else {
+      // token.feature is the id of the feature until the pool is laid out.
+      for (size_t i = 0; i < chunk.entries.size(); ++i) {
+        LexiconEntry entry = chunk.entries[i];
+        entry.key += key_base;
+        const std::string feature(chunk.features.data() + entry.token.feature);
+        std::pair<std::unordered_map<std::string, unsigned int>::iterator, bool> it =
+            feature_ids_.insert(std::make_pair(feature, static_cast<unsigned int>(feature_offsets_.size())));
+        if (it.second) {
+          CHECK_DIE(features_.size() + feature.size() + 1 <= UINT_MAX) << "too large features";
+          feature_offsets_.push_back(features_.size());
+          features_.append(feature.c_str(), feature.size() + 1);
+        }
+        entry.token.feature = it.first->second;
+        entries_.push_back(entry);
+      }
+      feature_size_ = features_.size();
+    }
+    keys_.append(chunk.keys);
+    size_ += chunk.entries.size();
+    if (memory() > max_memory_) {
+      spill();
+    }
+  }
+
+  size_t size() const { return size_; }
+  size_t run_size() const { return runs_.size(); }
+  // the number of distinct features with a feature pool
+  size_t feature_num() const { return feature_offsets_.size(); }
+
+  // the size of the feature section, available after sort() with a feature pool
+  size_t feature_size() const { return feature_size_; }
+
+  // Call f(key, length, token) for all entries sorted by their surfaces.
+  // Entries with the same surface are in the input order.
+  template <typename Function>
+  void sort(Function f) {
+    if (pool_ != NO_POOL && !pooled_) {
+      layoutFeatures();
+    }
+
+    if (runs_.empty()) {
+      LexiconEntryCompare cmp = {keys_.data()};
+      parallel_stable_sort(entries_.begin(), entries_.end(), cmp, thread_num_);
+      for (size_t i = 0; i < entries_.size(); ++i) {
+        f(keys_.data() + entries_[i].key, entries_[i].length, pooledToken(entries_[i].token));
+      }
+      return;
+    }
+
+    spill();
+    std::vector<Run*> runs;
+    for (size_t i = 0; i < runs_.size(); ++i) {
+      runs.push_back(new Run(runs_[i].c_str(), i));
+    }
+    std::priority_queue<Run*, std::vector<Run*>, RunCompare> queue;
+    for (size_t i = 0; i < runs.size(); ++i) {
+      if (runs[i]->next()) {
+        queue.push(runs[i]);
+      }
+    }
+    while (!queue.empty()) {
+      Run* run = queue.top();
+      queue.pop();
+      f(run->key.data(), run->key.size(), pooledToken(run->token));
+      if (run->next()) {
+        queue.push(run);
+      }
+    }
+    for (size_t i = 0; i < runs.size(); ++i) {
+      delete runs[i];
+    }
+  }
+
+  // Write the features in the input order.
+  void writeFeatures(std::ostream* os) {
+    if (fofs_.get()) {
+      fofs_->close();
+      std::ifstream ifs(feature_file().c_str(), std::ios::binary);
+      CHECK_DIE(ifs) << "no such file or directory: " << feature_file();
+      scoped_fixed_array<char, BUF_SIZE> buf;
+      while (ifs.read(buf.get(), buf.size()) || ifs.gcount() > 0) {
+        os->write(buf.get(), ifs.gcount());
+      }
+    }
+    os->write(features_.data(), features_.size());
+  }
+
+ private:
+  // A sorted run read from a temporary file.
+  struct Run {
+    Run(const char* filename, size_t id) : ifs(filename, std::ios::binary), id(id) {
+      CHECK_DIE(ifs) << "no such file or directory: " << filename;
+    }
+
+    bool next() {
+      unsigned int length = 0;
+      if (!ifs.read(reinterpret_cast<char*>(&length), sizeof(length))) {
+        return false;
+      }
+      key.resize(length);
+      ifs.read(&key[0], length);
+      ifs.read(reinterpret_cast<char*>(&token), sizeof(token));
+      CHECK_DIE(ifs) << "temporary file is broken";
+      return true;
+    }
+
+    std::ifstream ifs;
+    size_t id;
+    std::string key;
+    Token token;
+  };
+
+  // The top of the queue is the smallest surface; runs of earlier entries come first among the same surfaces.
+  struct RunCompare {
+    bool operator()(const Run* x, const Run* y) const { return x->key > y->key || (x->key == y->key && x->id > y->id); }
+  };
+
+  // Orders features by their reversed strings, so that a feature precedes the ones ending with it.
+  struct ReversedFeatureCompare {
+    const std::string* features;
+    const std::vector<unsigned int>* offsets;
+    const std::vector<unsigned int>* lengths;
+    bool operator()(unsigned int x, unsigned int y) const {
+      const char* px = features->data() + (*offsets)[x] + (*lengths)[x];
+      const char* py = features->data() + (*offsets)[y] + (*lengths)[y];
+      const size_t n = std::min((*lengths)[x], (*lengths)[y]);
+      for (size_t i = 1; i <= n; ++i) {
+        if (px[-i] != py[-i]) {
+          return static_cast<unsigned char>(px[-i]) < static_cast<unsigned char>(py[-i]);
+        }
+      }
+      return (*lengths)[x] < (*lengths)[y];
+    }
+  };
+
+  // Fix the offsets of the distinct features. With DEDUP_POOL, the features stay in the order of their first
+  // entries. With SUFFIX_POOL, a feature which ends another one, i.e. a prefix of the next one in the reversed
+  // order, points into the end of it.
+  void layoutFeatures() {
+    pooled_ = true;
+    feature_ids_.clear();
+    if (pool_ != SUFFIX_POOL) {
+      return;
+    }
+
+    const size_t n = feature_offsets_.size();
+    std::vector<unsigned int> lengths(n);
+    std::vector<unsigned int> ids(n);
+    for (size_t i = 0; i < n; ++i) {
+      lengths[i] = std::strlen(features_.data() + feature_offsets_[i]);
+      ids[i] = i;
+    }
+    ReversedFeatureCompare cmp = {&features_, &feature_offsets_, &lengths};
+    parallel_stable_sort(ids.begin(), ids.end(), cmp, thread_num_);
+
+    std::string pool;
+    std::vector<unsigned int> offsets(n);
+    for (size_t i = n; i-- > 0;) {
+      const unsigned int id = ids[i];
+      const char* feature = features_.data() + feature_offsets_[id];
+      if (i + 1 < n) {
+        const unsigned int next = ids[i + 1];
+        const char* end = features_.data() + feature_offsets_[next] + lengths[next];
+        if (lengths[id] <= lengths[next] && std::memcmp(end - lengths[id], feature, lengths[id]) == 0) {
+          offsets[id] = offsets[next] + lengths[next] - lengths[id];
+          continue;
+        }
+      }
+      offsets[id] = pool.size();
+      pool.append(feature, lengths[id] + 1);
+    }
+    features_.swap(pool);
+    feature_offsets_.swap(offsets);
+    feature_size_ = features_.size();
+  }
+
+  Token pooledToken(const Token& token) const {
+    if (pool_ == NO_POOL) {
+      return token;
+    }
+    Token pooled = token;
+    pooled.feature = feature_offsets_[token.feature];
+    return pooled;
+  }
+
+  std::string feature_file() const { return prefix_ + ".features"; }
+
+  // pooled features are not counted as they are never spilled.
+  size_t memory() const {
+    return keys_.size() + entries_.size() * sizeof(LexiconEntry) + (pool_ == NO_POOL ? features_.size() : 0);
+  }
+
+  void spill() {
+    if (!entries_.empty()) {
+      LexiconEntryCompare cmp = {keys_.data()};
+      parallel_stable_sort(entries_.begin(), entries_.end(), cmp, thread_num_);
+      runs_.push_back(prefix_ + ".run." + std::to_string(runs_.size()));
+      std::ofstream ofs(runs_.back().c_str(), std::ios::binary);
+      CHECK_DIE(ofs) << "permission denied: " << runs_.back();
+      for (size_t i = 0; i < entries_.size(); ++i) {
+        const LexiconEntry& entry = entries_[i];
+        ofs.write(reinterpret_cast<const char*>(&entry.length), sizeof(entry.length));
+        ofs.write(keys_.data() + entry.key, entry.length);
+        ofs.write(reinterpret_cast<const char*>(&entry.token), sizeof(entry.token));
+      }
+      CHECK_DIE(ofs) << "cannot write: " << runs_.back();
+    }
+    std::vector<LexiconEntry>().swap(entries_);
+    std::string().swap(keys_);
+
+    // pooled features stay in memory until they are laid out.
+    if (pool_ != NO_POOL) {
+      return;
+    }
+    if (!fofs_.get()) {
+      fofs_.reset(new std::ofstream(feature_file().c_str(), std::ios::binary));
+      CHECK_DIE(*fofs_) << "permission denied: " << feature_file();
+    }
+    fofs_->write(features_.data(), features_.size());
+    CHECK_DIE(*fofs_) << "cannot write: " << feature_file();
+    std::string().swap(features_);
+  }
+
+  const std::string prefix_;
+  const size_t max_memory_;
+  const size_t thread_num_;
+  const FeaturePool pool_;
+  size_t size_;
+  size_t feature_size_;
+  bool pooled_;
+  std::string keys_;
+  std::vector<LexiconEntry> entries_;
+  std::string features_;
+  std::unordered_map<std::string, unsigned int> feature_ids_;
+  std::vector<unsigned int> feature_offsets_;
+  std::vector<std::string> runs_;
+  scoped_ptr<std::ofstream> fofs_;
+};
+
 class Dictionary {
  public:
   typedef Darts::DoubleArray::result_pair_type result_type;
 
-  bool open(const std::string file, const char* mode = "r") { return open(file.c_str(), mode); }
+  bool open(const std::string file, const char* mode = "r", int load = 0) { return open(file.c_str(), mode, load); }
 
-  bool open(const char* file, const char* mode = "r") {
+  // |load| is a set of MMAP_* flags.
+  bool open(const char* file, const char* mode = "r", int load = 0) {
     close();
-    filename_.assign(file);
-    CHECK_FALSE(dmmap_->open(file, mode)) << "no such file or directory: " << file;
+    CHECK_FALSE(dmmap_->open(file, mode, load)) << "no such file or directory: " << file;
+    return openFromArray(file, dmmap_->begin(), dmmap_->end());
+  }
 
-    CHECK_FALSE(dmmap_->size() >= 100) << "dictionary file is broken: " << file;
+  // Open a dictionary in [begin, end), e.g. in a dictionary package, which is kept while the dictionary is used.
+  bool openFromArray(const char* file, const char* begin, const char* end) {
+    filename_.assign(file);
+    const size_t size = end - begin;
+    CHECK_FALSE(size >= 100) << "dictionary file is broken: " << file;
 
-    const char* ptr = dmmap_->begin();
+    const char* ptr = begin;
 
     unsigned int dsize;
     unsigned int tsize;
@@ -92,7 +835,7 @@ class Dictionary {
     unsigned int dummy;
 
     read_static<unsigned int>(&ptr, magic);
-    CHECK_FALSE((magic ^ DictionaryMagicID) == dmmap_->size()) << "dictionary file is broken: " << file;
+    CHECK_FALSE((magic ^ DictionaryMagicID) == size) << "dictionary file is broken: " << file;
 
     read_static<unsigned int>(&ptr, version_);
     CHECK_FALSE(version_ == DIC_VERSION) << "incompatible version: " << version_;
@@ -118,7 +861,7 @@ class Dictionary {
     feature_ = ptr;
     ptr += fsize;
 
-    CHECK_FALSE(ptr == dmmap_->end()) << "dictionary file is broken: " << file;
+    CHECK_FALSE(ptr == end) << "dictionary file is broken: " << file;
 
     return true;
   }
@@ -154,38 +897,18 @@ class Dictionary {
   // outputs
   static bool compile(const Param& param, const std::vector<std::string>& dics, const char* output) {
     Connector matrix;
-    scoped_ptr<DictionaryRewriter> rewrite;
-    scoped_ptr<POSIDGenerator> posid;
-    scoped_ptr<DecoderFeatureIndex> fi;
-    scoped_ptr<ContextID> cid;
-    scoped_ptr<Writer> writer;
-    scoped_ptr<Lattice> lattice;
-    scoped_ptr<StringBuffer> os;
-    scoped_ptr<CharProperty> property;
-    Node node;
+    POSIDGenerator posid;
 
     const std::string dicdir = param.get<std::string>("dicdir");
 
     const std::string matrix_file = create_filename(dicdir, std::string(MATRIX_DEF_FILE));
     const std::string matrix_bin_file = create_filename(dicdir, std::string(MATRIX_FILE));
-    const std::string left_id_file = create_filename(dicdir, std::string(LEFT_ID_FILE));
-    const std::string right_id_file = create_filename(dicdir, std::string(RIGHT_ID_FILE));
-    const std::string rewrite_file = create_filename(dicdir, std::string(REWRITE_FILE));
     const std::string pos_id_file = create_filename(dicdir, std::string(POS_ID_FILE));
 
-    std::vector<std::pair<std::string, Token*>> dic;
-
-    size_t offset = 0;
-    unsigned int lexsize = 0;
-    std::string fbuf;
-
     const std::string from = param.get<std::string>("dictionary-charset");
     const std::string to = param.get<std::string>("charset");
     const bool wakati = param.get<bool>("wakati");
     const int type = param.get<int>("type");
-    const std::string node_format = param.get<std::string>("node-format");
-    const int factor = param.get<int>("cost-factor");
-    CHECK_DIE(factor > 0) << "cost factor needs to be positive value";
 
     // for backward compatibility
     std::string config_charset = param.get<std::string>("config-charset");
@@ -193,186 +916,127 @@ class Dictionary {
       config_charset = from;
     }
 
-    CHECK_DIE(!from.empty()) << "input dictionary charset is empty";
-    CHECK_DIE(!to.empty()) << "output dictionary charset is empty";
-
-    Iconv iconv;
-    CHECK_DIE(iconv.open(from.c_str(), to.c_str())) << "iconv_open() failed with from=" << from << " to=" << to;
-
     Iconv config_iconv;
     CHECK_DIE(config_iconv.open(config_charset.c_str(), from.c_str()))
         << "iconv_open() failed with from=" << config_charset << " to=" << from;
 
-    if (!node_format.empty()) {
-      writer.reset(new Writer);
-      lattice.reset(new Lattice);
-      os.reset(new StringBuffer);
-      memset(&node, 0, sizeof(node));
-    }
-
     if (!matrix.openText(matrix_file.c_str()) && !matrix.open(matrix_bin_file.c_str())) {
       matrix.set_left_size(1);
       matrix.set_right_size(1);
     }
 
-    posid.reset(new POSIDGenerator);
-    posid->open(pos_id_file.c_str(), &config_iconv);
+    posid.open(pos_id_file.c_str(), &config_iconv);
 
-    std::istringstream iss(UNK_DEF_DEFAULT);
+    size_t thread_num = param.get<size_t>("threads");
+    if (thread_num == 0) {
+      thread_num = std::max<long>(1, sysconf(_SC_NPROCESSORS_ONLN));
+    }
+    size_t max_memory = param.get<size_t>("sort-buffer") * 1024 * 1024;
+    if (max_memory == 0) {
+      max_memory = static_cast<size_t>(sysconf(_SC_PHYS_PAGES)) * sysconf(_SC_PAGE_SIZE) / 2;
+    }
 
-    for (size_t i = 0; i < dics.size(); ++i) {
-      std::ifstream ifs(dics[i].c_str());
-      std::istream* is = &ifs;
-      if (!ifs) {
-        if (type == MECAB_UNK_DIC) {
-          std::cerr << dics[i] << " is not found. minimum setting is used." << std::endl;
-          is = &iss;
-        } else {
-          CHECK_DIE(ifs) << "no such file or directory: " << dics[i];
-        }
-      }
+    const std::string feature_pool = param.get<std::string>("feature-pool");
+    LexiconStore::FeaturePool pool = LexiconStore::NO_POOL;
+    if (feature_pool == "dedup") {
+      pool = LexiconStore::DEDUP_POOL;
+    } else if (feature_pool == "suffix") {
+      pool = LexiconStore::SUFFIX_POOL;
+    } else {
+      CHECK_DIE(feature_pool.empty()) << "unknown feature pool: " << feature_pool;
+    }
+    if (wakati) {
+      pool = LexiconStore::NO_POOL;
+    }
 
-      std::cout << "reading " << dics[i] << " ... ";
+    // converted CSV files are cached in shards of "shard-cache"/<output>.<hash>.shard
+    std::string shard_prefix;
+    const std::string shard_cache = param.get<std::string>("shard-cache");
+    if (!shard_cache.empty()) {
+      const std::string name(output);
+      shard_prefix = create_filename(shard_cache, name.substr(name.rfind('/') + 1) + ".");
+    }
 
-      scoped_fixed_array<char, BUF_SIZE> line;
+    LexiconStore store(output, max_memory, thread_num, pool);
+    {
+      LexiconReader reader(param, dics, &matrix, &posid, thread_num, shard_prefix);
+      size_t file = dics.size();
       size_t num = 0;
-
-      while (is->getline(line.get(), line.size())) {
-        char* col[8];
-        const size_t n = tokenizeCSV(line.get(), col, 5);
-        CHECK_DIE(n == 5) << "format error: " << line.get();
-
-        std::string w = col[0];
-        int lid = toInt(col[1]);
-        int rid = toInt(col[2]);
-        int cost = toInt(col[3]);
-        std::string feature = col[4];
-        const int pid = posid->id(feature.c_str());
-
-        if (cost == INT_MAX) {
-          CHECK_DIE(type == MECAB_USR_DIC) << "cost field should not be empty in sys/unk dic.";
-          if (!rewrite.get()) {
-            rewrite.reset(new DictionaryRewriter);
-            rewrite->open(rewrite_file.c_str(), &config_iconv);
-            fi.reset(new DecoderFeatureIndex);
-            CHECK_DIE(fi->open(param)) << "cannot open feature index";
-            property.reset(new CharProperty);
-            property->open(create_filename(param.get<std::string>("dicdir"), CHAR_PROPERTY_FILE));
-            property->set_charset(from.c_str());
+      scoped_ptr<std::ofstream> shard;
+      std::vector<std::string> shards;
+      for (const LexiconReader::Chunk* chunk = reader.next(); chunk; chunk = reader.next()) {
+        if (chunk->file != file) {
+          file = chunk->file;
+          std::cout << "reading " << dics[file] << " ... ";
+        }
+        store.add(*chunk);
+        num += chunk->entries.size();
+        if (!chunk->shard.empty() && !chunk->cached) {
+          if (!shard.get()) {
+            shard.reset(new std::ofstream((chunk->shard + ".tmp").c_str(), std::ios::binary));
           }
-          cost = calcCost(w, feature, factor, fi.get(), rewrite.get(), property.get());
+          LexiconReader::writeShard(*chunk, shard.get());
         }
-
-        if (lid < 0 || rid < 0 || lid == INT_MAX || rid == INT_MAX) {
-          if (!rewrite.get()) {
-            rewrite.reset(new DictionaryRewriter);
-            rewrite->open(rewrite_file.c_str(), &config_iconv);
+        if (chunk->last) {
+          std::cout << num << (chunk->cached ? " (cached)" : "") << std::endl;
+          num = 0;
+          if (shard.get()) {
+            shard->close();
+            CHECK_DIE(*shard && std::rename((chunk->shard + ".tmp").c_str(), chunk->shard.c_str()) == 0)
+                << "cannot write: " << chunk->shard;
+            shard.reset(0);
           }
-
-          std::string ufeature, lfeature, rfeature;
-          CHECK_DIE(rewrite->rewrite(feature, &ufeature, &lfeature, &rfeature)) << "rewrite failed: " << feature;
-
-          if (!cid.get()) {
-            cid.reset(new ContextID);
-            cid->open(left_id_file.c_str(), right_id_file.c_str(), &config_iconv);
-            CHECK_DIE(cid->left_size() == matrix.left_size() && cid->right_size() == matrix.right_size())
-                << "Context ID files(" << left_id_file << " or " << right_id_file << " may be broken";
+          if (!chunk->shard.empty()) {
+            shards.push_back(chunk->shard);
           }
-
-          lid = cid->lid(lfeature.c_str());
-          rid = cid->rid(rfeature.c_str());
-        }
-
-        CHECK_DIE(lid >= 0 && rid >= 0 && matrix.is_valid(lid, rid))
-            << "invalid ids are found lid=" << lid << " rid=" << rid;
-
-        if (w.empty()) {
-          std::cerr << "empty word is found, discard this line" << std::endl;
-          continue;
         }
-
-        if (!iconv.convert(&feature)) {
-          std::cerr << "iconv conversion failed. skip this entry" << std::endl;
-          continue;
-        }
-
-        if (type != MECAB_UNK_DIC && !iconv.convert(&w)) {
-          std::cerr << "iconv conversion failed. skip this entry" << std::endl;
-          continue;
-        }
-
-        if (!node_format.empty()) {
-          node.surface = w.c_str();
-          node.feature = feature.c_str();
-          node.length = w.size();
-          node.rlength = w.size();
-          node.posid = pid;
-          node.stat = MECAB_NOR_NODE;
-          lattice->set_sentence(w.c_str());
-          CHECK_DIE(os.get());
-          CHECK_DIE(writer.get());
-          os->clear();
-          CHECK_DIE(writer->writeNode(lattice.get(), node_format.c_str(), &node, &*os))
-              << "conversion error: " << feature << " with " << node_format;
-          *os << '\0';
-          feature = os->str();
-        }
-
-        std::string key;
-        if (!wakati) {
-          key = feature + '\0';
-        }
-
-        Token* token = new Token;
-        token->lcAttr = lid;
-        token->rcAttr = rid;
-        token->posid = pid;
-        token->wcost = cost;
-        token->feature = offset;
-        token->compound = 0;
-        dic.push_back(std::pair<std::string, Token*>(w, token));
-
-        // append to output buffer
-        if (!wakati) {
-          fbuf.append(key.data(), key.size());
-        }
-        offset += key.size();
-
-        ++num;
-        ++lexsize;
       }
-
-      std::cout << num << std::endl;
+      if (!shard_prefix.empty()) {
+        LexiconReader::pruneShards(shard_prefix, shards);
+      }
     }
-
-    if (wakati) {
-      fbuf.append("\0", 1);
+    if (store.run_size() > 0) {
+      std::cout << "merging " << store.run_size() << " sorted runs" << std::endl;
     }
 
-    std::stable_sort(dic.begin(), dic.end(), pair_1st_cmp<std::string, Token*>());
-
+    // surfaces of the double-array and tokens sorted by the surfaces
     size_t bsize = 0;
     size_t idx = 0;
-    std::string prev;
-    std::vector<const char*> str;
+    size_t i = 0;
+    std::string keys;
+    std::vector<size_t> offsets;
     std::vector<size_t> len;
     std::vector<Darts::DoubleArray::result_type> val;
+    std::string tbuf;
+    tbuf.reserve(store.size() * sizeof(Token));
 
-    for (size_t i = 0; i < dic.size(); ++i) {
-      if (i != 0 && prev != dic[i].first) {
-        str.push_back(dic[idx].first.c_str());
-        len.push_back(dic[idx].first.size());
-        val.push_back(bsize + (idx << 8));
-        bsize = 1;
+    store.sort([&](const char* key, size_t length, const Token& token) {
+      if (i == 0 || len.back() != length || std::memcmp(keys.data() + offsets.back(), key, length) != 0) {
+        if (i != 0) {
+          val.push_back(bsize + (idx << 8));
+        }
+        offsets.push_back(keys.size());
+        len.push_back(length);
+        keys.append(key, length);
+        bsize = 0;
         idx = i;
-      } else {
-        ++bsize;
       }
-      prev = dic[i].first;
+      ++bsize;
+      ++i;
+      tbuf.append(reinterpret_cast<const char*>(&token), sizeof(Token));
+    });
+    if (i != 0) {
+      val.push_back(bsize + (idx << 8));
+    }
+    if (pool != LexiconStore::NO_POOL) {
+      std::cout << "pooled " << store.feature_num() << " distinct features in " << store.feature_size() << " bytes"
+                << std::endl;
+    }
+
+    std::vector<const char*> str;
+    for (size_t j = 0; j < offsets.size(); ++j) {
+      str.push_back(keys.data() + offsets[j]);
     }
-    str.push_back(dic[idx].first.c_str());
-    len.push_back(dic[idx].first.size());
-    val.push_back(bsize + (idx << 8));
 
     CHECK_DIE(str.size() == len.size());
     CHECK_DIE(str.size() == val.size());
@@ -381,13 +1045,6 @@ class Dictionary {
     CHECK_DIE(da.build(str.size(), const_cast<char**>(&str[0]), &len[0], &val[0], &progress_bar_darts) == 0)
         << "unknown error in building double-array";
 
-    std::string tbuf;
-    for (size_t i = 0; i < dic.size(); ++i) {
-      tbuf.append(reinterpret_cast<const char*>(dic[i].second), sizeof(Token));
-      delete dic[i].second;
-    }
-    dic.clear();
-
     // needs to be 8byte(64bit) aligned
     while (tbuf.size() % 8 != 0) {
       Token dummy;
@@ -395,12 +1052,13 @@ class Dictionary {
       tbuf.append(reinterpret_cast<const char*>(&dummy), sizeof(Token));
     }
 
+    unsigned int lexsize = store.size();
     unsigned int dummy = 0;
     unsigned int lsize = matrix.left_size();
     unsigned int rsize = matrix.right_size();
     unsigned int dsize = da.unit_size() * da.size();
     unsigned int tsize = tbuf.size();
-    unsigned int fsize = fbuf.size();
+    unsigned int fsize = store.feature_size() + (wakati ? 1 : 0);
 
     unsigned int version = DIC_VERSION;
     char charset[32];
@@ -430,7 +1088,10 @@ class Dictionary {
 
     bofs.write(reinterpret_cast<const char*>(da.array()), da.unit_size() * da.size());
     bofs.write(const_cast<const char*>(tbuf.data()), tbuf.size());
-    bofs.write(const_cast<const char*>(fbuf.data()), fbuf.size());
+    store.writeFeatures(&bofs);
+    if (wakati) {
+      bofs.write("\0", 1);
+    }
 
     // save magic id
     magic = static_cast<unsigned int>(bofs.tellp());
@@ -1,8 +1,8 @@
 #ifndef _MECAB_DICTIONARY_REWRITER_H_
 #define _MECAB_DICTIONARY_REWRITER_H_
 
+#include <deque>
 #include <fstream>
-#include <map>
 #include <string>
 #include <vector>
 
@@ -10,6 +10,7 @@
 #include "mecab/utils/freelist.h"
 #include "mecab/utils/iconv.h"
 #include "mecab/utils/scoped_ptr.h"
+#include "mecab/utils/string_hash_map.h"
 
 namespace MeCab {
 
@@ -146,7 +147,11 @@ class DictionaryRewriter {
   RewriteRules unigram_rewrite_;
   RewriteRules left_rewrite_;
   RewriteRules right_rewrite_;
-  std::map<std::string, FeatureSet> cache_;
+  // the rewritten features of each feature, or 0 if no rule matches it; a deque keeps the FeatureSets in place as
+  // the cache grows
+  StringHashMap<const FeatureSet*> cache_;
+  std::deque<FeatureSet> features_;
+  FeatureSet empty_features_;
 
  public:
   bool open(const char* filename, Iconv* iconv = 0) {
@@ -183,7 +188,10 @@ class DictionaryRewriter {
     }
     return true;
   }
-  void clear() { cache_.clear(); }
+  void clear() {
+    cache_.clear();
+    features_.clear();
+  }
   // without cache
   bool rewrite(const std::string& feature, std::string* ufeature, std::string* lfeature, std::string* rfeature) const {
     scoped_fixed_array<char, BUF_SIZE> buf;
@@ -197,23 +205,32 @@ class DictionaryRewriter {
             right_rewrite_.rewrite(n, const_cast<const char**>(col.get()), rfeature));
   }
 
-  bool rewrite2(const std::string& feature, std::string* ufeature, std::string* lfeature, std::string* rfeature) {
-    std::map<std::string, FeatureSet>::const_iterator it = cache_.find(feature);
-    if (it == cache_.end()) {
-      if (!rewrite(feature, ufeature, lfeature, rfeature))
-        return false;
-      FeatureSet f;
-      f.ufeature = *ufeature;
-      f.lfeature = *lfeature;
-      f.rfeature = *rfeature;
-      cache_.insert(std::pair<std::string, FeatureSet>(feature, f));
-    } else {
-      *ufeature = it->second.ufeature;
-      *lfeature = it->second.lfeature;
-      *rfeature = it->second.rfeature;
+  // with cache; returns 0 if no rule matches. The FeatureSet is valid until clear().
+  const FeatureSet* rewrite2(const char* feature, size_t length) {
+    const FeatureSet* const* cached = cache_.find(feature, length);
+    if (cached) {
+      return *cached;
+    }
+    FeatureSet f;
+    if (!rewrite(std::string(feature, length), &f.ufeature, &f.lfeature, &f.rfeature)) {
+      cache_.insert(feature, length, 0);
+      return 0;
     }
+    features_.push_back(f);
+    cache_.insert(feature, length, &features_.back());
+    return &features_.back();
+  }
+  const FeatureSet* rewrite2(const char* feature) { return rewrite2(feature, std::strlen(feature)); }
+  const FeatureSet* rewrite2(const std::string& feature) { return rewrite2(feature.data(), feature.size()); }
 
-    return true;
+  // with cache; returns empty features if no rule matches, which the dictionary tools accept.
+  const FeatureSet& rewrite_or_empty(const char* feature) {
+    const FeatureSet* features = rewrite2(feature);
+    return features ? *features : empty_features_;
+  }
+  const FeatureSet& rewrite_or_empty(const std::string& feature) {
+    const FeatureSet* features = rewrite2(feature);
+    return features ? *features : empty_features_;
   }
 };
 
@@ -0,0 +1,355 @@
+#ifndef _MECAB_DOCUMENT_H_
+#define _MECAB_DOCUMENT_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "mecab/char_property.h"
+#include "mecab/common.h"
+#include "mecab/lattice.h"
+#include "mecab/model.h"
+#include "mecab/utils/scoped_ptr.h"
+#include "mecab/utils/thread.h"
+
+// sentence punctuation and line breaks in UTF-8
+#define MECAB_DOCUMENT_DELIMITERS "。．！？!?\r\n"
+
+namespace MeCab {
+
+/**
+ * DocumentParser analyzes a whole document as its segments.
+ * The document is split after runs of delimiter characters, which are sentence punctuation and
+ * line breaks by default, and characters of the given CharProperty categories. The segments are
+ * analyzed in parallel and their best paths are joined into the lattice of the document, so the
+ * nodes have offsets in the original document as if it were parsed at once.
+ * Only the best path is available (MECAB_ONE_BEST, optionally with MECAB_ALLOCATE_SENTENCE or
+ * MECAB_SURFACE_ONLY).
+ * The worker threads and their lattices are kept until the parser is destroyed, so that short
+ * documents do not pay for starting threads. parse() is not thread safe.
+ */
+class DocumentParser {
+ public:
+  struct Segment {
+    size_t begin;
+    size_t end;
+  };
+
+  DocumentParser()
+      : model_(0),
+        property_(0),
+        request_type_(0),
+        theta_(0),
+        document_(0),
+        segments_(0),
+        paths_(0),
+        next_(0),
+        generation_(0),
+        active_(0),
+        pending_(0),
+        stopped_(false) {}
+
+  ~DocumentParser() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopped_ = true;
+      job_.notify_all();
+    }
+    for (size_t i = 0; i < workers_.size(); ++i) {
+      workers_[i]->join();
+      delete workers_[i];
+    }
+  }
+
+  /**
+   * @param model model shared with the workers
+   * @param delimiters characters which end a segment, in the charset of the dictionary
+   * @param categories comma-separated names of CharProperty categories which end a segment, e.g. "SPACE"
+   */
+  bool open(const Model& model, const char* delimiters = MECAB_DOCUMENT_DELIMITERS, const char* categories = "") {
+    CHECK_FALSE(model.is_available()) << "Model is not available";
+    model_ = &model;
+    property_ = model.viterbi()->tokenizer()->char_property();
+
+    delimiters_.clear();
+    const char* end = delimiters + std::strlen(delimiters);
+    size_t mblen = 0;
+    for (const char* p = delimiters; p < end; p += mblen) {
+      property_->getCharInfo(p, end, &mblen);
+      CHECK_FALSE(mblen > 0) << "invalid delimiter: " << delimiters;
+      delimiters_.push_back(std::string(p, mblen));
+    }
+
+    categories_ = CharInfo();
+    std::string names(categories);
+    char* col[64];
+    const size_t n = tokenize(&names[0], ",", col, 64);
+    for (size_t i = 0; i < n; ++i) {
+      if (*col[i] == '\0') {
+        continue;
+      }
+      const int id = property_->id(col[i]);
+      CHECK_FALSE(id >= 0) << "unknown category: " << col[i];
+      categories_.type |= 1 << id;
+    }
+
+    return true;
+  }
+
+  /**
+   * Split |len| bytes of |str| into segments.
+   */
+  void split(const char* str, size_t len, std::vector<Segment>* segments) const {
+    segments->clear();
+    const char* end = str + len;
+    const char* begin = str;
+    bool delimited = false;
+    size_t mblen = 0;
+    for (const char* p = str; p < end; p += mblen) {
+      const CharInfo cinfo = property_->getCharInfo(p, end, &mblen);
+      if (mblen == 0) {
+        mblen = 1;
+      }
+      const bool is_delimiter = cinfo.isKindOf(categories_) || isDelimiter(p, mblen);
+      if (delimited && !is_delimiter) {
+        Segment segment = {static_cast<size_t>(begin - str), static_cast<size_t>(p - str)};
+        segments->push_back(segment);
+        begin = p;
+      }
+      delimited = is_delimiter;
+    }
+    if (begin < end || segments->empty()) {
+      Segment segment = {static_cast<size_t>(begin - str), len};
+      segments->push_back(segment);
+    }
+  }
+
+  /**
+   * Analyze the sentence of |lattice| as a document with |thread_num| threads.
+   */
+  bool parse(Lattice* lattice, size_t thread_num = 1) {
+    if (!model_) {
+      lattice->set_what("DocumentParser is not opened");
+      return false;
+    }
+    if (!lattice->sentence()) {
+      return false;
+    }
+    if (lattice->request_type() &
+        (MECAB_NBEST | MECAB_PARTIAL | MECAB_MARGINAL_PROB | MECAB_MARGINAL_PRUNED | MECAB_ALL_MORPHS)) {
+      lattice->set_what("only the best path is available for a document");
+      return false;
+    }
+    if (lattice->has_constraint()) {
+      lattice->set_what("constraints are not available for a document");
+      return false;
+    }
+
+    // segments are analyzed in place, or in a copy if the lattice owns the document.
+    const int request_type = lattice->request_type();
+    const size_t size = lattice->size();
+    const char* document = lattice->sentence();
+    std::string copy;
+    if (lattice->has_request_type(MECAB_ALLOCATE_SENTENCE)) {
+      copy.assign(document, size);
+      document = copy.data();
+    }
+
+    std::vector<Segment> segments;
+    split(document, size, &segments);
+    if (segments.size() == 1) {
+      return model_->viterbi()->analyze(lattice);
+    }
+
+    std::vector<std::vector<Node>> paths(segments.size());
+    thread_num = std::max<size_t>(1, std::min(thread_num, segments.size()));
+    while (workers_.size() + 1 < thread_num) {
+      workers_.push_back(new segment_thread(this));
+      workers_.back()->start();
+    }
+
+    request_type_ = request_type & ~MECAB_ALLOCATE_SENTENCE;
+    theta_ = lattice->theta();
+    document_ = document;
+    segments_ = &segments;
+    paths_ = &paths;
+    next_ = 0;
+    if (thread_num > 1) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      active_ = pending_ = thread_num - 1;
+      ++generation_;
+      job_.notify_all();
+    }
+    // the calling thread is one of the workers and reuses the lattice of the document.
+    std::string what;
+    analyzeSegments(lattice, &what);
+    if (thread_num > 1) {
+      std::unique_lock<std::mutex> lock(mutex_);
+      done_.wait(lock, [this] { return pending_ == 0; });
+    }
+
+    lattice->set_request_type(request_type);
+    lattice->set_sentence(document, size);
+    for (size_t i = 0; what.empty() && i + 1 < thread_num; ++i) {
+      what = workers_[i]->what();
+    }
+    if (!what.empty()) {
+      lattice->set_what(what.c_str());
+      return false;
+    }
+
+    join(lattice, document, paths);
+    return true;
+  }
+
+ private:
+  class segment_thread;
+
+  const Model* model_;
+  const CharProperty* property_;
+  std::vector<std::string> delimiters_;
+  CharInfo categories_;
+
+  // the document being analyzed
+  int request_type_;
+  double theta_;
+  const char* document_;
+  const std::vector<Segment>* segments_;
+  std::vector<std::vector<Node>>* paths_;
+  std::atomic<size_t> next_;
+
+  std::vector<segment_thread*> workers_;
+  std::mutex mutex_;
+  std::condition_variable job_;   // a document is given to the workers, or they are stopped
+  std::condition_variable done_;  // the workers have finished the document
+  unsigned long generation_;      // the number of documents given to the workers
+  size_t active_;                 // the number of workers analyzing the document
+  size_t pending_;                // the number of workers which have not finished the document
+  bool stopped_;
+
+  DocumentParser(const DocumentParser&);
+  DocumentParser& operator=(const DocumentParser&);
+
+  bool isDelimiter(const char* p, size_t mblen) const {
+    for (size_t i = 0; i < delimiters_.size(); ++i) {
+      if (delimiters_[i].size() == mblen && std::memcmp(delimiters_[i].data(), p, mblen) == 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Analyzes the segments of the current document taken in order with |lattice|, and keeps a copy of
+  // their best paths.
+  void analyzeSegments(Lattice* lattice, std::string* what) {
+    lattice->set_request_type(request_type_);
+    lattice->set_theta(theta_);
+    for (size_t i = next_++; i < segments_->size(); i = next_++) {
+      const Segment& segment = (*segments_)[i];
+      lattice->set_sentence(document_ + segment.begin, segment.end - segment.begin);
+      if (!model_->viterbi()->analyze(lattice)) {
+        what->assign(lattice->what());
+        return;
+      }
+      std::vector<Node>& path = (*paths_)[i];
+      for (const Node* node = lattice->bos_node()->next; node->next; node = node->next) {
+        path.push_back(*node);
+      }
+      // the path cost of the segment
+      path.push_back(*lattice->eos_node());
+    }
+  }
+
+  // Waits for the documents of the parser and analyzes their segments with its own lattice.
+  // The first |active_| workers take part in a document.
+  class segment_thread : public thread {
+   public:
+    explicit segment_thread(DocumentParser* parser) : parser_(parser), index_(parser->workers_.size()) {}
+
+    void run() {
+      unsigned long generation = 0;
+      for (;;) {
+        {
+          std::unique_lock<std::mutex> lock(parser_->mutex_);
+          parser_->job_.wait(lock, [this, generation] {
+            return parser_->stopped_ || parser_->generation_ != generation;
+          });
+          if (parser_->stopped_) {
+            return;
+          }
+          generation = parser_->generation_;
+          if (index_ >= parser_->active_) {
+            continue;
+          }
+        }
+        what_.clear();
+        parser_->analyzeSegments(&lattice_, &what_);
+        std::lock_guard<std::mutex> lock(parser_->mutex_);
+        if (--parser_->pending_ == 0) {
+          parser_->done_.notify_one();
+        }
+      }
+    }
+
+    const std::string& what() const { return what_; }
+
+   private:
+    DocumentParser* parser_;
+    const size_t index_;
+    Lattice lattice_;
+    std::string what_;
+  };
+
+  // Link copies of the best paths of the segments in |lattice|.
+  // Costs are accumulated over the segments.
+  void join(Lattice* lattice, const char* document, const std::vector<std::vector<Node>>& paths) const {
+    const Tokenizer<Node, Path>* tokenizer = model_->viterbi()->tokenizer();
+    Allocator<Node, Path>* allocator = lattice->allocator();
+    Node** begin_node_list = lattice->begin_nodes();
+    Node** end_node_list = lattice->end_nodes();
+
+    Node* bos_node = tokenizer->getBOSNode(allocator);
+    bos_node->surface = lattice->sentence();
+    end_node_list[0] = bos_node;
+
+    Node* prev = bos_node;
+    long cost = 0;
+    for (size_t i = 0; i < paths.size(); ++i) {
+      const std::vector<Node>& path = paths[i];
+      for (size_t j = 0; j + 1 < path.size(); ++j) {
+        Node* node = allocator->newNode();
+        const unsigned int id = node->id;
+        *node = path[j];
+        node->id = id;
+        node->prev = prev;
+        node->next = 0;
+        node->enext = 0;
+        node->bnext = 0;
+        node->rpath = 0;
+        node->lpath = 0;
+        const size_t pos = path[j].surface - document;
+        node->surface = lattice->sentence() + pos;
+        node->cost += cost;
+        node->isbest = 1;
+        prev->next = node;
+        begin_node_list[pos] = node;
+        end_node_list[pos + node->length] = node;
+        prev = node;
+      }
+      cost += path.back().cost;
+    }
+
+    Node* eos_node = tokenizer->getEOSNode(allocator);
+    eos_node->surface = lattice->sentence() + lattice->size();
+    eos_node->prev = prev;
+    eos_node->cost = cost;
+    prev->next = eos_node;
+    begin_node_list[lattice->size()] = eos_node;
+  }
+};
+
+}  // namespace MeCab
+
+#endif  // _MECAB_DOCUMENT_H_
@@ -1,6 +1,10 @@
 #ifndef _MECAB_FEATUREINDEX_H_
 #define _MECAB_FEATUREINDEX_H_
 
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
 #include <map>
 #include <vector>
 
@@ -13,6 +17,7 @@
 #include "mecab/utils/freelist.h"
 #include "mecab/utils/param.h"
 #include "mecab/utils/string_buffer.h"
+#include "mecab/utils/string_hash_map.h"
 
 #define BUFSIZE (2048)
 #define POSSIZE (64)
@@ -42,6 +47,7 @@ class FeatureIndex {
   virtual bool buildFeature(LearnerPath* path) = 0;
 
   void set_alpha(const double* alpha) { alpha_ = alpha; }
+  const double* alpha() const { return alpha_; }
 
   size_t size() const { return maxid_; }
 
@@ -192,6 +198,12 @@ class FeatureIndex {
     return q;
   }
 
+  // Compile the text model |txtfile| to the binary model, which is
+  //   uint32    number of features
+  //   char[32]  charset
+  //   double[]  weights
+  //   uint64[]  fingerprints of the features in ascending order, or the buckets of hashed features
+  //   uint64    hash-size, only in a model of hashed features
   static bool convert(const Param& param, const char* txtfile, std::string* output) {
     std::ifstream ifs(txtfile);
     CHECK_DIE(ifs) << "no such file or directory: " << txtfile;
@@ -199,6 +211,7 @@ class FeatureIndex {
     char* column[4];
     std::vector<std::pair<uint64_t, double>> dic;
     std::string model_charset;
+    uint64_t hash_size = 0;
 
     while (ifs.getline(buf.get(), buf.size())) {
       if (std::strlen(buf.get()) == 0) {
@@ -207,6 +220,8 @@ class FeatureIndex {
       CHECK_DIE(tokenize2(buf.get(), ":", column, 2) == 2) << "format error: " << buf.get();
       if (std::string(column[0]) == "charset") {
         model_charset = column[1] + 1;
+      } else if (std::string(column[0]) == "hash-size") {
+        hash_size = std::strtoull(column[1] + 1, 0, 10);
       }
     }
 
@@ -224,16 +239,25 @@ class FeatureIndex {
     if (to.empty()) {
       to = from;
     }
+    // the buckets are of the features in the charset of the model
+    CHECK_DIE(!hash_size || decode_charset(from.c_str()) == decode_charset(to.c_str()))
+        << "hashed features cannot be converted from=" << from << " to=" << to;
 
     Iconv iconv;
     CHECK_DIE(iconv.open(from.c_str(), to.c_str())) << "cannot create model from=" << from << " to=" << to;
 
     while (ifs.getline(buf.get(), buf.size())) {
       CHECK_DIE(tokenize2(buf.get(), "\t", column, 2) == 2) << "format error: " << buf.get();
+      const double alpha = atof(column[0]);
+      if (hash_size) {
+        const uint64_t bucket = std::strtoull(column[1], 0, 10);
+        CHECK_DIE(bucket < hash_size) << "format error: " << buf.get();
+        dic.push_back(std::pair<uint64_t, double>(bucket, alpha));
+        continue;
+      }
       std::string feature = column[1];
       CHECK_DIE(iconv.convert(&feature));
       const uint64_t fp = fingerprint(feature);
-      const double alpha = atof(column[0]);
       dic.push_back(std::pair<uint64_t, double>(fp, alpha));
     }
 
@@ -258,6 +282,10 @@ class FeatureIndex {
       output->append(reinterpret_cast<const char*>(&fp), sizeof(fp));
     }
 
+    if (hash_size) {
+      output->append(reinterpret_cast<const char*>(&hash_size), sizeof(hash_size));
+    }
+
     return true;
   }
   static bool compile(const Param& param, const char* txtfile, const char* binfile) {
@@ -364,14 +392,29 @@ class FeatureIndex {
   }
 };
 
+/**
+ * With the hash-size option, a feature is not given a new id but hashed to one of hash-size buckets by its
+ * fingerprint, so the index keeps no feature strings and the weights are bounded by hash-size whatever the corpus.
+ * Features in the same bucket share a weight. A model of hashed features has the header "hash-size: N", and its keys
+ * are the buckets, which DecoderFeatureIndex looks up with the fingerprints of the features modulo N.
+ */
 class EncoderFeatureIndex : public FeatureIndex {
  public:
-  bool open(const Param& param) { return openTemplate(param); }
+  EncoderFeatureIndex() : hash_size_(0) {}
+
+  bool open(const Param& param) {
+    hash_size_ = param.get<size_t>("hash-size");
+    CHECK_DIE(hash_size_ <= static_cast<size_t>(INT_MAX)) << "hash-size is out of range: " << hash_size_;
+    maxid_ = hash_size_;
+    return openTemplate(param);
+  }
   void close() {
     dic_.clear();
     feature_cache_.clear();
+    fvectors_.clear();
     maxid_ = 0;
   }
+  size_t hash_size() const { return hash_size_; }
   void clear() {}
 
   // TODO(taku): consider charset
@@ -386,6 +429,7 @@ class EncoderFeatureIndex : public FeatureIndex {
     char* column[8];
 
     std::string model_charset;
+    size_t model_hash_size = 0;
 
     while (ifs.getline(buf.get(), buf.size())) {
       if (std::strlen(buf.get()) == 0) {
@@ -394,10 +438,14 @@ class EncoderFeatureIndex : public FeatureIndex {
       CHECK_DIE(tokenize2(buf.get(), ":", column, 2) == 2) << "format error: " << buf.get();
       if (std::string(column[0]) == "charset") {
         model_charset = column[1] + 1;
+      } else if (std::string(column[0]) == "hash-size") {
+        model_hash_size = std::strtoull(column[1] + 1, 0, 10);
       } else {
         param->set(column[0], column[1] + 1, true);
       }
     }
+    CHECK_DIE(model_hash_size == hash_size_)
+        << "hash-size of the model is different. model_hash_size=" << model_hash_size << " hash_size=" << hash_size_;
 
     CHECK_DIE(dic_charset);
     CHECK_DIE(!model_charset.empty()) << "charset is empty";
@@ -410,11 +458,25 @@ class EncoderFeatureIndex : public FeatureIndex {
     CHECK_DIE(maxid_ == 0);
     CHECK_DIE(dic_.empty());
 
+    if (hash_size_) {
+      CHECK_DIE(decode_charset(model_charset.c_str()) == decode_charset(dic_charset))
+          << "hashed features cannot be converted from=" << model_charset << " to=" << dic_charset;
+      maxid_ = hash_size_;
+      alpha->resize(hash_size_);
+      while (ifs.getline(buf.get(), buf.size())) {
+        CHECK_DIE(tokenize2(buf.get(), "\t", column, 2) == 2) << "format error: " << buf.get();
+        const size_t bucket = std::strtoull(column[1], 0, 10);
+        CHECK_DIE(bucket < hash_size_) << "format error: " << buf.get();
+        (*alpha)[bucket] = atof(column[0]);
+      }
+      return true;
+    }
+
     while (ifs.getline(buf.get(), buf.size())) {
       CHECK_DIE(tokenize2(buf.get(), "\t", column, 2) == 2) << "format error: " << buf.get();
       std::string feature = column[1];
       CHECK_DIE(iconv.convert(&feature));
-      dic_.insert(std::make_pair(feature, maxid_++));
+      dic_.insert(feature.data(), feature.size(), maxid_++);
       alpha->push_back(atof(column[0]));
     }
 
@@ -436,8 +498,32 @@ class EncoderFeatureIndex : public FeatureIndex {
     ofs << header;
     ofs << std::endl;
 
-    for (std::map<std::string, int>::const_iterator it = dic_.begin(); it != dic_.end(); ++it) {
-      ofs << alpha_[it->second] << '\t' << it->first << '\n';
+    if (hash_size_) {
+      // the buckets in their order
+      for (size_t i = 0; i < hash_size_; ++i) {
+        if (alpha_[i] != 0.0) {
+          ofs << alpha_[i] << '\t' << i << '\n';
+        }
+      }
+      return true;
+    }
+
+    // a feature which is not in a model has no cost, so the features of zero weights, e.g. of L1 regularization,
+    // are dropped to make the model and its key table smaller
+    // the hash table has no order, so the features are sorted by their keys to keep the model stable
+    std::vector<std::pair<const char*, int>> features;
+    features.reserve(dic_.size());
+    dic_.for_each([this, &features](const char* key, size_t, int id) {
+      if (alpha_[id] != 0.0) {
+        features.push_back(std::make_pair(key, id));
+      }
+    });
+    std::sort(features.begin(), features.end(),
+              [](const std::pair<const char*, int>& a, const std::pair<const char*, int>& b) {
+                return std::strcmp(a.first, b.first) < 0;
+              });
+    for (size_t i = 0; i < features.size(); ++i) {
+      ofs << alpha_[features[i].second] << '\t' << features[i].first << '\n';
     }
 
     return true;
@@ -446,10 +532,9 @@ class EncoderFeatureIndex : public FeatureIndex {
     std::vector<size_t> freqv;
     // count fvector
     freqv.resize(maxid_);
-    for (std::map<std::string, std::pair<const int*, size_t>>::const_iterator it = feature_cache_.begin();
-         it != feature_cache_.end(); ++it) {
-      for (const int* f = it->second.first; *f != -1; ++f) {
-        freqv[*f] += it->second.second;  // freq
+    for (size_t i = 0; i < fvectors_.size(); ++i) {
+      for (const int* f = fvectors_[i].first; *f != -1; ++f) {
+        freqv[*f] += fvectors_[i].second;  // freq
       }
     }
 
@@ -457,6 +542,25 @@ class EncoderFeatureIndex : public FeatureIndex {
       return;
     }
 
+    if (hash_size_) {
+      // the ids are the buckets, so the rare buckets are removed from the feature vectors and keep their ids
+      for (size_t i = 0; i < fvectors_.size(); ++i) {
+        int* to = const_cast<int*>(fvectors_[i].first);
+        for (const int* f = fvectors_[i].first; *f != -1; ++f) {
+          if (freqv[*f] >= freq) {
+            *to++ = *f;
+          }
+        }
+        *to = -1;
+      }
+      for (size_t i = 0; i < observed->size(); ++i) {
+        if (freqv[i] < freq) {
+          (*observed)[i] = 0.0;
+        }
+      }
+      return;
+    }
+
     // make old2new map
     maxid_ = 0;
     std::map<int, int> old2new;
@@ -467,24 +571,22 @@ class EncoderFeatureIndex : public FeatureIndex {
     }
 
     // update dic_
-    for (std::map<std::string, int>::iterator it = dic_.begin(); it != dic_.end();) {
-      std::map<int, int>::const_iterator it2 = old2new.find(it->second);
-      if (it2 != old2new.end()) {
-        it->second = it2->second;
-        ++it;
-      } else {
-        dic_.erase(it++);
+    dic_.filter([&old2new](const char*, size_t, int& id) {
+      std::map<int, int>::const_iterator it = old2new.find(id);
+      if (it == old2new.end()) {
+        return false;
       }
-    }
+      id = it->second;
+      return true;
+    });
 
     // update all fvector
-    for (std::map<std::string, std::pair<const int*, size_t>>::const_iterator it = feature_cache_.begin();
-         it != feature_cache_.end(); ++it) {
-      int* to = const_cast<int*>(it->second.first);
-      for (const int* f = it->second.first; *f != -1; ++f) {
-        std::map<int, int>::const_iterator it2 = old2new.find(*f);
-        if (it2 != old2new.end()) {
-          *to = it2->second;
+    for (size_t i = 0; i < fvectors_.size(); ++i) {
+      int* to = const_cast<int*>(fvectors_[i].first);
+      for (const int* f = fvectors_[i].first; *f != -1; ++f) {
+        std::map<int, int>::const_iterator it = old2new.find(*f);
+        if (it != old2new.end()) {
+          *to = it->second;
           ++to;
         }
       }
@@ -509,50 +611,42 @@ class EncoderFeatureIndex : public FeatureIndex {
   bool buildFeature(LearnerPath* path) {
     path->rnode->wcost = path->cost = 0.0;
 
-    std::string ufeature1;
-    std::string lfeature1;
-    std::string rfeature1;
-    std::string ufeature2;
-    std::string lfeature2;
-    std::string rfeature2;
+    const FeatureSet* feature1 = rewrite_.rewrite2(path->lnode->feature);
+    CHECK_DIE(feature1) << " cannot rewrite pattern: " << path->lnode->feature;
 
-    CHECK_DIE(rewrite_.rewrite2(path->lnode->feature, &ufeature1, &lfeature1, &rfeature1))
-        << " cannot rewrite pattern: " << path->lnode->feature;
-
-    CHECK_DIE(rewrite_.rewrite2(path->rnode->feature, &ufeature2, &lfeature2, &rfeature2))
-        << " cannot rewrite pattern: " << path->rnode->feature;
+    const FeatureSet* feature2 = rewrite_.rewrite2(path->rnode->feature);
+    CHECK_DIE(feature2) << " cannot rewrite pattern: " << path->rnode->feature;
 
+    // the key is built in os_, which buildUnigramFeature() and buildBigramFeature() reuse, so it is inserted with
+    // the index of the fvector before they are called
     {
       os_.clear();
-      os_ << ufeature2 << ' ' << path->rnode->char_type << '\0';
-      const std::string key(os_.str());
-      std::map<std::string, std::pair<const int*, size_t>>::iterator it = feature_cache_.find(key);
-      if (it != feature_cache_.end()) {
-        path->rnode->fvector = it->second.first;
-        it->second.second++;
-      } else {
-        if (!buildUnigramFeature(path, ufeature2.c_str())) {
+      os_ << feature2->ufeature << ' ' << path->rnode->char_type;
+      std::pair<size_t*, bool> cache = feature_cache_.insert(os_.str(), os_.size(), fvectors_.size());
+      if (cache.second) {
+        if (!buildUnigramFeature(path, feature2->ufeature.c_str())) {
           return false;
         }
-        feature_cache_.insert(std::pair<std::string, std::pair<const int*, size_t>>(
-            key, std::pair<const int*, size_t>(path->rnode->fvector, 1)));
+        fvectors_.push_back(std::pair<const int*, size_t>(path->rnode->fvector, 0));
+      } else {
+        path->rnode->fvector = fvectors_[*cache.first].first;
       }
+      fvectors_[*cache.first].second++;
     }
 
     {
       os_.clear();
-      os_ << rfeature1 << ' ' << lfeature2 << '\0';
-      std::string key(os_.str());
-      std::map<std::string, std::pair<const int*, size_t>>::iterator it = feature_cache_.find(key);
-      if (it != feature_cache_.end()) {
-        path->fvector = it->second.first;
-        it->second.second++;
-      } else {
-        if (!buildBigramFeature(path, rfeature1.c_str(), lfeature2.c_str()))
+      os_ << feature1->rfeature << ' ' << feature2->lfeature;
+      std::pair<size_t*, bool> cache = feature_cache_.insert(os_.str(), os_.size(), fvectors_.size());
+      if (cache.second) {
+        if (!buildBigramFeature(path, feature1->rfeature.c_str(), feature2->lfeature.c_str())) {
           return false;
-        feature_cache_.insert(std::pair<std::string, std::pair<const int*, size_t>>(
-            key, std::pair<const int*, size_t>(path->fvector, 1)));
+        }
+        fvectors_.push_back(std::pair<const int*, size_t>(path->fvector, 0));
+      } else {
+        path->fvector = fvectors_[*cache.first].first;
       }
+      fvectors_[*cache.first].second++;
     }
 
     CHECK_DIE(path->fvector) << " fvector is NULL";
@@ -562,21 +656,69 @@ class EncoderFeatureIndex : public FeatureIndex {
   }
   void clearcache() {
     feature_cache_.clear();
+    std::vector<std::pair<const int*, size_t>>().swap(fvectors_);
     rewrite_.clear();
   }
 
+  // the keys of the features in the order of their ids, or no keys for hashed features
+  void keys(std::vector<const char*>* keys) const {
+    if (hash_size_) {
+      keys->clear();
+      return;
+    }
+    keys->assign(maxid_, 0);
+    dic_.for_each([keys](const char* key, size_t, int id) { (*keys)[id] = key; });
+  }
+
+  /**
+   * Add the features of |shard|, which has read other sentences with its own caches, to this index.
+   * The features of |shard| get the ids of this index in the order of their ids in |shard|, so merging the shards
+   * of a corpus in order gives the same ids as reading the whole corpus with this index. The feature vectors of
+   * |shard| are rewritten in place to the new ids and stay in |shard|, which must live as long as they are used.
+   * |shard_observed| is added to |observed| with the new ids. Hashed features keep their ids.
+   */
+  void merge(EncoderFeatureIndex* shard, const std::vector<double>& shard_observed, std::vector<double>* observed) {
+    std::vector<int> old2new(shard->maxid_);
+    if (hash_size_) {
+      CHECK_DIE(shard->hash_size_ == hash_size_) << "hash-size of the shard is different";
+      for (size_t i = 0; i < old2new.size(); ++i) {
+        old2new[i] = static_cast<int>(i);
+      }
+    } else {
+      std::vector<const char*> keys;
+      shard->keys(&keys);
+      for (size_t i = 0; i < keys.size(); ++i) {
+        old2new[i] = id(keys[i]);
+      }
+    }
+
+    for (size_t i = 0; i < shard->fvectors_.size(); ++i) {
+      for (int* f = const_cast<int*>(shard->fvectors_[i].first); *f != -1; ++f) {
+        *f = old2new[*f];
+      }
+      fvectors_.push_back(shard->fvectors_[i]);
+    }
+
+    observed->resize(std::max(observed->size(), maxid_));
+    for (size_t i = 0; i < shard_observed.size(); ++i) {
+      (*observed)[old2new[i]] += shard_observed[i];
+    }
+  }
+
  private:
-  std::map<std::string, int> dic_;
-  std::map<std::string, std::pair<const int*, size_t>> feature_cache_;
+  StringHashMap<int> dic_;
+  StringHashMap<size_t> feature_cache_;                  // the index in fvectors_ of a key
+  std::vector<std::pair<const int*, size_t>> fvectors_;  // the feature vectors and their frequencies
+  size_t hash_size_;                                     // the number of buckets, 0 unless features are hashed
   int id(const char* key) {
-    std::map<std::string, int>::const_iterator it = dic_.find(key);
-    if (it == dic_.end()) {
-      dic_.insert(std::pair<std::string, int>(std::string(key), maxid_));
-      return maxid_++;
-    } else {
-      return it->second;
+    if (hash_size_) {
+      return static_cast<int>(fingerprint(key, std::strlen(key)) % hash_size_);
+    }
+    std::pair<int*, bool> it = dic_.insert(key, static_cast<int>(maxid_));
+    if (it.second) {
+      ++maxid_;
     }
-    return -1;
+    return *it.first;
   }
 };
 
@@ -606,24 +748,17 @@ class DecoderFeatureIndex : public FeatureIndex {
   bool buildFeature(LearnerPath* path) {
     path->rnode->wcost = path->cost = 0.0;
 
-    std::string ufeature1;
-    std::string lfeature1;
-    std::string rfeature1;
-    std::string ufeature2;
-    std::string lfeature2;
-    std::string rfeature2;
-
-    CHECK_DIE(rewrite_.rewrite2(path->lnode->feature, &ufeature1, &lfeature1, &rfeature1))
-        << " cannot rewrite pattern: " << path->lnode->feature;
+    const FeatureSet* feature1 = rewrite_.rewrite2(path->lnode->feature);
+    CHECK_DIE(feature1) << " cannot rewrite pattern: " << path->lnode->feature;
 
-    CHECK_DIE(rewrite_.rewrite2(path->rnode->feature, &ufeature2, &lfeature2, &rfeature2))
-        << " cannot rewrite pattern: " << path->rnode->feature;
+    const FeatureSet* feature2 = rewrite_.rewrite2(path->rnode->feature);
+    CHECK_DIE(feature2) << " cannot rewrite pattern: " << path->rnode->feature;
 
-    if (!buildUnigramFeature(path, ufeature2.c_str())) {
+    if (!buildUnigramFeature(path, feature2->ufeature.c_str())) {
       return false;
     }
 
-    if (!buildBigramFeature(path, rfeature1.c_str(), lfeature2.c_str())) {
+    if (!buildBigramFeature(path, feature1->rfeature.c_str(), feature2->lfeature.c_str())) {
       return false;
     }
 
@@ -639,7 +774,7 @@ class DecoderFeatureIndex : public FeatureIndex {
     maxid_ = static_cast<size_t>(maxid);
     const size_t file_size = static_cast<size_t>(end - begin);
     const size_t expected_file_size = (sizeof(double) + sizeof(uint64_t)) * maxid_ + sizeof(maxid) + 32;
-    if (expected_file_size != file_size) {
+    if (expected_file_size != file_size && expected_file_size + sizeof(hash_size_) != file_size) {
       return false;
     }
     charset_ = ptr;
@@ -647,6 +782,14 @@ class DecoderFeatureIndex : public FeatureIndex {
     alpha_ = reinterpret_cast<const double*>(ptr);
     ptr += (sizeof(alpha_[0]) * maxid_);
     key_ = reinterpret_cast<const uint64_t*>(ptr);
+    ptr += (sizeof(key_[0]) * maxid_);
+    hash_size_ = 0;
+    if (ptr != end) {
+      std::memcpy(&hash_size_, ptr, sizeof(hash_size_));
+      if (hash_size_ == 0) {
+        return false;
+      }
+    }
     return true;
   }
   bool openBinaryModel(const Param& param) {
@@ -669,7 +812,10 @@ class DecoderFeatureIndex : public FeatureIndex {
     return openFromArray(model_buffer_.data(), model_buffer_.data() + model_buffer_.size());
   }
   int id(const char* key) {
-    const uint64_t fp = fingerprint(key, std::strlen(key));
+    uint64_t fp = fingerprint(key, std::strlen(key));
+    if (hash_size_) {
+      fp %= hash_size_;
+    }
     const uint64_t* result = std::lower_bound(key_, key_ + maxid_, fp);
     if (result == key_ + maxid_ || *result != fp) {
       return -1;
@@ -683,6 +829,7 @@ class DecoderFeatureIndex : public FeatureIndex {
   std::string model_buffer_;
   const uint64_t* key_;
   const char* charset_;
+  uint64_t hash_size_;  // the number of buckets of a model of hashed features, or 0
 };
 }  // namespace MeCab
 
@@ -21,6 +21,7 @@ class Lattice {
       : sentence_(0),
         size_(0),
         theta_(DEFAULT_THETA),
+        margin_(DEFAULT_MARGIN),
         Z_(0.0),
         request_type_(MECAB_ONE_BEST),
         allocator_(new Allocator<Node, Path>) {
@@ -31,6 +32,7 @@ class Lattice {
 
   /**
    * Clear all internal lattice data.
+   * theta and margin are parameters of the request and are kept.
    */
   void clear() {
     allocator_->free();
@@ -39,7 +41,6 @@ class Lattice {
     feature_constraint_.clear();
     boundary_constraint_.clear();
     size_ = 0;
-    theta_ = DEFAULT_THETA;
     Z_ = 0.0;
     sentence_ = 0;
   };
@@ -154,6 +155,20 @@ class Lattice {
    */
   float theta() const { return theta_; }
 
+  /**
+   * Set pruning margin of MECAB_MARGINAL_PRUNED mode.
+   * Nodes whose best path is less probable than the best path by more than |margin|
+   * in log-probability are pruned.
+   * @param margin pruning margin.
+   */
+  void set_margin(float margin) { margin_ = margin; }
+
+  /**
+   * Return pruning margin of MECAB_MARGINAL_PRUNED mode.
+   * @return pruning margin.
+   */
+  float margin() const { return margin_; }
+
   /**
    * Obtain next-best result. The internal linked list structure is updated.
    * You should set MECAB_NBEST reques_type in advance.
@@ -392,6 +407,7 @@ class Lattice {
   const char* sentence_;
   size_t size_;
   double theta_;
+  double margin_;
   double Z_;
   int request_type_;
   std::string what_;
@@ -260,6 +260,27 @@ class Mcsrch {
         stmin(0.0),
         stmax(0.0) {}
 
+  // visits the state between two calls of mcsrch(), see LBFGS::serialize()
+  template <class Archive>
+  void serialize(Archive* ar) {
+    ar->value(&infoc);
+    ar->value(&stage1);
+    ar->value(&brackt);
+    ar->value(&finit);
+    ar->value(&dginit);
+    ar->value(&dgtest);
+    ar->value(&width);
+    ar->value(&width1);
+    ar->value(&stx);
+    ar->value(&fx);
+    ar->value(&dgx);
+    ar->value(&sty);
+    ar->value(&fy);
+    ar->value(&dgy);
+    ar->value(&stmin);
+    ar->value(&stmax);
+  }
+
   void mcsrch(int size,
               double* x,
               double f,
@@ -269,8 +290,7 @@ class Mcsrch {
               int* info,
               int* nfev,
               double* wa,
-              bool orthant,
-              double C) {
+              bool orthant) {
     const double p5 = 0.5;
     const double p66 = 0.66;
     const double xtrapf = 4.0;
@@ -332,26 +352,10 @@ class Mcsrch {
       }
 
       if (orthant) {
+        // g is the pseudo-gradient, and a step does not cross the orthant of wa, or of -g for a zero
         for (int j = 1; j <= size; ++j) {
-          double grad_neg = 0.0;
-          double grad_pos = 0.0;
-          double grad = 0.0;
-          if (wa[j] == 0.0) {
-            grad_neg = g[j] - 1.0 / C;
-            grad_pos = g[j] + 1.0 / C;
-          } else {
-            grad_pos = grad_neg = g[j] + 1.0 * sigma(wa[j]) / C;
-          }
-          if (grad_neg > 0.0) {
-            grad = grad_neg;
-          } else if (grad_pos < 0.0) {
-            grad = grad_pos;
-          } else {
-            grad = 0.0;
-          }
-          const double p = pi(s[j], -grad);
-          const double xi = wa[j] == 0.0 ? sigma(-grad) : sigma(wa[j]);
-          x[j] = pi(wa[j] + *stp * p, xi);
+          const double xi = wa[j] == 0.0 ? sigma(-g[j]) : sigma(wa[j]);
+          x[j] = pi(wa[j] + *stp * s[j], xi);
         }
       } else {
         for (int j = 1; j <= size; ++j) {
@@ -448,22 +452,37 @@ class LBFGS {
     stp = stp1 = 0.0;
     diag_.clear();
     w_.clear();
+    v_.clear();
     delete mcsrch_;
     mcsrch_ = 0;
   }
 
+  /**
+   * Minimize f whose gradient at x is g. With |orthant|, f also has the L1 penalty sum |x_i| / C, which g excludes,
+   * and it is minimized by OWL-QN (Andrew and Gao, 2007) which keeps the weights which do not pay for the penalty
+   * at exactly zero.
+   */
   int optimize(size_t size, double* x, double f, double* g, bool orthant, double C) {
     static const int msize = 5;
     if (w_.empty()) {
       iflag_ = 0;
       w_.resize(size * (2 * msize + 1) + 2 * msize);
       diag_.resize(size);
+      if (orthant) {
+        v_.resize(size);
+      }
     } else if (diag_.size() != size) {
       std::cerr << "size of array is different" << std::endl;
       return -1;
     }
 
-    lbfgs_optimize(static_cast<int>(size), msize, x, f, g, &diag_[0], &w_[0], orthant, C, &iflag_);
+    const double* v = g;
+    if (orthant) {
+      pseudo_gradient(size, x, g, C, &v_[0]);
+      v = &v_[0];
+    }
+
+    lbfgs_optimize(static_cast<int>(size), msize, x, f, g, v, &diag_[0], &w_[0], orthant, &iflag_);
 
     if (iflag_ < 0) {
       std::cerr << "routine stops with unexpected error" << std::endl;
@@ -478,23 +497,78 @@ class LBFGS {
     return 1;  // evaluate next f and g
   }
 
+  /**
+   * Visit the state of the optimization between two calls of optimize() with ar->value(int*),
+   * ar->value(double*) and ar->array(std::vector<double>*), which either save or restore it, so that another
+   * instance can resume the optimization exactly where this one stopped.
+   */
+  template <class Archive>
+  void serialize(Archive* ar) {
+    ar->value(&iflag_);
+    ar->value(&iscn);
+    ar->value(&nfev);
+    ar->value(&iycn);
+    ar->value(&point);
+    ar->value(&npt);
+    ar->value(&iter);
+    ar->value(&info);
+    ar->value(&ispt);
+    ar->value(&isyt);
+    ar->value(&iypt);
+    ar->value(&stp);
+    ar->value(&stp1);
+    ar->array(&diag_);
+    ar->array(&w_);
+    ar->array(&v_);
+    int search = mcsrch_ != 0;
+    ar->value(&search);
+    if (!search) {
+      delete mcsrch_;
+      mcsrch_ = 0;
+      return;
+    }
+    if (!mcsrch_) {
+      mcsrch_ = new Mcsrch;
+    }
+    mcsrch_->serialize(ar);
+  }
+
  private:
   int iflag_, iscn, nfev, iycn, point, npt;
   int iter, info, ispt, isyt, iypt;
   double stp, stp1;
   std::vector<double> diag_;
   std::vector<double> w_;
+  std::vector<double> v_;
   Mcsrch* mcsrch_;
 
+  // the gradient of f with the L1 penalty at x, whose element at a zero weight is the one-sided derivative
+  // which decreases f, or 0 if neither side does
+  static void pseudo_gradient(size_t size, const double* x, const double* g, double C, double* v) {
+    for (size_t i = 0; i < size; ++i) {
+      if (x[i] == 0.0) {
+        if (g[i] + 1.0 / C < 0.0) {
+          v[i] = g[i] + 1.0 / C;
+        } else if (g[i] - 1.0 / C > 0.0) {
+          v[i] = g[i] - 1.0 / C;
+        } else {
+          v[i] = 0.0;
+        }
+      } else {
+        v[i] = g[i] + sigma(x[i]) / C;
+      }
+    }
+  }
+
   void lbfgs_optimize(int size,
                       int msize,
                       double* x,
                       double f,
                       const double* g,
+                      const double* v,
                       double* diag,
                       double* w,
                       bool orthant,
-                      double C,
                       int* iflag) {
     double yy = 0.0;
     double ys = 0.0;
@@ -503,6 +577,7 @@ class LBFGS {
 
     --diag;
     --g;
+    --v;
     --x;
     --w;
 
@@ -526,9 +601,9 @@ class LBFGS {
       ispt = size + (msize << 1);
       iypt = ispt + size * msize;
       for (int i = 1; i <= size; ++i) {
-        w[ispt + i] = -g[i] * diag[i];
+        w[ispt + i] = -v[i] * diag[i];
       }
-      stp1 = 1.0 / std::sqrt(ddot_(size, &g[1], &g[1]));
+      stp1 = 1.0 / std::sqrt(ddot_(size, &v[1], &v[1]));
     }
 
     // MAIN ITERATION LOOP
@@ -556,7 +631,7 @@ class LBFGS {
       w[size + cp] = 1.0 / ys;
 
       for (int i = 1; i <= size; ++i) {
-        w[i] = -g[i];
+        w[i] = -v[i];
       }
 
       bound = std::min(iter - 1, msize);
@@ -591,6 +666,13 @@ class LBFGS {
         }
       }
 
+      // CONSTRAIN THE DIRECTION TO THE ORTHANT OF THE STEEPEST DESCENT
+      if (orthant) {
+        for (int i = 1; i <= size; ++i) {
+          w[i] = pi(w[i], -v[i]);
+        }
+      }
+
       // STORE THE NEW SEARCH DIRECTION
       for (int i = 1; i <= size; ++i) {
         w[ispt + point * size + i] = w[i];
@@ -609,7 +691,7 @@ class LBFGS {
       }
 
     L172:
-      mcsrch_->mcsrch(size, &x[1], f, &g[1], &w[ispt + point * size + 1], &stp, &info, &nfev, &diag[1], orthant, C);
+      mcsrch_->mcsrch(size, &x[1], f, &v[1], &w[ispt + point * size + 1], &stp, &info, &nfev, &diag[1], orthant);
       if (info == -1) {
         *iflag = 1;  // next value
         return;
@@ -631,7 +713,7 @@ class LBFGS {
         point = 0;
       }
 
-      double gnorm = std::sqrt(ddot_(size, &g[1], &g[1]));
+      double gnorm = std::sqrt(ddot_(size, &v[1], &v[1]));
       double xnorm = std::max(1.0, std::sqrt(ddot_(size, &x[1], &x[1])));
       if (gnorm / xnorm <= eps) {
         *iflag = 0;  // OK terminated
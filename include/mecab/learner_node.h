@@ -78,7 +78,7 @@ inline bool node_cmp_eq(const LearnerNode& node1, const LearnerNode& node2, size
   return false;
 }
 
-inline bool is_empty(LearnerPath* path) {
+inline bool is_empty(const LearnerPath* path) {
   return ((!path->rnode->rpath && path->rnode->stat != MECAB_EOS_NODE) ||
           (!path->lnode->lpath && path->lnode->stat != MECAB_BOS_NODE));
 }
@@ -6,6 +6,7 @@
 #include <vector>
 
 #include "mecab.h"
+#include "mecab/compact_lattice.h"
 #include "mecab/feature_index.h"
 #include "mecab/tokenizer.h"
 #include "mecab/utils/freelist.h"
@@ -24,6 +25,21 @@ char* mystrdup(const char* str) {
 class LearnerTagger {
  public:
   bool empty() const { return (len_ == 0); }
+
+  // the number of nodes and paths in the lattice, which the cost of gradient() is proportional to
+  size_t lattice_size() const {
+    size_t size = 0;
+    for (size_t pos = 0; pos < begin_node_list_.size(); ++pos) {
+      for (const LearnerNode* node = begin_node_list_[pos]; node; node = node->bnext) {
+        ++size;
+        for (const LearnerPath* path = node->lpath; path; path = path->lnext) {
+          ++size;
+        }
+      }
+    }
+    return size;
+  }
+
   void close() {}
   void clear() {}
 
@@ -231,7 +247,8 @@ class EncoderLearnerTagger : public LearnerTagger {
         node->wcost = 0.0;
         node->bnext = begin_node_list_[pos];
         begin_node_list_[pos] = node;
-        std::cout << "adding virtual node: " << node->feature << std::endl;
+        // one write, as the sentences can be read by several threads
+        std::cout << ("adding virtual node: " + std::string(node->feature) + "\n") << std::flush;
       }
 
       pos += corpus[i]->length;
@@ -299,7 +316,32 @@ class EncoderLearnerTagger : public LearnerTagger {
 
     return true;
   }
+  /**
+   * Move the lattice into a CompactLattice, which gradient() and eval() use after this. The tagger does not refer
+   * to the nodes and the paths of the allocator any more, so the allocator can be freed for the next sentence.
+   */
+  void compact() {
+    lattice_.build(begin_node_list_, end_node_list_, len_, ans_path_list_, eval_size_, unk_eval_size_);
+    std::vector<LearnerNode*>().swap(begin_node_list_);
+    std::vector<LearnerNode*>().swap(end_node_list_);
+    std::vector<LearnerPath*>().swap(ans_path_list_);
+    begin_data_.reset();
+    begin_ = 0;
+  }
+
+  // the bytes of the lattice after compact()
+  size_t lattice_memory() const { return lattice_.memory(); }
+
+  // Use the weights of |feature_index| after the features of the sentence are merged into it.
+  void set_feature_index(FeatureIndex* feature_index) { feature_index_ = feature_index; }
+
+  size_t lattice_size() const { return lattice_.empty() ? LearnerTagger::lattice_size() : lattice_.size(); }
+
   int eval(size_t* crr, size_t* prec, size_t* recall) const {
+    if (!lattice_.empty()) {
+      return lattice_.eval(crr, prec, recall);
+    }
+
     int zeroone = 0;
 
     LearnerNode* res = end_node_list_[0]->next;
@@ -347,6 +389,10 @@ class EncoderLearnerTagger : public LearnerTagger {
     return zeroone;
   }
   double gradient(double* expected) {
+    if (!lattice_.empty()) {
+      return lattice_.gradient(feature_index_->alpha(), expected);
+    }
+
     viterbi();
 
     for (int pos = 0; pos <= static_cast<long>(len_); ++pos) {
@@ -377,6 +423,52 @@ class EncoderLearnerTagger : public LearnerTagger {
 
     return Z;
   }
+
+  // Add |scale| times the features of the correct path, which read() adds to |observed| once.
+  void add_observed(double* vector, double scale) const {
+    if (!lattice_.empty()) {
+      lattice_.add_observed(vector, scale);
+      return;
+    }
+    for (size_t i = 0; i < ans_path_list_.size(); ++i) {
+      const LearnerPath* path = ans_path_list_[i];
+      for (const int* f = path->fvector; *f != -1; ++f) {
+        vector[*f] += scale;
+      }
+      if (path->rnode->stat != MECAB_EOS_NODE) {
+        for (const int* f = path->rnode->fvector; *f != -1; ++f) {
+          vector[*f] += scale;
+        }
+      }
+    }
+  }
+
+  // Call |func| with the features which gradient() adds to, with duplicates.
+  template <class F>
+  void for_each_feature(F func) const {
+    if (!lattice_.empty()) {
+      lattice_.for_each_feature(func);
+      return;
+    }
+    for (size_t pos = 0; pos < begin_node_list_.size(); ++pos) {
+      for (const LearnerNode* node = begin_node_list_[pos]; node; node = node->bnext) {
+        for (const LearnerPath* path = node->lpath; path; path = path->lnext) {
+          if (is_empty(path)) {
+            continue;
+          }
+          for (const int* f = path->fvector; *f != -1; ++f) {
+            func(*f);
+          }
+          if (path->rnode->stat != MECAB_EOS_NODE) {
+            for (const int* f = path->rnode->fvector; *f != -1; ++f) {
+              func(*f);
+            }
+          }
+        }
+      }
+    }
+  }
+
   explicit EncoderLearnerTagger() : eval_size_(1024), unk_eval_size_(1024) {}
   virtual ~EncoderLearnerTagger() { close(); }
 
@@ -384,6 +476,7 @@ class EncoderLearnerTagger : public LearnerTagger {
   size_t eval_size_;
   size_t unk_eval_size_;
   std::vector<LearnerPath*> ans_path_list_;
+  CompactLattice lattice_;
 };
 
 class DecoderLearnerTagger : public LearnerTagger {
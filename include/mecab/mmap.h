@@ -2,23 +2,60 @@
 #define _MECAB_MMAP_H_
 
 #include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
+#include <cstring>
 #include <string>
 
 #include "mecab/common.h"
-#include "mecab/utils.h"
 
 namespace MeCab {
 
+// How the pages of a read-only mapping are loaded, set with the dictionary-load option.
+// By default pages are read on demand at their first access.
+enum {
+  MMAP_PREFAULT = 1,  // read the whole file and map its pages when it is opened
+  MMAP_LOCK = 2,      // keep the pages in memory with mlock()
+  MMAP_HUGEPAGE = 4   // copy the file to anonymous memory backed by transparent huge pages
+};
+
+// Parse a comma-separated list of prefault, mlock and hugepage into MMAP_* flags.
+inline bool parse_mmap_load(const std::string& str, int* load) {
+  *load = 0;
+  size_t begin = 0;
+  while (begin < str.size()) {
+    size_t end = str.find(',', begin);
+    if (end == std::string::npos) {
+      end = str.size();
+    }
+    const std::string name = str.substr(begin, end - begin);
+    if (name == "prefault") {
+      *load |= MMAP_PREFAULT;
+    } else if (name == "mlock") {
+      *load |= MMAP_LOCK;
+    } else if (name == "hugepage") {
+      *load |= MMAP_HUGEPAGE;
+    } else {
+      CHECK_FALSE(name.empty()) << "unknown dictionary load option: " << name;
+    }
+    begin = end + 1;
+  }
+  return true;
+}
+
 template <class T>
 class Mmap {
  private:
   T* text;
   size_t length;
+  size_t mapped_length;
   std::string fileName;
 
-  FILE* fd;
+  int fd;
   std::string flag;
 
  public:
@@ -33,55 +70,119 @@ class Mmap {
   size_t file_size() { return length; }
   bool empty() { return (length == 0); }
 
-  bool open(const char* filename, const char* mode = "r") {
+  // |load| is a set of MMAP_* flags, which apply to the "r" mode only.
+  bool open(const char* filename, const char* mode = "r", int load = 0) {
     this->close();
+    if (!map(filename, mode, load)) {
+      this->close();
+      return false;
+    }
+    return true;
+  }
+
+  void close() {
+    if (fd >= 0) {
+      ::close(fd);
+      fd = -1;
+    }
+
+    if (text) {
+      ::munmap(text, mapped_length);
+    }
+
+    text = 0;
+    length = 0;
+    mapped_length = 0;
+  }
+
+  Mmap() : text(NULL), length(0), mapped_length(0), fd(-1) {}
+  virtual ~Mmap() { this->close(); }
+
+ private:
+  // Open and map |filename|. A step which fails may leave the file descriptor open or a part of the file mapped,
+  // which open() releases with close().
+  bool map(const char* filename, const char* mode, int load) {
     struct stat st;
-    int fileDescriptor;
     fileName = std::string(filename);
     flag = std::string(mode);
 
     CHECK_FALSE(flag.compare("r") == 0 || flag.compare("r+") == 0)
         << "unknown open mode: " << filename << " mode: " << flag << std::endl;
 
-    flag += "b";
-
-    CHECK_FALSE((fd = ::fopen(filename, flag.c_str())) != NULL) << "open failed: " << filename;
+    // pages are read on demand, so the parts of a file which are never touched stay on disk.
+    // in "r+" mode, writes to the mapped memory go to the file.
+    int flags = O_RDONLY;
+    int prot = PROT_READ;
+    if (flag.compare("r+") == 0) {
+      flags = O_RDWR;
+      prot |= PROT_WRITE;
+    }
 
-    CHECK_FALSE((fileDescriptor = ::fileno(fd)) >= 0) << "cannot get file descriptor: " << filename;
-    CHECK_FALSE(::fstat(fileDescriptor, &st) >= 0) << "failed to get file size: " << filename;
+    CHECK_FALSE((fd = ::open(filename, flags)) >= 0) << "open failed: " << filename;
+    CHECK_FALSE(::fstat(fd, &st) >= 0) << "failed to get file size: " << filename;
 
     length = st.st_size;
+    mapped_length = length;
+    if (prot & PROT_WRITE) {
+      load = 0;
+    }
 
-    text = new T[length];
-    CHECK_FALSE(::fread(text, 1, length, fd) >= 0) << "read() failed: " << filename;
-    ::fclose(fd);
-    fd = NULL;
+    if (length > 0 && (load & MMAP_HUGEPAGE)) {
+      CHECK_FALSE(copyToHugePages(filename)) << "failed to copy to huge pages: " << filename;
+    } else if (length > 0) {
+      int map_flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+      if (load & MMAP_PREFAULT) {
+        map_flags |= MAP_POPULATE;
+      }
+#endif
+      void* p = ::mmap(0, length, prot, map_flags, fd, 0);
+      CHECK_FALSE(p != MAP_FAILED) << "mmap() failed: " << filename;
+      text = reinterpret_cast<T*>(p);
+    }
+    ::close(fd);
+    fd = -1;
+
+    if (text && (load & MMAP_LOCK)) {
+      CHECK_FALSE(::mlock(text, mapped_length) == 0)
+          << "mlock() failed: " << filename << ": " << std::strerror(errno) << " (see ulimit -l)";
+    }
 
     return true;
   }
 
-  void close() {
-    if (fd != NULL) {
-      ::fclose(fd);
-      fd = NULL;
+  // Read the file into a read-only anonymous mapping aligned to huge pages, for random accesses such as
+  // the matrix and the double array which miss the TLB with 4KB pages. Unlike the file mapping, the memory
+  // is not shared with other processes.
+  bool copyToHugePages(const char* filename) {
+    const size_t kHugePageSize = 2 << 20;
+    mapped_length = (length + kHugePageSize - 1) / kHugePageSize * kHugePageSize;
+    void* p = ::mmap(0, mapped_length + kHugePageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    CHECK_FALSE(p != MAP_FAILED) << "mmap() failed: " << filename;
+
+    // trim the mapping to the aligned range
+    char* begin = reinterpret_cast<char*>(p);
+    const uintptr_t address = reinterpret_cast<uintptr_t>(p);
+    char* aligned = reinterpret_cast<char*>((address + kHugePageSize - 1) & ~(kHugePageSize - 1));
+    if (aligned > begin) {
+      ::munmap(begin, aligned - begin);
     }
-
-    if (text) {
-      if (flag.compare("r+b")) {
-        FILE* fd2;
-        if ((fd2 = ::fopen(fileName.c_str(), "wb")) != NULL) {
-          ::fwrite(text, 1, length, fd2);
-          ::fclose(fd2);
-        }
-      }
-      delete[] text;
+    if (aligned + mapped_length < begin + mapped_length + kHugePageSize) {
+      ::munmap(aligned + mapped_length, begin + kHugePageSize - aligned);
     }
-
-    text = 0;
+    text = reinterpret_cast<T*>(aligned);
+#ifdef MADV_HUGEPAGE
+    ::madvise(aligned, mapped_length, MADV_HUGEPAGE);
+#endif
+
+    for (size_t offset = 0; offset < length;) {
+      const ssize_t n = ::pread(fd, aligned + offset, length - offset, offset);
+      CHECK_FALSE(n > 0) << "read() failed: " << filename;
+      offset += n;
+    }
+    CHECK_FALSE(::mprotect(aligned, mapped_length, PROT_READ) == 0) << "mprotect() failed: " << filename;
+    return true;
   }
-
-  Mmap() : text(NULL), length(0), fd(NULL) {}
-  virtual ~Mmap() { this->close(); }
 };
 }  // namespace MeCab
 
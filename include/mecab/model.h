@@ -13,7 +13,13 @@
 namespace MeCab {
 
 namespace {
-inline int get_request_type(bool allocateSentence, bool partial, bool allMorphs, bool marginal, int nbest) {
+inline int get_request_type(bool allocateSentence,
+                            bool partial,
+                            bool allMorphs,
+                            bool marginal,
+                            bool prunedMarginal,
+                            bool surfaceOnly,
+                            int nbest) {
   int request_type = MECAB_ONE_BEST;
 
   if (allocateSentence) {
@@ -32,6 +38,14 @@ inline int get_request_type(bool allocateSentence, bool partial, bool allMorphs,
     request_type |= MECAB_MARGINAL_PROB;
   }
 
+  if (prunedMarginal) {
+    request_type |= MECAB_MARGINAL_PRUNED;
+  }
+
+  if (surfaceOnly) {
+    request_type |= MECAB_SURFACE_ONLY;
+  }
+
   if (nbest >= 2) {
     request_type |= MECAB_NBEST;
   }
@@ -46,11 +60,16 @@ const std::vector<MeCab::Option> mecab_options{
     {"userdic", 'u', "", "FILE", "use FILE as a user dictionary"},
     {"lattice-level", 'l', "0", "INT", "lattice information level (DEPRECATED)"},
     {"dictionary-info", 'D', "", "", "show dictionary information and exit"},
-    {"output-format-type", 'O', "", "TYPE", "set output format type (wakati,none,...)"},
+    {"output-format-type", 'O', "", "TYPE", "set output format type (wakati,none,binary,...)"},
     {"all-morphs", 'a', "", "", "output all morphs(default false)"},
     {"nbest", 'N', "1", "INT", "output N best results (default 1)"},
     {"partial", 'p', "", "", "partial parsing mode (default false)"},
     {"marginal", 'm', "", "", "output marginal probability (default false)"},
+    {"marginal-float", 'f', "", "",
+     "compute marginal probability faster in single precision, within 1e-3 of the exact values (default false)"},
+    {"pruned-marginal", 'g', "", "", "output marginal probability of nodes near the best path only (default false)"},
+    {"marginal-margin", 'G', "10", "FLOAT", "prune nodes less probable than the best path by FLOAT in log (default 10)"},
+    {"surface-only", 's', "", "", "skip dictionary features, which are left empty, so %f and %F formats are not available (default false)"},
     {"max-grouping-size", 'M', "24", "INT", "maximum grouping size for unknown words (default 24)"},
     {"node-format", 'F', "%m\\t%H\\n", "STR", "use STR as the user-defined node format"},
     {"unk-format", 'U', "%m\\t%H\\n", "STR", "use STR as the user-defined unknown node format"},
@@ -63,6 +82,8 @@ const std::vector<MeCab::Option> mecab_options{
     {"allocate-sentence", 'C', "", "", "allocate new memory for input sentence"},
     {"theta", 't', "0.75", "FLOAT", "set temparature parameter theta (default 0.75)"},
     {"cost-factor", 'c', "700", "INT", "set cost factor (default 700)"},
+    {"dictionary-load", 'L', "", "TYPE",
+     "load dictionary files with TYPE, a comma-separated list of prefault, mlock and hugepage (default on demand)"},
     {"output", 'o', "", "FILE", "set the output file name"}};
 
 /**
@@ -70,7 +91,7 @@ const std::vector<MeCab::Option> mecab_options{
  */
 class Model {
  public:
-  Model() : viterbi_(new Viterbi), writer_(new Writer), request_type_(MECAB_ONE_BEST), theta_(0.0) {}
+  Model() : viterbi_(new Viterbi), writer_(new Writer), request_type_(MECAB_ONE_BEST), theta_(0.0), margin_(0.0) {}
   ~Model() {
     delete viterbi_;
     viterbi_ = 0;
@@ -95,10 +116,12 @@ class Model {
   bool open(const Param& param) {
     CHECK_FALSE(writer_->open(param) && viterbi_->open(param));
 
-    request_type_ =
-        get_request_type(param.get<bool>("allocate-sentence"), param.get<bool>("partial"),
-                         param.get<bool>("all-morphs"), param.get<bool>("marginal"), param.get<int>("nbest"));
+    request_type_ = get_request_type(param.get<bool>("allocate-sentence"), param.get<bool>("partial"),
+                                     param.get<bool>("all-morphs"), param.get<bool>("marginal"),
+                                     param.get<bool>("pruned-marginal"), param.get<bool>("surface-only"),
+                                     param.get<int>("nbest"));
     theta_ = param.get<double>("theta");
+    margin_ = param.get<double>("marginal-margin");
 
     return is_available();
   }
@@ -222,6 +245,7 @@ class Model {
       viterbi_ = m->take_viterbi();
       request_type_ = m->request_type();
       theta_ = m->theta();
+      margin_ = m->margin();
     }
 
     delete current_viterbi;
@@ -242,6 +266,8 @@ class Model {
 
   double theta() const { return theta_; }
 
+  double margin() const { return margin_; }
+
   const Viterbi* viterbi() const { return viterbi_; }
 
   const Writer* writer() const { return writer_.get(); }
@@ -252,6 +278,7 @@ class Model {
   scoped_ptr<Writer> writer_;
   int request_type_;
   double theta_;
+  double margin_;
 };
 
 }  // namespace MeCab
@@ -0,0 +1,409 @@
+#ifndef _MECAB_NODE_FORMAT_H_
+#define _MECAB_NODE_FORMAT_H_
+
+#include <string>
+#include <vector>
+
+#include "mecab/common.h"
+#include "mecab/data_structure.h"
+#include "mecab/lattice.h"
+#include "mecab/utils/string_buffer.h"
+#include "mecab/utils/string_utils.h"
+
+namespace MeCab {
+
+/**
+ * User-defined output format of a node, i.e. --node-format, --unk-format and so on.
+ * The format string is parsed once by compile() into a list of operations:
+ * literal spans, node fields and feature column indices.
+ * write() runs the operations for every node without looking at the format string again.
+ */
+class NodeFormat {
+ public:
+  NodeFormat() {}
+
+  /**
+   * Parse |format|. Return false and set |error| if |format| is malformed.
+   * @param format format string, e.g. "%m\\t%f[0]\\n"
+   * @param error error message
+   * @return boolean
+   */
+  bool compile(const char* format, std::string* error) {
+    ops_.clear();
+    literals_.clear();
+    columns_.clear();
+
+    for (const char* p = format; *p; p++) {
+      switch (*p) {
+        default:
+          addLiteral(*p);
+          break;
+
+        case '\\':
+          addLiteral(getEscapedChar(*++p));
+          if (!*p) {
+            return true;
+          }
+          break;
+
+        case '%': {  // macros
+          switch (*++p) {
+            default:
+              *error = "unknown meta char: ";
+              *error += *p;
+              return false;
+            case 'S':
+              addOp(SENTENCE);
+              break;  // input sentence
+            case 'L':
+              addOp(SENTENCE_SIZE);
+              break;  // sentence length
+            case 'm':
+              addOp(SURFACE);
+              break;  // morph
+            case 'M':
+              addOp(SURFACE_WITH_SPACE);
+              break;
+            case 'h':
+              addOp(POSID);
+              break;  // Part-Of-Speech ID
+            case '%':
+              addLiteral('%');
+              break;  // %
+            case 'c':
+              addOp(WORD_COST);
+              break;  // word cost
+            case 'H':
+              addOp(FEATURE);
+              break;
+            case 't':
+              addOp(CHAR_TYPE);
+              break;
+            case 's':
+              addOp(STAT);
+              break;
+            case 'P':
+              addOp(PROB);
+              break;
+            case 'p': {
+              switch (*++p) {
+                default:
+                  *error = "[iseSCwcnblLh] is required after %p";
+                  return false;
+                case 'i':
+                  addOp(NODE_ID);
+                  break;  // node id
+                case 'S':
+                  addOp(SPACE);
+                  break;  // space
+                case 's':
+                  addOp(BEGIN_POS);
+                  break;  // start position
+                case 'e':
+                  addOp(END_POS);
+                  break;  // end position
+                case 'C':
+                  addOp(CONNECTION_COST);
+                  break;  // connection cost
+                case 'w':
+                  addOp(WORD_COST);
+                  break;  // word cost
+                case 'c':
+                  addOp(COST);
+                  break;  // best cost
+                case 'n':
+                  addOp(NODE_COST);
+                  break;  // node cost
+                case 'b':
+                  addOp(IS_BEST);
+                  break;  // * if best path, otherwise ' '
+                case 'P':
+                  addOp(PROB);
+                  break;
+                case 'A':
+                  addOp(ALPHA);
+                  break;
+                case 'B':
+                  addOp(BETA);
+                  break;
+                case 'l':
+                  addOp(LENGTH);
+                  break;  // length of morph
+                case 'L':
+                  addOp(RLENGTH);
+                  break;  // length of morph including the spaces
+                case 'h': {  // Hidden Layer ID
+                  switch (*++p) {
+                    default:
+                      *error = "lr is required after %ph";
+                      return false;
+                    case 'l':
+                      addOp(LC_ATTR);
+                      break;  // current
+                    case 'r':
+                      addOp(RC_ATTR);
+                      break;  // prev
+                  }
+                } break;
+
+                case 'p': {
+                  Op op = {PATHS, *++p, 0, 0, 0};
+                  if (op.mode != 'i' && op.mode != 'c' && op.mode != 'P') {
+                    *error = "[icP] is required after %pp";
+                    return false;
+                  }
+                  op.separator = *++p;
+                  if (op.separator == '\\') {
+                    op.separator = getEscapedChar(*++p);
+                  }
+                  if (!*p) {
+                    *error = "separator is required after %pp";
+                    return false;
+                  }
+                  ops_.push_back(op);
+                } break;
+              }
+            } break;
+
+            case 'F':
+            case 'f': {
+              // separator
+              Op op = {COLUMNS, 0, '\t', columns_.size(), 0};  // default separator
+              if (*p == 'F') {                                 // change separator
+                if (*++p == '\\') {
+                  op.separator = getEscapedChar(*++p);
+                } else {
+                  op.separator = *p;
+                }
+                if (!*p) {
+                  *error = "cannot find '['";
+                  return false;
+                }
+              }
+
+              if (*++p != '[') {
+                *error = "cannot find '['";
+                return false;
+              }
+              size_t n = 0;
+              for (++p; *p != ']'; ++p) {
+                if (*p >= '0' && *p <= '9') {
+                  n = 10 * n + (*p - '0');
+                } else if (*p == ',') {
+                  columns_.push_back(n);
+                  n = 0;
+                } else {
+                  *error = "cannot find ']'";
+                  return false;
+                }
+              }
+              columns_.push_back(n);
+              op.size = columns_.size() - op.offset;
+              ops_.push_back(op);
+            } break;
+          }  // end switch
+        } break;  // end case '%'
+      }  // end switch
+    }
+
+    return true;
+  }
+
+  /**
+   * Write |node| in the compiled format.
+   * Return false and set the error to |lattice| if |node| lacks the information the format refers to.
+   * @return boolean
+   */
+  bool write(Lattice* lattice, const Node* node, StringBuffer* os) const {
+    for (std::vector<Op>::const_iterator op = ops_.begin(); op != ops_.end(); ++op) {
+      switch (op->type) {
+        case LITERAL:
+          os->write(literals_.data() + op->offset, op->size);
+          break;
+        case SENTENCE:
+          os->write(lattice->sentence(), lattice->size());
+          break;
+        case SENTENCE_SIZE:
+          *os << lattice->size();
+          break;
+        case SURFACE:
+          os->write(node->surface, node->length);
+          break;
+        case SURFACE_WITH_SPACE:
+          os->write(reinterpret_cast<const char*>(node->surface - node->rlength + node->length), node->rlength);
+          break;
+        case POSID:
+          *os << node->posid;
+          break;
+        case WORD_COST:
+          *os << static_cast<int>(node->wcost);
+          break;
+        case FEATURE:
+          *os << node->feature;
+          break;
+        case CHAR_TYPE:
+          *os << static_cast<unsigned int>(node->char_type);
+          break;
+        case STAT:
+          *os << static_cast<unsigned int>(node->stat);
+          break;
+        case PROB:
+          *os << node->prob;
+          break;
+        case NODE_ID:
+          *os << node->id;
+          break;
+        case SPACE:
+          os->write(reinterpret_cast<const char*>(node->surface - node->rlength + node->length),
+                    node->rlength - node->length);
+          break;
+        case BEGIN_POS:
+          *os << static_cast<int>(node->surface - lattice->sentence());
+          break;
+        case END_POS:
+          *os << static_cast<int>(node->surface - lattice->sentence() + node->length);
+          break;
+        case CONNECTION_COST:
+          *os << node->cost - node->prev->cost - node->wcost;
+          break;
+        case COST:
+          *os << node->cost;
+          break;
+        case NODE_COST:
+          *os << (node->cost - node->prev->cost);
+          break;
+        case IS_BEST:
+          *os << (node->isbest ? '*' : ' ');
+          break;
+        case ALPHA:
+          *os << node->alpha;
+          break;
+        case BETA:
+          *os << node->beta;
+          break;
+        case LENGTH:
+          *os << node->length;
+          break;
+        case RLENGTH:
+          *os << node->rlength;
+          break;
+        case LC_ATTR:
+          *os << node->lcAttr;
+          break;
+        case RC_ATTR:
+          *os << node->rcAttr;
+          break;
+        case PATHS:
+          if (!node->lpath) {
+            lattice->set_what("no path information is available");
+            return false;
+          }
+          for (Path* path = node->lpath; path; path = path->lnext) {
+            if (path != node->lpath) {
+              *os << op->separator;
+            }
+            switch (op->mode) {
+              case 'i':
+                *os << path->lnode->id;
+                break;
+              case 'c':
+                *os << path->cost;
+                break;
+              case 'P':
+                *os << path->prob;
+                break;
+            }
+          }
+          break;
+        case COLUMNS: {
+          if (node->feature[0] == '\0') {
+            lattice->set_what("no feature information available");
+            return false;
+          }
+          char** columns = 0;
+          const size_t size = lattice->allocator()->feature_columns(node->feature, &columns);
+          bool sep = false;
+          for (size_t i = op->offset; i < op->offset + op->size; ++i) {
+            const size_t n = columns_[i];
+            if (n >= size) {
+              lattice->set_what("given index is out of range");
+              return false;
+            }
+            const bool isfil = (columns[n][0] != '*');
+            if (isfil) {
+              if (sep) {
+                *os << op->separator;
+              }
+              *os << columns[n];
+            }
+            sep = isfil;
+          }
+        } break;
+      }
+    }
+
+    return true;
+  }
+
+ private:
+  enum OpType {
+    LITERAL,
+    SENTENCE,
+    SENTENCE_SIZE,
+    SURFACE,
+    SURFACE_WITH_SPACE,
+    POSID,
+    WORD_COST,
+    FEATURE,
+    CHAR_TYPE,
+    STAT,
+    PROB,
+    NODE_ID,
+    SPACE,
+    BEGIN_POS,
+    END_POS,
+    CONNECTION_COST,
+    COST,
+    NODE_COST,
+    IS_BEST,
+    ALPHA,
+    BETA,
+    LENGTH,
+    RLENGTH,
+    LC_ATTR,
+    RC_ATTR,
+    PATHS,
+    COLUMNS
+  };
+
+  struct Op {
+    OpType type;
+    char mode;       // PATHS: i, c or P
+    char separator;  // PATHS and COLUMNS
+    size_t offset;   // LITERAL: offset in literals_, COLUMNS: offset in columns_
+    size_t size;
+  };
+
+  void addOp(OpType type) {
+    const Op op = {type, 0, 0, 0, 0};
+    ops_.push_back(op);
+  }
+
+  // consecutive literal characters are merged into one span.
+  void addLiteral(char c) {
+    if (ops_.empty() || ops_.back().type != LITERAL) {
+      const Op op = {LITERAL, 0, 0, literals_.size(), 0};
+      ops_.push_back(op);
+    }
+    literals_ += c;
+    ++ops_.back().size;
+  }
+
+  std::vector<Op> ops_;
+  std::string literals_;
+  std::vector<size_t> columns_;
+};
+
+}  // namespace MeCab
+
+#endif  // _MECAB_NODE_FORMAT_H_
@@ -0,0 +1,122 @@
+#ifndef _MECAB_ONLINE_OPTIMIZER_H_
+#define _MECAB_ONLINE_OPTIMIZER_H_
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "mecab/common.h"
+
+namespace MeCab {
+
+/**
+ * Stochastic optimizers which update the weights with the gradient of a mini-batch, used by mecab-cost-train
+ * instead of LBFGS for large corpora.
+ *
+ * The gradients of mini-batches are sparse, so only the weights of the features in a gradient are updated.
+ * For sgd, the L2 regularization towards the initial weights is applied as a decay of the difference from them,
+ * (1 - rate * decay) per step, and the decay of the steps a weight was not updated in is applied when it is
+ * updated next time, or by finish(), which is exact. For adagrad and adam, whose steps do not scale with the
+ * gradient, the gradient of the regularization is added to the gradient of the features in a mini-batch, and
+ * the moments of the other features are kept as they are.
+ */
+class OnlineOptimizer {
+ public:
+  enum Algorithm { SGD, ADAGRAD, ADAM };
+
+  static bool parse(const std::string& name, Algorithm* algorithm) {
+    if (name == "sgd") {
+      *algorithm = SGD;
+    } else if (name == "adagrad") {
+      *algorithm = ADAGRAD;
+    } else if (name == "adam") {
+      *algorithm = ADAM;
+    } else {
+      CHECK_FALSE(false) << "unknown algorithm: " << name;
+    }
+    return true;
+  }
+
+  /**
+   * @param size the number of features
+   * @param decay coefficient of the L2 regularization per step, e.g. 1 / (C * the number of sentences) for the mean
+   * of a mini-batch
+   * @param origin weights which the regularization pulls the weights to
+   */
+  OnlineOptimizer(Algorithm algorithm, size_t size, double decay, const double* origin)
+      : algorithm_(algorithm), decay_(decay), origin_(origin), step_(0) {
+    if (algorithm_ == SGD) {
+      last_.resize(size, 0);
+    } else {
+      second_.resize(size, 0.0);
+    }
+    if (algorithm_ == ADAM) {
+      first_.resize(size, 0.0);
+    }
+  }
+
+  /**
+   * Update |x| with the gradient |g| of the features |ids|, with the learning rate |rate|.
+   * The rate has to be the same until finish() is called.
+   */
+  void update(double* x, const int* ids, size_t size, const double* g, double rate) {
+    ++step_;
+    const double kBeta1 = 0.9;
+    const double kBeta2 = 0.999;
+    const double kEpsilon = 1e-8;
+    const double correction1 = 1.0 - std::pow(kBeta1, static_cast<double>(step_));
+    const double correction2 = 1.0 - std::pow(kBeta2, static_cast<double>(step_));
+    for (size_t i = 0; i < size; ++i) {
+      const int k = ids[i];
+      if (algorithm_ == SGD) {
+        regularize(x, k, rate);
+        x[k] -= rate * g[k];
+        continue;
+      }
+      const double gk = g[k] + (x[k] - origin_[k]) * decay_;
+      switch (algorithm_) {
+        case SGD:
+          break;
+        case ADAGRAD:
+          second_[k] += gk * gk;
+          x[k] -= rate * gk / (std::sqrt(second_[k]) + kEpsilon);
+          break;
+        case ADAM:
+          first_[k] = kBeta1 * first_[k] + (1.0 - kBeta1) * gk;
+          second_[k] = kBeta2 * second_[k] + (1.0 - kBeta2) * gk * gk;
+          x[k] -= rate * (first_[k] / correction1) / (std::sqrt(second_[k] / correction2) + kEpsilon);
+          break;
+      }
+    }
+  }
+
+  // Apply the pending regularization of all weights of sgd, e.g. before the learning rate changes.
+  void finish(double* x, double rate) {
+    if (algorithm_ == SGD) {
+      for (size_t k = 0; k < last_.size(); ++k) {
+        regularize(x, k, rate);
+      }
+    }
+  }
+
+ private:
+  void regularize(double* x, size_t k, double rate) {
+    const size_t steps = step_ - last_[k];
+    if (steps > 0) {
+      x[k] = origin_[k] + (x[k] - origin_[k]) * std::pow(1.0 - rate * decay_, static_cast<double>(steps));
+      last_[k] = step_;
+    }
+  }
+
+  const Algorithm algorithm_;
+  const double decay_;
+  const double* origin_;
+  size_t step_;
+  std::vector<size_t> last_;  // the step which the regularization of a weight is applied until
+  std::vector<double> first_;
+  std::vector<double> second_;
+};
+
+}  // namespace MeCab
+
+#endif  // _MECAB_ONLINE_OPTIMIZER_H_
@@ -0,0 +1,216 @@
+#ifndef _MECAB_PACKAGE_H_
+#define _MECAB_PACKAGE_H_
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "mecab/common.h"
+#include "mecab/mmap.h"
+#include "mecab/utils/fingerprint.h"
+#include "mecab/utils/scoped_ptr.h"
+
+namespace MeCab {
+
+namespace {
+const unsigned int PackageMagicID = 0x4b50434du;  // "MCPK"
+}  // namespace
+
+// Header of a dictionary package, followed by |section_num| PackageSections.
+// The checksum is fingerprint_blocks() of the sections.
+struct PackageHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t section_num;
+  uint32_t alignment;
+  uint64_t checksum;
+  uint64_t reserved;
+};
+
+// A file in a dictionary package. |offset| is from the beginning of the package and is a multiple of
+// the alignment. The checksum is fingerprint_blocks() of the content.
+struct PackageSection {
+  char name[32];
+  uint64_t offset;
+  uint64_t size;
+  uint64_t checksum;
+  uint64_t reserved;
+};
+
+/**
+ * DictionaryPackage is a single file with the files of a compiled dictionary (sys.dic, unk.dic, matrix.bin,
+ * char.bin and dicrc), which is opened with one mapping. The files are stored as they are at aligned offsets,
+ * so they are used in the mapping without copies. Only the header and the table of sections are checked
+ * when a package is opened, as the pages of the files are read on demand; verify() checks the content.
+ */
+class DictionaryPackage {
+ public:
+  DictionaryPackage() : mmap_(new Mmap<char>), sections_(0), section_num_(0) {}
+
+  // |load| is a set of MMAP_* flags for the whole package.
+  bool open(const char* filename, int load = 0) {
+    close();
+    filename_ = filename;
+    CHECK_FALSE(mmap_->open(filename, "r", load)) << "no such file or directory: " << filename;
+    const size_t size = mmap_->file_size();
+    CHECK_FALSE(size >= sizeof(PackageHeader)) << "package file is broken: " << filename;
+
+    const PackageHeader* header = reinterpret_cast<const PackageHeader*>(mmap_->begin());
+    CHECK_FALSE(header->magic == PackageMagicID) << "not a dictionary package: " << filename;
+    CHECK_FALSE(header->version == PACKAGE_VERSION) << "incompatible version: " << header->version;
+    CHECK_FALSE(header->alignment > 0 &&
+                header->section_num <= (size - sizeof(PackageHeader)) / sizeof(PackageSection))
+        << "package file is broken: " << filename;
+
+    section_num_ = header->section_num;
+    sections_ = reinterpret_cast<const PackageSection*>(mmap_->begin() + sizeof(PackageHeader));
+    CHECK_FALSE(fingerprint_blocks(reinterpret_cast<const char*>(sections_), sizeof(PackageSection) * section_num_) ==
+                header->checksum)
+        << "package file is broken: " << filename;
+    for (size_t i = 0; i < section_num_; ++i) {
+      const PackageSection& section = sections_[i];
+      CHECK_FALSE(section.name[sizeof(section.name) - 1] == '\0' && section.offset <= size &&
+                  section.size <= size - section.offset && section.offset % header->alignment == 0)
+          << "package file is broken: " << filename;
+    }
+    return true;
+  }
+
+  void close() {
+    mmap_->close();
+    sections_ = 0;
+    section_num_ = 0;
+  }
+
+  /**
+   * Find the file |name| in the package.
+   * @return false if the package does not have the file
+   */
+  bool find(const char* name, const char** begin, const char** end) const {
+    for (size_t i = 0; i < section_num_; ++i) {
+      if (std::strcmp(sections_[i].name, name) == 0) {
+        *begin = mmap_->begin() + sections_[i].offset;
+        *end = *begin + sections_[i].size;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /**
+   * Check the checksums of all files, which reads the whole package.
+   */
+  bool verify() const {
+    for (size_t i = 0; i < section_num_; ++i) {
+      CHECK_FALSE(fingerprint_blocks(mmap_->begin() + sections_[i].offset, sections_[i].size) ==
+                  sections_[i].checksum)
+          << "package file is broken: " << filename_ << " (" << sections_[i].name << ")";
+    }
+    return true;
+  }
+
+  const std::string& filename() const { return filename_; }
+
+  /**
+   * Return true if |filename| is a file which starts like a dictionary package.
+   */
+  static bool is_package(const char* filename) {
+    std::ifstream ifs(filename, std::ios::binary);
+    uint32_t magic = 0;
+    return ifs.read(reinterpret_cast<char*>(&magic), sizeof(magic)) && magic == PackageMagicID;
+  }
+
+  /**
+   * Read the file |name| in the package |filename| without mapping the package, e.g. dicrc to parse
+   * the options before the dictionary is opened.
+   */
+  static bool read(const char* filename, const char* name, std::string* data) {
+    std::ifstream ifs(filename, std::ios::binary);
+    CHECK_FALSE(ifs) << "no such file or directory: " << filename;
+    PackageHeader header;
+    CHECK_FALSE(ifs.read(reinterpret_cast<char*>(&header), sizeof(header)) && header.magic == PackageMagicID)
+        << "not a dictionary package: " << filename;
+    CHECK_FALSE(header.version == PACKAGE_VERSION) << "incompatible version: " << header.version;
+    PackageSection section;
+    bool found = false;
+    for (size_t i = 0; i < header.section_num && !found; ++i) {
+      CHECK_FALSE(ifs.read(reinterpret_cast<char*>(&section), sizeof(section)))
+          << "package file is broken: " << filename;
+      found = std::strncmp(section.name, name, sizeof(section.name)) == 0;
+    }
+    CHECK_FALSE(found) << "no " << name << " in " << filename;
+
+    data->resize(section.size);
+    ifs.seekg(section.offset);
+    CHECK_FALSE(ifs.read(&(*data)[0], section.size) || section.size == 0) << "package file is broken: " << filename;
+    CHECK_FALSE(fingerprint_blocks(data->data(), data->size()) == section.checksum)
+        << "package file is broken: " << filename << " (" << name << ")";
+    return true;
+  }
+
+  /**
+   * Write the package |ofile| with |files|, pairs of the name in the package and the file to store.
+   * The package is written to a temporary file which is renamed to |ofile| at last, so that a package
+   * in use is replaced at once.
+   */
+  static bool build(const std::vector<std::pair<std::string, std::string>>& files, const char* ofile) {
+    const size_t kAlignment = 4096;
+    std::vector<PackageSection> sections(files.size());
+    uint64_t offset = sizeof(PackageHeader) + sizeof(PackageSection) * files.size();
+    for (size_t i = 0; i < files.size(); ++i) {
+      PackageSection& section = sections[i];
+      std::memset(&section, 0, sizeof(section));
+      CHECK_DIE(files[i].first.size() < sizeof(section.name)) << "too long name: " << files[i].first;
+      std::strncpy(section.name, files[i].first.c_str(), sizeof(section.name) - 1);
+
+      Mmap<char> mmap;
+      CHECK_DIE(mmap.open(files[i].second.c_str())) << "no such file or directory: " << files[i].second;
+      offset = (offset + kAlignment - 1) / kAlignment * kAlignment;
+      section.offset = offset;
+      section.size = mmap.file_size();
+      section.checksum = fingerprint_blocks(mmap.begin(), mmap.file_size());
+      offset += section.size;
+    }
+
+    PackageHeader header;
+    std::memset(&header, 0, sizeof(header));
+    header.magic = PackageMagicID;
+    header.version = PACKAGE_VERSION;
+    header.section_num = static_cast<uint32_t>(sections.size());
+    header.alignment = kAlignment;
+    header.checksum =
+        fingerprint_blocks(reinterpret_cast<const char*>(sections.data()), sizeof(PackageSection) * sections.size());
+
+    const std::string tmp = std::string(ofile) + ".tmp";
+    {
+      std::ofstream ofs(tmp.c_str(), std::ios::binary | std::ios::out);
+      CHECK_DIE(ofs) << "permission denied: " << tmp;
+      ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+      ofs.write(reinterpret_cast<const char*>(sections.data()), sizeof(PackageSection) * sections.size());
+      for (size_t i = 0; i < files.size(); ++i) {
+        const std::string padding(sections[i].offset - ofs.tellp(), '\0');
+        ofs.write(padding.data(), padding.size());
+        Mmap<char> mmap;
+        CHECK_DIE(mmap.open(files[i].second.c_str())) << "no such file or directory: " << files[i].second;
+        CHECK_DIE(mmap.file_size() == sections[i].size) << "file is modified: " << files[i].second;
+        ofs.write(mmap.begin(), mmap.file_size());
+      }
+      CHECK_DIE(ofs) << "cannot write: " << tmp;
+    }
+    CHECK_DIE(std::rename(tmp.c_str(), ofile) == 0) << "cannot write: " << ofile;
+    return true;
+  }
+
+ private:
+  scoped_ptr<Mmap<char>> mmap_;
+  const PackageSection* sections_;
+  size_t section_num_;
+  std::string filename_;
+};
+
+}  // namespace MeCab
+
+#endif  // _MECAB_PACKAGE_H_
@@ -1,6 +1,7 @@
 #ifndef __MECAB_TAGGER_H__
 #define __MECAB_TAGGER_H__
 
+#include "mecab/document.h"
 #include "mecab/lattice.h"
 #include "mecab/model.h"
 
@@ -11,7 +12,7 @@ namespace MeCab {
  */
 class Tagger {
  public:
-  Tagger() : current_model_(0), request_type_(MECAB_ONE_BEST), theta_(DEFAULT_THETA) {}
+  Tagger() : current_model_(0), request_type_(MECAB_ONE_BEST), theta_(DEFAULT_THETA), margin_(DEFAULT_MARGIN) {}
   ~Tagger() {}
 
   /**
@@ -60,6 +61,7 @@ class Tagger {
       return 0;
     }
     tagger->set_theta(model->theta());
+    tagger->set_margin(model->margin());
     tagger->set_request_type(model->request_type());
     return tagger;
   }
@@ -79,6 +81,7 @@ class Tagger {
     current_model_ = model_.get();
     request_type_ = model()->request_type();
     theta_ = model()->theta();
+    margin_ = model()->margin();
     return true;
   }
 
@@ -91,6 +94,7 @@ class Tagger {
     current_model_ = model_.get();
     request_type_ = model()->request_type();
     theta_ = model()->theta();
+    margin_ = model()->margin();
     return true;
   }
 
@@ -102,6 +106,7 @@ class Tagger {
     current_model_ = &model;
     request_type_ = current_model_->request_type();
     theta_ = current_model_->theta();
+    margin_ = current_model_->margin();
     return true;
   }
 
@@ -136,6 +141,34 @@ class Tagger {
     return model()->viterbi()->analyze(lattice);
   }
 
+  /**
+   * Parse lattice object as a document.
+   * The document is split after sentence punctuation, line breaks and the given delimiters, and
+   * the segments are analyzed with |thread_num| threads. The best paths of the segments are joined
+   * with their offsets in the document. See DocumentParser.
+   * The threads are kept for the next documents, which are analyzed one at a time.
+   * @param lattice lattice object
+   * @param thread_num number of threads
+   * @param delimiters characters which end a segment
+   * @param categories comma-separated names of character categories which end a segment
+   * @return boolean
+   */
+  bool parseDocument(Lattice* lattice,
+                     size_t thread_num = 1,
+                     const char* delimiters = MECAB_DOCUMENT_DELIMITERS,
+                     const char* categories = "") const {
+    // the parser keeps its threads and lattices for the next documents.
+    std::lock_guard<std::mutex> lock(document_mutex_);
+    if (!document_parser_.get()) {
+      document_parser_.reset(new DocumentParser);
+    }
+    if (!document_parser_->open(*model(), delimiters, categories)) {
+      lattice->set_what("invalid document delimiters or categories");
+      return false;
+    }
+    return document_parser_->parse(lattice, thread_num);
+  }
+
   /**
    * Parse given sentence and return parsed result as string.
    * You should not delete the returned string. The returned buffer
@@ -524,6 +557,18 @@ class Tagger {
    */
   float theta() const { return theta_; }
 
+  /**
+   * Set pruning margin of MECAB_MARGINAL_PRUNED mode.
+   * @param margin pruning margin.
+   */
+  void set_margin(float margin) { margin_ = margin; }
+
+  /**
+   * Return pruning margin of MECAB_MARGINAL_PRUNED mode.
+   * @return pruning margin.
+   */
+  float margin() const { return margin_; }
+
   /**
    * Return DictionaryInfo linked list.
    * @return DictionaryInfo linked list
@@ -544,6 +589,7 @@ class Tagger {
   void initRequestType() {
     mutable_lattice()->set_request_type(request_type_);
     mutable_lattice()->set_theta(theta_);
+    mutable_lattice()->set_margin(margin_);
   }
 
   Lattice* mutable_lattice() {
@@ -558,8 +604,11 @@ class Tagger {
 
   scoped_ptr<Model> model_;
   scoped_ptr<Lattice> lattice_;
+  mutable std::mutex document_mutex_;
+  mutable scoped_ptr<DocumentParser> document_parser_;
   int request_type_;
   double theta_;
+  double margin_;
   std::string what_;
 };
 }  // namespace MeCab
@@ -5,6 +5,7 @@
 #include "mecab/data_structure.h"
 #include "mecab/dictionary.h"
 #include "mecab/nbest_generator.h"
+#include "mecab/package.h"
 #include "mecab/utils/freelist.h"
 #include "mecab/utils/param.h"
 #include "mecab/utils/scoped_ptr.h"
@@ -12,20 +13,25 @@
 namespace MeCab {
 
 namespace {
-void inline read_node_info(const Dictionary& dic, const Token& token, LearnerNode** node) {
+void inline read_node_info(const Dictionary& dic, const Token& token, bool with_feature, LearnerNode** node) {
   (*node)->lcAttr = token.lcAttr;
   (*node)->rcAttr = token.rcAttr;
   (*node)->posid = token.posid;
   (*node)->wcost2 = token.wcost;
-  (*node)->feature = dic.feature(token);
+  (*node)->feature = with_feature ? dic.feature(token) : "";
 }
 
-void inline read_node_info(const Dictionary& dic, const Token& token, Node** node) {
+void inline read_node_info(const Dictionary& dic, const Token& token, bool with_feature, Node** node) {
   (*node)->lcAttr = token.lcAttr;
   (*node)->rcAttr = token.rcAttr;
   (*node)->posid = token.posid;
   (*node)->wcost = token.wcost;
-  (*node)->feature = dic.feature(token);
+  (*node)->feature = with_feature ? dic.feature(token) : "";
+}
+
+// MECAB_SURFACE_ONLY is ignored in partial parsing, whose constraints need features.
+inline bool with_feature(const Lattice* lattice, bool is_partial) {
+  return is_partial || !lattice || !lattice->has_request_type(MECAB_SURFACE_ONLY);
 }
 
 inline bool partial_match(const char* f1, const char* f2) {
@@ -110,6 +116,7 @@ class Tokenizer {
     }
 
     const char* begin2 = property_.seekToOtherType(begin, end, space_, &cinfo, &mblen, &clen);
+    const bool feature = with_feature(lattice, IsPartial);
 
     Dictionary::result_type* daresults = allocator->mutable_results();
     const size_t results_size = allocator->results_size();
@@ -121,7 +128,7 @@ class Tokenizer {
         const Token* token = (*it)->token(daresults[i]);
         for (size_t j = 0; j < size; ++j) {
           N* new_node = allocator->newNode();
-          read_node_info(**it, *(token + j), &new_node);
+          read_node_info(**it, *(token + j), feature, &new_node);
           new_node->length = daresults[i].length;
           new_node->rlength = begin2 - begin + new_node->length;
           new_node->surface = begin2;
@@ -214,23 +221,80 @@ class Tokenizer {
                 param.get<size_t>("max-grouping-size"));
   }
 
+  // |load| is a set of MMAP_* flags for all dictionary files.
   bool open(const std::string prefix,
             const std::string userdic,
             const std::string bosFeature,
             const std::string unkFeature,
-            const size_t maxGroupingSize) {
+            const size_t maxGroupingSize,
+            const int load = 0) {
     close();
 
-    CHECK_FALSE(unkdic_.open(create_filename(prefix, UNK_DIC_FILE).c_str()));
-    property_.open(create_filename(prefix, CHAR_PROPERTY_FILE));
+    CHECK_FALSE(unkdic_.open(create_filename(prefix, UNK_DIC_FILE).c_str(), "r", load));
+    property_.open(create_filename(prefix, CHAR_PROPERTY_FILE), load);
 
     Dictionary* sysdic = new Dictionary;
+    dic_.push_back(sysdic);
+    CHECK_FALSE(sysdic->open(create_filename(prefix, SYS_DIC_FILE).c_str(), "r", load));
+
+    return openUserDictionaries(prefix, userdic, bosFeature, unkFeature, maxGroupingSize, load);
+  }
+
+  // Open the dictionaries in |package|, which is kept while the tokenizer is used.
+  // |load| applies to the user dictionaries, as the package is loaded as a whole.
+  bool open(const DictionaryPackage& package,
+            const std::string userdic,
+            const std::string bosFeature,
+            const std::string unkFeature,
+            const size_t maxGroupingSize,
+            const int load = 0) {
+    close();
+
+    const std::string prefix = package.filename();
+    const char* begin = 0;
+    const char* end = 0;
+    CHECK_FALSE(package.find(UNK_DIC_FILE, &begin, &end)) << "no " << UNK_DIC_FILE << " in " << prefix;
+    CHECK_FALSE(unkdic_.openFromArray(create_filename(prefix, UNK_DIC_FILE).c_str(), begin, end));
+    CHECK_FALSE(package.find(CHAR_PROPERTY_FILE, &begin, &end)) << "no " << CHAR_PROPERTY_FILE << " in " << prefix;
+    property_.openFromArray(create_filename(prefix, CHAR_PROPERTY_FILE), begin, end);
+
+    Dictionary* sysdic = new Dictionary;
+    dic_.push_back(sysdic);
+    CHECK_FALSE(package.find(SYS_DIC_FILE, &begin, &end)) << "no " << SYS_DIC_FILE << " in " << prefix;
+    CHECK_FALSE(sysdic->openFromArray(create_filename(prefix, SYS_DIC_FILE).c_str(), begin, end));
+
+    return openUserDictionaries(prefix, userdic, bosFeature, unkFeature, maxGroupingSize, load);
+  }
+
+  void close() {
+    for (std::vector<Dictionary*>::iterator it = dic_.begin(); it != dic_.end(); ++it) {
+      delete *it;
+    }
+    dic_.clear();
+    unk_tokens_.clear();
+    unkdic_.close();
+    property_.close();
+  }
+
+  const DictionaryInfo* dictionary_info() const { return const_cast<const DictionaryInfo*>(dictionary_info_); }
+
+  const CharProperty* char_property() const { return &property_; }
+
+  explicit Tokenizer() : dictionary_info_freelist_(4), dictionary_info_(0), max_grouping_size_(0) {}
+  virtual ~Tokenizer() { this->close(); }
 
-    CHECK_FALSE(sysdic->open(create_filename(prefix, SYS_DIC_FILE).c_str()));
+ private:
+  // Open the user dictionaries after unk.dic, char.bin and the system dictionary.
+  bool openUserDictionaries(const std::string prefix,
+                            const std::string userdic,
+                            const std::string bosFeature,
+                            const std::string unkFeature,
+                            const size_t maxGroupingSize,
+                            const int load) {
+    Dictionary* sysdic = dic_[0];
     CHECK_FALSE(sysdic->type() == 0) << "not a system dictionary: " << prefix;
 
     property_.set_charset(sysdic->charset());
-    dic_.push_back(sysdic);
 
     if (!userdic.empty()) {
       scoped_fixed_array<char, BUF_SIZE> buf;
@@ -239,7 +303,7 @@ class Tokenizer {
       const size_t n = tokenizeCSV(buf.get(), dicfile.get(), dicfile.size());
       for (size_t i = 0; i < n; ++i) {
         Dictionary* d = new Dictionary;
-        CHECK_FALSE(d->open(dicfile[i]));
+        CHECK_FALSE(d->open(dicfile[i], "r", load));
         CHECK_FALSE(d->type() == 1) << "not a user dictionary: " << dicfile[i];
         CHECK_FALSE(sysdic->isCompatible(*d)) << "incompatible dictionary: " << dicfile[i];
         dic_.push_back(d);
@@ -290,20 +354,7 @@ class Tokenizer {
 
     return true;
   }
-  void close() {
-    for (std::vector<Dictionary*>::iterator it = dic_.begin(); it != dic_.end(); ++it) {
-      delete *it;
-    }
-    dic_.clear();
-    unk_tokens_.clear();
-    property_.close();
-  }
-  const DictionaryInfo* dictionary_info() const { return const_cast<const DictionaryInfo*>(dictionary_info_); }
 
-  explicit Tokenizer() : dictionary_info_freelist_(4), dictionary_info_(0), max_grouping_size_(0) {}
-  virtual ~Tokenizer() { this->close(); }
-
- private:
   std::vector<Dictionary*> dic_;
   Dictionary unkdic_;
   scoped_string bos_feature_;
@@ -323,19 +374,20 @@ class Tokenizer {
                   const Lattice* lattice,
                   const CharInfo cinfo,
                   N** result_node) const {
+    const bool feature = with_feature(lattice, IsPartial);
     do {
       const Token* token = unk_tokens_[cinfo.default_type].first;
       size_t size = unk_tokens_[cinfo.default_type].second;
       for (size_t k = 0; k < size; ++k) {
         N* new_node = allocator->newNode();
-        read_node_info(unkdic_, *(token + k), &new_node);
+        read_node_info(unkdic_, *(token + k), feature, &new_node);
         new_node->char_type = cinfo.default_type;
         new_node->surface = begin2;
         new_node->length = begin3 - begin2;
         new_node->rlength = begin3 - begin;
         new_node->stat = MECAB_UNK_NODE;
         new_node->bnext = *result_node;
-        if (unk_feature_.get())
+        if (feature && unk_feature_.get())
           new_node->feature = unk_feature_.get();
         if (IsPartial && !is_valid_node(lattice, new_node)) {
           continue;
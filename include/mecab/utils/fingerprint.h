@@ -1,7 +1,10 @@
 #ifndef __MECAB_UTILS_FINGERPRINT_H__
 #define __MECAB_UTILS_FINGERPRINT_H__
 
+#include <algorithm>
+#include <cstdio>
 #include <cstring>
+#include <fstream>
 #include <string>
 
 namespace MeCab {
@@ -200,6 +203,48 @@ inline uint64_t fingerprint(const std::string& str) {
   return fingerprint(str.data(), str.size());
 }
 
+inline std::string to_hex(uint64_t fp) {
+  char buf[17];
+  std::snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(fp));
+  return buf;
+}
+
+namespace {
+const size_t kFingerprintBlockSize = 1 << 20;
+}
+
+// 64 bit hash of |size| bytes hashed in blocks, so that data of any size can be hashed.
+// Same as fingerprint_file() of a file with the bytes.
+inline uint64_t fingerprint_blocks(const char* str, size_t size) {
+  std::string digests;
+  for (size_t i = 0; i < size; i += kFingerprintBlockSize) {
+    const uint64_t fp = fingerprint(str + i, std::min(kFingerprintBlockSize, size - i));
+    digests.append(reinterpret_cast<const char*>(&fp), sizeof(fp));
+  }
+  return fingerprint(digests);
+}
+
+// 64 bit hash of the content of a file, read in blocks so that files of any size can be hashed.
+// Return false if the file cannot be read.
+inline bool fingerprint_file(const char* filename, uint64_t* result) {
+  std::ifstream ifs(filename, std::ios::binary);
+  if (!ifs) {
+    return false;
+  }
+  const size_t kBlockSize = kFingerprintBlockSize;
+  std::string block(kBlockSize, '\0');
+  std::string digests;
+  while (ifs.read(&block[0], kBlockSize) || ifs.gcount() > 0) {
+    const uint64_t fp = fingerprint(block.data(), ifs.gcount());
+    digests.append(reinterpret_cast<const char*>(&fp), sizeof(fp));
+  }
+  if (ifs.bad()) {
+    return false;
+  }
+  *result = fingerprint(digests);
+  return true;
+}
+
 }  // namespace MeCab
 
 #endif  // __MECAB_UTILS_FINGERPRINT_H__
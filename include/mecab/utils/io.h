@@ -3,6 +3,9 @@
 
 #include <dirent.h>
 
+#include <sstream>
+
+#include "mecab/package.h"
 #include "mecab/utils/param.h"
 #include "mecab/utils/string_utils.h"
 
@@ -44,6 +47,17 @@ inline bool load_dictionary_resource(Param* param) {
   std::string rcpath = remove_filename(rcfile);
   dicdir = replace_string(dicdir, "$(rcpath)", rcpath);
   param->set("dicdir", dicdir, true);
+
+  // dicrc in a dictionary package
+  if (DictionaryPackage::is_package(dicdir.c_str())) {
+    std::string dicrc;
+    if (!DictionaryPackage::read(dicdir.c_str(), DICRC, &dicrc)) {
+      return false;
+    }
+    std::istringstream is(dicrc);
+    return param->parseStream(is);
+  }
+
   std::string dicrc = create_filename(dicdir, DICRC);
 
   return param->parseFile(dicrc);
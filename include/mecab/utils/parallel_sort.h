@@ -0,0 +1,111 @@
+#ifndef _MECAB_PARALLEL_SORT_H_
+#define _MECAB_PARALLEL_SORT_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+#include "mecab/utils/thread.h"
+
+namespace MeCab {
+
+namespace {
+
+template <typename Iterator, typename Compare>
+class sort_thread : public thread {
+ public:
+  void init(Iterator begin, Iterator end, Compare cmp) {
+    begin_ = begin;
+    end_ = end;
+    cmp_ = cmp;
+  }
+
+  void run() { std::stable_sort(begin_, end_, cmp_); }
+
+ private:
+  Iterator begin_;
+  Iterator end_;
+  Compare cmp_;
+};
+
+template <typename Iterator, typename Compare>
+class merge_thread : public thread {
+ public:
+  void init(Iterator begin, Iterator middle, Iterator end, Compare cmp) {
+    begin_ = begin;
+    middle_ = middle;
+    end_ = end;
+    cmp_ = cmp;
+  }
+
+  void run() { std::inplace_merge(begin_, middle_, end_, cmp_); }
+
+ private:
+  Iterator begin_;
+  Iterator middle_;
+  Iterator end_;
+  Compare cmp_;
+};
+
+}  // namespace
+
+// Same as std::stable_sort with |thread_num| threads.
+// The range is split into |thread_num| parts, which are sorted in parallel and then merged
+// pairwise, also in parallel. Equal elements keep their order as merging prefers the left part.
+template <typename Iterator, typename Compare>
+void parallel_stable_sort(Iterator begin, Iterator end, Compare cmp, size_t thread_num) {
+  const size_t kMinPartSize = 4096;
+  const size_t size = end - begin;
+  const size_t part_num = std::max<size_t>(1, std::min(thread_num, size / kMinPartSize));
+  if (part_num == 1) {
+    std::stable_sort(begin, end, cmp);
+    return;
+  }
+
+  std::vector<Iterator> bounds;
+  for (size_t i = 0; i <= part_num; ++i) {
+    bounds.push_back(begin + size * i / part_num);
+  }
+
+  {
+    // the calling thread sorts the first part.
+    std::vector<sort_thread<Iterator, Compare>> sorters(part_num);
+    for (size_t i = 0; i < part_num; ++i) {
+      sorters[i].init(bounds[i], bounds[i + 1], cmp);
+    }
+    for (size_t i = 1; i < part_num; ++i) {
+      sorters[i].start();
+    }
+    sorters[0].run();
+    for (size_t i = 1; i < part_num; ++i) {
+      sorters[i].join();
+    }
+  }
+
+  while (bounds.size() > 2) {
+    const size_t merge_num = (bounds.size() - 1) / 2;
+    std::vector<merge_thread<Iterator, Compare>> mergers(merge_num);
+    std::vector<Iterator> merged;
+    for (size_t i = 0; i < merge_num; ++i) {
+      mergers[i].init(bounds[2 * i], bounds[2 * i + 1], bounds[2 * i + 2], cmp);
+      merged.push_back(bounds[2 * i]);
+    }
+    // an odd part is left as is until the next round.
+    if ((bounds.size() - 1) % 2 == 1) {
+      merged.push_back(bounds[bounds.size() - 2]);
+    }
+    merged.push_back(end);
+    for (size_t i = 1; i < merge_num; ++i) {
+      mergers[i].start();
+    }
+    mergers[0].run();
+    for (size_t i = 1; i < merge_num; ++i) {
+      mergers[i].join();
+    }
+    bounds.swap(merged);
+  }
+}
+
+}  // namespace MeCab
+
+#endif  // _MECAB_PARALLEL_SORT_H_
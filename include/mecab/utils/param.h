@@ -176,7 +176,7 @@ class Param {
         if (iterator == longOptionMap.end())
           return printArgError(UNRECOGNIZED, argument);
 
-        Option selected = *iterator->second;
+        const Option& selected = *iterator->second;
         if (selected.argName.empty()) {
           // this argument does not need arguments, but passed
           if (argument.length() != selected.optionName.length() + 2)
@@ -184,7 +184,7 @@ class Param {
 
           configurations[selected.optionName] = "1";
         } else if (argument.length() == selected.optionName.length() + 2) {
-          optionForNextArg = &selected;
+          optionForNextArg = iterator->second;
         } else {
           auto value = argument.substr(selected.optionName.length() + 3);
           configurations[selected.optionName] = value;
@@ -196,7 +196,7 @@ class Param {
         if (iterator == shortOptionMap.end())
           return printArgError(UNRECOGNIZED, argument);
 
-        Option selected = *iterator->second;
+        const Option& selected = *iterator->second;
         if (selected.argName.empty()) {
           // this argument does not need arguments, but passed
           if (argument.length() != 2)
@@ -205,7 +205,7 @@ class Param {
           configurations[selected.optionName] = "1";
         } else if (argument.length() == 2) {
           // -a some-arg
-          optionForNextArg = &selected;
+          optionForNextArg = iterator->second;
         } else if (argument.at(2) == '=') {
           // -a=some-arg
           auto value = argument.substr(3);
@@ -260,8 +260,13 @@ class Param {
 
     CHECK_FALSE(!ifs.fail()) << "cannot open file: " << filename;
 
+    return parseStream(ifs);
+  }
+
+  // Same as parseFile() for the content of a file in |is|.
+  bool parseStream(std::istream& is) {
     std::string line;
-    while (std::getline(ifs, line)) {
+    while (std::getline(is, line)) {
       if (!line.size() || line[0] == ';' || line[0] == '#')
         continue;
 
@@ -106,6 +106,7 @@ class StringBuffer {
   StringBuffer& operator<<(const std::string& n) { return this->write(n.c_str()); }
 
   void clear() { size_ = 0; }
+  size_t size() const { return size_; }
   const char* str() const { return error_ ? 0 : const_cast<const char*>(ptr_); }
 };
 }  // namespace MeCab
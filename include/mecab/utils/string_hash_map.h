@@ -0,0 +1,158 @@
+#ifndef _MECAB_STRING_HASH_MAP_H_
+#define _MECAB_STRING_HASH_MAP_H_
+
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "mecab/utils/fingerprint.h"
+#include "mecab/utils/freelist.h"
+
+namespace MeCab {
+
+// An open addressing hash table from strings to values with linear probing.
+// The keys are copied once to an arena as null terminated strings, and find() and insert() take a pointer and a
+// length, so a lookup does not build a std::string.
+// A pointer to a value is valid until the next insert() or filter(), which may move the slots.
+template <class V>
+class StringHashMap {
+ public:
+  StringHashMap() : size_(0), keys_(kKeyChunkSize) {}
+
+  V* find(const char* key, size_t length) {
+    const size_t i = lookup(key, length, hash(key, length));
+    return table_.empty() || !table_[i].key ? 0 : &table_[i].value;
+  }
+  const V* find(const char* key, size_t length) const { return const_cast<StringHashMap*>(this)->find(key, length); }
+  V* find(const char* key) { return find(key, std::strlen(key)); }
+  const V* find(const char* key) const { return find(key, std::strlen(key)); }
+
+  // returns the value of |key| and true if |key| is new
+  std::pair<V*, bool> insert(const char* key, size_t length, const V& value) {
+    if (2 * (size_ + 1) > table_.size()) {
+      rehash(table_.empty() ? kInitialSize : 2 * table_.size());
+    }
+    const uint32_t h = hash(key, length);
+    const size_t i = lookup(key, length, h);
+    entry& e = table_[i];
+    if (e.key) {
+      return std::make_pair(&e.value, false);
+    }
+    char* copy = keys_.alloc(length + 1);
+    std::memcpy(copy, key, length);
+    copy[length] = '\0';
+    e.key = copy;
+    e.length = length;
+    e.hash = h;
+    e.value = value;
+    ++size_;
+    return std::make_pair(&e.value, true);
+  }
+  std::pair<V*, bool> insert(const char* key, const V& value) { return insert(key, std::strlen(key), value); }
+
+  // calls func(key, length, value) for each entry in no particular order
+  template <class Func>
+  void for_each(Func func) {
+    for (size_t i = 0; i < table_.size(); ++i) {
+      if (table_[i].key) {
+        func(table_[i].key, table_[i].length, table_[i].value);
+      }
+    }
+  }
+  template <class Func>
+  void for_each(Func func) const {
+    for (size_t i = 0; i < table_.size(); ++i) {
+      if (table_[i].key) {
+        func(table_[i].key, static_cast<size_t>(table_[i].length), static_cast<const V&>(table_[i].value));
+      }
+    }
+  }
+
+  // keeps only the entries for which keep(key, length, value) is true; keep() may modify the value.
+  // The keys of the removed entries stay in the arena until clear().
+  template <class Pred>
+  void filter(Pred keep) {
+    std::vector<entry> kept;
+    kept.reserve(size_);
+    for (size_t i = 0; i < table_.size(); ++i) {
+      if (table_[i].key && keep(table_[i].key, static_cast<size_t>(table_[i].length), table_[i].value)) {
+        kept.push_back(table_[i]);
+      }
+    }
+    table_.clear();
+    size_ = 0;
+    size_t capacity = kInitialSize;
+    while (2 * kept.size() > capacity) {
+      capacity *= 2;
+    }
+    rehash(capacity);
+    for (size_t i = 0; i < kept.size(); ++i) {
+      place(kept[i]);
+    }
+  }
+
+  void clear() {
+    std::vector<entry>().swap(table_);
+    size_ = 0;
+    keys_.free();
+  }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+ private:
+  struct entry {
+    const char* key;  // 0 for an empty slot
+    uint32_t length;
+    uint32_t hash;
+    V value;
+    entry() : key(0), length(0), hash(0), value() {}
+  };
+
+  static const size_t kInitialSize = 1024;
+  static const size_t kKeyChunkSize = 64 * 1024;
+
+  static uint32_t hash(const char* key, size_t length) { return static_cast<uint32_t>(fingerprint(key, length)); }
+
+  // the slot of |key|, or the empty slot where |key| is inserted
+  size_t lookup(const char* key, size_t length, uint32_t h) const {
+    if (table_.empty()) {
+      return 0;
+    }
+    const size_t mask = table_.size() - 1;
+    for (size_t i = h & mask;; i = (i + 1) & mask) {
+      const entry& e = table_[i];
+      if (!e.key || (e.hash == h && e.length == length && std::memcmp(e.key, key, length) == 0)) {
+        return i;
+      }
+    }
+  }
+
+  // puts an entry whose key is not in the table
+  void place(const entry& e) {
+    const size_t mask = table_.size() - 1;
+    size_t i = e.hash & mask;
+    while (table_[i].key) {
+      i = (i + 1) & mask;
+    }
+    table_[i] = e;
+    ++size_;
+  }
+
+  void rehash(size_t capacity) {
+    std::vector<entry> old(capacity);
+    old.swap(table_);
+    size_ = 0;
+    for (size_t i = 0; i < old.size(); ++i) {
+      if (old[i].key) {
+        place(old[i]);
+      }
+    }
+  }
+
+  std::vector<entry> table_;
+  size_t size_;
+  ChunkFreeList<char> keys_;
+};
+}  // namespace MeCab
+
+#endif  // _MECAB_STRING_HASH_MAP_H_
@@ -57,6 +57,28 @@ inline void uitoa(T val, char* s) {
   return;
 }
 
+// Parse a decimal integer with an optional sign at the beginning of [begin, end) like std::from_chars.
+// Neither a null terminator nor the locale is needed. Return the end of the digits, or |begin| if there are no digits.
+template <class T>
+inline const char* parse_integer(const char* begin, const char* end, T* value) {
+  const char* p = begin;
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+')) {
+    negative = *p == '-';
+    ++p;
+  }
+  const char* digits = p;
+  T result = 0;
+  for (; p < end && static_cast<unsigned char>(*p - '0') < 10; ++p) {
+    result = result * 10 + (*p - '0');
+  }
+  if (p == digits) {
+    return begin;
+  }
+  *value = negative ? -result : result;
+  return p;
+}
+
 inline std::string create_filename(const std::string& path, const std::string& file) {
   std::string s = path;
   if (s.size() && s[s.size() - 1] != '/')
@@ -3,6 +3,11 @@
 
 #include <pthread.h>
 
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
 namespace MeCab {
 
 class thread {
@@ -24,6 +29,55 @@ class thread {
 
   virtual ~thread() {}
 };
+
+// FIFO queue shared by threads. push() blocks while the queue holds |capacity| items
+// and pop() blocks while it is empty, until close() is called.
+template <typename T>
+class BoundedQueue {
+ public:
+  explicit BoundedQueue(size_t capacity) : capacity_(capacity), closed_(false) {}
+
+  // Return false if the queue is closed.
+  bool push(const T& value) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_full_.wait(lock, [this] { return closed_ || queue_.size() < capacity_; });
+    if (closed_) {
+      return false;
+    }
+    queue_.push_back(value);
+    not_empty_.notify_one();
+    return true;
+  }
+
+  // Return false if the queue is closed and drained.
+  bool pop(T* value) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_empty_.wait(lock, [this] { return closed_ || !queue_.empty(); });
+    if (queue_.empty()) {
+      return false;
+    }
+    *value = queue_.front();
+    queue_.pop_front();
+    not_full_.notify_one();
+    return true;
+  }
+
+  // Wake up all waiting threads. Items already queued can still be popped.
+  void close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+    not_empty_.notify_all();
+    not_full_.notify_all();
+  }
+
+ private:
+  std::deque<T> queue_;
+  std::mutex mutex_;
+  std::condition_variable not_empty_;
+  std::condition_variable not_full_;
+  const size_t capacity_;
+  bool closed_;
+};
 }  // namespace MeCab
 
 #endif  // _MECAB_THREAD_H_
@@ -9,6 +9,8 @@
 #include "mecab/connector.h"
 #include "mecab/data_structure.h"
 #include "mecab/lattice.h"
+#include "mecab/marginal.h"
+#include "mecab/package.h"
 #include "mecab/tokenizer.h"
 #include "mecab/utils/scoped_ptr.h"
 #include "mecab/utils/thread.h"
@@ -16,26 +18,13 @@
 namespace MeCab {
 
 namespace {
-void calc_alpha(Node* n, double beta) {
-  n->alpha = 0.0;
-  for (Path* path = n->lpath; path; path = path->lnext) {
-    n->alpha = logsumexp(n->alpha, -beta * path->cost + path->lnode->alpha, path == n->lpath);
-  }
-}
-
-void calc_beta(Node* n, double beta) {
-  n->beta = 0.0;
-  for (Path* path = n->rpath; path; path = path->rnext) {
-    n->beta = logsumexp(n->beta, -beta * path->cost + path->rnode->beta, path == n->rpath);
-  }
-}
-
-template <bool IsAllPath>
+// |connector| provides cost(lnode, rnode) like Connector.
+template <bool IsAllPath, class C>
 bool connect(size_t pos,
              Node* rnode,
              Node** begin_node_list,
              Node** end_node_list,
-             const Connector* connector,
+             const C* connector,
              Allocator<Node, Path>* allocator) {
   for (; rnode; rnode = rnode->bnext) {
     long best_cost = 2147483647;
@@ -81,22 +70,38 @@ bool connect(size_t pos,
 class Viterbi {
  public:
   bool open(const Param& param) {
+    marginal_float_ = param.get<bool>("marginal-float");
+    int load = 0;
+    CHECK_FALSE(parse_mmap_load(param.get<std::string>("dictionary-load"), &load));
     return open(param.get<std::string>("dicdir"), param.get<std::string>("userdic"),
                 param.get<std::string>("bos-feature"), param.get<std::string>("unk-feature"),
-                param.get<size_t>("max-grouping-size"), param.get<int>("cost-factor"));
+                param.get<size_t>("max-grouping-size"), param.get<int>("cost-factor"), load);
   }
   bool open(const std::string dicdir,
             const std::string userdic,
             const std::string bosFeature,
             const std::string unkFeature,
             const size_t maxGroupingSize,
-            const int costFactor) {
+            const int costFactor,
+            const int load = 0) {
     tokenizer_.reset(new Tokenizer<Node, Path>);
-    CHECK_FALSE(tokenizer_->open(dicdir, userdic, bosFeature, unkFeature, maxGroupingSize));
-    CHECK_FALSE(tokenizer_->dictionary_info()) << "Dictionary is empty";
-
     connector_.reset(new Connector);
-    CHECK_FALSE(connector_->open(dicdir));
+
+    // |dicdir| is a directory or a dictionary package, which is mapped once for all files.
+    if (DictionaryPackage::is_package(dicdir.c_str())) {
+      package_.reset(new DictionaryPackage);
+      CHECK_FALSE(package_->open(dicdir.c_str(), load));
+      CHECK_FALSE(tokenizer_->open(*package_, userdic, bosFeature, unkFeature, maxGroupingSize, load));
+      const char* begin = 0;
+      const char* end = 0;
+      CHECK_FALSE(package_->find(MATRIX_FILE, &begin, &end)) << "no " << MATRIX_FILE << " in " << dicdir;
+      CHECK_FALSE(connector_->openFromArray(create_filename(dicdir, MATRIX_FILE).c_str(), begin, end));
+    } else {
+      package_.reset(0);
+      CHECK_FALSE(tokenizer_->open(dicdir, userdic, bosFeature, unkFeature, maxGroupingSize, load));
+      CHECK_FALSE(connector_->open(dicdir, load));
+    }
+    CHECK_FALSE(tokenizer_->dictionary_info()) << "Dictionary is empty";
 
     CHECK_FALSE(tokenizer_->dictionary_info()->lsize == connector_->left_size() &&
                 tokenizer_->dictionary_info()->rsize == connector_->right_size())
@@ -165,12 +170,23 @@ class Viterbi {
 
   static bool buildResultForNBest(Lattice* lattice) { return buildAllLattice(lattice); }
 
-  Viterbi() : tokenizer_(0), connector_(0), cost_factor_(0) {}
+  Viterbi() : package_(0), tokenizer_(0), connector_(0), cost_factor_(0), marginal_float_(false) {}
   virtual ~Viterbi() {}
 
  private:
+  // The kind of the matrix is chosen here, so that connect() looks up costs without checking it.
   template <bool IsAllPath, bool IsPartial>
   bool viterbi(Lattice* lattice) const {
+    if (connector_->is_compressed()) {
+      const Connector::CompressedCost connector(connector_.get());
+      return viterbi<IsAllPath, IsPartial>(lattice, &connector);
+    }
+    const Connector::DenseCost connector(connector_.get());
+    return viterbi<IsAllPath, IsPartial>(lattice, &connector);
+  }
+
+  template <bool IsAllPath, bool IsPartial, class C>
+  bool viterbi(Lattice* lattice, const C* connector) const {
     Node** end_node_list = lattice->end_nodes();
     Node** begin_node_list = lattice->begin_nodes();
     Allocator<Node, Path>* allocator = lattice->allocator();
@@ -186,7 +202,7 @@ class Viterbi {
       if (end_node_list[pos]) {
         Node* right_node = tokenizer_->lookup<IsPartial>(begin + pos, end, allocator, lattice);
         begin_node_list[pos] = right_node;
-        if (!connect<IsAllPath>(pos, right_node, begin_node_list, end_node_list, connector_.get(), allocator)) {
+        if (!connect<IsAllPath>(pos, right_node, begin_node_list, end_node_list, connector, allocator)) {
           lattice->set_what("too long sentence.");
           return false;
         }
@@ -199,7 +215,7 @@ class Viterbi {
 
     for (long pos = len; static_cast<long>(pos) >= 0; --pos) {
       if (end_node_list[pos]) {
-        if (!connect<IsAllPath>(pos, eos_node, begin_node_list, end_node_list, connector_.get(), allocator)) {
+        if (!connect<IsAllPath>(pos, eos_node, begin_node_list, end_node_list, connector, allocator)) {
           lattice->set_what("too long sentence.");
           return false;
         }
@@ -213,44 +229,32 @@ class Viterbi {
     return true;
   }
 
-  static bool forwardbackward(Lattice* lattice) {
-    if (!lattice->has_request_type(MECAB_MARGINAL_PROB)) {
-      return true;
-    }
-
-    Node** end_node_list = lattice->end_nodes();
-    Node** begin_node_list = lattice->begin_nodes();
-
-    const size_t len = lattice->size();
-    const double theta = lattice->theta();
-
-    end_node_list[0]->alpha = 0.0;
-    for (int pos = 0; pos <= static_cast<long>(len); ++pos) {
-      for (Node* node = begin_node_list[pos]; node; node = node->bnext) {
-        calc_alpha(node, theta);
+  bool forwardbackward(Lattice* lattice) const {
+    if (lattice->has_request_type(MECAB_MARGINAL_PROB)) {
+      if (marginal_float_) {
+        return forwardbackward_fast(lattice);
       }
+      return forwardbackward_reference(lattice);
     }
 
-    begin_node_list[len]->beta = 0.0;
-    for (int pos = static_cast<long>(len); pos >= 0; --pos) {
-      for (Node* node = end_node_list[pos]; node; node = node->enext) {
-        calc_beta(node, theta);
+    if (lattice->has_request_type(MECAB_MARGINAL_PRUNED)) {
+      if (marginal_float_) {
+        return forwardbackwardPruned<float>(lattice);
       }
+      return forwardbackwardPruned<double>(lattice);
     }
 
-    const double Z = begin_node_list[len]->alpha;
-    lattice->set_Z(Z);  // alpha of EOS
+    return true;
+  }
 
-    for (int pos = 0; pos <= static_cast<long>(len); ++pos) {
-      for (Node* node = begin_node_list[pos]; node; node = node->bnext) {
-        node->prob = std::exp(node->alpha + node->beta - Z);
-        for (Path* path = node->lpath; path; path = path->lnext) {
-          path->prob = std::exp(path->lnode->alpha - theta * path->cost + path->rnode->beta - Z);
-        }
-      }
+  template <typename T>
+  bool forwardbackwardPruned(Lattice* lattice) const {
+    if (connector_->is_compressed()) {
+      const Connector::CompressedCost connector(connector_.get());
+      return forwardbackward_pruned<T>(lattice, &connector);
     }
-
-    return true;
+    const Connector::DenseCost connector(connector_.get());
+    return forwardbackward_pruned<T>(lattice, &connector);
   }
 
   static bool initPartial(Lattice* lattice) {
@@ -269,8 +273,9 @@ class Viterbi {
     std::vector<char*> lines;
     const size_t lsize = tokenize(str, "\n", std::back_inserter(lines), lattice->size() + 1);
     char* column[2];
-    scoped_array<char> buf(new char[lattice->size() + 1]);
-    StringBuffer os(buf.get(), lattice->size() + 1);
+    // surfaces and the terminating NUL; the last line may have no line break.
+    scoped_array<char> buf(new char[lattice->size() + 2]);
+    StringBuffer os(buf.get(), lattice->size() + 2);
 
     std::vector<std::pair<char*, char*>> tokens;
     tokens.reserve(lsize);
@@ -357,9 +362,12 @@ class Viterbi {
     return true;
   }
 
+  // destroyed after the tokenizer and the connector, which use its mapping
+  scoped_ptr<DictionaryPackage> package_;
   scoped_ptr<Tokenizer<Node, Path>> tokenizer_;
   scoped_ptr<Connector> connector_;
   int cost_factor_;
+  bool marginal_float_;
 };
 }  // namespace MeCab
 
@@ -3,7 +3,9 @@
 
 #include <string>
 
+#include "mecab/binary_format.h"
 #include "mecab/common.h"
+#include "mecab/node_format.h"
 #include "mecab/utils/param.h"
 #include "mecab/utils/scoped_ptr.h"
 #include "mecab/utils/string_buffer.h"
@@ -30,6 +32,8 @@ class Writer {
       write_ = &Writer::writeDump;
     } else if (ostyle == "em") {
       write_ = &Writer::writeEM;
+    } else if (ostyle == "binary") {
+      write_ = &Writer::writeBinary;
     } else {
       // default values
       std::string node_format = "%m\\t%H\\n";
@@ -82,11 +86,12 @@ class Writer {
         if (eon_format != eon_format2) {
           eon_format = eon_format2;
         }
-        node_format_.reset_string(node_format.c_str());
-        bos_format_.reset_string(bos_format.c_str());
-        eos_format_.reset_string(eos_format.c_str());
-        unk_format_.reset_string(unk_format.c_str());
-        eon_format_.reset_string(eon_format.c_str());
+        std::string error;
+        CHECK_FALSE(node_format_.compile(node_format.c_str(), &error)) << error;
+        CHECK_FALSE(bos_format_.compile(bos_format.c_str(), &error)) << error;
+        CHECK_FALSE(eos_format_.compile(eos_format.c_str(), &error)) << error;
+        CHECK_FALSE(unk_format_.compile(unk_format.c_str(), &error)) << error;
+        CHECK_FALSE(eon_format_.compile(eon_format.c_str(), &error)) << error;
       }
     }
 
@@ -122,255 +127,27 @@ class Writer {
   bool writeNode(Lattice* lattice, const Node* node, StringBuffer* os) const {
     switch (node->stat) {
       case MECAB_BOS_NODE:
-        return writeNode(lattice, bos_format_.get(), node, os);
+        return bos_format_.write(lattice, node, os);
       case MECAB_EOS_NODE:
-        return writeNode(lattice, eos_format_.get(), node, os);
+        return eos_format_.write(lattice, node, os);
       case MECAB_UNK_NODE:
-        return writeNode(lattice, unk_format_.get(), node, os);
+        return unk_format_.write(lattice, node, os);
       case MECAB_NOR_NODE:
-        return writeNode(lattice, node_format_.get(), node, os);
+        return node_format_.write(lattice, node, os);
       case MECAB_EON_NODE:
-        return writeNode(lattice, eon_format_.get(), node, os);
+        return eon_format_.write(lattice, node, os);
     }
     return true;
   }
 
-  bool writeNode(Lattice* lattice, const char* p, const Node* node, StringBuffer* os) const {
-    scoped_fixed_array<char, BUF_SIZE> buf;
-    scoped_fixed_array<char*, 64> ptr;
-    size_t psize = 0;
-
-    for (; *p; p++) {
-      switch (*p) {
-        default:
-          *os << *p;
-          break;
-
-        case '\\':
-          *os << getEscapedChar(*++p);
-          break;
-
-        case '%': {  // macros
-          switch (*++p) {
-            default: {
-              std::string error = "unknown meta char: ";
-              error += *p;
-              lattice->set_what(error.c_str());
-              return false;
-            }
-              // input sentence
-            case 'S':
-              os->write(lattice->sentence(), lattice->size());
-              break;
-              // sentence length
-            case 'L':
-              *os << lattice->size();
-              break;
-              // morph
-            case 'm':
-              os->write(node->surface, node->length);
-              break;
-            case 'M':
-              os->write(reinterpret_cast<const char*>(node->surface - node->rlength + node->length), node->rlength);
-              break;
-            case 'h':
-              *os << node->posid;
-              break;  // Part-Of-Speech ID
-            case '%':
-              *os << '%';
-              break;  // %
-            case 'c':
-              *os << static_cast<int>(node->wcost);
-              break;  // word cost
-            case 'H':
-              *os << node->feature;
-              break;
-            case 't':
-              *os << static_cast<unsigned int>(node->char_type);
-              break;
-            case 's':
-              *os << static_cast<unsigned int>(node->stat);
-              break;
-            case 'P':
-              *os << node->prob;
-              break;
-            case 'p': {
-              switch (*++p) {
-                default:
-                  lattice->set_what("[iseSCwcnblLh] is required after %p");
-                  return false;
-                case 'i':
-                  *os << node->id;
-                  break;  // node id
-                case 'S':
-                  os->write(reinterpret_cast<const char*>(node->surface - node->rlength + node->length),
-                            node->rlength - node->length);
-                  break;  // space
-                  // start position
-                case 's':
-                  *os << static_cast<int>(node->surface - lattice->sentence());
-                  break;
-                  // end position
-                case 'e':
-                  *os << static_cast<int>(node->surface - lattice->sentence() + node->length);
-                  break;
-                  // connection cost
-                case 'C':
-                  *os << node->cost - node->prev->cost - node->wcost;
-                  break;
-                case 'w':
-                  *os << node->wcost;
-                  break;  // word cost
-                case 'c':
-                  *os << node->cost;
-                  break;  // best cost
-                case 'n':
-                  *os << (node->cost - node->prev->cost);
-                  break;
-                  // node cost
-                  // * if best path, otherwise ' '
-                case 'b':
-                  *os << (node->isbest ? '*' : ' ');
-                  break;
-                case 'P':
-                  *os << node->prob;
-                  break;
-                case 'A':
-                  *os << node->alpha;
-                  break;
-                case 'B':
-                  *os << node->beta;
-                  break;
-                case 'l':
-                  *os << node->length;
-                  break;  // length of morph
-                  // length of morph including the spaces
-                case 'L':
-                  *os << node->rlength;
-                  break;
-                case 'h': {  // Hidden Layer ID
-                  switch (*++p) {
-                    default:
-                      lattice->set_what("lr is required after %ph");
-                      return false;
-                    case 'l':
-                      *os << node->lcAttr;
-                      break;  // current
-                    case 'r':
-                      *os << node->rcAttr;
-                      break;  // prev
-                  }
-                } break;
-
-                case 'p': {
-                  char mode = *++p;
-                  char sep = *++p;
-                  if (sep == '\\') {
-                    sep = getEscapedChar(*++p);
-                  }
-                  if (!node->lpath) {
-                    lattice->set_what("no path information is available");
-                    return false;
-                  }
-                  for (Path* path = node->lpath; path; path = path->lnext) {
-                    if (path != node->lpath)
-                      *os << sep;
-                    switch (mode) {
-                      case 'i':
-                        *os << path->lnode->id;
-                        break;
-                      case 'c':
-                        *os << path->cost;
-                        break;
-                      case 'P':
-                        *os << path->prob;
-                        break;
-                      default:
-                        lattice->set_what("[icP] is required after %pp");
-                        return false;
-                    }
-                  }
-                } break;
-              }
-            } break;
-
-            case 'F':
-            case 'f': {
-              if (node->feature[0] == '\0') {
-                lattice->set_what("no feature information available");
-                return false;
-              }
-              if (!psize) {
-                std::strncpy(buf.get(), node->feature, buf.size());
-                psize = tokenizeCSV(buf.get(), ptr.get(), ptr.size());
-              }
-
-              // separator
-              char separator = '\t';  // default separator
-              if (*p == 'F') {        // change separator
-                if (*++p == '\\') {
-                  separator = getEscapedChar(*++p);
-                } else {
-                  separator = *p;
-                }
-              }
-
-              if (*++p != '[') {
-                lattice->set_what("cannot find '['");
-                return false;
-              }
-              size_t n = 0;
-              bool sep = false;
-              bool isfil = false;
-              p++;
-
-              for (;; ++p) {
-                switch (*p) {
-                  case '0':
-                  case '1':
-                  case '2':
-                  case '3':
-                  case '4':
-                  case '5':
-                  case '6':
-                  case '7':
-                  case '8':
-                  case '9':
-                    n = 10 * n + (*p - '0');
-                    break;
-                  case ',':
-                  case ']':
-                    if (n >= psize) {
-                      lattice->set_what("given index is out of range");
-                      return false;
-                    }
-                    isfil = (ptr[n][0] != '*');
-                    if (isfil) {
-                      if (sep) {
-                        *os << separator;
-                      }
-                      *os << ptr[n];
-                    }
-                    if (*p == ']') {
-                      goto last;
-                    }
-                    sep = isfil;
-                    n = 0;
-                    break;
-                  default:
-                    lattice->set_what("cannot find ']'");
-                    return false;
-                }
-              }
-            }
-            last:
-              break;
-          }       // end switch
-        } break;  // end case '%'
-      }           // end switch
+  bool writeNode(Lattice* lattice, const char* format, const Node* node, StringBuffer* os) const {
+    NodeFormat node_format;
+    std::string error;
+    if (!node_format.compile(format, &error)) {
+      lattice->set_what(error.c_str());
+      return false;
     }
-
-    return true;
+    return node_format.write(lattice, node, os);
   }
 
   bool write(Lattice* lattice, StringBuffer* os) const {
@@ -380,13 +157,38 @@ class Writer {
     return (this->*write_)(lattice, os);
   }
 
+  // Write up to N best results followed by the end-of-NBest node.
+  bool writeNBest(Lattice* lattice, size_t N, StringBuffer* os) const {
+    if (N == 0 || N > NBEST_MAX) {
+      lattice->set_what("nbest size must be 1 <= nbest <= 512");
+      return false;
+    }
+
+    for (size_t i = 0; i < N; ++i) {
+      if (!lattice->next()) {
+        break;
+      }
+
+      if (!write(lattice, os)) {
+        return false;
+      }
+    }
+
+    Node eon_node;
+    memset(&eon_node, 0, sizeof(eon_node));
+    eon_node.stat = MECAB_EON_NODE;
+    eon_node.next = 0;
+    eon_node.surface = lattice->sentence() + lattice->size();
+    return writeNode(lattice, &eon_node, os);
+  }
+
  private:
   bool (Writer::*write_)(Lattice* lattice, StringBuffer* s) const;
-  scoped_string node_format_;
-  scoped_string bos_format_;
-  scoped_string eos_format_;
-  scoped_string unk_format_;
-  scoped_string eon_format_;
+  NodeFormat node_format_;
+  NodeFormat bos_format_;
+  NodeFormat eos_format_;
+  NodeFormat unk_format_;
+  NodeFormat eon_format_;
   scoped_ptr<StringBuffer> temp_buffer;
 
   StringBuffer* getStream() const { return temp_buffer.get(); }
@@ -428,31 +230,13 @@ class Writer {
   }
 
   const char* stringifyLatticeNBestInternal(Lattice* lattice, size_t N, StringBuffer* os) const {
-    if (N == 0 || N > NBEST_MAX) {
-      lattice->set_what("nbest size must be 1 <= nbest <= 512");
-      return 0;
-    }
-
-    for (size_t i = 0; i < N; ++i) {
-      if (!lattice->next()) {
-        break;
-      }
-
-      if (!write(lattice, os)) {
-        return 0;
-      }
-    }
+    os->clear();
 
-    Node eon_node;
-    memset(&eon_node, 0, sizeof(eon_node));
-    eon_node.stat = MECAB_EON_NODE;
-    eon_node.next = 0;
-    eon_node.surface = lattice->sentence() + lattice->size();
-    if (!writeNode(lattice, &eon_node, os)) {
+    if (!writeNBest(lattice, N, os)) {
       return 0;
     }
-    *os << '\0';
 
+    *os << '\0';
     if (!os->str()) {
       lattice->set_what("output buffer overflow");
       return 0;
@@ -483,22 +267,24 @@ class Writer {
     return true;  // do nothing
   }
   bool writeUser(Lattice* lattice, StringBuffer* os) const {
-    if (!writeNode(lattice, bos_format_.get(), lattice->bos_node(), os)) {
+    if (!bos_format_.write(lattice, lattice->bos_node(), os)) {
       return false;
     }
     const Node* node = 0;
     for (node = lattice->bos_node()->next; node->next; node = node->next) {
-      const char* fmt = (node->stat == MECAB_UNK_NODE ? unk_format_.get() : node_format_.get());
-      if (!writeNode(lattice, fmt, node, os)) {
+      const NodeFormat& fmt = (node->stat == MECAB_UNK_NODE ? unk_format_ : node_format_);
+      if (!fmt.write(lattice, node, os)) {
         return false;
       }
     }
-    if (!writeNode(lattice, eos_format_.get(), node, os)) {
+    if (!eos_format_.write(lattice, node, os)) {
       return false;
     }
     return true;
   }
 
+  bool writeBinary(Lattice* lattice, StringBuffer* os) const { return writeBinaryRecord(lattice, os); }
+
   bool writeDump(Lattice* lattice, StringBuffer* os) const {
     const char* str = lattice->sentence();
     for (const Node* node = lattice->bos_node(); node; node = node->next) {
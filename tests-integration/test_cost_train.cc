@@ -1,4 +1,9 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 #include <fstream>
+#include <iterator>
+#include <map>
 
 #include "fixture/tmpdir.h"
 #include "gmock/gmock.h"
@@ -24,6 +29,30 @@ void copy_file(std::string from, std::string to) {
 
   dst << src.rdbuf();
 }
+
+const char* kCorpusPath = "../test-data/cost-train/training-data.txt";
+const char* kSeedPath = "../test-data/cost-train/seed";
+const char* kTestPath = "../test-data/cost-train/test-data.txt";
+
+// Copies the seed dictionary to |tmpdir| and compiles it there, so that mecab-cost-train runs with -d |tmpdir|.
+// Call it with ASSERT_NO_FATAL_FAILURE().
+void compile_seed_dictionary(const fixture::TmpDir& tmpdir) {
+  ASSERT_TRUE(is_exists(kCorpusPath));
+  ASSERT_TRUE(is_exists(kSeedPath));
+
+  for (auto file : {"char.def", "dicrc", "dictionary.csv", "feature.def", "rewrite.def", "unk.def"}) {
+    copy_file(std::string(kSeedPath) + "/" + file, tmpdir.getPath() + "/" + file);
+  }
+
+  testing::internal::CaptureStdout();
+  testing::internal::CaptureStderr();
+  {
+    MAKE_ARGS(mecab_dict_index_args, "mecab-dict-index", "-d", kSeedPath, "-o", tmpdir.getPath());
+    mecab_dict_index(mecab_dict_index_args.size(), mecab_dict_index_args.data());
+  }
+  testing::internal::GetCapturedStderr();
+  testing::internal::GetCapturedStdout();
+}
 }  // namespace
 
 class mecab_cost_train_test : public testing::TestWithParam<size_t> {};
@@ -41,32 +70,194 @@ TEST_P(mecab_cost_train_test, run_with_thread_num) {
       "LEVEL 1:    11.7647(54/459) 11.2735(54/479) 11.5139\n"
       "LEVEL 2:    11.3290(52/459) 10.8559(52/479) 11.0874\n"
       "LEVEL 4:    11.3290(52/459) 10.8559(52/479) 11.0874";
-  const std::string corpusPath = "../test-data/cost-train/training-data.txt";
-  const std::string costTrainSeedPath = "../test-data/cost-train/seed";
-  const std::string costTrainTestPath = "../test-data/cost-train/test-data.txt";
 
-  ASSERT_TRUE(is_exists(corpusPath));
-  ASSERT_TRUE(is_exists(costTrainSeedPath));
-  ASSERT_TRUE(is_exists(costTrainTestPath));
+  ASSERT_TRUE(is_exists(kTestPath));
+  ASSERT_NO_FATAL_FAILURE(compile_seed_dictionary(tmpdir));
 
   const std::string modelPath = tmpdir.getPath() + "/model.bin";
   const std::string dicPath = tmpdir.createPath("dic");
   const std::string testProcessedPath = tmpdir.getPath() + "/test.txt";
   const std::string evalResultPath = tmpdir.getPath() + "/result.txt";
 
-  for (auto file : {"char.def", "dicrc", "dictionary.csv", "feature.def", "rewrite.def", "unk.def"}) {
-    copy_file(costTrainSeedPath + "/" + file, tmpdir.getPath() + "/" + file);
+  testing::internal::CaptureStdout();
+  testing::internal::CaptureStderr();
+  {
+    MAKE_ARGS(mecab_cost_train_args, "mecab-cost-train", "-c", "1.0", "-p", std::to_string(GetParam()), "-d",
+              tmpdir.getPath(), "-f", "1", kCorpusPath, modelPath);
+    mecab_cost_train(mecab_cost_train_args.size(), mecab_cost_train_args.data());
+  }
+  {
+    MAKE_ARGS(mecab_dict_gen_args, "mecab-dict-gen", "-d", tmpdir.getPath(), "-m", modelPath, "-o", dicPath);
+    mecab_dict_gen(mecab_dict_gen_args.size(), mecab_dict_gen_args.data());
+  }
+  {
+    MAKE_ARGS(mecab_dict_index_args, "mecab-dict-index", "-d", dicPath, "-o", dicPath);
+    mecab_dict_index(mecab_dict_index_args.size(), mecab_dict_index_args.data());
+  }
+  {
+    MAKE_ARGS(mecab_test_gen_args, "mecab-test-gen", "-o", testProcessedPath, kTestPath);
+    mecab_test_gen(mecab_test_gen_args.size(), mecab_test_gen_args.data());
+  }
+  {
+    MAKE_ARGS(run_mecab_main_args, "mecab", "-r", "/dev/null", "-d", dicPath, "-o", evalResultPath, testProcessedPath);
+    mecab_main(run_mecab_main_args.size(), run_mecab_main_args.data());
+  }
+  {
+    MAKE_ARGS(mecab_system_eval_args, "mecab-system-eval", "-l", "0 1 2 4", evalResultPath, kTestPath);
+    mecab_system_eval(mecab_system_eval_args.size(), mecab_system_eval_args.data());
   }
 
+  testing::internal::GetCapturedStderr();  // remove stdout
+  std::string captured = testing::internal::GetCapturedStdout();
+  ASSERT_THAT(captured, ::testing::HasSubstr(trainingResult));
+}
+
+class mecab_cost_train_algorithm_test : public testing::TestWithParam<std::string> {};
+
+TEST_P(mecab_cost_train_algorithm_test, run_with_algorithm) {
+  fixture::TmpDir tmpdir;
+  ASSERT_NO_FATAL_FAILURE(compile_seed_dictionary(tmpdir));
+
+  const std::string modelPath = tmpdir.getPath() + "/model.bin";
+
+  int result = -1;
   testing::internal::CaptureStdout();
   testing::internal::CaptureStderr();
   {
-    MAKE_ARGS(mecab_dict_index_args, "mecab-dict-index", "-d", costTrainSeedPath, "-o", tmpdir.getPath());
-    mecab_dict_index(mecab_dict_index_args.size(), mecab_dict_index_args.data());
+    MAKE_ARGS(mecab_cost_train_args, "mecab-cost-train", "-c", "1.0", "-p", "2", "-d", tmpdir.getPath(), "-f", "1",
+              "-a", GetParam(), "-b", "4", "-l", "0.05", "-i", "10", kCorpusPath, modelPath);
+    result = mecab_cost_train(mecab_cost_train_args.size(), mecab_cost_train_args.data());
+  }
+
+  testing::internal::GetCapturedStderr();
+  std::string captured = testing::internal::GetCapturedStdout();
+  ASSERT_EQ(result, 0);
+  ASSERT_THAT(captured, ::testing::HasSubstr("algorithm:           " + GetParam()));
+  ASSERT_THAT(captured, ::testing::HasSubstr("epoch=9 "));
+  ASSERT_TRUE(is_exists(modelPath));
+}
+
+TEST(mecab_cost_train_test, run_with_l1_regularization) {
+  fixture::TmpDir tmpdir;
+  ASSERT_NO_FATAL_FAILURE(compile_seed_dictionary(tmpdir));
+
+  std::map<std::string, size_t> model_lines;
+  testing::internal::CaptureStdout();
+  testing::internal::CaptureStderr();
+  for (auto regularization : {"l2", "l1", "elastic-net"}) {
+    const std::string modelPath = tmpdir.getPath() + "/" + regularization + ".bin";
+    MAKE_ARGS(mecab_cost_train_args, "mecab-cost-train", "-c", "1.0", "-d", tmpdir.getPath(), "-f", "1", "-R",
+              regularization, kCorpusPath, modelPath);
+    mecab_cost_train(mecab_cost_train_args.size(), mecab_cost_train_args.data());
+
+    std::ifstream model(modelPath);
+    for (std::string line; std::getline(model, line);) {
+      ++model_lines[regularization];
+    }
+  }
+
+  testing::internal::GetCapturedStderr();
+  std::string captured = testing::internal::GetCapturedStdout();
+  ASSERT_THAT(captured, ::testing::HasSubstr("regularization:      l1"));
+  // the features of zero weights are not written
+  EXPECT_GT(model_lines["l2"], 0);
+  EXPECT_LT(model_lines["elastic-net"], model_lines["l2"] / 10);
+  EXPECT_LT(model_lines["l1"], model_lines["elastic-net"]);
+}
+
+TEST(mecab_cost_train_test, run_with_threads_twice) {
+  fixture::TmpDir tmpdir;
+  ASSERT_NO_FATAL_FAILURE(compile_seed_dictionary(tmpdir));
+
+  // the threads add up the same sentences in the same order in every run
+  std::vector<std::string> models;
+  testing::internal::CaptureStdout();
+  testing::internal::CaptureStderr();
+  for (auto name : {"first.bin", "second.bin"}) {
+    const std::string modelPath = tmpdir.getPath() + "/" + name;
+    MAKE_ARGS(mecab_cost_train_args, "mecab-cost-train", "-c", "1.0", "-p", "4", "-d", tmpdir.getPath(), "-f", "1",
+              kCorpusPath, modelPath);
+    mecab_cost_train(mecab_cost_train_args.size(), mecab_cost_train_args.data());
+    std::ifstream model(modelPath);
+    models.push_back(std::string((std::istreambuf_iterator<char>(model)), std::istreambuf_iterator<char>()));
   }
+  testing::internal::GetCapturedStderr();
+  testing::internal::GetCapturedStdout();
+
+  ASSERT_FALSE(models[0].empty());
+  EXPECT_TRUE(models[1] == models[0]);
+}
+
+class mecab_cost_train_resume_test : public testing::TestWithParam<size_t> {};
+
+TEST_P(mecab_cost_train_resume_test, resume_from_checkpoint) {
+  fixture::TmpDir tmpdir;
+  ASSERT_NO_FATAL_FAILURE(compile_seed_dictionary(tmpdir));
+
+  const std::string checkpointPath = tmpdir.getPath() + "/checkpoint.bin";
+  const std::string modelPath = tmpdir.getPath() + "/model.bin";
+  const std::string resumedModelPath = tmpdir.getPath() + "/resumed.bin";
+  testing::internal::CaptureStdout();
+  testing::internal::CaptureStderr();
+  {
+    // the last checkpoint is of the iteration 10 or 20 of the whole training
+    MAKE_ARGS(mecab_cost_train_args, "mecab-cost-train", "-c", "1.0", "-p", std::to_string(GetParam()), "-d",
+              tmpdir.getPath(), "-f", "1", "-R", "elastic-net", "-k", checkpointPath, "-K", "10", kCorpusPath,
+              modelPath);
+    mecab_cost_train(mecab_cost_train_args.size(), mecab_cost_train_args.data());
+  }
+  testing::internal::GetCapturedStderr();
+  const std::string trained = testing::internal::GetCapturedStdout();
+
+  testing::internal::CaptureStdout();
+  testing::internal::CaptureStderr();
   {
     MAKE_ARGS(mecab_cost_train_args, "mecab-cost-train", "-c", "1.0", "-p", std::to_string(GetParam()), "-d",
-              tmpdir.getPath(), "-f", "1", corpusPath, modelPath);
+              tmpdir.getPath(), "-f", "1", "-R", "elastic-net", "-S", checkpointPath, kCorpusPath, resumedModelPath);
+    mecab_cost_train(mecab_cost_train_args.size(), mecab_cost_train_args.data());
+  }
+  testing::internal::GetCapturedStderr();
+  const std::string resumed = testing::internal::GetCapturedStdout();
+
+  ASSERT_TRUE(is_exists(checkpointPath));
+  EXPECT_FALSE(is_exists(checkpointPath + ".tmp"));
+  ASSERT_THAT(resumed, ::testing::HasSubstr("Resuming from checkpoint: " + checkpointPath));
+  EXPECT_THAT(resumed, ::testing::Not(::testing::HasSubstr("iter=0 ")));
+
+  // the resumed training runs the rest of the iterations as the whole training did, and writes the same model
+  const size_t iter = resumed.find("\niter=");
+  ASSERT_NE(iter, std::string::npos);
+  const std::string first_line = resumed.substr(iter + 1, resumed.find(" time=", iter) - iter - 1);
+  EXPECT_THAT(trained, ::testing::HasSubstr(first_line));
+  std::ifstream model(modelPath);
+  std::ifstream resumed_model(resumedModelPath);
+  const std::string model_text((std::istreambuf_iterator<char>(model)), std::istreambuf_iterator<char>());
+  const std::string resumed_model_text((std::istreambuf_iterator<char>(resumed_model)),
+                                       std::istreambuf_iterator<char>());
+  ASSERT_FALSE(model_text.empty());
+  EXPECT_EQ(resumed_model_text, model_text);
+}
+
+TEST(mecab_cost_train_test, run_with_hashed_features) {
+  fixture::TmpDir tmpdir;
+
+  const std::string trainingResult =
+      "              precision          recall         F\n"
+      "LEVEL 0:    12.4183(57/459) 11.8998(57/479) 12.1535\n";
+
+  ASSERT_TRUE(is_exists(kTestPath));
+  ASSERT_NO_FATAL_FAILURE(compile_seed_dictionary(tmpdir));
+
+  const std::string modelPath = tmpdir.getPath() + "/model.bin";
+  const std::string dicPath = tmpdir.createPath("dic");
+  const std::string testProcessedPath = tmpdir.getPath() + "/test.txt";
+  const std::string evalResultPath = tmpdir.getPath() + "/result.txt";
+
+  testing::internal::CaptureStdout();
+  testing::internal::CaptureStderr();
+  {
+    MAKE_ARGS(mecab_cost_train_args, "mecab-cost-train", "-c", "1.0", "-d", tmpdir.getPath(), "-f", "1", "-H",
+              "4096", kCorpusPath, modelPath);
     mecab_cost_train(mecab_cost_train_args.size(), mecab_cost_train_args.data());
   }
   {
@@ -78,7 +269,7 @@ TEST_P(mecab_cost_train_test, run_with_thread_num) {
     mecab_dict_index(mecab_dict_index_args.size(), mecab_dict_index_args.data());
   }
   {
-    MAKE_ARGS(mecab_test_gen_args, "mecab-test-gen", "-o", testProcessedPath, costTrainTestPath);
+    MAKE_ARGS(mecab_test_gen_args, "mecab-test-gen", "-o", testProcessedPath, kTestPath);
     mecab_test_gen(mecab_test_gen_args.size(), mecab_test_gen_args.data());
   }
   {
@@ -86,13 +277,212 @@ TEST_P(mecab_cost_train_test, run_with_thread_num) {
     mecab_main(run_mecab_main_args.size(), run_mecab_main_args.data());
   }
   {
-    MAKE_ARGS(mecab_system_eval_args, "mecab-system-eval", "-l", "0 1 2 4", evalResultPath, costTrainTestPath);
+    MAKE_ARGS(mecab_system_eval_args, "mecab-system-eval", "-l", "0", evalResultPath, kTestPath);
     mecab_system_eval(mecab_system_eval_args.size(), mecab_system_eval_args.data());
   }
 
-  testing::internal::GetCapturedStderr();  // remove stdout
+  testing::internal::GetCapturedStderr();
   std::string captured = testing::internal::GetCapturedStdout();
+  ASSERT_THAT(captured, ::testing::HasSubstr("hash-size:           4096"));
+  // the dictionary of the hashed model parses as well as the one of the whole features
   ASSERT_THAT(captured, ::testing::HasSubstr(trainingResult));
+
+  // the keys of the model are the buckets
+  std::ifstream model(modelPath);
+  std::string line;
+  bool hashed = false;
+  while (std::getline(model, line) && !line.empty()) {
+    hashed = hashed || line == "hash-size: 4096";
+  }
+  EXPECT_TRUE(hashed);
+  size_t buckets = 0;
+  while (std::getline(model, line)) {
+    const size_t tab = line.find('\t');
+    ASSERT_NE(tab, std::string::npos);
+    EXPECT_LT(std::stoul(line.substr(tab + 1)), 4096);
+    ++buckets;
+  }
+  EXPECT_GT(buckets, 0);
+  EXPECT_LE(buckets, 4096);
+
+  // the binary model has the buckets and the hash-size after them
+  MeCab::Param param;
+  std::string binary;
+  ASSERT_TRUE(MeCab::FeatureIndex::convert(param, modelPath.c_str(), &binary));
+  ASSERT_EQ(binary.size(), 4 + 32 + (sizeof(double) + sizeof(uint64_t)) * buckets + sizeof(uint64_t));
+  uint64_t hash_size = 0;
+  std::memcpy(&hash_size, binary.data() + binary.size() - sizeof(hash_size), sizeof(hash_size));
+  EXPECT_EQ(hash_size, 4096);
+
+  // the buckets do not depend on the threads which read the corpus
+  param.set("dicdir", tmpdir.getPath());
+  param.set("hash-size", "4096");
+  ASSERT_TRUE(param.parseFile((tmpdir.getPath() + "/dicrc").c_str()));
+  MeCab::Tokenizer<MeCab::LearnerNode, MeCab::LearnerPath> tokenizer;
+  ASSERT_TRUE(tokenizer.open(param));
+  std::vector<double> observed[2];
+  for (size_t i = 0; i < 2; ++i) {
+    MeCab::EncoderFeatureIndex feature_index;
+    ASSERT_TRUE(feature_index.open(param));
+    MeCab::CorpusReader reader(param, &tokenizer, &feature_index, param.get<size_t>("eval-size"),
+                               param.get<size_t>("unk-eval-size"));
+    std::vector<MeCab::EncoderLearnerTagger*> x;
+    testing::internal::CaptureStdout();
+    reader.read(kCorpusPath, i == 0 ? 1 : 3, &x, &observed[i]);
+    testing::internal::GetCapturedStdout();
+    EXPECT_EQ(feature_index.size(), 4096);
+    observed[i].resize(feature_index.size());
+    for (size_t j = 0; j < x.size(); ++j) {
+      delete x[j];
+    }
+  }
+  EXPECT_EQ(observed[1], observed[0]);
+}
+
+TEST(mecab_cost_train_test, compact_lattice_keeps_gradient) {
+  fixture::TmpDir tmpdir;
+  ASSERT_NO_FATAL_FAILURE(compile_seed_dictionary(tmpdir));
+
+  testing::internal::CaptureStdout();
+  testing::internal::CaptureStderr();
+
+  MeCab::Param param;
+  param.set("dicdir", tmpdir.getPath());
+  ASSERT_TRUE(param.parseFile((tmpdir.getPath() + "/dicrc").c_str()));
+  MeCab::EncoderFeatureIndex feature_index;
+  MeCab::Tokenizer<MeCab::LearnerNode, MeCab::LearnerPath> tokenizer;
+  MeCab::Allocator<MeCab::LearnerNode, MeCab::LearnerPath> allocator;
+  ASSERT_TRUE(tokenizer.open(param));
+  ASSERT_TRUE(feature_index.open(param));
+
+  // the same sentences with the lattices in the allocator and in CompactLattice
+  std::vector<MeCab::EncoderLearnerTagger*> full;
+  std::vector<MeCab::EncoderLearnerTagger*> compact;
+  std::vector<double> observed;
+  for (auto taggers : {&full, &compact}) {
+    std::ifstream ifs(kCorpusPath);
+    while (ifs) {
+      MeCab::EncoderLearnerTagger* tagger = new MeCab::EncoderLearnerTagger();
+      tagger->open(&tokenizer, &allocator, &feature_index, param.get<size_t>("eval-size"),
+                   param.get<size_t>("unk-eval-size"));
+      tagger->read(&ifs, &observed);
+      if (tagger->empty()) {
+        delete tagger;
+        continue;
+      }
+      if (taggers == &compact) {
+        tagger->compact();
+      }
+      taggers->push_back(tagger);
+    }
+  }
+  testing::internal::GetCapturedStderr();
+  testing::internal::GetCapturedStdout();
+  ASSERT_EQ(full.size(), compact.size());
+  ASSERT_GT(full.size(), 0);
+
+  std::vector<double> alpha(feature_index.size());
+  for (size_t i = 0; i < alpha.size(); ++i) {
+    alpha[i] = 0.01 * static_cast<double>(i % 7) - 0.03;
+  }
+  feature_index.set_alpha(&alpha[0]);
+
+  for (size_t i = 0; i < full.size(); ++i) {
+    EXPECT_EQ(full[i]->lattice_size(), compact[i]->lattice_size());
+
+    // the gradient of the full lattice is the reference, which CompactLattice computes up to rounding
+    std::vector<double> full_expected(alpha.size());
+    std::vector<double> compact_expected(alpha.size());
+    const double full_loss = full[i]->gradient(&full_expected[0]);
+    EXPECT_NEAR(full_loss, compact[i]->gradient(&compact_expected[0]), 1e-10 * std::fabs(full_loss));
+    for (size_t k = 0; k < alpha.size(); ++k) {
+      EXPECT_NEAR(full_expected[k], compact_expected[k], 1e-10 * std::max(1.0, std::fabs(full_expected[k])))
+          << "sentence " << i << ", feature " << k;
+    }
+
+    size_t full_eval[3] = {0, 0, 0};
+    size_t compact_eval[3] = {0, 0, 0};
+    EXPECT_EQ(full[i]->eval(&full_eval[0], &full_eval[1], &full_eval[2]),
+              compact[i]->eval(&compact_eval[0], &compact_eval[1], &compact_eval[2]));
+    EXPECT_EQ(std::vector<size_t>(full_eval, full_eval + 3), std::vector<size_t>(compact_eval, compact_eval + 3));
+
+    std::vector<double> full_observed(alpha.size());
+    std::vector<double> compact_observed(alpha.size());
+    full[i]->add_observed(&full_observed[0], 1.0);
+    compact[i]->add_observed(&compact_observed[0], 1.0);
+    EXPECT_EQ(full_observed, compact_observed);
+
+    delete full[i];
+    delete compact[i];
+  }
+}
+
+TEST(mecab_cost_train_test, parallel_reader_keeps_features) {
+  fixture::TmpDir tmpdir;
+  ASSERT_NO_FATAL_FAILURE(compile_seed_dictionary(tmpdir));
+
+  testing::internal::CaptureStdout();
+  testing::internal::CaptureStderr();
+
+  MeCab::Param param;
+  param.set("dicdir", tmpdir.getPath());
+  ASSERT_TRUE(param.parseFile((tmpdir.getPath() + "/dicrc").c_str()));
+  const size_t eval_size = param.get<size_t>("eval-size");
+  const size_t unk_eval_size = param.get<size_t>("unk-eval-size");
+  MeCab::Tokenizer<MeCab::LearnerNode, MeCab::LearnerPath> tokenizer;
+  ASSERT_TRUE(tokenizer.open(param));
+
+  // the corpus read by one thread, and by more threads than the sentences at last
+  const size_t thread_nums[] = {1, 2, 5, 64};
+  std::vector<MeCab::EncoderFeatureIndex*> feature_indexes;
+  std::vector<MeCab::CorpusReader*> readers;
+  std::vector<std::vector<MeCab::EncoderLearnerTagger*>> taggers(4);
+  std::vector<std::vector<double>> observed(4);
+  for (size_t i = 0; i < 4; ++i) {
+    feature_indexes.push_back(new MeCab::EncoderFeatureIndex());
+    ASSERT_TRUE(feature_indexes[i]->open(param));
+    readers.push_back(new MeCab::CorpusReader(param, &tokenizer, feature_indexes[i], eval_size, unk_eval_size));
+    readers[i]->read(kCorpusPath, thread_nums[i], &taggers[i], &observed[i]);
+    feature_indexes[i]->shrink(1, &observed[i]);
+  }
+  testing::internal::GetCapturedStderr();
+  testing::internal::GetCapturedStdout();
+  ASSERT_GT(taggers[0].size(), 0);
+
+  const size_t psize = feature_indexes[0]->size();
+  std::vector<double> alpha(psize);
+  for (size_t i = 0; i < alpha.size(); ++i) {
+    alpha[i] = 0.01 * static_cast<double>(i % 7) - 0.03;
+  }
+  observed[0].resize(psize);
+  for (size_t i = 0; i < 4; ++i) {
+    feature_indexes[i]->set_alpha(&alpha[0]);
+  }
+
+  for (size_t i = 1; i < 4; ++i) {
+    ASSERT_EQ(feature_indexes[i]->size(), psize) << thread_nums[i] << " threads";
+    ASSERT_EQ(taggers[i].size(), taggers[0].size()) << thread_nums[i] << " threads";
+    observed[i].resize(psize);
+    EXPECT_EQ(observed[i], observed[0]) << thread_nums[i] << " threads";
+
+    for (size_t j = 0; j < taggers[0].size(); ++j) {
+      EXPECT_EQ(taggers[i][j]->lattice_size(), taggers[0][j]->lattice_size());
+      std::vector<double> expected(psize);
+      std::vector<double> parallel_expected(psize);
+      EXPECT_EQ(taggers[0][j]->gradient(&expected[0]), taggers[i][j]->gradient(&parallel_expected[0]));
+      EXPECT_EQ(expected, parallel_expected) << thread_nums[i] << " threads, sentence " << j;
+    }
+  }
+
+  for (size_t i = 0; i < 4; ++i) {
+    for (size_t j = 0; j < taggers[i].size(); ++j) {
+      delete taggers[i][j];
+    }
+    delete readers[i];
+    delete feature_indexes[i];
+  }
 }
 
 INSTANTIATE_TEST_SUITE_P(ThreadNum, mecab_cost_train_test, testing::Values(1, 4));
+INSTANTIATE_TEST_SUITE_P(ThreadNum, mecab_cost_train_resume_test, testing::Values(1, 3));
+INSTANTIATE_TEST_SUITE_P(Algorithm, mecab_cost_train_algorithm_test, testing::Values("sgd", "adagrad", "adam"));
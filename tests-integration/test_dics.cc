@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <cstdio>
 #include <fstream>
 
 #include "fixture/tmpdir.h"
@@ -42,6 +43,75 @@ bool compare_files(const std::string filename1, const std::string filename2) {
 
   return std::equal(begin1, std::istreambuf_iterator<char>(), begin2);  // Second argument is end-of-range iterator
 }
+
+std::string dictionary_dir(const std::string& name) {
+  return "../test-data/" + name;
+}
+
+std::vector<char*> make_args(std::vector<std::string>* arguments) {
+  std::vector<char*> args;
+  for (size_t i = 0; i < arguments->size(); ++i) {
+    args.push_back(const_cast<char*>((*arguments)[i].c_str()));
+  }
+  return args;
+}
+
+// runs dict-index for the dictionary |name| into |processedDictionaryDir| and returns its stdout.
+std::string run_dict_index(const std::string& name,
+                           const std::string& processedDictionaryDir,
+                           const std::vector<std::string>& extra_args = {}) {
+  std::vector<std::string> arguments{"dict-index", "-d", dictionary_dir(name), "-o", processedDictionaryDir};
+  arguments.insert(arguments.end(), extra_args.begin(), extra_args.end());
+  std::vector<char*> args = make_args(&arguments);
+
+  ::testing::internal::CaptureStdout();
+  ::testing::internal::CaptureStderr();
+  mecab_dict_index(args.size(), args.data());
+  ::testing::internal::GetCapturedStderr();
+  return ::testing::internal::GetCapturedStdout();
+}
+
+// creates the directory |name| in |tmpdir| with the dicrc of the dictionary |name|.
+std::string create_dictionary_dir(const fixture::TmpDir& tmpdir, const std::string& name) {
+  const std::string processedDictionaryDir = tmpdir.createPath(name);
+  copy_file(dictionary_dir(name) + "/dicrc", processedDictionaryDir + "/dicrc");
+  return processedDictionaryDir;
+}
+
+// builds the dictionary |name| into a new directory of |tmpdir| and returns the directory.
+std::string build_dictionary(const fixture::TmpDir& tmpdir,
+                             const std::string& name,
+                             const std::vector<std::string>& extra_args = {}) {
+  const std::string processedDictionaryDir = create_dictionary_dir(tmpdir, name);
+  run_dict_index(name, processedDictionaryDir, extra_args);
+  return processedDictionaryDir;
+}
+
+// analyzes |input| with the dictionary |dicdir| into |outputPath|.
+void run_mecab(const std::string& dicdir,
+               const std::string& input,
+               const std::string& outputPath,
+               const std::vector<std::string>& extra_args = {}) {
+  std::vector<std::string> arguments{"mecab", "-r", "/dev/null", "-d", dicdir};
+  arguments.insert(arguments.end(), extra_args.begin(), extra_args.end());
+  arguments.insert(arguments.end(), {"-o", outputPath, input});
+  std::vector<char*> args = make_args(&arguments);
+
+  ::testing::internal::CaptureStdout();
+  ::testing::internal::CaptureStderr();
+  mecab_main(args.size(), args.data());
+  ::testing::internal::GetCapturedStdout();
+  ::testing::internal::GetCapturedStderr();
+}
+
+// analyzes the test of the dictionary |name| with |dicdir| and compares the output with its test.gld.
+void run_and_compare_gold(const std::string& name,
+                          const std::string& dicdir,
+                          const std::string& outputPath,
+                          const std::vector<std::string>& extra_args = {}) {
+  run_mecab(dicdir, dictionary_dir(name) + "/test", outputPath, extra_args);
+  EXPECT_TRUE(compare_files(outputPath, dictionary_dir(name) + "/test.gld")) << outputPath;
+}
 }  // namespace
 
 class mecab_dics_test : public testing::TestWithParam<const char*> {};
@@ -53,36 +123,182 @@ class mecab_dics_test : public testing::TestWithParam<const char*> {};
 TEST_P(mecab_dics_test, test_index_command) {
   fixture::TmpDir tmpdir;
 
-  const std::string dictionaryDir = "../test-data/" + std::string(GetParam());
-  const std::string processedDictionaryDir = tmpdir.createPath(GetParam());
+  const std::string dictionaryDir = dictionary_dir(GetParam());
+  ASSERT_TRUE(is_exists(dictionaryDir));
+  ASSERT_TRUE(is_exists(dictionaryDir + "/dicrc"));
+  ASSERT_TRUE(is_exists(dictionaryDir + "/test"));
+  ASSERT_TRUE(is_exists(dictionaryDir + "/test.gld"));
 
-  const std::string dicrc = dictionaryDir + "/dicrc";
-  const std::string testCase = dictionaryDir + "/test";
-  const std::string truePath = dictionaryDir + "/test.gld";
-  const std::string predictPath = processedDictionaryDir + "/output.txt";
+  const std::string processedDictionaryDir = build_dictionary(tmpdir, GetParam());
+  run_and_compare_gold(GetParam(), processedDictionaryDir, processedDictionaryDir + "/output.txt");
+}
 
-  ASSERT_TRUE(is_exists(dictionaryDir));
-  ASSERT_TRUE(is_exists(dicrc));
-  ASSERT_TRUE(is_exists(testCase));
-  ASSERT_TRUE(is_exists(truePath));
+TEST_P(mecab_dics_test, test_surface_only_keeps_segmentation) {
+  fixture::TmpDir tmpdir;
 
-  copy_file(dicrc, processedDictionaryDir + "/dicrc");
+  const std::string processedDictionaryDir = build_dictionary(tmpdir, GetParam());
+  const std::string testCase = dictionary_dir(GetParam()) + "/test";
+  const std::string wakatiPath = processedDictionaryDir + "/wakati.txt";
+  const std::string surfaceOnlyPath = processedDictionaryDir + "/surface-only.txt";
 
-  // remove stdout
-  ::testing::internal::CaptureStdout();
-  ::testing::internal::CaptureStderr();
-  {
-    MAKE_ARGS(mecab_dict_index_args, "dict-index", "-d", dictionaryDir, "-o", processedDictionaryDir);
-    mecab_dict_index(mecab_dict_index_args.size(), mecab_dict_index_args.data());
+  run_mecab(processedDictionaryDir, testCase, wakatiPath, {"-O", "wakati"});
+  run_mecab(processedDictionaryDir, testCase, surfaceOnlyPath, {"-s", "-O", "wakati"});
+
+  ASSERT_TRUE(is_exists(surfaceOnlyPath));
+  ASSERT_TRUE(compare_files(wakatiPath, surfaceOnlyPath));
+}
+
+TEST_P(mecab_dics_test, test_threads_keep_output_order) {
+  fixture::TmpDir tmpdir;
+
+  const std::string processedDictionaryDir = build_dictionary(tmpdir, GetParam());
+  const std::string testCase = dictionary_dir(GetParam()) + "/test";
+  const std::string nbestPath = processedDictionaryDir + "/nbest.txt";
+  const std::string nbestThreadsPath = processedDictionaryDir + "/nbest-threads.txt";
+
+  run_and_compare_gold(GetParam(), processedDictionaryDir, processedDictionaryDir + "/output.txt", {"-T", "4"});
+  run_mecab(processedDictionaryDir, testCase, nbestPath, {"-N", "3"});
+  run_mecab(processedDictionaryDir, testCase, nbestThreadsPath, {"-N", "3", "-T", "4"});
+
+  ASSERT_TRUE(is_exists(nbestThreadsPath));
+  ASSERT_TRUE(compare_files(nbestPath, nbestThreadsPath));
+}
+
+TEST_P(mecab_dics_test, test_parse_document_matches_sentences) {
+  fixture::TmpDir tmpdir;
+
+  const std::string processedDictionaryDir = build_dictionary(tmpdir, GetParam());
+
+  MAKE_ARGS(model_args, "mecab", "-r", "/dev/null", "-d", processedDictionaryDir);
+  MeCab::scoped_ptr<MeCab::Model> model(MeCab::Model::create(model_args.size(), model_args.data()));
+  ASSERT_TRUE(model.get());
+  MeCab::scoped_ptr<MeCab::Tagger> tagger(MeCab::Tagger::create(model.get()));
+
+  // every line of the test is a segment of the document.
+  std::ifstream ifs(dictionary_dir(GetParam()) + "/test");
+  std::string document;
+  std::vector<std::string> expected;
+  MeCab::Lattice lattice;
+  for (std::string line; std::getline(ifs, line);) {
+    line += "\n";
+    document += line;
+    lattice.set_sentence(line.c_str(), line.size());
+    ASSERT_TRUE(tagger->parse(&lattice));
+    for (const MeCab::Node* node = lattice.bos_node()->next; node->next; node = node->next) {
+      expected.push_back(std::string(node->surface, node->length) + "\t" + node->feature);
+    }
+  }
+
+  // the threads of a document are reused by the next ones, also when fewer of them are needed.
+  for (size_t thread_num : {1, 4, 2, 4}) {
+    lattice.set_request_type(MECAB_ONE_BEST | MECAB_ALLOCATE_SENTENCE);
+    lattice.set_sentence(document.c_str(), document.size());
+    ASSERT_TRUE(tagger->parseDocument(&lattice, thread_num)) << lattice.what();
+    std::vector<std::string> actual;
+    for (const MeCab::Node* node = lattice.bos_node()->next; node->next; node = node->next) {
+      EXPECT_EQ(std::string(node->surface, node->length),
+                document.substr(node->surface - lattice.sentence(), node->length));
+      actual.push_back(std::string(node->surface, node->length) + "\t" + node->feature);
+    }
+    EXPECT_EQ(actual, expected);
+  }
+}
+
+TEST_P(mecab_dics_test, test_feature_pool_keeps_output) {
+  for (const char* pool : {"dedup", "suffix"}) {
+    fixture::TmpDir tmpdir;
+    const std::string processedDictionaryDir = build_dictionary(tmpdir, GetParam(), {"-P", pool});
+    run_and_compare_gold(GetParam(), processedDictionaryDir, processedDictionaryDir + "/output.txt");
   }
+}
+
+TEST_P(mecab_dics_test, test_matrix_compression_keeps_output) {
+  fixture::TmpDir tmpdir;
+
+  // deduplicated rows and columns keep the costs as they are
+  const std::string processedDictionaryDir = build_dictionary(tmpdir, GetParam(), {"-X", "dedup"});
+  run_and_compare_gold(GetParam(), processedDictionaryDir, processedDictionaryDir + "/output.txt");
+}
+
+TEST_P(mecab_dics_test, test_package_keeps_output) {
+  fixture::TmpDir tmpdir;
+
+  const std::string processedDictionaryDir = build_dictionary(tmpdir, GetParam(), {"-k"});
+  const std::string package = tmpdir.createPath("package") + "/" + DIC_PACKAGE_FILE;
+
+  // the package is used without the other files of the dictionary
+  copy_file(processedDictionaryDir + "/" + DIC_PACKAGE_FILE, package);
+  run_and_compare_gold(GetParam(), package, processedDictionaryDir + "/output.txt");
+
+  MeCab::DictionaryPackage dictionaryPackage;
+  ASSERT_TRUE(dictionaryPackage.open(package.c_str()));
+  EXPECT_TRUE(dictionaryPackage.verify());
+  const char* begin = 0;
+  const char* end = 0;
+  EXPECT_TRUE(dictionaryPackage.find(SYS_DIC_FILE, &begin, &end));
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(begin) % 4096, 0);
+  EXPECT_FALSE(dictionaryPackage.find("model.bin", &begin, &end));
+  dictionaryPackage.close();
+
+  // a modified file in the package is detected by verify()
   {
-    MAKE_ARGS(mecab_main_args, "mecab", "-r", "/dev/null", "-d", processedDictionaryDir, "-o", predictPath, testCase);
-    mecab_main(mecab_main_args.size(), mecab_main_args.data());
+    std::fstream fs(package.c_str(), std::ios::binary | std::ios::in | std::ios::out);
+    fs.seekp(-1, std::ios::end);
+    fs.put('\xff');
   }
-  ::testing::internal::GetCapturedStdout();
-  ::testing::internal::GetCapturedStderr();
+  ASSERT_TRUE(dictionaryPackage.open(package.c_str()));
+  ::testing::internal::CaptureStderr();
+  EXPECT_FALSE(dictionaryPackage.verify());
+  EXPECT_NE(::testing::internal::GetCapturedStderr().find("package file is broken"), std::string::npos);
+}
+
+TEST_P(mecab_dics_test, test_dictionary_load_keeps_output) {
+  fixture::TmpDir tmpdir;
+
+  const std::string processedDictionaryDir = build_dictionary(tmpdir, GetParam(), {"-k"});
+  run_and_compare_gold(GetParam(), processedDictionaryDir, processedDictionaryDir + "/output.txt",
+                       {"-L", "prefault,hugepage"});
+  run_and_compare_gold(GetParam(), processedDictionaryDir + "/" + DIC_PACKAGE_FILE,
+                       processedDictionaryDir + "/output-package.txt", {"-L", "hugepage"});
+}
+
+TEST_P(mecab_dics_test, test_incremental_index_command) {
+  fixture::TmpDir tmpdir;
+
+  const std::string processedDictionaryDir = create_dictionary_dir(tmpdir, GetParam());
+  const std::string sysdic = processedDictionaryDir + "/sys.dic";
+
+  std::vector<std::string> outputs;
+  for (int i = 0; i < 3; ++i) {
+    if (i == 2) {
+      // a modified output is rebuilt.
+      std::ofstream(sysdic, std::ios::app) << "x";
+    }
+    outputs.push_back(run_dict_index(GetParam(), processedDictionaryDir, {"-I"}));
+  }
+
+  const std::string skipped = sysdic + " is up to date. skipped.";
+  EXPECT_EQ(outputs[0].find(skipped), std::string::npos);
+  EXPECT_NE(outputs[1].find(skipped), std::string::npos);
+  EXPECT_EQ(outputs[2].find(skipped), std::string::npos);
+  EXPECT_NE(outputs[2].find("(cached)"), std::string::npos);
+  EXPECT_TRUE(is_exists(processedDictionaryDir + "/dict-index.manifest"));
+
+  // building one of the outputs, or with another number of threads, does not rebuild it.
+  EXPECT_NE(run_dict_index(GetParam(), processedDictionaryDir, {"-I", "-s"}).find(skipped), std::string::npos);
+  EXPECT_NE(run_dict_index(GetParam(), processedDictionaryDir, {"-I", "-T", "1"}).find(skipped), std::string::npos);
+
+  // the outputs are kept by file name, so a moved output directory is up to date.
+  const std::string movedDictionaryDir = tmpdir.getPath() + "/moved";
+  ASSERT_EQ(std::rename(processedDictionaryDir.c_str(), movedDictionaryDir.c_str()), 0);
+  const std::string movedSkipped = movedDictionaryDir + "/sys.dic is up to date. skipped.";
+  EXPECT_NE(run_dict_index(GetParam(), movedDictionaryDir, {"-I"}).find(movedSkipped), std::string::npos);
+
+  // an option which Dictionary::compile reads rebuilds it.
+  EXPECT_EQ(run_dict_index(GetParam(), movedDictionaryDir, {"-I", "-P", "dedup"}).find(movedSkipped),
+            std::string::npos);
 
-  ASSERT_TRUE(compare_files(predictPath, truePath));
+  run_and_compare_gold(GetParam(), movedDictionaryDir, movedDictionaryDir + "/output.txt");
 }
 
 INSTANTIATE_TEST_SUITE_P(DictionaryName,
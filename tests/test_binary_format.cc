@@ -0,0 +1,79 @@
+#include <string>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "mecab/binary_format.h"
+#include "mecab/lattice.h"
+
+namespace {
+
+const char* kResult =
+    "すもも\t名詞,一般,*,*,*,*,すもも,スモモ,スモモ\n"
+    "も\t助詞,係助詞,*,*,*,*,も,モ,モ\n"
+    "もも\t名詞,一般,*,*,*,*,もも,モモ,モモ\n"
+    "EOS\n";
+
+}  // namespace
+
+TEST(mecab_binary_format, test_write_and_read_record) {
+  MeCab::Lattice lattice;
+  lattice.set_result(kResult);
+  int cost = -1000;
+  for (MeCab::Node* node = lattice.bos_node()->next; node->next; node = node->next) {
+    node->posid = 7;
+    node->lcAttr = 100;
+    node->rcAttr = 200;
+    node->wcost = -3;
+    node->cost = cost;
+    cost *= 5;
+  }
+
+  MeCab::StringBuffer os;
+  ASSERT_TRUE(MeCab::writeBinaryRecord(&lattice, &os));
+  ASSERT_TRUE(MeCab::writeBinaryRecord(&lattice, &os));
+  const std::string data(os.str(), os.size());
+
+  MeCab::BinaryRecord record;
+  const size_t size = MeCab::readBinaryRecord(data.data(), data.size(), &record);
+  ASSERT_EQ(size * 2, data.size());
+  ASSERT_EQ(std::string(record.sentence, record.size), "すももももも");
+  ASSERT_EQ(record.tokens.size(), 3);
+  ASSERT_EQ(record.features.size(), 3);
+
+  const char* surfaces[] = {"すもも", "も", "もも"};
+  cost = -1000;
+  for (size_t i = 0; i < record.tokens.size(); ++i) {
+    const MeCab::BinaryToken& token = record.tokens[i];
+    EXPECT_EQ(record.surface(token), surfaces[i]);
+    EXPECT_EQ(token.posid, 7);
+    EXPECT_EQ(token.lcAttr, 100);
+    EXPECT_EQ(token.rcAttr, 200);
+    EXPECT_EQ(token.wcost, -3);
+    EXPECT_EQ(token.cost, cost);
+    cost *= 5;
+    ASSERT_TRUE(record.feature(token));
+    EXPECT_EQ(token.feature_id, MeCab::fingerprint(record.feature(token)->feature, record.feature(token)->size));
+  }
+  EXPECT_EQ(std::string(record.feature(record.tokens[1])->feature, record.feature(record.tokens[1])->size),
+            "助詞,係助詞,*,*,*,*,も,モ,モ");
+
+  MeCab::BinaryRecord second;
+  ASSERT_EQ(MeCab::readBinaryRecord(data.data() + size, data.size() - size, &second), size);
+  EXPECT_EQ(second.tokens[2].feature_id, record.tokens[2].feature_id);
+}
+
+TEST(mecab_binary_format, test_read_truncated_record) {
+  MeCab::Lattice lattice;
+  lattice.set_result(kResult);
+  MeCab::StringBuffer os;
+  ASSERT_TRUE(MeCab::writeBinaryRecord(&lattice, &os));
+  const std::string data(os.str(), os.size());
+
+  MeCab::BinaryRecord record;
+  for (size_t size = 0; size < data.size(); ++size) {
+    EXPECT_EQ(MeCab::readBinaryRecord(data.data(), size, &record), 0);
+  }
+  std::string broken = data;
+  broken[0] = 'X';
+  EXPECT_EQ(MeCab::readBinaryRecord(broken.data(), broken.size(), &record), 0);
+}
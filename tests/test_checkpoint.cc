@@ -0,0 +1,65 @@
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "mecab/checkpoint.h"
+
+namespace {
+// one step of minimizing sum (i + 1)^2 (x_i - center_i)^2 / 2 + sum |x_i| / 2
+int step(MeCab::LBFGS* lbfgs, const std::vector<double>& center, std::vector<double>* x) {
+  double f = 0.0;
+  std::vector<double> g(x->size());
+  for (size_t i = 0; i < x->size(); ++i) {
+    const double scale = (i + 1.0) * (i + 1.0);
+    f += scale * ((*x)[i] - center[i]) * ((*x)[i] - center[i]) / 2.0 + std::fabs((*x)[i]) / 2.0;
+    g[i] = scale * ((*x)[i] - center[i]);
+  }
+  return lbfgs->optimize(x->size(), &(*x)[0], f, &g[0], true, 2.0);
+}
+}  // namespace
+
+TEST(mecab_checkpoint, test_resume_lbfgs) {
+  const std::string filename = "test-checkpoint.bin";
+  const std::vector<const char*> keys = {"U00:a", "B00:a/b", "U01:c", "B01:c/d"};
+  const std::vector<double> center = {2.0, 0.1, -3.0, -0.5};
+  std::vector<double> x(center.size(), 0.0);
+  MeCab::LBFGS lbfgs;
+  for (int itr = 0; itr < 3; ++itr) {
+    ASSERT_EQ(step(&lbfgs, center, &x), 1);
+  }
+
+  MeCab::Checkpoint checkpoint(keys.size(), keys);
+  const MeCab::CheckpointState state = {3, 1, 0.5, 1.5, 0.0, 2.0};
+  checkpoint.write(filename, state, x, &lbfgs);
+  ASSERT_TRUE(checkpoint.wait());
+
+  MeCab::CheckpointState resumed_state;
+  std::vector<double> resumed_x;
+  MeCab::LBFGS resumed;
+  ASSERT_TRUE(checkpoint.read(filename, &resumed_state, &resumed_x, &resumed));
+  EXPECT_EQ(resumed_state.iteration, 3);
+  EXPECT_EQ(resumed_state.converge, 1);
+  EXPECT_EQ(resumed_state.objective, 0.5);
+  EXPECT_EQ(resumed_state.seconds, 1.5);
+  EXPECT_EQ(resumed_state.l1_cost, 2.0);
+  EXPECT_EQ(resumed_x, x);
+
+  // both continue bit-identically, through the line searches of the rest of the optimization
+  for (int itr = 0; itr < 100; ++itr) {
+    const int ret = step(&lbfgs, center, &x);
+    ASSERT_EQ(step(&resumed, center, &resumed_x), ret);
+    ASSERT_EQ(resumed_x, x);
+    if (ret <= 0) {
+      break;
+    }
+  }
+
+  // a checkpoint of other features is not read
+  MeCab::Checkpoint other(keys.size(), {"U00:a", "B00:a/b", "U01:c", "B01:c/e"});
+  EXPECT_FALSE(other.read(filename, &resumed_state, &resumed_x, &resumed));
+
+  std::remove(filename.c_str());
+}
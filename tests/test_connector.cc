@@ -0,0 +1,245 @@
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "mecab/connector.h"
+
+namespace {
+
+// files are written in the working directory and removed by the tests.
+const char* kMatrixDef = "test-connector-matrix.def";
+const char* kMatrixBin = "test-connector-matrix.bin";
+const char* kMatrixBin2 = "test-connector-matrix2.bin";
+
+short expected_cost(size_t l, size_t r) {
+  return static_cast<short>((l * 7919 + r * 104729) % 20000) - 10000;
+}
+
+// a matrix.def large enough to be parsed in several parts
+void write_matrix_def(size_t lsize, size_t rsize) {
+  std::ofstream ofs(kMatrixDef);
+  ofs << lsize << " " << rsize << "\n";
+  for (size_t r = 0; r < rsize; ++r) {
+    for (size_t l = 0; l < lsize; ++l) {
+      ofs << l << ((l + r) % 2 ? "\t" : " ") << r << " " << expected_cost(l, r) << "\n";
+    }
+  }
+}
+
+std::string read_file(const char* filename) {
+  std::ifstream ifs(filename, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+}
+
+void compile_quietly(const char* ifile, const char* ofile, size_t thread_num, const std::string& compression = "") {
+  testing::internal::CaptureStdout();
+  MeCab::Connector::compile(ifile, ofile, thread_num, compression);
+  testing::internal::GetCapturedStdout();
+}
+
+// costs of 40 distinct rows and 30 distinct columns. costs of a row range over |range|.
+short duplicated_cost(size_t l, size_t r, int range) {
+  return static_cast<short>(((l % 30) * 7919 + (r % 40) * 104729) % range + (r % 40) * 100 - 2000);
+}
+
+void write_duplicated_matrix_def(size_t lsize, size_t rsize, int range) {
+  std::ofstream ofs(kMatrixDef);
+  ofs << lsize << " " << rsize << "\n";
+  for (size_t r = 0; r < rsize; ++r) {
+    for (size_t l = 0; l < lsize; ++l) {
+      ofs << l << " " << r << " " << duplicated_cost(l, r, range) << "\n";
+    }
+  }
+}
+
+}  // namespace
+
+TEST(mecab_connector, test_compile_in_parallel) {
+  const size_t lsize = 600;
+  const size_t rsize = 500;
+  write_matrix_def(lsize, rsize);
+  compile_quietly(kMatrixDef, kMatrixBin, 4);
+  compile_quietly(kMatrixDef, kMatrixBin2, 1);
+
+  MeCab::Connector connector;
+  ASSERT_TRUE(connector.open(kMatrixBin));
+  ASSERT_TRUE(connector.verify());
+  ASSERT_EQ(connector.left_size(), lsize);
+  ASSERT_EQ(connector.right_size(), rsize);
+  for (size_t r = 0; r < rsize; ++r) {
+    for (size_t l = 0; l < lsize; ++l) {
+      ASSERT_EQ(connector.transition_cost(l, r), expected_cost(l, r));
+    }
+  }
+  EXPECT_EQ(read_file(kMatrixBin), read_file(kMatrixBin2));
+
+  std::remove(kMatrixDef);
+  std::remove(kMatrixBin);
+  std::remove(kMatrixBin2);
+}
+
+TEST(mecab_connector, test_open_matrix_without_header) {
+  const short matrix[] = {2, 3, 1, 2, 3, 4, 5, -6};
+  {
+    std::ofstream ofs(kMatrixBin, std::ios::binary);
+    ofs.write(reinterpret_cast<const char*>(matrix), sizeof(matrix));
+  }
+
+  MeCab::Connector connector;
+  ASSERT_TRUE(connector.open(kMatrixBin));
+  EXPECT_EQ(connector.left_size(), 2);
+  EXPECT_EQ(connector.right_size(), 3);
+  EXPECT_EQ(connector.transition_cost(1, 0), 2);
+  EXPECT_EQ(connector.transition_cost(1, 2), -6);
+  connector.close();
+
+  std::remove(kMatrixBin);
+}
+
+TEST(mecab_connector, test_reject_broken_matrix) {
+  {
+    std::ofstream ofs(kMatrixDef);
+    ofs << "2 2\n0 0 1\n1 0 2\n0 1 3\n1 1 4\n";
+  }
+  compile_quietly(kMatrixDef, kMatrixBin, 1);
+
+  std::string data = read_file(kMatrixBin);
+  ASSERT_EQ(data.size(), sizeof(MeCab::MatrixHeader) + 4 * sizeof(short));
+  data[data.size() - 1] ^= 1;
+  {
+    std::ofstream ofs(kMatrixBin, std::ios::binary);
+    ofs << data;
+  }
+
+  // open() checks only the header and the sizes, and verify() finds the broken data.
+  MeCab::Connector connector;
+  ASSERT_TRUE(connector.open(kMatrixBin));
+  testing::internal::CaptureStderr();
+  EXPECT_FALSE(connector.verify());
+  EXPECT_THAT(testing::internal::GetCapturedStderr(), testing::HasSubstr("matrix file is broken"));
+  connector.close();
+
+  std::remove(kMatrixDef);
+  std::remove(kMatrixBin);
+}
+
+TEST(mecab_connector, test_compile_invalid_lines) {
+  {
+    std::ofstream ofs(kMatrixDef);
+    ofs << "2 2\n0 0 1\n1 x 2\n";
+  }
+  EXPECT_DEATH(compile_quietly(kMatrixDef, kMatrixBin, 1), "format error: 1 x 2");
+
+  {
+    std::ofstream ofs(kMatrixDef);
+    ofs << "2 2\n0 0 1\n2 0 2\n";
+  }
+  EXPECT_DEATH(compile_quietly(kMatrixDef, kMatrixBin, 1), "index values are out of range: 2 0 2");
+
+  std::remove(kMatrixDef);
+  std::remove(kMatrixBin);
+}
+
+TEST(mecab_connector, test_dedup_matrix_is_lossless) {
+  const size_t lsize = 300;
+  const size_t rsize = 200;
+  write_duplicated_matrix_def(lsize, rsize, 5000);
+  compile_quietly(kMatrixDef, kMatrixBin, 1, "dedup");
+
+  MeCab::Connector connector;
+  ASSERT_TRUE(connector.open(kMatrixBin));
+  ASSERT_TRUE(connector.is_compressed());
+  ASSERT_EQ(connector.left_size(), lsize);
+  ASSERT_EQ(connector.right_size(), rsize);
+  for (size_t r = 0; r < rsize; ++r) {
+    for (size_t l = 0; l < lsize; ++l) {
+      ASSERT_EQ(connector.transition_cost(l, r), duplicated_cost(l, r, 5000));
+    }
+  }
+  // 40 rows and 30 columns are stored
+  const std::string data = read_file(kMatrixBin);
+  EXPECT_EQ(data.size(), sizeof(MeCab::MatrixHeader) + sizeof(MeCab::CompressedMatrixHeader) +
+                             sizeof(short) * (lsize + rsize + 40 * 30));
+  connector.close();
+
+  std::remove(kMatrixDef);
+  std::remove(kMatrixBin);
+}
+
+TEST(mecab_connector, test_dense_and_compressed_costs) {
+  const size_t lsize = 60;
+  const size_t rsize = 80;
+  write_duplicated_matrix_def(lsize, rsize, 5000);
+  compile_quietly(kMatrixDef, kMatrixBin, 1);
+  compile_quietly(kMatrixDef, kMatrixBin2, 1, "dedup");
+
+  MeCab::Connector dense;
+  ASSERT_TRUE(dense.open(kMatrixBin));
+  ASSERT_FALSE(dense.is_compressed());
+  MeCab::Connector compressed;
+  ASSERT_TRUE(compressed.open(kMatrixBin2));
+  ASSERT_TRUE(compressed.is_compressed());
+
+  const MeCab::Connector::DenseCost dense_cost(&dense);
+  const MeCab::Connector::CompressedCost compressed_cost(&compressed);
+  MeCab::Node lnode = MeCab::Node();
+  MeCab::Node rnode = MeCab::Node();
+  rnode.wcost = 3;
+  for (size_t r = 0; r < rsize; ++r) {
+    for (size_t l = 0; l < lsize; ++l) {
+      lnode.rcAttr = l;
+      rnode.lcAttr = r;
+      ASSERT_EQ(dense_cost.cost(&lnode, &rnode), duplicated_cost(l, r, 5000) + 3);
+      ASSERT_EQ(compressed_cost.cost(&lnode, &rnode), duplicated_cost(l, r, 5000) + 3);
+      ASSERT_EQ(compressed.cost(&lnode, &rnode), dense.cost(&lnode, &rnode));
+    }
+  }
+
+  // the raw matrix of a compressed matrix is not a lsize * rsize array
+  EXPECT_DEATH(compressed.mutable_matrix(), "raw matrix is not available for a compressed matrix");
+  EXPECT_DEATH(MeCab::Connector::DenseCost{&compressed}, "raw matrix is not available for a compressed matrix");
+  EXPECT_DEATH(MeCab::Connector::CompressedCost{&dense}, "matrix is not compressed");
+
+  std::remove(kMatrixDef);
+  std::remove(kMatrixBin);
+  std::remove(kMatrixBin2);
+}
+
+TEST(mecab_connector, test_delta_matrix) {
+  const size_t lsize = 300;
+  const size_t rsize = 200;
+
+  // rows ranging over 256 costs are lossless
+  write_duplicated_matrix_def(lsize, rsize, 256);
+  compile_quietly(kMatrixDef, kMatrixBin, 1, "delta8");
+  {
+    MeCab::Connector connector;
+    ASSERT_TRUE(connector.open(kMatrixBin));
+    ASSERT_TRUE(connector.is_compressed());
+    ASSERT_TRUE(connector.verify());
+    for (size_t r = 0; r < rsize; ++r) {
+      for (size_t l = 0; l < lsize; ++l) {
+        ASSERT_EQ(connector.transition_cost(l, r), duplicated_cost(l, r, 256));
+      }
+    }
+  }
+
+  // rows ranging over 5000 costs are rounded to multiples of 32 from their minimum
+  write_duplicated_matrix_def(lsize, rsize, 5000);
+  compile_quietly(kMatrixDef, kMatrixBin, 1, "delta8");
+  {
+    MeCab::Connector connector;
+    ASSERT_TRUE(connector.open(kMatrixBin));
+    for (size_t r = 0; r < rsize; ++r) {
+      for (size_t l = 0; l < lsize; ++l) {
+        ASSERT_LE(std::abs(connector.transition_cost(l, r) - duplicated_cost(l, r, 5000)), 16);
+      }
+    }
+  }
+
+  std::remove(kMatrixDef);
+  std::remove(kMatrixBin);
+}
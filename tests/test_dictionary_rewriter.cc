@@ -0,0 +1,52 @@
+#include <cstdio>
+#include <fstream>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "mecab/dictionary_rewriter.h"
+
+namespace {
+
+// files are written in the working directory and removed by the tests.
+const char* kRewriteDef = "test-dictionary-rewriter-rewrite.def";
+
+void write_rewrite_def() {
+  std::ofstream ofs(kRewriteDef);
+  ofs << "[unigram rewrite]\nnoun,*\t$1,$2\n"
+      << "[left rewrite]\nnoun,*\t$1\n"
+      << "[right rewrite]\nnoun,*\t$2\n";
+}
+
+}  // namespace
+
+TEST(mecab_dictionary_rewriter, test_rewrite_matched_feature) {
+  write_rewrite_def();
+  MeCab::DictionaryRewriter rewriter;
+  ASSERT_TRUE(rewriter.open(kRewriteDef));
+
+  const MeCab::FeatureSet* features = rewriter.rewrite2("noun,proper");
+  ASSERT_TRUE(features);
+  EXPECT_EQ(features->ufeature, "noun,proper");
+  EXPECT_EQ(features->lfeature, "noun");
+  EXPECT_EQ(features->rfeature, "proper");
+  EXPECT_EQ(rewriter.rewrite2("noun,proper"), features);
+  EXPECT_EQ(&rewriter.rewrite_or_empty("noun,proper"), features);
+
+  std::remove(kRewriteDef);
+}
+
+TEST(mecab_dictionary_rewriter, test_rewrite_unmatched_feature) {
+  write_rewrite_def();
+  MeCab::DictionaryRewriter rewriter;
+  ASSERT_TRUE(rewriter.open(kRewriteDef));
+
+  // a miss is cached too, and the dictionary tools get empty features for it
+  EXPECT_FALSE(rewriter.rewrite2("verb,base"));
+  EXPECT_FALSE(rewriter.rewrite2("verb,base"));
+  const MeCab::FeatureSet& features = rewriter.rewrite_or_empty("verb,base");
+  EXPECT_EQ(features.ufeature, "");
+  EXPECT_EQ(features.lfeature, "");
+  EXPECT_EQ(features.rfeature, "");
+
+  std::remove(kRewriteDef);
+}
@@ -0,0 +1,49 @@
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "mecab/lbfgs.h"
+
+namespace {
+// minimize sum (x_i - center_i)^2 / 2 and, with |orthant|, sum |x_i| / C
+std::vector<double> minimize(const std::vector<double>& center, bool orthant, double C) {
+  std::vector<double> x(center.size(), 0.0);
+  std::vector<double> g(center.size(), 0.0);
+  MeCab::LBFGS lbfgs;
+  for (int itr = 0; itr < 100; ++itr) {
+    double f = 0.0;
+    for (size_t i = 0; i < x.size(); ++i) {
+      f += (x[i] - center[i]) * (x[i] - center[i]) / 2.0;
+      if (orthant) {
+        f += std::fabs(x[i]) / C;
+      }
+      g[i] = x[i] - center[i];
+    }
+    const int ret = lbfgs.optimize(x.size(), &x[0], f, &g[0], orthant, C);
+    EXPECT_GE(ret, 0);
+    if (ret <= 0) {
+      break;
+    }
+  }
+  return x;
+}
+}  // namespace
+
+TEST(mecab_lbfgs, test_optimize) {
+  const std::vector<double> x = minimize({2.0, 0.1, -3.0}, false, 1.0);
+
+  EXPECT_NEAR(x[0], 2.0, 1e-6);
+  EXPECT_NEAR(x[1], 0.1, 1e-6);
+  EXPECT_NEAR(x[2], -3.0, 1e-6);
+}
+
+TEST(mecab_lbfgs, test_optimize_with_l1) {
+  // the L1 penalty moves the minimum towards zero by 1 / C, and keeps the weights whose gradient at zero is
+  // smaller than 1 / C at exactly zero
+  const std::vector<double> x = minimize({2.0, 0.1, -3.0, -0.5}, true, 1.0);
+
+  EXPECT_NEAR(x[0], 1.0, 1e-6);
+  EXPECT_EQ(x[1], 0.0);
+  EXPECT_NEAR(x[2], -2.0, 1e-6);
+  EXPECT_EQ(x[3], 0.0);
+}
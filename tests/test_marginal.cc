@@ -0,0 +1,304 @@
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "mecab/lattice.h"
+#include "mecab/marginal.h"
+
+namespace {
+
+// Connection costs of a random lattice, looked up like MeCab::Connector.
+class RandomConnector {
+ public:
+  int cost(const MeCab::Node* lnode, const MeCab::Node* rnode) const {
+    return costs_.find(key(lnode, rnode))->second;
+  }
+  void set_cost(const MeCab::Node* lnode, const MeCab::Node* rnode, int cost) { costs_[key(lnode, rnode)] = cost; }
+
+ private:
+  static uint64_t key(const MeCab::Node* lnode, const MeCab::Node* rnode) {
+    return (static_cast<uint64_t>(lnode->id) << 32) | rnode->id;
+  }
+  std::unordered_map<uint64_t, int> costs_;
+};
+
+// Builds a fully connected lattice over |sentence| where every position starts
+// |width| nodes of each length from 1 to 3, and every edge gets a random connection cost.
+// Node::cost and Node::prev are set to the best path from BOS as Viterbi does.
+void build_random_lattice(MeCab::Lattice* lattice,
+                          const char* sentence,
+                          unsigned int seed,
+                          size_t width = 1,
+                          RandomConnector* connector = 0) {
+  std::mt19937 rng(seed);
+  std::uniform_int_distribution<int> cost(-3000, 3000);
+
+  lattice->set_sentence(sentence);
+  const size_t len = lattice->size();
+  MeCab::Node** begin_node_list = lattice->begin_nodes();
+  MeCab::Node** end_node_list = lattice->end_nodes();
+  MeCab::Allocator<MeCab::Node, MeCab::Path>* allocator = lattice->allocator();
+
+  MeCab::Node* bos_node = lattice->newNode();
+  bos_node->stat = MECAB_BOS_NODE;
+  end_node_list[0] = bos_node;
+
+  for (size_t pos = 0; pos <= len; ++pos) {
+    if (!end_node_list[pos]) {
+      continue;
+    }
+    std::vector<MeCab::Node*> rnodes;
+    if (pos == len) {
+      MeCab::Node* eos_node = lattice->newNode();
+      eos_node->stat = MECAB_EOS_NODE;
+      rnodes.push_back(eos_node);
+    } else {
+      for (size_t length = 1; length <= 3 && pos + length <= len; ++length) {
+        for (size_t i = 0; i < width; ++i) {
+          MeCab::Node* node = lattice->newNode();
+          node->length = node->rlength = length;
+          rnodes.push_back(node);
+        }
+      }
+    }
+
+    for (size_t i = 0; i < rnodes.size(); ++i) {
+      MeCab::Node* rnode = rnodes[i];
+      rnode->cost = 2147483647;
+      for (MeCab::Node* lnode = end_node_list[pos]; lnode; lnode = lnode->enext) {
+        MeCab::Path* path = allocator->newPath();
+        path->cost = cost(rng);
+        path->rnode = rnode;
+        path->lnode = lnode;
+        path->lnext = rnode->lpath;
+        rnode->lpath = path;
+        path->rnext = lnode->rpath;
+        lnode->rpath = path;
+        if (lnode->cost + path->cost < rnode->cost) {
+          rnode->cost = lnode->cost + path->cost;
+          rnode->prev = lnode;
+        }
+        if (connector) {
+          connector->set_cost(lnode, rnode, path->cost);
+        }
+      }
+      rnode->bnext = begin_node_list[pos];
+      begin_node_list[pos] = rnode;
+    }
+
+    // EOS is linked into end_node_list[len] as Viterbi does.
+    for (size_t i = 0; i < rnodes.size(); ++i) {
+      const size_t x = pos + rnodes[i]->rlength;
+      rnodes[i]->enext = end_node_list[x];
+      end_node_list[x] = rnodes[i];
+    }
+  }
+}
+
+// Marks the nodes on the best path with Node::isbest.
+void mark_best_path(MeCab::Lattice* lattice) {
+  for (MeCab::Node* node = lattice->eos_node(); node; node = node->prev) {
+    node->isbest = 1;
+  }
+}
+
+struct Marginals {
+  std::vector<float> alpha, beta, prob, path_prob;
+  double Z;
+};
+
+Marginals collect(MeCab::Lattice* lattice) {
+  Marginals m;
+  m.Z = lattice->Z();
+  for (size_t pos = 0; pos <= lattice->size(); ++pos) {
+    for (const MeCab::Node* node = lattice->begin_nodes(pos); node; node = node->bnext) {
+      m.alpha.push_back(node->alpha);
+      m.beta.push_back(node->beta);
+      m.prob.push_back(node->prob);
+      for (const MeCab::Path* path = node->lpath; path; path = path->lnext) {
+        m.path_prob.push_back(path->prob);
+      }
+    }
+  }
+  return m;
+}
+
+void expect_near(const Marginals& expected, const Marginals& actual, double score_tolerance, double prob_tolerance) {
+  ASSERT_EQ(expected.alpha.size(), actual.alpha.size());
+  ASSERT_EQ(expected.path_prob.size(), actual.path_prob.size());
+  EXPECT_NEAR(expected.Z, actual.Z, score_tolerance * std::max(1.0, std::abs(expected.Z)));
+  for (size_t i = 0; i < expected.alpha.size(); ++i) {
+    EXPECT_NEAR(expected.alpha[i], actual.alpha[i], score_tolerance * std::max(1.0f, std::abs(expected.alpha[i])));
+    EXPECT_NEAR(expected.beta[i], actual.beta[i], score_tolerance * std::max(1.0f, std::abs(expected.beta[i])));
+    EXPECT_NEAR(expected.prob[i], actual.prob[i], prob_tolerance);
+  }
+  for (size_t i = 0; i < expected.path_prob.size(); ++i) {
+    EXPECT_NEAR(expected.path_prob[i], actual.path_prob[i], prob_tolerance);
+  }
+}
+
+// Every position is covered by exactly one node of each path.
+void expect_node_marginals_sum_to_one(const MeCab::Lattice& lattice) {
+  for (size_t pos = 0; pos < lattice.size(); ++pos) {
+    double sum = 0.0;
+    for (size_t begin = 0; begin <= pos; ++begin) {
+      for (const MeCab::Node* node = lattice.begin_nodes(begin); node; node = node->bnext) {
+        if (begin + node->rlength > pos) {
+          sum += node->prob;
+        }
+      }
+    }
+    EXPECT_NEAR(sum, 1.0, 1e-3);
+  }
+}
+
+}  // namespace
+
+TEST(mecab_marginal, test_fast_exp_and_log) {
+  for (double x = -60.0; x <= 60.0; x += 0.37) {
+    EXPECT_NEAR(MeCab::fast_exp(x) / std::exp(x), 1.0, 1e-14);
+    EXPECT_NEAR(MeCab::fast_exp(static_cast<float>(x)) / std::exp(static_cast<float>(x)), 1.0, 1e-6);
+  }
+  for (double x = 1e-6; x < 1e6; x *= 1.7) {
+    EXPECT_NEAR(MeCab::fast_log(x), std::log(x), 1e-14);
+    EXPECT_NEAR(MeCab::fast_log(static_cast<float>(x)), std::log(static_cast<float>(x)), 1e-6);
+  }
+}
+
+TEST(mecab_marginal, test_forwardbackward_fast_matches_reference) {
+  const char* sentences[] = {"a", "abcdefgh", "abcdefghijklmnopqrstuvwxyz0123456789"};
+  const float thetas[] = {0.75f, 0.01f, 0.001f};
+
+  for (size_t i = 0; i < sizeof(sentences) / sizeof(sentences[0]); ++i) {
+    for (size_t j = 0; j < sizeof(thetas) / sizeof(thetas[0]); ++j) {
+      MeCab::Lattice lattice;
+      build_random_lattice(&lattice, sentences[i], static_cast<unsigned int>(i * 10 + j));
+      lattice.set_theta(thetas[j]);
+
+      ASSERT_TRUE(MeCab::forwardbackward_reference(&lattice));
+      const Marginals reference = collect(&lattice);
+
+      MeCab::Lattice float_lattice;
+      build_random_lattice(&float_lattice, sentences[i], static_cast<unsigned int>(i * 10 + j));
+      float_lattice.set_theta(thetas[j]);
+      ASSERT_TRUE(MeCab::forwardbackward_fast(&float_lattice));
+      expect_near(reference, collect(&float_lattice), 1e-5, 1e-3);
+    }
+  }
+}
+
+TEST(mecab_marginal, test_forwardbackward_fast_wide_lattice) {
+  // 300 paths leave every node, more than the initial capacity of the scratch buffer.
+  MeCab::Lattice lattice;
+  build_random_lattice(&lattice, "abcdef", 7, 100);
+  lattice.set_theta(0.01f);
+  ASSERT_TRUE(MeCab::forwardbackward_reference(&lattice));
+  const Marginals reference = collect(&lattice);
+
+  MeCab::Lattice float_lattice;
+  build_random_lattice(&float_lattice, "abcdef", 7, 100);
+  float_lattice.set_theta(0.01f);
+  ASSERT_TRUE(MeCab::forwardbackward_fast(&float_lattice));
+  expect_near(reference, collect(&float_lattice), 1e-5, 1e-3);
+}
+
+TEST(mecab_marginal, test_marginal_buffer_keeps_paths_on_growth) {
+  // a node with more right paths than the initial capacity grows the buffer in the middle of its paths.
+  MeCab::Lattice lattice;
+  build_random_lattice(&lattice, "abcdef", 7, 100);
+  MeCab::MarginalBuffer<float> buffer(&lattice);
+  const size_t node_size = lattice.allocator()->node_size();
+  for (size_t i = 0; i < node_size; ++i) {
+    buffer.costs()[i] = static_cast<long>(i);
+    buffer.alpha()[i] = i * 0.5f;
+    buffer.beta()[i] = i * 0.25f;
+  }
+
+  const MeCab::Node* bos_node = lattice.bos_node();
+  std::vector<MeCab::Path*> paths;
+  for (MeCab::Path* path = bos_node->rpath; path; path = path->rnext) {
+    paths.push_back(path);
+  }
+  ASSERT_GT(paths.size(), buffer.capacity());
+
+  size_t size = 0;
+  for (size_t i = 0; i < paths.size(); ++i) {
+    if (size == buffer.capacity()) {
+      buffer.reserve(size + 1);
+    }
+    buffer.scores()[size] = static_cast<float>(i);
+    buffer.paths()[size++] = paths[i];
+  }
+
+  for (size_t i = 0; i < node_size; ++i) {
+    EXPECT_EQ(buffer.costs()[i], static_cast<long>(i));
+    EXPECT_EQ(buffer.alpha()[i], i * 0.5f);
+    EXPECT_EQ(buffer.beta()[i], i * 0.25f);
+  }
+  for (size_t i = 0; i < paths.size(); ++i) {
+    EXPECT_EQ(buffer.scores()[i], static_cast<float>(i));
+    EXPECT_EQ(buffer.paths()[i], paths[i]);
+  }
+}
+
+TEST(mecab_marginal, test_forwardbackward_fast_node_marginals_sum_to_one) {
+  MeCab::Lattice lattice;
+  build_random_lattice(&lattice, "abcdefghijklmnop", 42);
+  lattice.set_theta(0.01f);
+  ASSERT_TRUE(MeCab::forwardbackward_fast(&lattice));
+  expect_node_marginals_sum_to_one(lattice);
+}
+
+TEST(mecab_marginal, test_forwardbackward_pruned_without_pruning_matches_reference) {
+  const size_t widths[] = {1, 100};
+  for (size_t i = 0; i < sizeof(widths) / sizeof(widths[0]); ++i) {
+    MeCab::Lattice lattice;
+    build_random_lattice(&lattice, "abcdefgh", 3, widths[i]);
+    lattice.set_theta(0.01f);
+    ASSERT_TRUE(MeCab::forwardbackward_reference(&lattice));
+    Marginals reference = collect(&lattice);
+    reference.path_prob.clear();
+
+    MeCab::Lattice pruned_lattice;
+    RandomConnector connector;
+    build_random_lattice(&pruned_lattice, "abcdefgh", 3, widths[i], &connector);
+    pruned_lattice.set_theta(0.01f);
+    pruned_lattice.set_margin(1e6f);
+    ASSERT_TRUE(MeCab::forwardbackward_pruned<double>(&pruned_lattice, &connector));
+    Marginals pruned = collect(&pruned_lattice);
+    pruned.path_prob.clear();
+    expect_near(reference, pruned, 1e-6, 1e-4);
+  }
+}
+
+TEST(mecab_marginal, test_forwardbackward_pruned_keeps_nodes_near_best_path) {
+  const float margins[] = {0.0f, 1.0f, 5.0f};
+  for (size_t i = 0; i < sizeof(margins) / sizeof(margins[0]); ++i) {
+    MeCab::Lattice lattice;
+    RandomConnector connector;
+    build_random_lattice(&lattice, "abcdefghijklmnopqrstuvwxyz", 11, 2, &connector);
+    mark_best_path(&lattice);
+    lattice.set_theta(0.01f);
+    lattice.set_margin(margins[i]);
+    ASSERT_TRUE(MeCab::forwardbackward_pruned<float>(&lattice, &connector));
+
+    size_t pruned_size = 0;
+    for (size_t pos = 0; pos < lattice.size(); ++pos) {
+      for (const MeCab::Node* node = lattice.begin_nodes(pos); node; node = node->bnext) {
+        if (node->isbest) {
+          EXPECT_GT(node->prob, 0.0f);
+        }
+        if (margins[i] == 0.0f) {
+          EXPECT_NEAR(node->prob, node->isbest ? 1.0f : 0.0f, 1e-4);
+        }
+        if (node->prob == 0.0f) {
+          ++pruned_size;
+        }
+      }
+    }
+    EXPECT_GT(pruned_size, 0);
+    expect_node_marginals_sum_to_one(lattice);
+  }
+}
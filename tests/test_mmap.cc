@@ -36,3 +36,58 @@ TEST(mecab_mmap, test_open_mmap_instance_with_invalid_mode) {
   EXPECT_THAT(captured,
               ::testing::HasSubstr("unknown open mode: ../test-data/cc/file-used-in-test-mmap.txt mode: invalid"));
 }
+
+TEST(mecab_mmap, test_open_mmap_instance_with_load) {
+  const int loads[] = {MeCab::MMAP_PREFAULT, MeCab::MMAP_LOCK, MeCab::MMAP_HUGEPAGE,
+                       MeCab::MMAP_PREFAULT | MeCab::MMAP_LOCK | MeCab::MMAP_HUGEPAGE};
+  for (size_t i = 0; i < sizeof(loads) / sizeof(loads[0]); ++i) {
+    MeCab::Mmap<char> mmap;
+    ASSERT_TRUE(mmap.open("../test-data/cc/file-used-in-test-mmap.txt", "r", loads[i]));
+    ASSERT_EQ(std::string(mmap.begin(), mmap.end()), "test content\n");
+    ASSERT_EQ(mmap.file_size(), 13);
+    if (loads[i] & MeCab::MMAP_HUGEPAGE) {
+      // copied to memory aligned to huge pages
+      EXPECT_EQ(reinterpret_cast<uintptr_t>(mmap.begin()) % (2 << 20), 0);
+    }
+    mmap.close();
+    ASSERT_EQ(mmap.begin(), nullptr);
+  }
+}
+
+TEST(mecab_mmap, test_parse_mmap_load) {
+  int load = -1;
+  ASSERT_TRUE(MeCab::parse_mmap_load("", &load));
+  EXPECT_EQ(load, 0);
+  ASSERT_TRUE(MeCab::parse_mmap_load("prefault", &load));
+  EXPECT_EQ(load, MeCab::MMAP_PREFAULT);
+  ASSERT_TRUE(MeCab::parse_mmap_load("hugepage,mlock", &load));
+  EXPECT_EQ(load, MeCab::MMAP_HUGEPAGE | MeCab::MMAP_LOCK);
+
+  testing::internal::CaptureStderr();
+  EXPECT_FALSE(MeCab::parse_mmap_load("prefault,populate", &load));
+  EXPECT_THAT(testing::internal::GetCapturedStderr(), ::testing::HasSubstr("unknown dictionary load option: populate"));
+}
+
+// the lowest file descriptor which is not in use
+int next_fd() {
+  const int fd = ::dup(0);
+  ::close(fd);
+  return fd;
+}
+
+TEST(mecab_mmap, test_open_mmap_instance_releases_file_on_failure) {
+  // a directory is opened, but it can be neither mapped nor read
+  const int loads[] = {0, MeCab::MMAP_HUGEPAGE};
+  for (size_t i = 0; i < sizeof(loads) / sizeof(loads[0]); ++i) {
+    MeCab::Mmap<char> mmap;
+    testing::internal::CaptureStderr();
+    const int fd = next_fd();
+    const bool opened = mmap.open("../test-data/cc", "r", loads[i]);
+    const int fd_after_open = next_fd();
+    testing::internal::GetCapturedStderr();
+    ASSERT_FALSE(opened);
+    EXPECT_EQ(fd_after_open, fd);
+    EXPECT_EQ(mmap.begin(), nullptr);
+    EXPECT_EQ(mmap.file_size(), 0);
+  }
+}
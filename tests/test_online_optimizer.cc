@@ -0,0 +1,72 @@
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "mecab/online_optimizer.h"
+
+TEST(mecab_online_optimizer, test_parse) {
+  MeCab::OnlineOptimizer::Algorithm algorithm;
+  ASSERT_TRUE(MeCab::OnlineOptimizer::parse("sgd", &algorithm));
+  ASSERT_EQ(algorithm, MeCab::OnlineOptimizer::SGD);
+  ASSERT_TRUE(MeCab::OnlineOptimizer::parse("adagrad", &algorithm));
+  ASSERT_EQ(algorithm, MeCab::OnlineOptimizer::ADAGRAD);
+  ASSERT_TRUE(MeCab::OnlineOptimizer::parse("adam", &algorithm));
+  ASSERT_EQ(algorithm, MeCab::OnlineOptimizer::ADAM);
+
+  testing::internal::CaptureStderr();
+  ASSERT_FALSE(MeCab::OnlineOptimizer::parse("lbfgs", &algorithm));
+  EXPECT_THAT(testing::internal::GetCapturedStderr(), ::testing::HasSubstr("unknown algorithm: lbfgs"));
+}
+
+TEST(mecab_online_optimizer, test_sgd_update) {
+  const std::vector<double> origin(2, 0.0);
+  std::vector<double> x(2, 0.0);
+  const std::vector<double> g = {1.0, -2.0};
+  const int ids[] = {0, 1};
+  MeCab::OnlineOptimizer optimizer(MeCab::OnlineOptimizer::SGD, x.size(), 0.0, &origin[0]);
+
+  optimizer.update(&x[0], ids, 2, &g[0], 0.5);
+  EXPECT_DOUBLE_EQ(x[0], -0.5);
+  EXPECT_DOUBLE_EQ(x[1], 1.0);
+}
+
+TEST(mecab_online_optimizer, test_sgd_lazy_regularization) {
+  const std::vector<double> origin = {1.0, 1.0};
+  const std::vector<double> g = {0.3, 0.0};
+  const int ids[] = {0};
+  const double rate = 0.1;
+  const double decay = 0.5;
+
+  // only the weight 0 is in the gradients, and the decay of the weight 1 is applied by finish()
+  std::vector<double> lazy = {2.0, 3.0};
+  MeCab::OnlineOptimizer optimizer(MeCab::OnlineOptimizer::SGD, lazy.size(), decay, &origin[0]);
+  for (int i = 0; i < 3; ++i) {
+    optimizer.update(&lazy[0], ids, 1, &g[0], rate);
+  }
+  EXPECT_DOUBLE_EQ(lazy[1], 3.0);
+  optimizer.finish(&lazy[0], rate);
+
+  std::vector<double> eager = {2.0, 3.0};
+  for (int i = 0; i < 3; ++i) {
+    for (size_t k = 0; k < eager.size(); ++k) {
+      eager[k] -= rate * (g[k] + decay * (eager[k] - origin[k]));
+    }
+  }
+  EXPECT_DOUBLE_EQ(lazy[0], eager[0]);
+  EXPECT_DOUBLE_EQ(lazy[1], eager[1]);
+}
+
+TEST(mecab_online_optimizer, test_adaptive_update) {
+  const std::vector<double> origin(1, 0.0);
+  const std::vector<double> g = {4.0};
+  const int ids[] = {0};
+
+  // the first step of adagrad and adam is the learning rate in the opposite direction of the gradient
+  std::vector<double> adagrad(1, 0.0);
+  MeCab::OnlineOptimizer(MeCab::OnlineOptimizer::ADAGRAD, 1, 0.0, &origin[0]).update(&adagrad[0], ids, 1, &g[0], 0.1);
+  EXPECT_NEAR(adagrad[0], -0.1, 1e-6);
+
+  std::vector<double> adam(1, 0.0);
+  MeCab::OnlineOptimizer(MeCab::OnlineOptimizer::ADAM, 1, 0.0, &origin[0]).update(&adam[0], ids, 1, &g[0], 0.1);
+  EXPECT_NEAR(adam[0], -0.1, 1e-6);
+}
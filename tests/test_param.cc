@@ -256,6 +256,15 @@ TEST(mecab_utils_param, test_value_containing_whitespcae) {
   ASSERT_EQ(param.get<std::string>("arg-option"), "0 1 2 4");
 }
 
+TEST(mecab_utils_param, test_parse_flag_before_argument) {
+  MeCab::Param param;
+
+  MAKE_ARGS(arguments, "command", "-t", "-a", "hello", "--test-option", "--arg-option", "world");
+  ASSERT_TRUE(param.parse(arguments.size(), arguments.data(), options));
+  ASSERT_TRUE(param.get<bool>("test-option"));
+  ASSERT_EQ(param.get<std::string>("arg-option"), "world");
+}
+
 TEST(mecab_utils_param, test_parse_autolink_dicrc) {
   MeCab::Param param;
 
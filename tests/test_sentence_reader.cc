@@ -0,0 +1,61 @@
+#include <string>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "mecab/cli/sentence_reader.h"
+
+namespace {
+
+// file content: "first line\n\nEOS\nlast line" without the last line break
+const char* kFile = "../test-data/cc/file-used-in-test-sentence-reader.txt";
+
+std::vector<std::string> read_all(MeCab::SentenceReader* reader) {
+  std::vector<std::string> sentences;
+  const char* sentence = 0;
+  size_t length = 0;
+  while (reader->next(&sentence, &length)) {
+    sentences.push_back(std::string(sentence, length));
+  }
+  return sentences;
+}
+
+}  // namespace
+
+TEST(mecab_sentence_reader, test_read_lines_of_mapped_file) {
+  MeCab::SentenceReader reader(kFile, 8192, false);
+  ASSERT_TRUE(reader.good());
+  ASSERT_TRUE(reader.is_mapped());
+
+  const std::vector<std::string> sentences = read_all(&reader);
+  ASSERT_EQ(sentences.size(), 4);
+  EXPECT_EQ(sentences[0], "first line");
+  EXPECT_EQ(sentences[1], "");
+  EXPECT_EQ(sentences[2], "EOS");
+  EXPECT_EQ(sentences[3], "last line");
+}
+
+TEST(mecab_sentence_reader, test_read_partial_sentences_of_mapped_file) {
+  MeCab::SentenceReader reader(kFile, 8192, true);
+  ASSERT_TRUE(reader.is_mapped());
+
+  const std::vector<std::string> sentences = read_all(&reader);
+  ASSERT_EQ(sentences.size(), 3);
+  EXPECT_EQ(sentences[0], "first line\n\n");
+  EXPECT_EQ(sentences[1], "EOS\n");
+  EXPECT_EQ(sentences[2], "last line");
+}
+
+TEST(mecab_sentence_reader, test_mapped_line_has_no_length_limit) {
+  MeCab::SentenceReader reader(kFile, 4, false);
+
+  const std::vector<std::string> sentences = read_all(&reader);
+  ASSERT_EQ(sentences.size(), 4);
+  EXPECT_EQ(sentences[0], "first line");
+}
+
+TEST(mecab_sentence_reader, test_missing_file) {
+  MeCab::SentenceReader reader("../test-data/cc/no-such-file.txt", 8192, false);
+  EXPECT_FALSE(reader.good());
+  EXPECT_FALSE(reader.is_mapped());
+}
@@ -0,0 +1,81 @@
+#include <string>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "mecab/lattice.h"
+#include "mecab/writer.h"
+
+namespace {
+
+const char* kResult =
+    "すもも\t名詞,一般,*,*,*,*,すもも,スモモ,スモモ\n"
+    "も\t助詞,係助詞,*,*,*,*,も,モ,モ\n"
+    "もも\t名詞,一般,*,*,*,*,もも,モモ,モモ\n"
+    "EOS\n";
+
+std::string write_node(MeCab::Lattice* lattice, const char* format, const MeCab::Node* node) {
+  MeCab::Writer writer;
+  MeCab::StringBuffer os;
+  if (!writer.writeNode(lattice, format, node, &os)) {
+    return std::string("error: ") + lattice->what();
+  }
+  os << '\0';
+  return os.str();
+}
+
+}  // namespace
+
+TEST(mecab_writer, test_write_node_format) {
+  MeCab::Lattice lattice;
+  lattice.set_result(kResult);
+  const MeCab::Node* node = lattice.bos_node()->next;
+
+  EXPECT_EQ(write_node(&lattice, "%m\\t%H\\n", node), "すもも\t名詞,一般,*,*,*,*,すもも,スモモ,スモモ\n");
+  EXPECT_EQ(write_node(&lattice, "%f[7]/%f[6]/%F-[0,1,2,3]", node), "スモモ/すもも/名詞-一般");
+  EXPECT_EQ(write_node(&lattice, "%F\\t[2,0,1] 100%%", node), "名詞\t一般 100%");
+  EXPECT_EQ(write_node(&lattice, "%ps-%pe %pl %S", node->next), "9-12 3 すももももも");
+}
+
+TEST(mecab_writer, test_write_node_format_error) {
+  MeCab::Lattice lattice;
+  lattice.set_result(kResult);
+  const MeCab::Node* node = lattice.bos_node()->next;
+
+  EXPECT_EQ(write_node(&lattice, "%z", node), "error: unknown meta char: z");
+  EXPECT_EQ(write_node(&lattice, "%px", node), "error: [iseSCwcnblLh] is required after %p");
+  EXPECT_EQ(write_node(&lattice, "%ppx,", node), "error: [icP] is required after %pp");
+  EXPECT_EQ(write_node(&lattice, "%f0]", node), "error: cannot find '['");
+  EXPECT_EQ(write_node(&lattice, "%f[0", node), "error: cannot find ']'");
+  EXPECT_EQ(write_node(&lattice, "%f[9]", node), "error: given index is out of range");
+  EXPECT_EQ(write_node(&lattice, "%ppi,", node), "error: no path information is available");
+}
+
+TEST(mecab_writer, test_write_user_format) {
+  MeCab::Param param;
+  param.set("output-format-type", "");
+  param.set("node-format", "%m/%f[7] ");
+  param.set("unk-format", "%m/%f[7] ");
+  param.set("bos-format", "");
+  param.set("eos-format", "\\n");
+  param.set("eon-format", "");
+
+  MeCab::Writer writer;
+  ASSERT_TRUE(writer.open(param));
+  MeCab::Lattice lattice;
+  lattice.set_result(kResult);
+  MeCab::StringBuffer os;
+  ASSERT_TRUE(writer.write(&lattice, &os));
+  os << '\0';
+  EXPECT_STREQ(os.str(), "すもも/スモモ も/モ もも/モモ \n");
+}
+
+TEST(mecab_writer, test_open_rejects_malformed_format) {
+  MeCab::Param param;
+  param.set("output-format-type", "");
+  param.set("node-format", "%f[0");
+
+  MeCab::Writer writer;
+  testing::internal::CaptureStderr();
+  EXPECT_FALSE(writer.open(param));
+  EXPECT_THAT(testing::internal::GetCapturedStderr(), ::testing::HasSubstr("cannot find ']'"));
+}
@@ -0,0 +1,47 @@
+#include <algorithm>
+#include <cstdlib>
+#include <utility>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "mecab/utils/parallel_sort.h"
+
+namespace {
+
+struct first_less {
+  bool operator()(const std::pair<int, int>& x, const std::pair<int, int>& y) const { return x.first < y.first; }
+};
+
+}  // namespace
+
+TEST(mecab_parallel_sort, test_parallel_stable_sort_keeps_order_of_equal_elements) {
+  std::vector<std::pair<int, int>> values;
+  std::srand(0);
+  for (int i = 0; i < 100000; ++i) {
+    values.push_back(std::make_pair(std::rand() % 100, i));
+  }
+  std::vector<std::pair<int, int>> expected = values;
+  std::stable_sort(expected.begin(), expected.end(), first_less());
+
+  for (size_t thread_num = 1; thread_num <= 5; ++thread_num) {
+    std::vector<std::pair<int, int>> actual = values;
+    MeCab::parallel_stable_sort(actual.begin(), actual.end(), first_less(), thread_num);
+    EXPECT_EQ(actual, expected) << thread_num << " threads";
+  }
+}
+
+TEST(mecab_parallel_sort, test_parallel_stable_sort_small_range) {
+  std::vector<std::pair<int, int>> values;
+  MeCab::parallel_stable_sort(values.begin(), values.end(), first_less(), 4);
+  EXPECT_TRUE(values.empty());
+
+  values.push_back(std::make_pair(2, 0));
+  values.push_back(std::make_pair(1, 1));
+  values.push_back(std::make_pair(2, 2));
+  MeCab::parallel_stable_sort(values.begin(), values.end(), first_less(), 4);
+  ASSERT_EQ(values.size(), 3);
+  EXPECT_EQ(values[0], std::make_pair(1, 1));
+  EXPECT_EQ(values[1], std::make_pair(2, 0));
+  EXPECT_EQ(values[2], std::make_pair(2, 2));
+}
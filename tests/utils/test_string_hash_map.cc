@@ -0,0 +1,59 @@
+#include <map>
+#include <string>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "mecab/utils/string_hash_map.h"
+
+TEST(mecab_string_hash_map, test_insert_and_find) {
+  MeCab::StringHashMap<int> map;
+  EXPECT_EQ(map.find("a"), nullptr);
+
+  std::pair<int*, bool> a = map.insert("a", 1);
+  EXPECT_TRUE(a.second);
+  EXPECT_EQ(*a.first, 1);
+  std::pair<int*, bool> again = map.insert("a", 2);
+  EXPECT_FALSE(again.second);
+  EXPECT_EQ(*again.first, 1);
+
+  // a key is compared with its length, so a prefix or a key with the same bytes is another key
+  const char buf[] = "abc";
+  map.insert(buf, 2, 3);
+  EXPECT_EQ(map.size(), 2);
+  ASSERT_NE(map.find("ab"), nullptr);
+  EXPECT_EQ(*map.find("ab"), 3);
+  EXPECT_EQ(*map.find(buf, 1), 1);
+  EXPECT_EQ(map.find(buf, 3), nullptr);
+
+  map.clear();
+  EXPECT_TRUE(map.empty());
+  EXPECT_EQ(map.find("a"), nullptr);
+}
+
+TEST(mecab_string_hash_map, test_grow_and_filter) {
+  MeCab::StringHashMap<int> map;
+  std::map<std::string, int> expected;
+  for (int i = 0; i < 10000; ++i) {
+    const std::string key = "key" + std::to_string(i);
+    map.insert(key.data(), key.size(), i);
+    expected[key] = i;
+  }
+  EXPECT_EQ(map.size(), expected.size());
+
+  std::map<std::string, int> actual;
+  map.for_each([&actual](const char* key, size_t length, int value) { actual[std::string(key, length)] = value; });
+  EXPECT_EQ(actual, expected);
+
+  // keep the even values and halve them
+  map.filter([](const char*, size_t, int& value) {
+    if (value % 2 != 0) {
+      return false;
+    }
+    value /= 2;
+    return true;
+  });
+  EXPECT_EQ(map.size(), 5000);
+  EXPECT_EQ(map.find("key1"), nullptr);
+  ASSERT_NE(map.find("key9998"), nullptr);
+  EXPECT_EQ(*map.find("key9998"), 4999);
+}
@@ -47,3 +47,24 @@ TEST(mecab_utils_string_utils, test_get_escaped_char) {
   ASSERT_EQ(MeCab::getEscapedChar('f'), '\f');
   ASSERT_EQ(MeCab::getEscapedChar('u'), '\0');  // unknown
 }
+
+TEST(mecab_utils_string_utils, test_parse_integer) {
+  const char* str = "-123 +45 6x";
+  const char* end = str + std::strlen(str);
+  int value = 0;
+
+  const char* p = MeCab::parse_integer(str, end, &value);
+  ASSERT_EQ(p, str + 4);
+  ASSERT_EQ(value, -123);
+  p = MeCab::parse_integer(p + 1, end, &value);
+  ASSERT_EQ(p, str + 8);
+  ASSERT_EQ(value, 45);
+  p = MeCab::parse_integer(p + 1, end, &value);
+  ASSERT_EQ(*p, 'x');
+  ASSERT_EQ(value, 6);
+
+  // no digits
+  ASSERT_EQ(MeCab::parse_integer(p, end, &value), p);
+  ASSERT_EQ(MeCab::parse_integer(str, str + 1, &value), str);
+  ASSERT_EQ(value, 6);
+}
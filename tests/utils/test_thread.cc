@@ -0,0 +1,55 @@
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "mecab/utils/thread.h"
+
+namespace {
+
+class producer_thread : public MeCab::thread {
+ public:
+  producer_thread(MeCab::BoundedQueue<int>* queue, int size) : queue_(queue), size_(size) {}
+
+  void run() {
+    for (int i = 0; i < size_; ++i) {
+      queue_->push(i);
+    }
+    queue_->close();
+  }
+
+ private:
+  MeCab::BoundedQueue<int>* queue_;
+  int size_;
+};
+
+}  // namespace
+
+TEST(mecab_thread, test_bounded_queue_keeps_order) {
+  MeCab::BoundedQueue<int> queue(2);
+  producer_thread producer(&queue, 1000);
+  producer.start();
+
+  std::vector<int> values;
+  int value = 0;
+  while (queue.pop(&value)) {
+    values.push_back(value);
+  }
+  producer.join();
+
+  ASSERT_EQ(values.size(), 1000);
+  for (size_t i = 0; i < values.size(); ++i) {
+    EXPECT_EQ(values[i], i);
+  }
+}
+
+TEST(mecab_thread, test_closed_bounded_queue) {
+  MeCab::BoundedQueue<int> queue(2);
+  ASSERT_TRUE(queue.push(1));
+  queue.close();
+
+  int value = 0;
+  EXPECT_FALSE(queue.push(2));
+  ASSERT_TRUE(queue.pop(&value));
+  EXPECT_EQ(value, 1);
+  EXPECT_FALSE(queue.pop(&value));
+}